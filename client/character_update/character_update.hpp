@@ -3,7 +3,12 @@
 
 #include "../interaction/multiplayer_physics/physics.hpp"
 #include "../interaction/mouse/mouse.hpp"
+#include "character_movement/character_movement.hpp"
+#include "character_movement/character_movement_jolt.hpp"
 
+/**
+ * \brief predicts one input, the velocity update is the shared one in character_movement.hpp so it matches the server
+ */
 void update_player_camera_and_velocity(JPH::Ref<JPH::CharacterVirtual> &character, Camera &camera, Mouse &mouse,
                                        NetworkedInputSnapshot &input_snapshot, float movement_acceleration,
                                        double time_since_last_update, JPH::Vec3 gravity);
@@ -1,20 +1,25 @@
+#include <algorithm>
 #include <chrono>
+#include <iterator>
 #include <linux/input.h>
 #include <stdexcept>
 #include <stdio.h>
 #include "client.hpp"
-#include "expiring_data_container/expiring_data_container.hpp"
 #include "networked_input_snapshot/networked_input_snapshot.hpp"
 #include "networked_character_data/networked_character_data.hpp"
 #include "character_update/character_update.hpp"
 #include "spdlog/spdlog.h"
 #include "formatting/formatting.hpp"
+#include "allocation_tracker/allocation_tracker.hpp"
 
 ClientNetwork::ClientNetwork(NetworkedInputSnapshot *input_snapshot, std::string &ip_address, int port)
     : input_snapshot(input_snapshot), server_ip_address(ip_address), server_port(port) {
     initialize_client_network();
 }
-ClientNetwork::~ClientNetwork() { disconnect_from_server(); }
+ClientNetwork::~ClientNetwork() {
+    stop_network_thread();
+    disconnect_from_server();
+}
 
 void ClientNetwork::initialize_client_network() {
     if (enet_initialize() != 0) {
@@ -25,7 +30,7 @@ void ClientNetwork::initialize_client_network() {
 
     client = {0};
     client = enet_host_create(NULL /* create a client host */, 1 /* only allow 1 outgoing connection */,
-                              2 /* allow up 2 channels to be used, 0 and 1 */,
+                              4 /* allow up 4 channels to be used, 0, 1, 2 and 3 */,
                               0 /* assume any amount of incoming bandwidth */,
                               0 /* assume any amount of outgoing bandwidth */);
     if (client == NULL) {
@@ -47,8 +52,8 @@ void ClientNetwork::attempt_to_connect_to_server() {
     enet_address_set_host(&address, this->server_ip_address.c_str());
     address.port = this->server_port;
 
-    /* Initiate the connection, allocating the two channels 0 and 1. */
-    server_connection = enet_host_connect(client, &address, 2, 0);
+    /* Initiate the connection, allocating the four channels 0, 1, 2 and 3. */
+    server_connection = enet_host_connect(client, &address, 4, 0);
     if (server_connection == NULL) {
         fprintf(stderr, "No available peers for initiating an ENet connection.\n");
         exit(EXIT_FAILURE);
@@ -77,13 +82,14 @@ void ClientNetwork::attempt_to_connect_to_server() {
  * therefore we we will re-apply 4 and 5 to the authorative game state, we leave the regular timeline of the
  * client to do this, and we consider ourself back at 5 as if no time has passed.
  *
- *
+ * if the world state recorder still has the tick at which 3 was applied, the whole world is rolled back to it first,
+ * that way dynamic bodies (like the ball) are re-simulated alongside the player instead of being left in the future.
+ * otherwise we fall back to only resetting the local character.
  */
 void ClientNetwork::reconcile_local_game_state_with_server_update(
     NetworkedCharacterData &networked_character_data, Physics &physics, Camera &camera, Mouse &mouse,
     std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-    ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history, JPH::Vec3 &authorative_position,
-    JPH::Vec3 &authorative_velocity
+    WorldStateRecorder &world_state_recorder, JPH::Vec3 &authorative_position, JPH::Vec3 &authorative_velocity
 
 ) {
     auto ciht_of_last_server_processed_input_snapshot =
@@ -92,8 +98,8 @@ void ClientNetwork::reconcile_local_game_state_with_server_update(
     // note that this has to match what we did in the expiring data container
     std::chrono::steady_clock::time_point reconstructed_time_point(ciht_of_last_server_processed_input_snapshot);
 
-    std::vector<NetworkedInputSnapshot> snapshots_to_be_reprocessed =
-        processed_input_snapshot_history.get_data_exceeding(reconstructed_time_point);
+    // every processed input is sent right after it's processed, so the inputs we sent are the ones to replay
+    gather_snapshots_to_reprocess(reconstructed_time_point.time_since_epoch().count());
 
     JPH::Ref<JPH::CharacterVirtual> client_physics_character =
         physics.client_id_to_physics_character[networked_character_data.client_id];
@@ -101,165 +107,252 @@ void ClientNetwork::reconcile_local_game_state_with_server_update(
 
     reconcile_mutex.lock();
 
-    std::string reconciliation_history;
-    reconciliation_history +=
-        fmt::format("starting reconciliation, game state before reconciliation is: \n{}", physics);
-
-    // bool first_time_rollback = true;
-    // for (int i = 0; i < snapshots_to_be_reprocessed.size(); i++) {
-    //     if (first_time_rollback) {
-    //         first_time_rollback = false;
-    //         continue;
-    //     }
-    //     reconciliation_history +=
-    //         fmt::format("rolled back to state just after applying snapshot with cihtems: {} \n",
-    //                     snapshots_to_be_reprocessed[i].client_input_history_insertion_time_epoch_ms);
-    // }
-    //
-    // int num_physics_frames_to_step_back = snapshots_to_be_reprocessed.size() - 1;
+    // only put together when it's logged, it prints the whole world a few times over
+    bool log_reconciliation = spdlog::get("network")->should_log(spdlog::level::info);
+    fmt::memory_buffer reconciliation_history;
+    auto history = std::back_inserter(reconciliation_history);
+    if (log_reconciliation) {
+        fmt::format_to(history, "starting reconciliation, game state before reconciliation is: \n{}", physics);
+    }
 
-    // PhysicsFrame physics_frame_before_predicted_inputs_applied =
-    //     physics.physics_frames.get_nth_from_recent(num_physics_frames_to_step_back);
+    // the first snapshot is the one the server has already processed, every tick after it gets re-simulated, and one
+    // tick was recorded per processed snapshot so we can find the tick of the acknowledged one by counting back.
+    uint64_t num_physics_frames_to_step_back =
+        snapshots_to_be_reprocessed.empty() ? 0 : snapshots_to_be_reprocessed.size() - 1;
+
+    bool rolled_back_world = false;
+    uint64_t acknowledged_tick = 0;
+    if (!snapshots_to_be_reprocessed.empty() && !world_state_recorder.empty() &&
+        world_state_recorder.most_recent_tick() >= num_physics_frames_to_step_back) {
+        acknowledged_tick = world_state_recorder.most_recent_tick() - num_physics_frames_to_step_back;
+        rolled_back_world = world_state_recorder.restore(acknowledged_tick, physics);
+    }
 
-    // physics.physics_system.RestoreState(physics_frame_before_predicted_inputs_applied.physics_state);
+    if (log_reconciliation) {
+        fmt::format_to(history, "rolled back world to tick {}: {}\n", acknowledged_tick, rolled_back_world);
+    }
 
     client_physics_character->SetPosition(authorative_position);
     client_physics_character->SetLinearVelocity(authorative_velocity);
     physics.refresh_contacts(client_physics_character);
 
-    // reconciliation_history += fmt::format("after rolling back physics world state is: {}", physics);
-
-    reconciliation_history += fmt::format("Authorative game state set current state: {}", physics);
+    if (rolled_back_world) {
+        // the corrected state becomes history, so if another update comes in for a later tick we don't restore the
+        // mispredicted one
+        world_state_recorder.record(acknowledged_tick, physics);
+    }
 
-    reconciliation_history +=
-        fmt::format("starting reconciliation about to re apply {} snapshots out of {}\n",
-                    snapshots_to_be_reprocessed.size() - 1, processed_input_snapshot_history.size());
+    if (log_reconciliation) {
+        fmt::format_to(history, "Authorative game state set current state: {}", physics);
+        fmt::format_to(history, "starting reconciliation about to re apply {} snapshots out of {}\n",
+                       num_physics_frames_to_step_back, snapshots_to_be_reprocessed.size());
+    }
 
-    // spdlog::get("network")->info("starting reconciliation about to re apply {} snapshots out of {}",
-    //                              snapshots_to_be_reprocessed.size(), processed_input_snapshot_history.size());
     bool first_time = true; // temp fix for some reason the reprocessed snapshots is getting the matchign tiem one but
                             // should be strict
-    for (NetworkedInputSnapshot snapshot_to_be_reprocessed : snapshots_to_be_reprocessed) {
+    uint64_t replayed_tick = acknowledged_tick;
+    for (NetworkedInputSnapshot &snapshot_to_be_reprocessed : snapshots_to_be_reprocessed) {
         if (first_time) {
             first_time = false;
             continue;
         }
-        reconciliation_history += fmt::format("re-applying the following snapshot: \n{}", snapshot_to_be_reprocessed);
-        // TODO this probably needs to be locked with a mutex so that a network and local update
-        // can't occur at the same time for now I don't care.
+        if (log_reconciliation) {
+            fmt::format_to(history, "re-applying the following snapshot: \n{}", snapshot_to_be_reprocessed);
+        }
         update_player_camera_and_velocity(client_physics_character, camera, mouse, snapshot_to_be_reprocessed,
                                           movement_acceleration,
                                           snapshot_to_be_reprocessed.time_delta_used_for_client_side_processing_ms,
                                           physics.physics_system.GetGravity());
 
-        physics.update_characters_only(snapshot_to_be_reprocessed.time_delta_used_for_client_side_processing_ms);
-        // this being commented out makes it smoother because physics call rate doesn't increase, without it it would
-        // physics.update(
-        //     snapshot_to_be_reprocessed
-        //         .time_delta_used_for_client_side_processing_ms); // update in the for loop because the other
-        //         characters
-        //                                                          // that have velocity will be simulated as well
-        JPH::Vec3 reconciliation_position = client_physics_character->GetPosition();
-        JPH::Vec3 reconciliation_velocity = client_physics_character->GetLinearVelocity();
-        reconciliation_history +=
-            fmt::format("after applying that update that players new state is: \n position: {} velocity: {}\n",
-                        reconciliation_position, reconciliation_velocity);
-
-        // reconciliation_stream << "just processed cihtems: "
-        //                       << snapshot_to_be_reprocessed.client_input_history_insertion_time_epoch_ms << "|||,"
-        //                       << reconciliation_position << "|||,";
-    }
-
-    // client_id_to_character_data[networked_character_data.client_id] = networked_character_data;
-    // apply new changes, we have to do this because render uses this structure
-    // uint64_t client_id = networked_character_data.client_id;
-    // client_id_to_character_data[client_id].camera_yaw_angle = camera.yaw_angle;
-    // client_id_to_character_data[client_id].camera_pitch_angle = camera.pitch_angle;
-    // client_id_to_character_data[client_id].character_x_position = client_physics_character->GetPosition().GetX();
-    // client_id_to_character_data[client_id].character_y_position = client_physics_character->GetPosition().GetY();
-    // client_id_to_character_data[client_id].character_z_position = client_physics_character->GetPosition().GetZ();
-    //
-
-    // JPH::Vec3 position_after_reconciliation = client_physics_character->GetPosition();
-    // JPH::Vec3 velocity_after_reconciliation = client_physics_character->GetLinearVelocity();
-    reconciliation_history += fmt::format("after reconciliation the game state is: \n{}", physics);
+        if (rolled_back_world) {
+            // the whole world was rewound, so the whole world has to be stepped forward again
+            physics.update(snapshot_to_be_reprocessed.time_delta_used_for_client_side_processing_ms);
+            replayed_tick++;
+            world_state_recorder.record(replayed_tick, physics);
+        } else {
+            physics.update_characters_only(snapshot_to_be_reprocessed.time_delta_used_for_client_side_processing_ms);
+        }
 
-    reconcile_mutex.unlock();
+        if (log_reconciliation) {
+            JPH::Vec3 reconciliation_position = client_physics_character->GetPosition();
+            JPH::Vec3 reconciliation_velocity = client_physics_character->GetLinearVelocity();
+            fmt::format_to(history,
+                           "after applying that update that players new state is: \n position: {} velocity: {}\n",
+                           reconciliation_position, reconciliation_velocity);
+        }
+    }
 
-    // std::ostringstream x;
-    // x << position_after_reconciliation;
-    // std::string pos_str = x.str();
-    //
-    // std::ostringstream y;
-    // y << velocity_after_reconciliation;
-    // std::string vel_str = y.str();
+    if (log_reconciliation) {
+        fmt::format_to(history, "after reconciliation the game state is: \n{}", physics);
+    }
 
-    // std::string reconciliation_positions = reconciliation_stream.str();
-    //
+    reconcile_mutex.unlock();
 
-    spdlog::get("network")->info(reconciliation_history);
+    if (log_reconciliation) {
+        spdlog::get("network")->info(fmt::string_view(reconciliation_history.data(), reconciliation_history.size()));
+    }
+}
+
+/**
+ * \brief fills snapshots_to_be_reprocessed with the sent inputs from the acknowledged one on, oldest first. an input
+ * that has been overwritten in sent_input_snapshots is too old to replay, so at most that many are.
+ */
+void ClientNetwork::gather_snapshots_to_reprocess(uint64_t acknowledged_insertion_time) {
+    snapshots_to_be_reprocessed.clear();
+    uint64_t oldest_sequence = latest_sent_sequence + 1;
+    for (uint64_t sequence = latest_sent_sequence; sequence > 0; sequence--) {
+        const SentInputSnapshot &sent_input_snapshot = sent_input_snapshots[sequence % sent_input_snapshots.size()];
+        if (sent_input_snapshot.sequence != sequence ||
+            sent_input_snapshot.input_insertion_time < acknowledged_insertion_time) {
+            break;
+        }
+        oldest_sequence = sequence;
+    }
+    for (uint64_t sequence = oldest_sequence; sequence <= latest_sent_sequence; sequence++) {
+        snapshots_to_be_reprocessed.push_back(sent_input_snapshots[sequence % sent_input_snapshots.size()].input);
+    }
 }
 
+/**
+ * \brief drains what the network thread received since the last tick and reconciles against the newest game state,
+ * call it from the simulation thread
+ */
 std::function<void(double)>
 ClientNetwork::network_step_closure(int service_period_ms, Physics &physics, Camera &camera, Mouse &mouse,
                                     std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-                                    ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history) {
+                                    WorldStateRecorder &world_state_recorder) {
 
     return
         [this, &service_period_ms, &physics, &client_id_to_character_data, &camera, &mouse,
-         &processed_input_snapshot_history](double service_period_ms_temp) { // temp because usually this is delta time
-            ENetEvent event;
-
-            while (enet_host_service(this->client, &event, 0) > 0) {
-                handle_network_event(event, physics, camera, mouse, client_id_to_character_data,
-                                     processed_input_snapshot_history);
+         &world_state_recorder](double service_period_ms_temp) { // temp because usually this is delta time
+            ReceivedServerMessage *message;
+            while ((message = received_server_messages.front()) != nullptr) {
+                handle_received_server_message(*message, physics, camera, mouse, client_id_to_character_data);
+                received_server_messages.pop();
             }
             // by the time the while loop finishes if any new game state updates arrived, then this->mrcgsu will be
             // correct also of two arrived it will be pointing the the newest as the variable name implies
 
-            bool client_id_received_already = id != -1;
-            if (client_id_received_already) {
-                // this has to be called
+            // our own entry is skipped until one of our inputs is acknowledged, the join accept's included, so
+            // having an id doesn't mean there's a state of ours to reconcile against yet
+            if (has_own_game_state_update) {
                 update_local_client_with_game_state(this->most_recent_client_game_state_update, physics, camera, mouse,
-                                                    client_id_to_character_data, processed_input_snapshot_history);
+                                                    client_id_to_character_data, world_state_recorder);
             }
 
         };
 }
 
-void ClientNetwork::handle_network_event(
-    ENetEvent event, Physics &physics, Camera &camera, Mouse &mouse,
-    std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-    ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history) {
+void ClientNetwork::start_network_thread() {
+    network_thread_running = true;
+    network_thread = std::thread(&ClientNetwork::run_network_thread, this);
+}
+
+void ClientNetwork::stop_network_thread() {
+    if (!network_thread.joinable()) {
+        return;
+    }
+    network_thread_running = false;
+    network_thread.join();
+}
+
+/**
+ * \brief waits on the socket rather than on the frame, so a packet is handled as soon as it arrives and the round trip
+ * time enet measures is the network's and not our frame time's
+ */
+void ClientNetwork::run_network_thread() {
+    allocation_tracker::set_thread_name("network");
+    ENetEvent event;
+    while (network_thread_running) {
+        if (enet_host_service(client, &event, network_service_timeout_ms) > 0) {
+            handle_network_event(event);
+            while (enet_host_service(client, &event, 0) > 0) {
+                handle_network_event(event);
+            }
+        }
+        send_outgoing_packets();
+    }
+    spdlog::get("network")->info("network thread stopped, dropped {} received game states", dropped_server_messages);
+}
+
+/**
+ * \brief runs on the network thread, game states are decoded here straight into a slot of the queue so the simulation
+ * thread only has to apply them
+ */
+void ClientNetwork::handle_network_event(ENetEvent &event) {
 
     switch (event.type) {
     case ENET_EVENT_TYPE_CONNECT: // is this even possible on the client?
-        // spdlog::get("network")
-        //     ->info("A new client connected from {}:{}", event.peer->address.host,
-        //     event.peer->address.port);
-
         printf("A new client connected from %x:%u.\n", event.peer->address.host, event.peer->address.port);
         /* Store any relevant client information here. */
         event.peer->data = (void *)"Client information";
         break;
 
     case ENET_EVENT_TYPE_RECEIVE: {
-
-        if (event.packet->dataLength == sizeof(uint64_t)) { // client id
-            uint64_t receivedID = *reinterpret_cast<const uint64_t *>(event.packet->data);
-            this->id = receivedID;
-            physics.create_character(receivedID);
-
-            spdlog::get("network")->info("Received unique ID from server: {}", receivedID);
-            // printf("Received unique ID from server: %lu\n", receivedID);
-        } else {
-
-            bool client_id_received_already = id != -1;
-            if (client_id_received_already) { // everything after the client id is a game state update
-                NetworkedCharacterData *game_update = reinterpret_cast<NetworkedCharacterData *>(event.packet->data);
-                size_t game_update_length = event.packet->dataLength / sizeof(NetworkedCharacterData);
-                process_game_state_update(game_update, game_update_length, physics, camera, mouse,
-                                          client_id_to_character_data, processed_input_snapshot_history);
+        bool is_join_accept = event.channelID == join_accept::channel;
+        // can overtake the join accept, since it's on another channel, and a despawn mustn't get lost
+        bool is_entity_lifecycle = event.channelID == entity_lifecycle::channel;
+        bool is_time_sync = event.channelID == time_sync::channel;
+        // game states only start once the server has admitted us
+        if (is_join_accept || is_entity_lifecycle || network_thread_received_client_id) {
+            // only a game state can be dropped, the next one replaces it anyway, losing a join accept would leave us
+            // without an id for good and losing a despawn would leave a character behind
+            bool is_game_state = !is_join_accept && !is_entity_lifecycle && !is_time_sync;
+            ReceivedServerMessage *message = received_server_messages.begin_push();
+            if (message == nullptr && !is_game_state) {
+                // the simulation drains this every tick, so the wait is at most about a tick
+                spdlog::get("network")->warn("the simulation isn't keeping up with received messages, waiting for it");
+                while (message == nullptr && network_thread_running) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    message = received_server_messages.begin_push();
+                }
+            }
+            if (message == nullptr) {
+                if (is_game_state) {
+                    // the simulation has stalled and the newest game state will be along soon enough
+                    dropped_server_messages++;
+                    spdlog::get("network")->warn(
+                        "the simulation isn't keeping up with received messages, dropping a game state");
+                }
+            } else if (is_join_accept) {
+                if (decode_join_accept(event.packet->data, event.packet->dataLength, character_data_codec,
+                                       message->client_id, message->character_states)) {
+                    message->type = ServerMessageType::JOIN_ACCEPT;
+                    message->received_at = std::chrono::steady_clock::now().time_since_epoch().count();
+                    network_thread_received_client_id = true;
+                    received_server_messages.finish_push();
+                } else {
+                    spdlog::get("network")->warn("received a malformed join accept of {} bytes",
+                                                 event.packet->dataLength);
+                }
+            } else if (is_entity_lifecycle) {
+                if (decode_entity_lifecycle_events(event.packet->data, event.packet->dataLength,
+                                                   message->entity_lifecycle_events)) {
+                    message->type = ServerMessageType::ENTITY_LIFECYCLE;
+                    message->received_at = std::chrono::steady_clock::now().time_since_epoch().count();
+                    received_server_messages.finish_push();
+                } else {
+                    spdlog::get("network")->warn("received a malformed lifecycle message of {} bytes",
+                                                 event.packet->dataLength);
+                }
+            } else if (is_time_sync) {
+                if (decode_time_sync_response(event.packet->data, event.packet->dataLength,
+                                              message->time_sync_response)) {
+                    message->type = ServerMessageType::TIME_SYNC;
+                    message->received_at = std::chrono::steady_clock::now().time_since_epoch().count();
+                    received_server_messages.finish_push();
+                } else {
+                    spdlog::get("network")->warn("received a malformed time sync response of {} bytes",
+                                                 event.packet->dataLength);
+                }
+            } else if (decode_snapshot_part(event.packet->data, event.packet->dataLength, character_data_codec,
+                                            received_snapshot_part_header, message->character_states)) {
+                message->type = ServerMessageType::GAME_STATE;
+                message->tick = received_snapshot_part_header.tick;
+                message->received_at = std::chrono::steady_clock::now().time_since_epoch().count();
+                received_server_messages.finish_push();
+            } else {
+                spdlog::get("network")->warn("received a malformed game state of {} bytes", event.packet->dataLength);
             }
         }
 
@@ -284,10 +377,112 @@ void ClientNetwork::handle_network_event(
     }
 }
 
+/**
+ * \brief runs on the simulation thread, everything that needs the simulation's state (physics, the input sequence
+ * numbers) happens here rather than on the network thread
+ */
+void ClientNetwork::handle_received_server_message(
+    const ReceivedServerMessage &message, Physics &physics, Camera &camera, Mouse &mouse,
+    std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data) {
+
+    if (message.type == ServerMessageType::ENTITY_LIFECYCLE) {
+        handle_entity_lifecycle_events(message.entity_lifecycle_events, client_id_to_character_data);
+        return;
+    }
+
+    if (message.type == ServerMessageType::TIME_SYNC) {
+        server_clock.add_sample(message.time_sync_response, message.received_at);
+        run_ahead_ticks += message.time_sync_response.input_buffer_depth - input_buffer_depth;
+        input_buffer_depth = message.time_sync_response.input_buffer_depth;
+        spdlog::get("network")->info("the server's clock is {:.3f} ms ahead of ours, round trip {:.3f} ms, our inputs "
+                                     "arrive {:.3f} ms off the tick phase we want and {} are kept back",
+                                     server_clock.get_offset_ns() / 1e6, server_clock.get_round_trip_time_ns() / 1e6,
+                                     latest_tick_phase_error_ns / 1e6, input_buffer_depth);
+        return;
+    }
+
+    const CharacterStateArrays &states = message.character_states;
+    if (message.type == ServerMessageType::JOIN_ACCEPT) {
+        this->id = message.client_id;
+        physics.create_character(message.client_id);
+        spdlog::get("network")->info("Received unique ID from server: {}", message.client_id);
+
+        // nothing to reconcile against yet, our character just starts where the server put it. the other characters
+        // go through the same path as a game state below, ours is skipped there since none of our inputs are acked
+        for (size_t i = 0; i < states.size(); i++) {
+            if (states.entity_ids[i] == this->id) {
+                JPH::Ref<JPH::CharacterVirtual> own_character = physics.client_id_to_physics_character[this->id];
+                own_character->SetPosition(
+                    JPH::RVec3(states.position_x[i], states.position_y[i], states.position_z[i]));
+                own_character->SetLinearVelocity(
+                    JPH::Vec3(states.velocity_x[i], states.velocity_y[i], states.velocity_z[i]));
+            }
+        }
+    }
+
+    received_game_update.clear();
+    for (size_t i = 0; i < states.size(); i++) {
+        uint64_t entity_id = states.entity_ids[i];
+        if (despawned_client_ids.count(entity_id) != 0) {
+            continue;
+        }
+        // acknowledgements are only meaningful for our own character, the others refer to inputs of other clients
+        uint64_t acknowledged_input_insertion_time = 0;
+        if (entity_id == this->id && !find_acknowledged_input_insertion_time(states.acknowledged_inputs[i],
+                                                                             message.received_at,
+                                                                             acknowledged_input_insertion_time)) {
+            continue; // nothing of ours has been processed yet, or it's too old to reconcile against
+        }
+        if (message.type == ServerMessageType::GAME_STATE) {
+            auto last_applied_tick = client_id_to_last_applied_tick.find(entity_id);
+            // compared as a difference so that it keeps working when the 32 bit tick wraps around
+            if (last_applied_tick != client_id_to_last_applied_tick.end() &&
+                static_cast<int32_t>(message.tick - last_applied_tick->second) < 0) {
+                continue; // a part of an older game state that arrived late
+            }
+            client_id_to_last_applied_tick[entity_id] = message.tick;
+        }
+        if (entity_id != this->id) {
+            client_id_to_update_received_at[entity_id] = message.received_at;
+        }
+        received_game_update.push_back(
+            get_character_state<NetworkedCharacterData>(states, i, acknowledged_input_insertion_time));
+    }
+    process_game_state_update(received_game_update.data(), received_game_update.size(), physics, camera, mouse,
+                              client_id_to_character_data);
+}
+
+/**
+ * \brief runs on the simulation thread. a character that left is forgotten completely, the renderer and the dead
+ * reckoning build their state from client_id_to_character_data every frame, so it's gone from those with the next frame
+ */
+void ClientNetwork::handle_entity_lifecycle_events(
+    const std::vector<EntityLifecycleEvent> &events,
+    std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data) {
+    for (const EntityLifecycleEvent &event : events) {
+        uint64_t entity_id = event.entity_id;
+        if (entity_id == this->id) {
+            continue; // ours is only ever spawned by the join accept
+        }
+        switch (event.type) {
+        case EntityLifecycleEventType::SPAWN:
+            despawned_client_ids.erase(entity_id);
+            break;
+        case EntityLifecycleEventType::DESPAWN:
+            despawned_client_ids.insert(entity_id);
+            client_id_to_character_data.erase(entity_id);
+            client_id_to_update_received_at.erase(entity_id);
+            client_id_to_last_applied_tick.erase(entity_id);
+            spdlog::get("network")->info("character {} left", entity_id);
+            break;
+        }
+    }
+}
+
 void ClientNetwork::update_local_client_with_game_state(
     NetworkedCharacterData &networked_character_data, Physics &physics, Camera &camera, Mouse &mouse,
     std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-    ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history) {
+    WorldStateRecorder &world_state_recorder) {
     // server is authorative blindly apply the update.
     client_id_to_character_data[networked_character_data.client_id] = networked_character_data;
     JPH::Ref<JPH::CharacterVirtual> client_physics_character =
@@ -317,7 +512,7 @@ void ClientNetwork::update_local_client_with_game_state(
 
     // now account for the local updates that have ocurred since then
     reconcile_local_game_state_with_server_update(networked_character_data, physics, camera, mouse,
-                                                  client_id_to_character_data, processed_input_snapshot_history,
+                                                  client_id_to_character_data, world_state_recorder,
                                                   authoriative_position, authoriative_velocity);
 
     JPH::Vec3 position_after_reconciliation = client_physics_character->GetPosition();
@@ -325,6 +520,11 @@ void ClientNetwork::update_local_client_with_game_state(
 
     JPH::Vec3 predicted_position_diff = position_with_prediction - position_after_reconciliation;
     JPH::Vec3 predicted_velocity_diff = velocity_with_prediction - velocity_after_reconciliation;
+    if (has_new_own_game_state_update) {
+        // later ticks re-apply the same update, what they move the character by isn't a misprediction
+        reconciliation_report.add_reconciliation(predicted_position_diff.Length());
+        has_new_own_game_state_update = false;
+    }
 
     spdlog::get("network")->info("prediction deltas, pos: {}, vel: {}\n poslen: {}, vellen: {}",
                                  predicted_position_diff, predicted_velocity_diff, predicted_position_diff.Length(),
@@ -333,18 +533,18 @@ void ClientNetwork::update_local_client_with_game_state(
 
 void ClientNetwork::process_game_state_update(
     NetworkedCharacterData *game_update, int game_update_length, Physics &physics, Camera &camera, Mouse &mouse,
-    std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-    ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history) {
+    std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data) {
 
-    std::ostringstream first_look;
-    for (size_t i = 0; i < game_update_length; ++i) {
-        NetworkedCharacterData networked_character_data = game_update[i];
-        first_look << networked_character_data;
-    }
+    if (spdlog::get("network")->should_log(spdlog::level::info)) {
+        fmt::memory_buffer first_look;
+        for (size_t i = 0; i < game_update_length; ++i) {
+            fmt::format_to(std::back_inserter(first_look), "{}", game_update[i]);
+        }
 
-    spdlog::get("network")->info(
-        "Just received a game update containing: \n {} individual character updates with data: \n {}",
-        game_update_length, first_look.str());
+        spdlog::get("network")->info(
+            "Just received a game update containing: \n {} individual character updates with data: \n {}",
+            game_update_length, fmt::string_view(first_look.data(), first_look.size()));
+    }
 
     for (size_t i = 0; i < game_update_length; ++i) {
         NetworkedCharacterData networked_character_data = game_update[i];
@@ -359,6 +559,8 @@ void ClientNetwork::process_game_state_update(
             }
             this->most_recent_client_game_state_update =
                 networked_character_data; // this is key, this function updates the most recent game state update
+            this->has_own_game_state_update = true;
+            this->has_new_own_game_state_update = true;
             // the reason why this is so important is that if two server messages come in between client ticks, we won't
             // reconcile on both, only at the start of the tick will we actually reconcile with the most recent one that
             // we've received.
@@ -368,9 +570,9 @@ void ClientNetwork::process_game_state_update(
     }
 }
 
-int ClientNetwork::start_network_loop(int send_frequency_hz, Physics &physics, Camera &camera, Mouse &mouse,
-                                      std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-                                      ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history) {
+int ClientNetwork::start_network_loop(
+    int send_frequency_hz, Physics &physics, Camera &camera, Mouse &mouse,
+    std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data) {
     // ENetEvent event;
     //
     // bool first_iteration = true;
@@ -589,25 +791,207 @@ int ClientNetwork::start_network_loop(int send_frequency_hz, Physics &physics, C
 /*
  * \pre this->id != -1
  */
-void ClientNetwork::send_input_snapshot(
-    ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history) {
+void ClientNetwork::send_input_snapshot(const NetworkedInputSnapshot &processed_input_snapshot) {
     assert(this->id != -1);
 
-    if (processed_input_snapshot_history.size() == 0) {
-        return; // nothing to do because there is no data to send, this should never occur.
+    InputState input_state;
+    input_state.left_pressed = processed_input_snapshot.left_pressed;
+    input_state.right_pressed = processed_input_snapshot.right_pressed;
+    input_state.forward_pressed = processed_input_snapshot.forward_pressed;
+    input_state.backward_pressed = processed_input_snapshot.backward_pressed;
+    input_state.jump_pressed = processed_input_snapshot.jump_pressed;
+    input_state.mouse_position_x = processed_input_snapshot.mouse_position_x;
+    input_state.mouse_position_y = processed_input_snapshot.mouse_position_y;
+
+    // the server knows who we are from the connection, so the id doesn't have to be sent
+    uint64_t sequence = input_snapshot_encoder.encode(input_state, encoded_input_snapshot);
+    SentInputSnapshot &sent_input_snapshot = sent_input_snapshots[sequence % sent_input_snapshots.size()];
+    sent_input_snapshot.sequence = sequence;
+    sent_input_snapshot.input_insertion_time = processed_input_snapshot.client_input_history_insertion_time_epoch_ms;
+    sent_input_snapshot.input = processed_input_snapshot;
+    latest_sent_sequence = sequence;
+
+    spdlog::get("network")->info("~~~> sending input snapshot {} as sequence {}, {}", encoded_input_snapshot.size(),
+                                 sequence, processed_input_snapshot);
+    // printf("msx %f msy %f\n", this->input_snapshot->mouse_position_x,
+    // this->input_snapshot->mouse_position_y);
+    queue_outgoing_packet(0, false, encoded_input_snapshot);
+    if (server_clock.is_synchronized()) {
+        uint64_t sent_at = std::chrono::steady_clock::now().time_since_epoch().count();
+        latest_tick_phase_error_ns = server_clock.tick_phase_error_ns(
+            sent_at, std::chrono::duration_cast<std::chrono::nanoseconds>(tick_arrival_lead).count());
+        has_new_tick_phase_error = true;
     }
+    send_client_reports_if_due();
+    send_time_sync_request_if_due();
+}
 
-    NetworkedInputSnapshot most_recently_added_processed_snapshot = processed_input_snapshot_history.get_most_recent();
-    most_recently_added_processed_snapshot.client_id = this->id; // TODO this should be done somwhere else...
-    ENetPacket *packet = enet_packet_create(&most_recently_added_processed_snapshot, sizeof(NetworkedInputSnapshot),
-                                            0); // 0 indicates unreliable packet
-    //
+bool ClientNetwork::take_tick_alignment(std::chrono::nanoseconds &server_tick_period,
+                                        std::chrono::nanoseconds &phase_correction) {
+    if (!server_clock.is_synchronized() || (!has_new_tick_phase_error && run_ahead_ticks == 0)) {
+        return false;
+    }
 
-    spdlog::get("network")->info("~~~> sending input snapshot, {}", most_recently_added_processed_snapshot);
-    // printf("msx %f msy %f\n", this->input_snapshot->mouse_position_x,
-    // this->input_snapshot->mouse_position_y);
-    enet_peer_send(server_connection, 0, packet);
-    enet_host_flush(client);
+    server_tick_period = std::chrono::nanoseconds(server_clock.get_tick_period_ns());
+    phase_correction = std::chrono::nanoseconds(0);
+    if (has_new_tick_phase_error) {
+        // arriving late means sending earlier
+        int64_t max_correction_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(max_tick_phase_correction).count();
+        phase_correction = std::chrono::nanoseconds(
+            std::clamp(static_cast<int64_t>(-latest_tick_phase_error_ns * tick_phase_correction_gain),
+                       -max_correction_ns, max_correction_ns));
+        has_new_tick_phase_error = false;
+    }
+    // a whole tick earlier doesn't change the phase, the pacer just runs the ticks in between right away
+    phase_correction -= run_ahead_ticks * server_tick_period;
+    run_ahead_ticks = 0;
+    return true;
+}
+
+/**
+ * \brief hands an encoded message to the network thread, data is copied into the queue slot which keeps its memory
+ * from the last time around
+ */
+void ClientNetwork::queue_outgoing_packet(uint8_t channel, bool reliable, const std::vector<uint8_t> &data) {
+    OutgoingPacket *outgoing_packet = outgoing_packets.begin_push();
+    if (outgoing_packet == nullptr) {
+        dropped_outgoing_packets++;
+        spdlog::get("network")->warn("the network thread isn't keeping up with outgoing packets, dropping one");
+        return;
+    }
+    outgoing_packet->channel = channel;
+    outgoing_packet->reliable = reliable;
+    outgoing_packet->data.assign(data.begin(), data.end());
+    outgoing_packets.finish_push();
+}
+
+void ClientNetwork::send_outgoing_packets() {
+    bool sent_anything = false;
+    OutgoingPacket *outgoing_packet;
+    while ((outgoing_packet = outgoing_packets.front()) != nullptr) {
+        ENetPacket *packet = enet_packet_create(outgoing_packet->data.data(), outgoing_packet->data.size(),
+                                                outgoing_packet->reliable ? ENET_PACKET_FLAG_RELIABLE : 0);
+        if (enet_peer_send(server_connection, outgoing_packet->channel, packet) < 0) {
+            enet_packet_destroy(packet);
+        }
+        outgoing_packets.pop();
+        sent_anything = true;
+    }
+    if (sent_anything) {
+        enet_host_flush(client);
+    }
+}
+
+/**
+ * \brief tells the server how the game has been going on our end since the last report, so it shows up in the
+ * server's metrics. reports are reliable, losing one would lose everything counted since the one before it.
+ */
+void ClientNetwork::send_client_reports_if_due() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_client_report_time < client_report_period) {
+        return;
+    }
+    last_client_report_time = now;
+
+    encode_reconciliation_report(reconciliation_report, encoded_client_report);
+    reconciliation_report = ReconciliationReport();
+    send_encoded_client_report();
+
+    std::unique_lock<std::mutex> lock(input_latency_report_mutex);
+    if (input_latency_report.input_to_acknowledgement.get_count() != 0 ||
+        input_latency_report.acknowledgement_to_render.get_count() != 0) {
+        encode_input_latency_report(input_latency_report, encoded_client_report);
+        input_latency_report.input_to_acknowledgement.reset();
+        input_latency_report.acknowledgement_to_render.reset();
+        lock.unlock();
+        send_encoded_client_report();
+    }
+}
+
+void ClientNetwork::send_encoded_client_report() {
+    queue_outgoing_packet(client_report::channel, true, encoded_client_report);
+}
+
+/**
+ * \brief the request carries the tick phase error we last measured, so the server can tell how well clients line up
+ */
+void ClientNetwork::send_time_sync_request_if_due() {
+    auto now = std::chrono::steady_clock::now();
+    bool warming_up = num_time_sync_requests_sent < ServerClock::num_kept_samples;
+    if (now - last_time_sync_request_time < (warming_up ? initial_time_sync_period : time_sync_period)) {
+        return;
+    }
+    last_time_sync_request_time = now;
+    num_time_sync_requests_sent++;
+
+    time_sync_request.client_sent_at = now.time_since_epoch().count();
+    time_sync_request.tick_phase_error_ms = latest_tick_phase_error_ns / 1e6f;
+    encode_time_sync_request(time_sync_request, encoded_time_sync_request);
+    queue_outgoing_packet(time_sync::channel, false, encoded_time_sync_request);
+}
+
+/**
+ * \brief the server sends back the low 32 bits of the sequence number of the last input of ours it processed, this
+ * turns that back into the insertion time of the processed snapshot we sent under that number.
+ *
+ * \return false if the server hasn't processed any of our inputs yet or the input is too old to still be remembered
+ */
+bool ClientNetwork::find_acknowledged_input_insertion_time(uint32_t low_bits_of_sequence, uint64_t received_at,
+                                                           uint64_t &input_insertion_time) {
+    uint64_t sequence = input_snapshot_encoder.restore_sequence(low_bits_of_sequence);
+    const SentInputSnapshot &sent_input_snapshot = sent_input_snapshots[sequence % sent_input_snapshots.size()];
+    if (sequence == 0 || sent_input_snapshot.sequence != sequence) {
+        return false;
+    }
+    input_snapshot_encoder.acknowledge(sequence);
+    record_input_to_acknowledgement_latencies(sequence, received_at);
+    input_insertion_time = sent_input_snapshot.input_insertion_time;
+    return true;
+}
+
+static uint32_t nanoseconds_to_clamped_microseconds(uint64_t nanoseconds) {
+    return static_cast<uint32_t>(std::min<uint64_t>(nanoseconds / 1000, UINT32_MAX));
+}
+
+/**
+ * \brief an acknowledgement covers every input up to its sequence, each of them that we still remember gets its own
+ * latency, an input whose own acknowledgement got lost still counts with the one that made it.
+ */
+void ClientNetwork::record_input_to_acknowledgement_latencies(uint64_t acknowledged_sequence, uint64_t received_at) {
+    if (acknowledged_sequence <= last_latency_measured_sequence) {
+        return; // a game state that was overtaken by a newer one
+    }
+    std::lock_guard<std::mutex> lock(input_latency_report_mutex);
+
+    uint64_t first_unmeasured_sequence = std::max(last_latency_measured_sequence + 1,
+                                                  acknowledged_sequence >= sent_input_snapshots.size()
+                                                      ? acknowledged_sequence - sent_input_snapshots.size() + 1
+                                                      : 1);
+    for (uint64_t sequence = first_unmeasured_sequence; sequence <= acknowledged_sequence; sequence++) {
+        const SentInputSnapshot &sent_input_snapshot = sent_input_snapshots[sequence % sent_input_snapshots.size()];
+        if (sent_input_snapshot.sequence == sequence && received_at >= sent_input_snapshot.input_insertion_time) {
+            input_latency_report.input_to_acknowledgement.record(
+                nanoseconds_to_clamped_microseconds(received_at - sent_input_snapshot.input_insertion_time));
+        }
+    }
+    last_latency_measured_sequence = acknowledged_sequence;
+    unrendered_acknowledgement_times.push_back(received_at);
+}
+
+void ClientNetwork::take_unrendered_acknowledgement_times(std::vector<uint64_t> &acknowledgement_times) {
+    acknowledgement_times.insert(acknowledgement_times.end(), unrendered_acknowledgement_times.begin(),
+                                 unrendered_acknowledgement_times.end());
+    unrendered_acknowledgement_times.clear();
+}
+
+void ClientNetwork::record_acknowledgements_rendered(const std::vector<uint64_t> &acknowledgement_times) {
+    uint64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::lock_guard<std::mutex> lock(input_latency_report_mutex);
+    for (uint64_t acknowledgement_time : acknowledgement_times) {
+        input_latency_report.acknowledgement_to_render.record(
+            nanoseconds_to_clamped_microseconds(now - acknowledgement_time));
+    }
 }
 
 void ClientNetwork::disconnect_from_server() {
@@ -6,9 +6,58 @@
 #include "interaction/multiplayer_physics/physics.hpp"
 #include "networked_input_snapshot/networked_input_snapshot.hpp"
 #include "interaction/camera/camera.hpp"
-#include "expiring_data_container/expiring_data_container.hpp"
 #include "networked_character_data/networked_character_data.hpp"
+#include "world_state_recorder/world_state_recorder.hpp"
+#include "compact_character_data/compact_character_data.hpp"
+#include "compact_input_snapshot/compact_input_snapshot.hpp"
+#include "client_report/client_report.hpp"
+#include "join_accept/join_accept.hpp"
+#include "snapshot_parts/snapshot_parts.hpp"
+#include "entity_lifecycle/entity_lifecycle.hpp"
+#include "time_sync/time_sync.hpp"
+#include "server_clock/server_clock.hpp"
+#include "spsc_queue/spsc_queue.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_set>
+
+/**
+ * \brief the server acknowledges inputs by their sequence number, this is how we get back to the processed input
+ * snapshot that was sent under it
+ */
+struct SentInputSnapshot {
+    uint64_t sequence = 0;
+    uint64_t input_insertion_time = 0;
+    NetworkedInputSnapshot input; // replayed by reconciliation once the server has acknowledged an earlier one
+};
+
+enum class ServerMessageType { JOIN_ACCEPT, GAME_STATE, ENTITY_LIFECYCLE, TIME_SYNC };
+
+/**
+ * \brief something the network thread received and decoded, waiting for the simulation thread to pick it up
+ */
+struct ReceivedServerMessage {
+    ServerMessageType type = ServerMessageType::GAME_STATE;
+    uint64_t client_id = 0;                // only for JOIN_ACCEPT
+    uint32_t tick = 0;                     // only for GAME_STATE, the server tick of the snapshot part
+    CharacterStateArrays character_states; // every character for JOIN_ACCEPT, one part's worth for GAME_STATE
+    uint64_t received_at = 0;              // steady clock time the packet came out of enet
+    std::vector<EntityLifecycleEvent> entity_lifecycle_events; // only for ENTITY_LIFECYCLE
+    TimeSyncResponse time_sync_response;                       // only for TIME_SYNC
+};
+
+/**
+ * \brief an encoded message the simulation thread wants sent, the network thread turns it into an enet packet
+ */
+struct OutgoingPacket {
+    uint8_t channel = 0;
+    bool reliable = false;
+    std::vector<uint8_t> data;
+};
 
 class ClientNetwork {
   public:
@@ -21,45 +70,151 @@ class ClientNetwork {
     ENetPeer *server_connection;
     std::string server_ip_address;
     int server_port;
-    NetworkedCharacterData most_recent_client_game_state_update;
+    NetworkedCharacterData most_recent_client_game_state_update{};
+    // false until the server has acknowledged one of our inputs, there's nothing to reconcile against before that
+    bool has_own_game_state_update = false;
+    // set when a game state brought a newer state of ours, reconciliation runs every tick but only that one counts as a
+    // correction in reconciliation_report
+    bool has_new_own_game_state_update = false;
+    // steady clock time the newest update for each other character arrived, lets the renderer tell it's gone stale
+    std::unordered_map<uint64_t, uint64_t> client_id_to_update_received_at;
+    // the parts of a game state arrive on their own and out of order, so a character is only updated by a part of a
+    // tick that's newer than the one it was last updated from
+    std::unordered_map<uint64_t, uint32_t> client_id_to_last_applied_tick;
+    // characters the server said are gone, so a game state that was still on its way doesn't bring them back. an id
+    // leaves again once it's spawned for someone new, and the server hands out the lowest free ids, so this stays small
+    std::unordered_set<uint64_t> despawned_client_ids;
 
     std::function<void(double)>
     network_step_closure(int send_frequency_hz, Physics &physics, Camera &camera, Mouse &mouse,
                          std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-                         ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history);
+                         WorldStateRecorder &world_state_recorder);
 
-    void handle_network_event(ENetEvent event, Physics &physics, Camera &camera, Mouse &mouse,
-                              std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-                              ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history);
+    /**
+     * \brief the enet host is only touched by the network thread once this is called, it services the connection
+     * continuously so acks, pings and game states don't wait on a slow frame
+     * \pre attempt_to_connect_to_server was run
+     */
+    void start_network_thread();
+    void stop_network_thread();
+
+    void handle_received_server_message(
+        const ReceivedServerMessage &message, Physics &physics, Camera &camera, Mouse &mouse,
+        std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data);
+    void handle_entity_lifecycle_events(
+        const std::vector<EntityLifecycleEvent> &events,
+        std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data);
 
     void process_game_state_update(NetworkedCharacterData *game_update, int game_update_length, Physics &physics,
                                    Camera &camera, Mouse &mouse,
-                                   std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-                                   ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history);
+                                   std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data);
 
     int start_network_loop(int send_frequency_hz, Physics &physics, Camera &camera, Mouse &mouse,
-                           std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-                           ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history);
+                           std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data);
 
-    void send_input_snapshot(ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history);
+    /**
+     * \brief queues the input snapshot the simulation just processed and keeps it around for reconciliation
+     */
+    void send_input_snapshot(const NetworkedInputSnapshot &processed_input_snapshot);
 
     std::mutex reconcile_mutex;
     void reconcile_local_game_state_with_server_update(
         NetworkedCharacterData &networked_character_data, Physics &physics, Camera &camera, Mouse &mouse,
         std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-        ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history,
-        JPH::Vec3 &authorative_position, JPH::Vec3 &authorative_velocity);
+        WorldStateRecorder &world_state_recorder, JPH::Vec3 &authorative_position, JPH::Vec3 &authorative_velocity);
 
     void update_local_client_with_game_state(
         NetworkedCharacterData &networked_character_data, Physics &physics, Camera &camera, Mouse &mouse,
         std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-        ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history);
+        WorldStateRecorder &world_state_recorder);
+    /**
+     * \brief moves the arrival times of acknowledgements since the last call into acknowledgement_times, they go along
+     * with the simulated frame they first show up in
+     */
+    void take_unrendered_acknowledgement_times(std::vector<uint64_t> &acknowledgement_times);
+    /**
+     * \brief call from the render thread once a frame showing these acknowledgements has been rendered
+     */
+    void record_acknowledgements_rendered(const std::vector<uint64_t> &acknowledgement_times);
+    /**
+     * \brief how the simulation should tick for our inputs to reach the server a little before the tick that takes
+     * them starts: as long as the server's ticks, and moved by phase_correction. only a part of the error measured
+     * with the last input is corrected at a time, so one late measurement doesn't throw the ticks around. when the
+     * server starts keeping more of our inputs back against jitter, the correction also has us run ahead a whole tick
+     * for each, so the server has them without its character going a tick without input, and back when it's fewer
+     * \return false if there's nothing new, once per input sent after the server's clock is known
+     */
+    bool take_tick_alignment(std::chrono::nanoseconds &server_tick_period, std::chrono::nanoseconds &phase_correction);
     void initialize_client_network();
     void attempt_to_connect_to_server();
     void disconnect_from_server();
 
   private:
-    unsigned int input_snapshot_to_binary();
+    void run_network_thread();
+    void handle_network_event(ENetEvent &event);
+    void send_outgoing_packets();
+    void queue_outgoing_packet(uint8_t channel, bool reliable, const std::vector<uint8_t> &data);
+
+    bool find_acknowledged_input_insertion_time(uint32_t low_bits_of_sequence, uint64_t received_at,
+                                                uint64_t &input_insertion_time);
+    void record_input_to_acknowledgement_latencies(uint64_t acknowledged_sequence, uint64_t received_at);
+    void send_client_reports_if_due();
+    void send_encoded_client_report();
+    void send_time_sync_request_if_due();
+    void gather_snapshots_to_reprocess(uint64_t acknowledged_insertion_time);
+
+    // how long the network thread waits for a packet before checking for something to send, this bounds how long an
+    // input sits in outgoing_packets
+    static constexpr uint32_t network_service_timeout_ms = 1;
+    static constexpr size_t received_server_messages_capacity = 64;
+    static constexpr size_t outgoing_packets_capacity = 64;
+
+    std::thread network_thread;
+    std::atomic<bool> network_thread_running = false;
+    bool network_thread_received_client_id = false; // network thread only
+    CompactCharacterDataCodec character_data_codec; // network thread only
+    SnapshotPartHeader received_snapshot_part_header; // network thread only
+    SpscQueue<ReceivedServerMessage, received_server_messages_capacity> received_server_messages;
+    SpscQueue<OutgoingPacket, outgoing_packets_capacity> outgoing_packets;
+    uint64_t dropped_server_messages = 0;  // network thread only, only ever game states
+    uint64_t dropped_outgoing_packets = 0; // simulation thread only
+
+    InputSnapshotEncoder input_snapshot_encoder;
+    std::vector<uint8_t> encoded_input_snapshot;
+    std::array<SentInputSnapshot, compact_input_snapshot::history_length> sent_input_snapshots;
+    uint64_t latest_sent_sequence = 0; // 0 until the first input is sent
+    // scratch for reconciliation, kept between ticks so that reconciling doesn't allocate
+    std::vector<NetworkedInputSnapshot> snapshots_to_be_reprocessed;
+    std::vector<NetworkedCharacterData> received_game_update;
+
+    // gathered between reports, reports are sent at most every client_report_period
+    static constexpr std::chrono::seconds client_report_period{1};
+    ReconciliationReport reconciliation_report;
+    std::chrono::steady_clock::time_point last_client_report_time = std::chrono::steady_clock::now();
+    std::mutex input_latency_report_mutex; // the render thread records into it as well
+    InputLatencyReport input_latency_report;
+    uint64_t last_latency_measured_sequence = 0;
+    // steady clock times at which acknowledgements arrived that haven't been rendered yet
+    std::vector<uint64_t> unrendered_acknowledgement_times;
+    std::vector<uint8_t> encoded_client_report;
+
+    // a few requests quickly to get going, then now and then to follow the clocks drifting apart
+    static constexpr std::chrono::milliseconds initial_time_sync_period{100};
+    static constexpr std::chrono::seconds time_sync_period{1};
+    // how long before the server's next tick starts we want our inputs to arrive, enough to not miss it on a bit of
+    // jitter without the input waiting around
+    static constexpr std::chrono::microseconds tick_arrival_lead{2000};
+    static constexpr double tick_phase_correction_gain = 0.1;
+    static constexpr std::chrono::microseconds max_tick_phase_correction{1000};
+    ServerClock server_clock; // simulation thread only
+    std::chrono::steady_clock::time_point last_time_sync_request_time;
+    size_t num_time_sync_requests_sent = 0;
+    TimeSyncRequest time_sync_request;
+    std::vector<uint8_t> encoded_time_sync_request;
+    int64_t latest_tick_phase_error_ns = 0;
+    bool has_new_tick_phase_error = false;
+    int input_buffer_depth = 0; // how many of our inputs the server keeps back, as of the last time sync response
+    int run_ahead_ticks = 0;    // the changes to it we haven't run ahead or fallen back for yet
 };
 
 #endif // MWE_NETWORKING_CLIENT_HPP
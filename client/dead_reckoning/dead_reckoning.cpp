@@ -0,0 +1,88 @@
+#include "dead_reckoning.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+static float nanoseconds_to_seconds(uint64_t nanoseconds) { return static_cast<float>(nanoseconds) * 1e-9f; }
+
+glm::vec3 DeadReckoning::extrapolation_offset(const glm::vec3 &velocity, float seconds) const {
+    glm::vec3 offset = velocity * seconds;
+    // on the ground the vertical velocity is about zero and gravity would sink the character into the floor
+    if (std::abs(velocity.y) > settings.airborne_vertical_speed) {
+        offset += 0.5f * settings.gravity * seconds * seconds;
+    }
+    return offset;
+}
+
+void DeadReckoning::apply(std::vector<CharacterRenderState> &characters, uint64_t own_client_id, uint64_t now) {
+    frame++;
+
+    for (CharacterRenderState &character : characters) {
+        if (character.client_id == own_client_id || character.received_at == 0) {
+            continue; // our own character is predicted, not extrapolated
+        }
+
+        auto [it, inserted] = client_id_to_remote_character.try_emplace(character.client_id);
+        RemoteCharacter &remote_character = it->second;
+        remote_character.last_seen_frame = frame;
+
+        if (inserted) {
+            remote_character.received_at = character.received_at;
+            remote_character.update_interval_seconds = settings.initial_update_interval_seconds;
+            remote_character.drawn_position = character.position;
+        } else if (character.received_at != remote_character.received_at) {
+            float interval = nanoseconds_to_seconds(character.received_at - remote_character.received_at);
+            remote_character.update_interval_seconds +=
+                (interval - remote_character.update_interval_seconds) * settings.update_interval_smoothing;
+            remote_character.received_at = character.received_at;
+
+            // only a guess needs blending back, an update that's on time is just the character's next step, and
+            // blending those would drag the character behind for good
+            if (remote_character.was_extrapolated) {
+                glm::vec3 correction = remote_character.drawn_position - character.position;
+                // anything much further off than we'd ever extrapolate is a teleport, that should just happen
+                bool blend_back = glm::length(correction) <= 2.0f * settings.max_extrapolation_meters;
+                remote_character.correction = blend_back ? correction : glm::vec3(0.0f);
+                remote_character.correction_started_at = now;
+            }
+        }
+
+        glm::vec3 position = character.position;
+
+        float age = now > remote_character.received_at
+                        ? nanoseconds_to_seconds(now - remote_character.received_at)
+                        : 0.0f;
+        // counting from when the update became late rather than from when it arrived, so a character doesn't jump
+        // the moment it starts being extrapolated
+        float overdue = age - remote_character.update_interval_seconds * settings.lateness_factor;
+        remote_character.was_extrapolated = overdue > 0.0f && settings.max_extrapolation_seconds > 0.0f;
+        if (remote_character.was_extrapolated) {
+            glm::vec3 offset =
+                extrapolation_offset(character.velocity, std::min(overdue, settings.max_extrapolation_seconds));
+            float distance = glm::length(offset);
+            if (distance > settings.max_extrapolation_meters) {
+                offset *= settings.max_extrapolation_meters / distance;
+            }
+            position += offset;
+        }
+
+        if (settings.blend_back_seconds > 0.0f) {
+            float since_correction = nanoseconds_to_seconds(now - remote_character.correction_started_at);
+            float remaining_correction = 1.0f - since_correction / settings.blend_back_seconds;
+            if (remaining_correction > 0.0f) {
+                position += remote_character.correction * remaining_correction;
+            }
+        }
+
+        character.position = position;
+        remote_character.drawn_position = position;
+    }
+
+    // forget characters that have left, which is rare, so only look when there are more remembered than drawn
+    if (client_id_to_remote_character.size() > characters.size()) {
+        for (auto it = client_id_to_remote_character.begin(); it != client_id_to_remote_character.end();) {
+            it = it->second.last_seen_frame == frame ? std::next(it) : client_id_to_remote_character.erase(it);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef DEAD_RECKONING_HPP
+#define DEAD_RECKONING_HPP
+
+#include "simulated_frame/simulated_frame.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct DeadReckoningSettings {
+    // an update counts as late once this many of the usual intervals between a character's updates have gone by
+    float lateness_factor = 1.5f;
+    float initial_update_interval_seconds = 1.0f / 60.0f;
+    // how quickly the usual interval follows the intervals actually seen, per update
+    float update_interval_smoothing = 0.1f;
+    // past these a character is left where it is, guessing any further is more likely wrong than helpful
+    float max_extrapolation_seconds = 0.25f;
+    float max_extrapolation_meters = 2.0f;
+    glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+    // below this vertical speed a character is taken to be on the ground, where the floor cancels out gravity
+    float airborne_vertical_speed = 0.5f;
+    // how long a character takes to ease from where it was drawn to where a fresh update says it is
+    float blend_back_seconds = 0.1f;
+};
+
+/**
+ * \brief keeps remote characters moving when their updates are late instead of freezing them. once a character's
+ * newest update is older than usual it's moved along by its velocity (and gravity when it's in the air) for however
+ * long the update is overdue, capped in time and distance.
+ *
+ * when a fresh update arrives the difference between where the character was drawn and where it really is fades out
+ * over blend_back_seconds, so the character doesn't snap. a character that's on time is drawn exactly where the
+ * server put it, so nobody gets any extra delay.
+ *
+ * runs at render time, on whatever thread renders.
+ */
+class DeadReckoning {
+  public:
+    explicit DeadReckoning(const DeadReckoningSettings &settings) : settings(settings) {}
+
+    /**
+     * \brief moves the remote characters in place to where they should be drawn now
+     * \param now steady clock time in nanoseconds, the same clock as CharacterRenderState::received_at
+     */
+    void apply(std::vector<CharacterRenderState> &characters, uint64_t own_client_id, uint64_t now);
+
+    /**
+     * \brief how far a character moving like this gets in the given time, without the caps
+     */
+    glm::vec3 extrapolation_offset(const glm::vec3 &velocity, float seconds) const;
+
+  private:
+    struct RemoteCharacter {
+        uint64_t received_at = 0;
+        float update_interval_seconds = 0.0f;
+        glm::vec3 drawn_position = glm::vec3(0.0f);
+        // where it was drawn minus where the update that just arrived put it, fades out from correction_started_at
+        glm::vec3 correction = glm::vec3(0.0f);
+        uint64_t correction_started_at = 0;
+        bool was_extrapolated = false;
+        uint64_t last_seen_frame = 0;
+    };
+
+    DeadReckoningSettings settings;
+    std::unordered_map<uint64_t, RemoteCharacter> client_id_to_remote_character;
+    uint64_t frame = 0;
+};
+
+#endif // DEAD_RECKONING_HPP
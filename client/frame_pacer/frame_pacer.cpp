@@ -0,0 +1,32 @@
+#include "frame_pacer.hpp"
+#include <algorithm>
+#include <thread>
+
+FramePacer::FramePacer(double rate_hz)
+    : nominal_period(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(1.0 / rate_hz))),
+      period(nominal_period),
+      next_deadline(std::chrono::steady_clock::now()) {}
+
+void FramePacer::wait_for_next_frame() {
+    next_deadline += period;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now > next_deadline + max_frames_behind * period) {
+        skipped_frames += (now - next_deadline) / period;
+        next_deadline = now;
+        return;
+    }
+
+    if (next_deadline - now > spin_before_deadline) {
+        std::this_thread::sleep_until(next_deadline - spin_before_deadline);
+    }
+    while (std::chrono::steady_clock::now() < next_deadline) {
+        std::this_thread::yield();
+    }
+}
+
+void FramePacer::set_period(std::chrono::nanoseconds new_period) {
+    auto max_change = std::chrono::duration_cast<std::chrono::nanoseconds>(nominal_period * max_period_change);
+    period = std::clamp(new_period, nominal_period - max_change, nominal_period + max_change);
+}
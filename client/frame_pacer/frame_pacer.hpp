@@ -0,0 +1,47 @@
+#ifndef FRAME_PACER_HPP
+#define FRAME_PACER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * \brief keeps a loop running at a fixed rate. the deadlines are a fixed period apart instead of being a fixed time
+ * after the last frame ended, so the rate doesn't drift with how long the frames take.
+ *
+ * sleeping is only accurate to a millisecond or so, the last bit before a deadline is spent yielding instead, which
+ * keeps the frames evenly spaced.
+ */
+class FramePacer {
+  public:
+    explicit FramePacer(double rate_hz);
+
+    /**
+     * \brief blocks until the next deadline. if the loop has fallen more than max_frames_behind frames behind, the
+     * missed frames are skipped instead of being run back to back to catch up.
+     */
+    void wait_for_next_frame();
+    /**
+     * \brief frames are this long from the next one on, to follow a clock that runs a little off the rate we were made
+     * with. it's kept within max_period_change of that rate
+     */
+    void set_period(std::chrono::nanoseconds new_period);
+    /**
+     * \brief moves the next deadline by offset, to line the frames up with something else
+     */
+    void shift(std::chrono::nanoseconds offset) { next_deadline += offset; }
+
+    std::chrono::nanoseconds get_period() const { return period; }
+    uint64_t get_skipped_frames() const { return skipped_frames; }
+
+    static constexpr int max_frames_behind = 4;
+    static constexpr std::chrono::microseconds spin_before_deadline{1500};
+    static constexpr double max_period_change = 0.1;
+
+  private:
+    std::chrono::nanoseconds nominal_period;
+    std::chrono::nanoseconds period;
+    std::chrono::steady_clock::time_point next_deadline;
+    uint64_t skipped_frames = 0;
+};
+
+#endif // FRAME_PACER_HPP
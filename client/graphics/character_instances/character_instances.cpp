@@ -0,0 +1,286 @@
+#include "character_instances.hpp"
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+// players are told apart by color, there's no need for more than a handful
+static const std::array<glm::vec4, 8> player_colors = {{
+    {0.90f, 0.30f, 0.25f, 1.0f},
+    {0.25f, 0.55f, 0.90f, 1.0f},
+    {0.35f, 0.80f, 0.35f, 1.0f},
+    {0.95f, 0.75f, 0.20f, 1.0f},
+    {0.70f, 0.40f, 0.85f, 1.0f},
+    {0.20f, 0.80f, 0.80f, 1.0f},
+    {0.95f, 0.55f, 0.20f, 1.0f},
+    {0.85f, 0.85f, 0.85f, 1.0f},
+}};
+
+void CharacterInstances::sync(const std::vector<CharacterRenderState> &characters, uint64_t own_client_id) {
+    sync_count++;
+
+    for (const CharacterRenderState &character : characters) {
+        uint64_t client_id = character.client_id;
+        if (client_id == own_client_id) {
+            continue; // we don't see ourselves
+        }
+        const glm::vec3 &position = character.position;
+
+        auto index_it = client_id_to_instance_index.find(client_id);
+        if (index_it == client_id_to_instance_index.end()) {
+            index_it = client_id_to_instance_index.emplace(client_id, instances.size()).first;
+            instances.push_back({glm::translate(glm::mat4(1.0f), position),
+                                 player_colors[client_id % player_colors.size()]});
+            instance_client_ids.push_back(client_id);
+            instance_last_seen_sync.push_back(sync_count);
+            mark_changed(index_it->second);
+            continue;
+        }
+
+        size_t instance_index = index_it->second;
+        instance_last_seen_sync[instance_index] = sync_count;
+        glm::mat4 &local_to_world = instances[instance_index].local_to_world;
+        if (glm::vec3(local_to_world[3]) != position) {
+            local_to_world[3] = glm::vec4(position, 1.0f);
+            mark_changed(instance_index);
+        }
+    }
+
+    // whoever wasn't seen left, walking backwards so the swapped in instance has already been checked
+    for (size_t i = instances.size(); i-- > 0;) {
+        if (instance_last_seen_sync[i] != sync_count) {
+            remove_instance(i);
+        }
+    }
+}
+
+void CharacterInstances::mark_changed(size_t instance_index) {
+    if (first_changed_instance == end_of_changed_instances) {
+        first_changed_instance = instance_index;
+        end_of_changed_instances = instance_index + 1;
+        return;
+    }
+    first_changed_instance = std::min(first_changed_instance, instance_index);
+    end_of_changed_instances = std::max(end_of_changed_instances, instance_index + 1);
+}
+
+void CharacterInstances::mark_uploaded() {
+    first_changed_instance = 0;
+    end_of_changed_instances = 0;
+}
+
+/**
+ * \brief swaps the last instance into the removed one's place so the array stays packed
+ */
+void CharacterInstances::remove_instance(size_t instance_index) {
+    size_t last_index = instances.size() - 1;
+    client_id_to_instance_index.erase(instance_client_ids[instance_index]);
+    if (instance_index != last_index) {
+        instances[instance_index] = instances[last_index];
+        instance_client_ids[instance_index] = instance_client_ids[last_index];
+        instance_last_seen_sync[instance_index] = instance_last_seen_sync[last_index];
+        client_id_to_instance_index[instance_client_ids[instance_index]] = instance_index;
+        mark_changed(instance_index);
+    }
+    instances.pop_back();
+    instance_client_ids.pop_back();
+    instance_last_seen_sync.pop_back();
+
+    // nothing past the end has to be uploaded anymore
+    end_of_changed_instances = std::min(end_of_changed_instances, instances.size());
+    first_changed_instance = std::min(first_changed_instance, end_of_changed_instances);
+}
+
+// the transform takes up the four attribute locations after the position, one per column
+constexpr GLuint position_location = 0;
+constexpr GLuint local_to_world_location = 1;
+constexpr GLuint color_location = 5;
+
+static const char *instanced_vertex_shader_source = R"(
+#version 330 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in mat4 local_to_world;
+layout (location = 5) in vec4 color;
+
+uniform mat4 world_to_clip;
+
+out vec3 world_position;
+flat out vec4 instance_color;
+
+void main() {
+    vec4 world_position_homogeneous = local_to_world * vec4(position, 1.0);
+    world_position = world_position_homogeneous.xyz;
+    instance_color = color;
+    gl_Position = world_to_clip * world_position_homogeneous;
+}
+)";
+
+// the model's normals aren't ours to rely on, the face normal falls out of the screen space derivatives
+static const char *instanced_fragment_shader_source = R"(
+#version 330 core
+in vec3 world_position;
+flat in vec4 instance_color;
+
+out vec4 fragment_color;
+
+void main() {
+    vec3 normal = normalize(cross(dFdx(world_position), dFdy(world_position)));
+    float light = 0.35 + 0.65 * max(dot(normal, normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+    fragment_color = vec4(instance_color.rgb * light, instance_color.a);
+}
+)";
+
+static GLuint compile_shader(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint compiled;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        std::array<char, 1024> info_log;
+        glGetShaderInfoLog(shader, info_log.size(), nullptr, info_log.data());
+        throw std::runtime_error(std::string("couldn't compile the character instance shader: ") + info_log.data());
+    }
+    return shader;
+}
+
+static GLuint create_instanced_shader_program() {
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, instanced_vertex_shader_source);
+    GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, instanced_fragment_shader_source);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        std::array<char, 1024> info_log;
+        glGetProgramInfoLog(program, info_log.size(), nullptr, info_log.data());
+        throw std::runtime_error(std::string("couldn't link the character instance shader: ") + info_log.data());
+    }
+    return program;
+}
+
+CharacterInstanceRenderer::CharacterInstanceRenderer(const Model &character_model) {
+    shader_program_id = create_instanced_shader_program();
+    world_to_clip_location = glGetUniformLocation(shader_program_id, "world_to_clip");
+
+    glGenBuffers(1, &instance_buffer_object);
+
+    std::vector<glm::vec3> positions;
+    for (const auto &mesh : character_model.meshes) {
+        positions.clear();
+        for (const auto &vertex : mesh.vertices) {
+            positions.push_back(vertex.position);
+        }
+
+        InstancedMesh instanced_mesh;
+        instanced_mesh.num_indices = static_cast<GLsizei>(mesh.indices.size());
+        glGenVertexArrays(1, &instanced_mesh.vertex_attribute_object);
+        glGenBuffers(1, &instanced_mesh.vertex_buffer_object);
+        glGenBuffers(1, &instanced_mesh.element_buffer_object);
+
+        glBindVertexArray(instanced_mesh.vertex_attribute_object);
+        glBindBuffer(GL_ARRAY_BUFFER, instanced_mesh.vertex_buffer_object);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(position_location);
+        glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, instanced_mesh.element_buffer_object);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(),
+                     GL_STATIC_DRAW);
+
+        attach_instance_attributes(instanced_mesh.vertex_attribute_object);
+        meshes.push_back(instanced_mesh);
+    }
+    glBindVertexArray(0);
+}
+
+CharacterInstanceRenderer::~CharacterInstanceRenderer() {
+    for (InstancedMesh &mesh : meshes) {
+        glDeleteVertexArrays(1, &mesh.vertex_attribute_object);
+        glDeleteBuffers(1, &mesh.vertex_buffer_object);
+        glDeleteBuffers(1, &mesh.element_buffer_object);
+    }
+    glDeleteBuffers(1, &instance_buffer_object);
+    glDeleteProgram(shader_program_id);
+}
+
+/**
+ * \pre the vertex attribute object is bound
+ */
+void CharacterInstanceRenderer::attach_instance_attributes(GLuint vertex_attribute_object) {
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_object);
+    for (GLuint column = 0; column < 4; column++) {
+        GLuint location = local_to_world_location + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(CharacterInstance),
+                              reinterpret_cast<void *>(offsetof(CharacterInstance, local_to_world) +
+                                                       column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    glEnableVertexAttribArray(color_location);
+    glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, sizeof(CharacterInstance),
+                          reinterpret_cast<void *>(offsetof(CharacterInstance, color)));
+    glVertexAttribDivisor(color_location, 1);
+}
+
+/**
+ * \brief the buffer only ever grows, doubling so that players joining one by one don't reallocate it each time. when it
+ * doesn't grow only the changed range is sent.
+ */
+void CharacterInstanceRenderer::upload_changed_instances(CharacterInstances &character_instances) {
+    const std::vector<CharacterInstance> &instances = character_instances.get_instances();
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_object);
+
+    if (instances.size() > instance_buffer_capacity) {
+        instance_buffer_capacity = std::max<size_t>(instances.size(), instance_buffer_capacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, instance_buffer_capacity * sizeof(CharacterInstance), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(CharacterInstance), instances.data());
+        spdlog::info("grew the character instance buffer to {} instances", instance_buffer_capacity);
+    } else if (character_instances.get_first_changed_instance() != character_instances.get_end_of_changed_instances()) {
+        size_t first = character_instances.get_first_changed_instance();
+        size_t count = character_instances.get_end_of_changed_instances() - first;
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(CharacterInstance), count * sizeof(CharacterInstance),
+                        instances.data() + first);
+    }
+    character_instances.mark_uploaded();
+}
+
+void CharacterInstanceRenderer::draw(CharacterInstances &character_instances, const glm::mat4 &world_to_clip) {
+    upload_changed_instances(character_instances);
+
+    GLsizei num_instances = static_cast<GLsizei>(character_instances.get_instances().size());
+    if (num_instances == 0) {
+        return;
+    }
+
+    glUseProgram(shader_program_id);
+    glUniformMatrix4fv(world_to_clip_location, 1, GL_FALSE, &world_to_clip[0][0]);
+    for (const InstancedMesh &mesh : meshes) {
+        glBindVertexArray(mesh.vertex_attribute_object);
+        glDrawElementsInstanced(GL_TRIANGLES, mesh.num_indices, GL_UNSIGNED_INT, nullptr, num_instances);
+    }
+    glBindVertexArray(0);
+}
+
+glm::mat4 camera_pov_world_to_clip(int screen_width, int screen_height, const glm::vec3 &camera_position,
+                                   float yaw_angle, float pitch_angle, float fov_degrees, float render_distance) {
+    glm::vec3 look_direction(std::cos(yaw_angle) * std::cos(pitch_angle), std::sin(pitch_angle),
+                             std::sin(yaw_angle) * std::cos(pitch_angle));
+    glm::mat4 world_to_camera =
+        glm::lookAt(camera_position, camera_position + look_direction, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 camera_to_clip = glm::perspective(glm::radians(fov_degrees),
+                                                static_cast<float>(screen_width) / static_cast<float>(screen_height),
+                                                0.1f, render_distance);
+    return camera_to_clip * world_to_camera;
+}
@@ -0,0 +1,96 @@
+#ifndef CHARACTER_INSTANCES_HPP
+#define CHARACTER_INSTANCES_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "../textured_model_loading/model_loading.hpp"
+#include "../../simulated_frame/simulated_frame.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief what the gpu needs to draw one character, laid out exactly as it sits in the instance buffer
+ */
+struct CharacterInstance {
+    glm::mat4 local_to_world;
+    glm::vec4 color;
+};
+
+/**
+ * \brief every character but our own as a tightly packed array that can be uploaded as is. it's kept in sync with the
+ * character data one character at a time instead of being rebuilt, so once it has grown to the number of players a
+ * frame doesn't allocate, and only the part of the array that actually changed gets uploaded.
+ */
+class CharacterInstances {
+  public:
+    void sync(const std::vector<CharacterRenderState> &characters, uint64_t own_client_id);
+
+    const std::vector<CharacterInstance> &get_instances() const { return instances; }
+    /**
+     * \brief the instances in [first, end) changed since the last call to mark_uploaded, empty if first == end
+     */
+    size_t get_first_changed_instance() const { return first_changed_instance; }
+    size_t get_end_of_changed_instances() const { return end_of_changed_instances; }
+    void mark_uploaded();
+
+  private:
+    void mark_changed(size_t instance_index);
+    void remove_instance(size_t instance_index);
+
+    std::vector<CharacterInstance> instances;
+    // parallel to instances
+    std::vector<uint64_t> instance_client_ids;
+    std::vector<uint64_t> instance_last_seen_sync;
+    std::unordered_map<uint64_t, size_t> client_id_to_instance_index;
+    uint64_t sync_count = 0;
+
+    size_t first_changed_instance = 0;
+    size_t end_of_changed_instances = 0;
+};
+
+/**
+ * \brief draws every character instance with one instanced draw call per mesh of the character model.
+ *
+ * the character's geometry is copied out of the model into buffers of our own, the model's textured shader draws a
+ * single object per call, so the characters get their own shader which reads the transform and a color per instance.
+ */
+class CharacterInstanceRenderer {
+  public:
+    explicit CharacterInstanceRenderer(const Model &character_model);
+    ~CharacterInstanceRenderer();
+
+    CharacterInstanceRenderer(const CharacterInstanceRenderer &) = delete;
+    CharacterInstanceRenderer &operator=(const CharacterInstanceRenderer &) = delete;
+
+    void draw(CharacterInstances &character_instances, const glm::mat4 &world_to_clip);
+
+  private:
+    void upload_changed_instances(CharacterInstances &character_instances);
+    void attach_instance_attributes(GLuint vertex_attribute_object);
+
+    struct InstancedMesh {
+        GLuint vertex_attribute_object;
+        GLuint vertex_buffer_object;
+        GLuint element_buffer_object;
+        GLsizei num_indices;
+    };
+
+    GLuint shader_program_id;
+    GLint world_to_clip_location;
+    std::vector<InstancedMesh> meshes;
+
+    GLuint instance_buffer_object;
+    size_t instance_buffer_capacity = 0; // in instances, only grows
+};
+
+/**
+ * \brief the projection and view of the player's point of view, the same ones bind_CWL_matrix_uniforms_camera_pov
+ * binds for the map, computed once a frame for every character instead of once per character
+ */
+glm::mat4 camera_pov_world_to_clip(int screen_width, int screen_height, const glm::vec3 &camera_position,
+                                   float yaw_angle, float pitch_angle, float fov_degrees, float render_distance);
+
+#endif // CHARACTER_INSTANCES_HPP
@@ -3,65 +3,57 @@
 #include "shaders/CWL_uniform_binder_camera_pov.hpp"
 #include "spdlog/spdlog.h"
 
-void render(GLuint shader_program_id, Model *map, Model &character_model,
-            std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data, Camera *camera,
-            int screen_width, int screen_height, uint64_t *client_id) {
+#include <algorithm>
 
-    if (*client_id == -1) {
+// the field of view and render distance the player sees the world with
+constexpr float camera_pov_fov_degrees = 90;
+constexpr float camera_pov_render_distance = 100;
+
+void render(GLuint shader_program_id, Model *map, CharacterInstanceRenderer &character_instance_renderer,
+            CharacterInstances &character_instances, const std::vector<CharacterRenderState> &characters,
+            uint64_t own_client_id, int screen_width, int screen_height) {
+
+    if (own_client_id == -1) {
         return; // we've not yet connected to the server, nothing to render.
     }
 
     glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-    spdlog::info("check inner render");
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    spdlog::info("inner render check complete");
-
-    // instanced rendering of all the players at their different locations or something? or just multiple draw calls
-    // with different transforms for each character, get the characters position, turn it into a matrix, bind that
-    // matrix into the shader program and call draw. so we need to iterate through the received data which is a list of
-    // blah blah
-
-    glm::vec3 client_character_position;
-    Camera client_camera;
-    std::unordered_map<uint64_t, glm::mat4>
-        client_id_to_translation_matrix; // excludes our own, we don't need to draw our own model
 
-    for (auto pair : client_id_to_character_data) {
-        NetworkedCharacterData player_data = pair.second;
-        glm::vec3 glm_character_position(player_data.character_x_position, player_data.character_y_position,
-                                         player_data.character_z_position);
-        if (player_data.client_id == *client_id) {
-            client_character_position = glm_character_position;
-            client_camera.set_look_direction(player_data.camera_yaw_angle, player_data.camera_pitch_angle);
-        } else {
-            glm::mat4 translation_matrix = glm::translate(glm::mat4(1.0f), glm_character_position);
-            client_id_to_translation_matrix[player_data.client_id] = translation_matrix;
-        }
+    // only our own character decides the point of view, the others are kept in sync with their instances
+    auto own_character_it = std::find_if(
+        characters.begin(), characters.end(),
+        [own_client_id](const CharacterRenderState &character) { return character.client_id == own_client_id; });
+    if (own_character_it == characters.end()) {
+        return; // no game state has reached us yet
     }
+    const CharacterRenderState &own_character = *own_character_it;
+    Camera client_camera;
+    client_camera.set_look_direction(own_character.camera_yaw_angle, own_character.camera_pitch_angle);
 
-    for (auto pair : client_id_to_translation_matrix) {
-        glm::mat4 translation_matrix = pair.second;
-        bind_CWL_matrix_uniforms_camera_pov(shader_program_id, screen_width, screen_height, client_character_position,
-                                            translation_matrix, client_camera, 90, 100);
-        character_model.draw();
-    }
+    character_instances.sync(characters, own_client_id);
 
     // for the map we use the identity transfomraiton, it stays fixed
-    bind_CWL_matrix_uniforms_camera_pov(shader_program_id, screen_width, screen_height, client_character_position,
-                                        glm::mat4(1.0f), client_camera, 90, 100);
-
+    glUseProgram(shader_program_id);
+    bind_CWL_matrix_uniforms_camera_pov(shader_program_id, screen_width, screen_height, own_character.position,
+                                        glm::mat4(1.0f), client_camera, camera_pov_fov_degrees,
+                                        camera_pov_render_distance);
     map->draw();
+
+    glm::mat4 world_to_clip = camera_pov_world_to_clip(
+        screen_width, screen_height, own_character.position, own_character.camera_yaw_angle,
+        own_character.camera_pitch_angle, camera_pov_fov_degrees, camera_pov_render_distance);
+    character_instance_renderer.draw(character_instances, world_to_clip);
 }
 
-std::function<void(double)>
-render_closure(GLuint shader_program_id, Model *map, Model &character_model,
-               std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data, Camera *camera,
-               GLFWwindow *window, unsigned int screen_width_px, unsigned int screen_height_px, uint64_t *client_id) {
-    return [shader_program_id, map, window, camera, screen_width_px, screen_height_px, &character_model, client_id,
-            &client_id_to_character_data](double time_since_last_render_sec) {
-        render(shader_program_id, map, character_model, client_id_to_character_data, camera, screen_width_px,
-               screen_height_px, client_id);
+std::function<void(const std::vector<CharacterRenderState> &, uint64_t)>
+render_closure(GLuint shader_program_id, Model *map, CharacterInstanceRenderer &character_instance_renderer,
+               CharacterInstances &character_instances, GLFWwindow *window, unsigned int screen_width_px,
+               unsigned int screen_height_px) {
+    return [shader_program_id, map, window, screen_width_px, screen_height_px, &character_instance_renderer,
+            &character_instances](const std::vector<CharacterRenderState> &characters, uint64_t own_client_id) {
+        render(shader_program_id, map, character_instance_renderer, character_instances, characters, own_client_id,
+               screen_width_px, screen_height_px);
         glfwSwapBuffers(window);
-        glfwPollEvents();
     };
 }
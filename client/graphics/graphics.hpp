@@ -5,14 +5,19 @@
 #include <GLFW/glfw3.h>
 
 #include "textured_model_loading/model_loading.hpp"
+#include "character_instances/character_instances.hpp"
 #include "../interaction/camera/camera.hpp"
-#include "../networked_character_data/networked_character_data.hpp"
+#include "../simulated_frame/simulated_frame.hpp"
 
 #include <functional>
 
-std::function<void(double)>
-render_closure(GLuint shader_program_id, Model *map, Model &character_model,
-               std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data, Camera *camera,
-               GLFWwindow *window, unsigned int screen_width_px, unsigned int screen_height_px, uint64_t *client_id);
+/**
+ * \brief renders the given characters from the point of view of our own one and swaps buffers, the window's context has
+ * to be current on the calling thread
+ */
+std::function<void(const std::vector<CharacterRenderState> &, uint64_t)>
+render_closure(GLuint shader_program_id, Model *map, CharacterInstanceRenderer &character_instance_renderer,
+               CharacterInstances &character_instances, GLFWwindow *window, unsigned int screen_width_px,
+               unsigned int screen_height_px);
 
 #endif
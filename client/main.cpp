@@ -7,7 +7,7 @@
 #include "graphics/graphics.hpp"
 
 #include "networked_input_snapshot/networked_input_snapshot.hpp"
-#include "expiring_data_container/expiring_data_container.hpp"
+#include "world_state_recorder/world_state_recorder.hpp"
 #include "networked_character_data/networked_character_data.hpp"
 
 #include "interaction/multiplayer_physics/physics.hpp"
@@ -15,14 +15,21 @@
 #include "interaction/mouse/mouse.hpp"
 
 #include "rate_limited_loop/rate_limited_loop.hpp"
+#include "frame_pacer/frame_pacer.hpp"
+#include "simulated_frame/simulated_frame.hpp"
+#include "dead_reckoning/dead_reckoning.hpp"
 
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 #include "spdlog/sinks/basic_file_sink.h"
 
 #include "formatting/formatting.hpp"
+#include "allocation_tracker/allocation_tracker.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <mutex>
 #include <thread>
 
 // void update(double time_since_last_update) {}
@@ -43,22 +50,31 @@ void set_character_render_state(std::unordered_map<uint64_t, NetworkedCharacterD
     client_id_to_character_data[*client_id].character_x_position = client_physics_character->GetPosition().GetX();
     client_id_to_character_data[*client_id].character_y_position = client_physics_character->GetPosition().GetY();
     client_id_to_character_data[*client_id].character_z_position = client_physics_character->GetPosition().GetZ();
-    spdlog::info("just set character state");
 }
 
+/**
+ * \param sampled_input_snapshot a copy of the live input snapshot the main thread makes after polling events, guarded
+ * by sampled_input_mutex since the simulation runs on its own thread
+ * \param processed_input_snapshot the input the tick was simulated with, sent right after
+ */
 std::function<void(double)> update_closure(
-    std::mutex &reconcile_mutex, ExpiringDataContainer<NetworkedInputSnapshot> &processed_input_snapshot_history,
+    std::mutex &reconcile_mutex, NetworkedInputSnapshot &processed_input_snapshot,
     std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
-    NetworkedInputSnapshot &live_input_snapshot, Physics &physics, Mouse &mouse, Camera &camera, uint64_t *client_id) {
-    return [&live_input_snapshot, &processed_input_snapshot_history, &mouse, &camera, client_id,
-            &client_id_to_character_data, &physics, &reconcile_mutex](double time_since_last_update_ms) {
+    NetworkedInputSnapshot &sampled_input_snapshot, std::mutex &sampled_input_mutex, Physics &physics,
+    WorldStateRecorder &world_state_recorder, Mouse &mouse, Camera &camera, uint64_t *client_id) {
+    return [&sampled_input_snapshot, &sampled_input_mutex, &processed_input_snapshot, &mouse, &camera,
+            client_id, &client_id_to_character_data, &physics, &world_state_recorder,
+            &reconcile_mutex](double time_since_last_update_ms) {
         if (*client_id == -1) {
             return; // we've not yet connected to the server, no reason to start doing anything yet. we can do better by
                     // waiting to start any thread until this condition is met. which can be check occasionally.
         }
 
-        NetworkedInputSnapshot frozen_input_snapshot = live_input_snapshot;
-        // TODO make sure that the player exists first? mutex it?
+        NetworkedInputSnapshot frozen_input_snapshot;
+        {
+            std::lock_guard<std::mutex> lock(sampled_input_mutex);
+            frozen_input_snapshot = sampled_input_snapshot;
+        }
         const float movement_acceleration = 15.0f;
 
         JPH::Ref<JPH::CharacterVirtual> client_physics_character = physics.client_id_to_physics_character[*client_id];
@@ -67,29 +83,18 @@ std::function<void(double)> update_closure(
                                           physics.physics_system.GetGravity());
 
         physics.update(time_since_last_update_ms);
+        // one recorded world state per processed input snapshot, reconciliation relies on this to find the tick
+        world_state_recorder.record_next(physics);
 
         uint64_t time = std::chrono::steady_clock::now().time_since_epoch().count();
         frozen_input_snapshot.client_input_history_insertion_time_epoch_ms = time;
         frozen_input_snapshot.time_delta_used_for_client_side_processing_ms = time_since_last_update_ms;
 
-        spdlog::info("physics tick with delta: {}\nusing input snapshot: {}, physics world: {}",
-                     time_since_last_update_ms, frozen_input_snapshot, physics);
+        spdlog::trace("physics tick with delta: {}\nusing input snapshot: {}, physics world: {}",
+                      time_since_last_update_ms, frozen_input_snapshot, physics);
 
-        // reconcile_mutex.unlock();
-
-        // JPH::Vec3 velocity_after_reconciliation = client_physics_character->GetLinearVelocity();
-        JPH::Vec3 position_after_update = client_physics_character->GetPosition();
-        JPH::Vec3 velocity_after_update = client_physics_character->GetPosition();
-        // std::ostringstream pos_stream;
-        // pos_stream << position_after_update;
-        // std::string pos_str = pos_stream.str();
-
-        processed_input_snapshot_history.insert(frozen_input_snapshot);
-        spdlog::info("[]~~ inserting into input snapshot history, it has size {}",
-                     processed_input_snapshot_history.size());
-        // printf("[]~~ inserting into input snapshot history, it has size %zu\n",
-        // processed_input_snapshot_history.size());
-        // input_snapshot_history_container.print_state();
+        // the network keeps the sent inputs for reconciliation, so there's no history to insert into here
+        processed_input_snapshot = frozen_input_snapshot;
     };
 }
 
@@ -148,7 +153,9 @@ void create_logger_system() {
     spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%F] [%l] %v");
 }
 
-void parse_command_line_arguments(int argc, char *argv[], std::string &ip_address, int &port) {
+void parse_command_line_arguments(int argc, char *argv[], std::string &ip_address, int &port, bool &use_linear_setup,
+                                  DeadReckoningSettings &dead_reckoning_settings,
+                                  AllocationTrackingSettings &allocation_tracking_settings) {
     bool ip_specified = false;
 
     // Parsing command line arguments
@@ -159,8 +166,23 @@ void parse_command_line_arguments(int argc, char *argv[], std::string &ip_addres
             ip_specified = true;
         } else if (arg == "-port" && i + 1 < argc) {
             port = std::stoi(argv[++i]);
+        } else if (arg == "-linear") {
+            use_linear_setup = true;
+        } else if (arg == "-max-extrapolation-ms" && i + 1 < argc) {
+            // 0 turns extrapolation off, late characters then stand still until their update arrives
+            dead_reckoning_settings.max_extrapolation_seconds = std::stof(argv[++i]) / 1000.0f;
+        } else if (arg == "-count-allocations") {
+            allocation_tracking_settings.count = true;
+        } else if (arg == "-check-allocations" && i + 1 < argc) {
+            allocation_tracking_settings.check = true;
+            allocation_tracking_settings.check_ticks = std::stoull(argv[++i]);
+        } else if (arg == "-allocation-warm-up" && i + 1 < argc) {
+            allocation_tracking_settings.warm_up_ticks = std::stoull(argv[++i]);
         } else {
-            std::cerr << "Usage: " << argv[0] << " -ip <IP address> [-port <port>]" << std::endl;
+            std::cerr << "Usage: " << argv[0]
+                      << " -ip <IP address> [-port <port>] [-linear] [-max-extrapolation-ms <ms>]"
+                      << " [-count-allocations] [-check-allocations <ticks>] [-allocation-warm-up <ticks>]"
+                      << std::endl;
             exit(1);
         }
     }
@@ -168,12 +190,187 @@ void parse_command_line_arguments(int argc, char *argv[], std::string &ip_addres
     // Check if IP address was specified
     if (!ip_specified) {
         std::cerr << "Error: IP address is required." << std::endl;
-        std::cerr << "Usage: " << argv[0] << " -ip <IP address> [-port <port>]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " -ip <IP address> [-port <port>] [-linear] [-max-extrapolation-ms <ms>]"
+                  << std::endl;
         exit(1);
     }
 }
 
-void start_linear_order_setup(int argc, char *argv[]) {
+/**
+ * \brief copies what the render thread needs out of the simulation at the end of a tick
+ */
+void capture_simulated_frame(SimulatedFrame &frame, uint64_t tick,
+                             std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
+                             ClientNetwork &client_network) {
+    frame.tick = tick;
+    frame.simulated_at = std::chrono::steady_clock::now();
+    frame.own_client_id = client_network.id;
+
+    frame.characters.clear();
+    for (const auto &[client_id, character_data] : client_id_to_character_data) {
+        auto received_at = client_network.client_id_to_update_received_at.find(client_id);
+        frame.characters.push_back(
+            {client_id,
+             glm::vec3(character_data.character_x_position, character_data.character_y_position,
+                       character_data.character_z_position),
+             character_data.camera_yaw_angle, character_data.camera_pitch_angle,
+             glm::vec3(character_data.character_x_velocity, character_data.character_y_velocity,
+                       character_data.character_z_velocity),
+             received_at != client_network.client_id_to_update_received_at.end() ? received_at->second : 0});
+    }
+    std::sort(frame.characters.begin(), frame.characters.end(),
+              [](const CharacterRenderState &a, const CharacterRenderState &b) { return a.client_id < b.client_id; });
+
+    frame.acknowledgement_times.clear();
+    client_network.take_unrendered_acknowledgement_times(frame.acknowledgement_times);
+}
+
+/**
+ * \brief every stage of a frame one after the other on the main thread, with a variable delta. kept around to compare
+ * against the threaded setup.
+ */
+void run_linear_loop(const std::function<void(double)> &simulate_tick,
+                     const std::function<void(const std::vector<CharacterRenderState> &, uint64_t)> &render,
+                     const std::function<int()> &termination, const std::function<void()> &sample_input,
+                     std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
+                     ClientNetwork &client_network, DeadReckoning &dead_reckoning,
+                     TickAllocationMonitor &allocation_monitor) {
+    allocation_tracker::set_thread_name("main");
+    SimulatedFrame frame;
+    uint64_t tick = 0;
+
+    const uint32_t target_frame_duration_ms = 1000 / 60; // Target frame duration in milliseconds (16.67 ms)
+    auto previous_frame_time = std::chrono::high_resolution_clock::now();
+    while (!termination()) {
+
+        auto current_frame_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> delta_time = current_frame_time - previous_frame_time;
+        double delta_time_seconds = delta_time.count(); // Delta time in seconds
+        previous_frame_time = current_frame_time;
+
+        glfwPollEvents();
+        sample_input();
+
+        simulate_tick(delta_time_seconds);
+        capture_simulated_frame(frame, tick++, client_id_to_character_data, client_network);
+
+        spdlog::info("starting render");
+        dead_reckoning.apply(frame.characters, frame.own_client_id,
+                             std::chrono::steady_clock::now().time_since_epoch().count());
+        render(frame.characters, frame.own_client_id);
+        client_network.record_acknowledgements_rendered(frame.acknowledgement_times);
+        spdlog::info("render complete");
+
+        // Calculate elapsed time after physics and rendering
+        auto after_update_and_render_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> elapsed_update_and_render_time =
+            after_update_and_render_time - current_frame_time;
+
+        spdlog::info("update and render took {} milliseconds", elapsed_update_and_render_time.count());
+
+        // Calculate sleep time to maintain 60 Hz frequency
+        auto sleep_duration = std::chrono::milliseconds(target_frame_duration_ms) - elapsed_update_and_render_time;
+        if (sleep_duration > std::chrono::milliseconds(0)) {
+            std::this_thread::sleep_for(sleep_duration);
+        }
+
+        if (!allocation_monitor.end_tick(tick)) {
+            break;
+        }
+    }
+}
+
+/**
+ * \brief the simulation runs on its own thread at a fixed rate with a fixed delta, and the render thread draws what it
+ * simulated, blending the last two ticks by how far into the next tick it is. a slow frame then only delays the
+ * frame, not input sampling, prediction or the network. the main thread only polls events since glfw wants that.
+ */
+void run_threaded_loops(const std::function<void(double)> &simulate_tick,
+                        const std::function<void(const std::vector<CharacterRenderState> &, uint64_t)> &render,
+                        const std::function<int()> &termination, const std::function<void()> &sample_input,
+                        std::unordered_map<uint64_t, NetworkedCharacterData> &client_id_to_character_data,
+                        ClientNetwork &client_network, DeadReckoning &dead_reckoning, GLFWwindow *window,
+                        int update_rate_hz, int render_max_rate_hz, TickAllocationMonitor &allocation_monitor) {
+    SimulatedFrameExchange simulated_frame_exchange;
+    std::atomic<bool> running = true;
+
+    std::thread simulation_thread([&]() {
+        allocation_tracker::set_thread_name("simulation");
+        FramePacer simulation_pacer(update_rate_hz);
+        const double fixed_delta_time_seconds = 1.0 / update_rate_hz;
+        uint64_t tick = 0;
+        while (running) {
+            simulate_tick(fixed_delta_time_seconds);
+            capture_simulated_frame(simulated_frame_exchange.get_back_frame(), tick++, client_id_to_character_data,
+                                    client_network);
+            simulated_frame_exchange.publish();
+            // ticking along with the server lets every input reach it just before the tick that takes it
+            std::chrono::nanoseconds server_tick_period, phase_correction;
+            if (client_network.take_tick_alignment(server_tick_period, phase_correction)) {
+                simulation_pacer.set_period(server_tick_period);
+                simulation_pacer.shift(phase_correction);
+            }
+            simulation_pacer.wait_for_next_frame();
+
+            // the render thread's frames count toward whichever tick they're drawn in
+            if (!allocation_monitor.end_tick(tick)) {
+                glfwSetWindowShouldClose(window, GLFW_TRUE); // the main thread closes the window and stops us
+            }
+        }
+        spdlog::info("simulation thread stopped, {} ticks were skipped", simulation_pacer.get_skipped_frames());
+    });
+
+    // the context can only be current on one thread at a time
+    glfwMakeContextCurrent(nullptr);
+    std::thread render_thread([&]() {
+        allocation_tracker::set_thread_name("render");
+        glfwMakeContextCurrent(window);
+        FramePacer render_pacer(render_max_rate_hz);
+        SimulatedFrame previous_frame, current_frame;
+        std::vector<CharacterRenderState> interpolated_characters;
+        while (running) {
+            bool took_new_frame = simulated_frame_exchange.take_latest(previous_frame);
+            if (took_new_frame) {
+                std::swap(previous_frame, current_frame);
+            }
+
+            if (current_frame.own_client_id != -1) {
+                std::chrono::duration<float> tick_duration = current_frame.simulated_at - previous_frame.simulated_at;
+                std::chrono::duration<float> since_current_tick =
+                    std::chrono::steady_clock::now() - current_frame.simulated_at;
+                float alpha = tick_duration.count() > 0
+                                  ? std::clamp(since_current_tick.count() / tick_duration.count(), 0.0f, 1.0f)
+                                  : 1.0f;
+                interpolate_frames(previous_frame, current_frame, alpha, interpolated_characters);
+                dead_reckoning.apply(interpolated_characters, current_frame.own_client_id,
+                                     std::chrono::steady_clock::now().time_since_epoch().count());
+                render(interpolated_characters, current_frame.own_client_id);
+                if (took_new_frame) {
+                    client_network.record_acknowledgements_rendered(current_frame.acknowledgement_times);
+                }
+            }
+            render_pacer.wait_for_next_frame();
+        }
+        glfwMakeContextCurrent(nullptr);
+    });
+
+    // events keep being handled while a frame is slow, the simulation gets input sampled at least every millisecond
+    allocation_tracker::set_thread_name("main");
+    while (!termination()) {
+        glfwWaitEventsTimeout(0.001);
+        sample_input();
+    }
+
+    running = false;
+    simulation_thread.join();
+    render_thread.join();
+    glfwMakeContextCurrent(window); // so the gpu resources can be cleaned up
+}
+
+/**
+ * \return non-zero if the allocation check failed
+ */
+int start_client(int argc, char *argv[]) {
 
     // Default port value
     int port = 7777; // Default port
@@ -181,10 +378,20 @@ void start_linear_order_setup(int argc, char *argv[]) {
     // Variable to store the IP address
     std::string ip_address;
 
+    bool use_linear_setup = false;
+    DeadReckoningSettings dead_reckoning_settings;
+    // counts what every tick allocates and where, or fails once a tick after the warm up allocates at all
+    AllocationTrackingSettings allocation_tracking_settings;
+
     // Parse command line arguments
-    parse_command_line_arguments(argc, argv, ip_address, port);
+    parse_command_line_arguments(argc, argv, ip_address, port, use_linear_setup, dead_reckoning_settings,
+                                 allocation_tracking_settings);
 
     create_logger_system();
+    if (allocation_tracking_settings.check) {
+        // every log line allocates, the check is about what the ticks do otherwise
+        spdlog::set_level(spdlog::level::warn);
+    }
 
     Mouse mouse;
     unsigned int window_width_px = 600, window_height_px = 600;
@@ -195,14 +402,13 @@ void start_linear_order_setup(int argc, char *argv[]) {
     const int network_send_rate_hz = 60;
 
     // "live" means that on mouse and keyboard callbacks it is disjointly written to
-    // immediately
+    // immediately, only the main thread touches it, the simulation reads the sampled copy
     NetworkedInputSnapshot live_input_snapshot;
+    NetworkedInputSnapshot sampled_input_snapshot;
+    std::mutex sampled_input_mutex;
     Camera camera;
-    glm::vec3 character_position(0, 0, 0);
 
-    ExpiringDataContainer<NetworkedInputSnapshot> processed_input_snapshot_history(std::chrono::milliseconds(2000));
-
-    GameLoop game_loop;
+    NetworkedInputSnapshot processed_input_snapshot;
 
     std::unordered_map<uint64_t, NetworkedCharacterData> client_id_to_character_data;
 
@@ -221,81 +427,75 @@ void start_linear_order_setup(int argc, char *argv[]) {
 
     Physics physics;
     physics.load_model_into_physics_world(&map);
+    // jolt's allocator is only registered by the physics
+    TickAllocationMonitor allocation_monitor(allocation_tracking_settings);
+    if (allocation_tracker::is_enabled()) {
+        allocation_tracker::install_jolt_hooks();
+    }
+
+    // at 60Hz that's over 2.5 seconds of inputs to roll back through, when more are replayed than this holds only the
+    // local character is rewound
+    WorldStateRecorder world_state_recorder(160, physics.physics_system.GetMaxBodies());
 
     ClientNetwork client_network(&live_input_snapshot, ip_address, port);
     client_network.attempt_to_connect_to_server();
+    // from here on the network thread owns the connection, the simulation only talks to it through queues
+    client_network.start_network_thread();
 
     std::function<void(double)> process_received_game_states_received_since_end_of_last_tick_and_reconcile =
         client_network.network_step_closure(network_send_rate_hz, physics, camera, mouse, client_id_to_character_data,
-                                            processed_input_snapshot_history);
+                                            world_state_recorder);
 
-    std::function<void(double)> update =
-        update_closure(client_network.reconcile_mutex, processed_input_snapshot_history, client_id_to_character_data,
-                       live_input_snapshot, physics, mouse, camera, &client_network.id);
+    std::function<void(double)> update = update_closure(
+        client_network.reconcile_mutex, processed_input_snapshot, client_id_to_character_data,
+        sampled_input_snapshot, sampled_input_mutex, physics, world_state_recorder, mouse, camera, &client_network.id);
 
-    std::function<void(double)> render =
-        render_closure(player_pov_shader_pipeline.shader_program_id, &map, character_model, client_id_to_character_data,
-                       &camera, window, window_width_px, window_height_px, &client_network.id);
+    CharacterInstanceRenderer character_instance_renderer(character_model);
+    CharacterInstances character_instances;
+    std::function<void(const std::vector<CharacterRenderState> &, uint64_t)> render =
+        render_closure(player_pov_shader_pipeline.shader_program_id, &map, character_instance_renderer,
+                       character_instances, window, window_width_px, window_height_px);
 
     std::function<int()> termination = termination_closure(window);
 
-    // RateLimitedLoop render_loop;
-    // std::function start_render_loop = [&]() { render_loop.start(render_max_rate_hz, render, termination); };
-    // std::thread render_thread(start_render_loop);
-    // render_thread.detach();
-
-    const uint32_t target_frame_duration_ms = 1000 / 60; // Target frame duration in milliseconds (16.67 ms)
-    auto previous_frame_time = std::chrono::high_resolution_clock::now();
-    while (!termination()) {
-
-        auto current_frame_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> delta_time = current_frame_time - previous_frame_time;
-        double delta_time_seconds = delta_time.count(); // Delta time in seconds
-        previous_frame_time = current_frame_time;
+    std::function<void()> sample_input = [&]() {
+        std::lock_guard<std::mutex> lock(sampled_input_mutex);
+        sampled_input_snapshot = live_input_snapshot;
+    };
 
-        // Update physics with delta time in seconds
-        //
-        spdlog::info("starting update");
+    std::function<void(double)> simulate_tick = [&](double delta_time_seconds) {
         update(delta_time_seconds);
-        spdlog::info("update complete");
 
-        // by sending first, we guarentee a common frequency of sending and it won't the frequency will not
-        // pick up random time variance by sending after render.
+        // by sending right after the update, we guarentee a common frequency of sending and the frequency will not
+        // pick up random time variance from the rest of the tick. this only queues it, the network thread sends it.
         bool established_connection = client_network.id != -1;
         if (established_connection) {
-            client_network.send_input_snapshot(processed_input_snapshot_history);
+            client_network.send_input_snapshot(processed_input_snapshot);
         }
 
-        // this can't be in the established connection block for some reason, look into that if you ever need
-        // to put it in the block
+        // this can't be in the established connection block, the client id itself arrives through it
         process_received_game_states_received_since_end_of_last_tick_and_reconcile(0);
 
-        // Render with delta time in seconds, always render after, because it it was done first it
-        // would add random offsets to the send time.
-
         set_character_render_state(client_id_to_character_data, physics, camera, &client_network.id);
+    };
 
-        spdlog::info("starting render");
-        render(delta_time_seconds);
-        spdlog::info("render complete");
-
-        // Calculate elapsed time after physics and rendering
-        auto after_update_and_render_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> elapsed_update_and_render_time =
-            after_update_and_render_time - current_frame_time;
-
-        spdlog::info("update and render took {} milliseconds", elapsed_update_and_render_time.count());
+    // remote characters are drawn moving along when their updates are late rather than frozen
+    DeadReckoning dead_reckoning(dead_reckoning_settings);
 
-        // Calculate total elapsed time for the frame
-        auto frame_end_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> elapsed_frame_time = frame_end_time - current_frame_time;
+    if (use_linear_setup) {
+        run_linear_loop(simulate_tick, render, termination, sample_input, client_id_to_character_data,
+                        client_network, dead_reckoning, allocation_monitor);
+    } else {
+        run_threaded_loops(simulate_tick, render, termination, sample_input, client_id_to_character_data,
+                           client_network, dead_reckoning, window, update_rate_hz, render_max_rate_hz,
+                           allocation_monitor);
+    }
 
-        // Calculate sleep time to maintain 60 Hz frequency
-        auto sleep_duration = std::chrono::milliseconds(target_frame_duration_ms) - elapsed_frame_time;
-        if (sleep_duration > std::chrono::milliseconds(0)) {
-            std::this_thread::sleep_for(sleep_duration);
-        }
+    if (allocation_tracking_settings.check) {
+        std::cerr << "allocation check " << (allocation_monitor.exit_code() == 0 ? "passed" : "failed")
+                  << ", see logs.txt" << std::endl;
     }
+    return allocation_monitor.exit_code();
 }
 
-int main(int argc, char *argv[]) { start_linear_order_setup(argc, argv); }
+int main(int argc, char *argv[]) { return start_client(argc, argv); }
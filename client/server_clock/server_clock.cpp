@@ -0,0 +1,45 @@
+#include "server_clock.hpp"
+
+void ServerClock::add_sample(const TimeSyncResponse &response, uint64_t received_at) {
+    // the differences are taken between times of the same clock first, so they're small and can be signed
+    int64_t request_time_ns = static_cast<int64_t>(response.server_received_at - response.client_sent_at);
+    int64_t response_time_ns = static_cast<int64_t>(response.server_sent_at - received_at);
+    int64_t round_trip_time_ns = static_cast<int64_t>(received_at - response.client_sent_at) -
+                                 static_cast<int64_t>(response.server_sent_at - response.server_received_at);
+
+    Sample &sample = samples[next_sample];
+    sample.offset_ns = (request_time_ns + response_time_ns) / 2;
+    sample.round_trip_time_ns = round_trip_time_ns > 0 ? static_cast<uint64_t>(round_trip_time_ns) : 0;
+    next_sample = (next_sample + 1) % num_kept_samples;
+    if (num_samples < num_kept_samples) {
+        num_samples++;
+    }
+
+    best_sample = 0;
+    for (size_t i = 1; i < num_samples; i++) {
+        if (samples[i].round_trip_time_ns < samples[best_sample].round_trip_time_ns) {
+            best_sample = i;
+        }
+    }
+
+    if (response.tick_period_ns > 0) {
+        tick_started_at = response.tick_started_at;
+        tick_period_ns = response.tick_period_ns;
+    }
+}
+
+int64_t ServerClock::tick_phase_error_ns(uint64_t client_sent_at, int64_t lead_ns) const {
+    uint64_t arrives_at = to_server_time(client_sent_at) + get_round_trip_time_ns() / 2;
+    int64_t period = tick_period_ns;
+    int64_t into_tick = static_cast<int64_t>(arrives_at - tick_started_at) % period;
+    if (into_tick < 0) {
+        into_tick += period;
+    }
+    int64_t error = into_tick - (period - lead_ns);
+    if (error > period / 2) {
+        error -= period;
+    } else if (error <= -period / 2) {
+        error += period;
+    }
+    return error;
+}
@@ -0,0 +1,58 @@
+#ifndef SERVER_CLOCK_HPP
+#define SERVER_CLOCK_HPP
+
+#include "time_sync/time_sync.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \brief our estimate of the server's steady clock and of when its ticks start, from the time sync answers.
+ *
+ * every answer gives a round trip and an offset between the clocks. the offset is only exact if the request and the
+ * answer took equally long, and a sample that was held up somewhere is lopsided, so the offset of the sample with the
+ * shortest round trip of the last few is the one that's used, like ntp does.
+ *
+ * simulation thread only.
+ */
+class ServerClock {
+  public:
+    /**
+     * \param received_at steady clock nanoseconds when the answer came out of enet
+     */
+    void add_sample(const TimeSyncResponse &response, uint64_t received_at);
+
+    /**
+     * \brief true once there's an offset and the server has said how long its ticks are
+     */
+    bool is_synchronized() const { return num_samples > 0 && tick_period_ns > 0; }
+    int64_t get_offset_ns() const { return samples[best_sample].offset_ns; } // the server's clock minus ours
+    uint64_t get_round_trip_time_ns() const { return samples[best_sample].round_trip_time_ns; }
+    uint32_t get_tick_period_ns() const { return tick_period_ns; }
+
+    uint64_t to_server_time(uint64_t client_time) const { return client_time + get_offset_ns(); }
+    /**
+     * \brief where a packet sent at client_sent_at arrives in the server's tick, compared to arriving lead_ns before
+     * the next tick starts. it's within half a tick either way, positive means it arrives later than that
+     */
+    int64_t tick_phase_error_ns(uint64_t client_sent_at, int64_t lead_ns) const;
+
+    static constexpr size_t num_kept_samples = 8;
+
+  private:
+    struct Sample {
+        int64_t offset_ns = 0;
+        uint64_t round_trip_time_ns = 0;
+    };
+
+    std::array<Sample, num_kept_samples> samples;
+    size_t num_samples = 0;
+    size_t next_sample = 0;
+    size_t best_sample = 0;
+
+    // from the newest answer, older ones would have to be extrapolated further
+    uint64_t tick_started_at = 0; // on the server's clock
+    uint32_t tick_period_ns = 0;
+};
+
+#endif // SERVER_CLOCK_HPP
@@ -0,0 +1,59 @@
+#include "simulated_frame.hpp"
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+#include <utility>
+
+void SimulatedFrameExchange::publish() {
+    std::lock_guard<std::mutex> lock(ready_mutex);
+    if (ready_frame_is_new) {
+        // the frame being overwritten never got rendered, its acknowledgements will be rendered with this one
+        back_frame.acknowledgement_times.insert(back_frame.acknowledgement_times.begin(),
+                                                ready_frame.acknowledgement_times.begin(),
+                                                ready_frame.acknowledgement_times.end());
+    }
+    std::swap(back_frame, ready_frame);
+    ready_frame_is_new = true;
+}
+
+bool SimulatedFrameExchange::take_latest(SimulatedFrame &frame) {
+    std::lock_guard<std::mutex> lock(ready_mutex);
+    if (!ready_frame_is_new) {
+        return false;
+    }
+    std::swap(ready_frame, frame);
+    ready_frame_is_new = false;
+    return true;
+}
+
+// going the short way around, so turning past the point where the angle wraps doesn't spin the camera
+static float interpolate_angle(float previous, float current, float alpha) {
+    float difference = std::remainder(current - previous, glm::two_pi<float>());
+    return previous + difference * alpha;
+}
+
+void interpolate_frames(const SimulatedFrame &previous, const SimulatedFrame &current, float alpha,
+                        std::vector<CharacterRenderState> &interpolated_characters) {
+    interpolated_characters.clear();
+
+    // both are sorted by client id, so matching characters up is a merge
+    size_t previous_index = 0;
+    for (const CharacterRenderState &current_character : current.characters) {
+        while (previous_index < previous.characters.size() &&
+               previous.characters[previous_index].client_id < current_character.client_id) {
+            previous_index++;
+        }
+        bool was_in_previous = previous_index < previous.characters.size() &&
+                               previous.characters[previous_index].client_id == current_character.client_id;
+        if (!was_in_previous) {
+            interpolated_characters.push_back(current_character);
+            continue;
+        }
+
+        const CharacterRenderState &previous_character = previous.characters[previous_index];
+        interpolated_characters.push_back(
+            {current_character.client_id, glm::mix(previous_character.position, current_character.position, alpha),
+             interpolate_angle(previous_character.camera_yaw_angle, current_character.camera_yaw_angle, alpha),
+             interpolate_angle(previous_character.camera_pitch_angle, current_character.camera_pitch_angle, alpha),
+             current_character.velocity, current_character.received_at});
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SIMULATED_FRAME_HPP
+#define SIMULATED_FRAME_HPP
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * \brief everything about a character the render thread needs to draw it
+ */
+struct CharacterRenderState {
+    uint64_t client_id;
+    glm::vec3 position;
+    float camera_yaw_angle;
+    float camera_pitch_angle;
+    glm::vec3 velocity = glm::vec3(0.0f);
+    uint64_t received_at = 0; // steady clock time the newest update for it arrived, 0 for our own character
+};
+
+/**
+ * \brief what the world looked like at the end of one simulation tick, the render thread only ever sees these and
+ * never the simulation itself
+ */
+struct SimulatedFrame {
+    uint64_t tick = 0;
+    std::chrono::steady_clock::time_point simulated_at;
+    uint64_t own_client_id = -1;
+    std::vector<CharacterRenderState> characters; // sorted by client id
+    // steady clock times at which acknowledgements arrived during this tick, to measure when they get rendered
+    std::vector<uint64_t> acknowledgement_times;
+};
+
+/**
+ * \brief hands frames from the simulation thread to the render thread through three buffers: the one the simulation
+ * fills, the one waiting to be taken and the one being rendered. handing over only swaps two frames, which moves no
+ * characters around, so neither thread waits on the other and the buffers' memory gets reused.
+ *
+ * frames the render thread was too slow to take are overwritten by newer ones.
+ */
+class SimulatedFrameExchange {
+  public:
+    SimulatedFrame &get_back_frame() { return back_frame; }
+    void publish();
+
+    /**
+     * \brief swaps the newest published frame into the caller's frame, the caller's old frame is reused as a buffer
+     * \return false if nothing new was published since the last take, frame is left as it was
+     */
+    bool take_latest(SimulatedFrame &frame);
+
+  private:
+    SimulatedFrame back_frame; // only touched by the simulation thread
+
+    std::mutex ready_mutex;
+    SimulatedFrame ready_frame;
+    bool ready_frame_is_new = false;
+};
+
+/**
+ * \brief blends two consecutive frames, alpha 0 is previous and 1 is current. characters only in the current frame
+ * are drawn where they are, characters only in the previous one are gone.
+ */
+void interpolate_frames(const SimulatedFrame &previous, const SimulatedFrame &current, float alpha,
+                        std::vector<CharacterRenderState> &interpolated_characters);
+
+#endif // SIMULATED_FRAME_HPP
@@ -0,0 +1,229 @@
+#include "world_state_recorder.hpp"
+#include "Jolt/Physics/Body/BodyLock.h"
+#include <algorithm>
+#include <cstring>
+
+void PooledStateRecorder::reserve(size_t capacity_bytes) {
+    if (capacity_bytes > buffer.size()) {
+        buffer.resize(capacity_bytes);
+    }
+}
+
+void PooledStateRecorder::WriteBytes(const void *inData, size_t inNumBytes) {
+    size_t required_size = write_position + inNumBytes;
+    if (required_size > buffer.size()) {
+        // only happens while the recorder is warming up or the world got bigger, doubling keeps this rare
+        buffer.resize(std::max(required_size, buffer.size() * 2));
+        growth_count++;
+    }
+    std::memcpy(buffer.data() + write_position, inData, inNumBytes);
+    write_position = required_size;
+}
+
+void PooledStateRecorder::ReadBytes(void *outData, size_t inNumBytes) {
+    if (read_position + inNumBytes > write_position) {
+        failed = true;
+        std::memset(outData, 0, inNumBytes);
+        return;
+    }
+    std::memcpy(outData, buffer.data() + read_position, inNumBytes);
+    read_position += inNumBytes;
+}
+
+bool PooledStateRecorder::IsEOF() const { return read_position >= write_position; }
+
+bool PooledStateRecorder::IsFailed() const { return failed; }
+
+void PooledStateRecorder::clear() {
+    write_position = 0;
+    read_position = 0;
+    failed = false;
+}
+
+void PooledStateRecorder::rewind() {
+    read_position = 0;
+    failed = false;
+}
+
+WorldStateRecorder::WorldStateRecorder(size_t capacity_in_ticks, size_t max_bodies, size_t initial_bytes_per_tick)
+    : slots(capacity_in_ticks), body_to_resting_states(max_bodies),
+      resting_states(max_bodies * resting_states_per_body) {
+    for (Slot &slot : slots) {
+        slot.recorder.reserve(initial_bytes_per_tick);
+        slot.active_bodies.reserve(max_bodies);
+    }
+    for (RestingState &resting_state : resting_states) {
+        resting_state.recorder.reserve(resting_state_bytes);
+    }
+    body_ids.reserve(max_bodies);
+}
+
+uint64_t WorldStateRecorder::record_next(Physics &physics) {
+    uint64_t tick = any_recorded ? latest_tick + 1 : 0;
+    record(tick, physics);
+    return tick;
+}
+
+void WorldStateRecorder::record(uint64_t tick, Physics &physics) {
+    Slot &slot = slot_for_tick(tick);
+    slot.recorder.clear();
+
+    physics.physics_system.SaveState(slot.recorder, JPH::EStateRecorderState::All, &active_body_filter);
+
+    uint64_t number_of_characters = physics.client_id_to_physics_character.size();
+    slot.recorder.Write(number_of_characters);
+    for (const auto &pair : physics.client_id_to_physics_character) {
+        slot.recorder.Write(pair.first);
+        pair.second->SaveState(slot.recorder);
+    }
+    record_resting_states(tick, physics, slot);
+
+    slot.tick = tick;
+    slot.valid = true;
+
+    if (!any_recorded || tick > latest_tick) {
+        latest_tick = tick;
+    }
+    any_recorded = true;
+}
+
+bool WorldStateRecorder::has_tick(uint64_t tick) const {
+    const Slot &slot = slot_for_tick(tick);
+    return slot.valid && slot.tick == tick;
+}
+
+bool WorldStateRecorder::restore(uint64_t tick, Physics &physics) {
+    if (!has_tick(tick)) {
+        return false; // either never recorded or already overwritten by a newer tick
+    }
+
+    Slot &slot = slot_for_tick(tick);
+    slot.recorder.rewind();
+
+    if (!physics.physics_system.RestoreState(slot.recorder, &active_body_filter)) {
+        return false;
+    }
+    // a body that was awake then may have fallen asleep since, it has to keep moving from where it's put back
+    if (!slot.active_bodies.empty()) {
+        physics.physics_system.GetBodyInterface().ActivateBodies(slot.active_bodies.data(),
+                                                                 static_cast<int>(slot.active_bodies.size()));
+    }
+    restore_resting_states(tick, physics);
+
+    uint64_t number_of_characters = 0;
+    slot.recorder.Read(number_of_characters);
+    for (uint64_t i = 0; i < number_of_characters; i++) {
+        uint64_t client_id = 0;
+        slot.recorder.Read(client_id);
+        auto character_it = physics.client_id_to_physics_character.find(client_id);
+        if (character_it == physics.client_id_to_physics_character.end()) {
+            // the character state has no size prefix, so we can't skip past it, the characters we've already
+            // restored are still correct.
+            break;
+        }
+        character_it->second->RestoreState(slot.recorder);
+    }
+
+    return !slot.recorder.IsFailed();
+}
+
+WorldStateRecorder::RestingState &WorldStateRecorder::push_resting_state(size_t body_index) {
+    RestingStateRing &ring = body_to_resting_states[body_index];
+    if (ring.count == resting_states_per_body) {
+        ring.oldest = (ring.oldest + 1) % resting_states_per_body;
+    } else {
+        ring.count++;
+    }
+    RestingState &resting_state = newest_resting_state(body_index);
+    resting_state.recorder.clear();
+    return resting_state;
+}
+
+/**
+ * \brief notes which bodies the slot holds, saves the state of every body that fell asleep since the last record and
+ * marks the ones that woke up. a body that was already asleep when recording started is saved the first time it's seen.
+ */
+void WorldStateRecorder::record_resting_states(uint64_t tick, Physics &physics, Slot &slot) {
+    // a resting state that ended before the oldest tick in the ring can't be restored anymore
+    uint64_t newest_tick = any_recorded ? std::max(tick, latest_tick) : tick;
+    uint64_t oldest_tick_in_ring = newest_tick >= slots.size() ? newest_tick - slots.size() + 1 : 0;
+
+    slot.active_bodies.clear();
+    physics.physics_system.GetBodies(body_ids);
+    const JPH::BodyLockInterface &lock_interface = physics.physics_system.GetBodyLockInterface();
+    for (const JPH::BodyID &body_id : body_ids) {
+        JPH::BodyLockRead lock(lock_interface, body_id);
+        if (!lock.Succeeded() || lock.GetBody().IsStatic()) {
+            continue;
+        }
+        const JPH::Body &body = lock.GetBody();
+        size_t body_index = body_id.GetIndex();
+        RestingStateRing &ring = body_to_resting_states[body_index];
+        if (ring.body_key != body_id.GetIndexAndSequenceNumber()) {
+            // the index was handed to a new body, the old one's resting states aren't this one's
+            ring = RestingStateRing();
+            ring.body_key = body_id.GetIndexAndSequenceNumber();
+        }
+        bool was_asleep = ring.count > 0 && newest_resting_state(body_index).awake_from == still_asleep;
+
+        if (body.IsActive()) {
+            slot.active_bodies.push_back(body_id);
+            if (was_asleep) {
+                newest_resting_state(body_index).awake_from = tick;
+            }
+        } else if (!was_asleep) {
+            RestingState &resting_state = push_resting_state(body_index);
+            resting_state.asleep_since = tick;
+            resting_state.awake_from = still_asleep;
+            physics.physics_system.SaveBodyState(body, resting_state.recorder);
+        }
+
+        while (ring.count > 0 && resting_state_at(body_index, 0).awake_from <= oldest_tick_in_ring) {
+            ring.oldest = (ring.oldest + 1) % resting_states_per_body;
+            ring.count--;
+        }
+    }
+}
+
+/**
+ * \brief puts every body that was asleep at tick and has woken up since back into the state it slept in, and forgets
+ * the resting states from after tick, those are about to be recorded again
+ */
+void WorldStateRecorder::restore_resting_states(uint64_t tick, Physics &physics) {
+    const JPH::BodyLockInterface &lock_interface = physics.physics_system.GetBodyLockInterface();
+    body_ids.clear(); // the ones to put back to sleep
+    for (size_t body_index = 0; body_index < body_to_resting_states.size(); body_index++) {
+        RestingStateRing &ring = body_to_resting_states[body_index];
+        while (ring.count > 0 && newest_resting_state(body_index).asleep_since > tick) {
+            ring.count--;
+        }
+        // still asleep means it hasn't changed, awake by tick means it's in the slot
+        if (ring.count == 0 || newest_resting_state(body_index).awake_from == still_asleep ||
+            newest_resting_state(body_index).awake_from <= tick) {
+            continue;
+        }
+
+        RestingState &resting_state = newest_resting_state(body_index);
+        JPH::BodyID body_id(ring.body_key);
+        JPH::BodyLockWrite lock(lock_interface, body_id);
+        if (!lock.Succeeded()) {
+            continue; // the body is gone
+        }
+        resting_state.recorder.rewind();
+        physics.physics_system.RestoreBodyState(lock.GetBody(), resting_state.recorder);
+        resting_state.awake_from = still_asleep;
+        body_ids.push_back(body_id);
+    }
+
+    if (!body_ids.empty()) {
+        physics.physics_system.GetBodyInterface().DeactivateBodies(body_ids.data(), static_cast<int>(body_ids.size()));
+    }
+}
+
+uint64_t WorldStateRecorder::total_buffer_growths() const {
+    uint64_t total = 0;
+    for (const Slot &slot : slots) {
+        total += slot.recorder.number_of_growths();
+    }
+    return total;
+}
@@ -0,0 +1,158 @@
+#ifndef WORLD_STATE_RECORDER_HPP
+#define WORLD_STATE_RECORDER_HPP
+
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "Jolt/Physics/Body/BodyID.h"
+#include "Jolt/Physics/StateRecorder.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief a jolt state recorder backed by a byte buffer which is never shrunk, once it has grown to the size of a
+ * typical world state, saving and restoring no longer allocates.
+ */
+class PooledStateRecorder final : public JPH::StateRecorder {
+  public:
+    PooledStateRecorder() = default;
+
+    void WriteBytes(const void *inData, size_t inNumBytes) override;
+    void ReadBytes(void *outData, size_t inNumBytes) override;
+    bool IsEOF() const override;
+    bool IsFailed() const override;
+
+    /**
+     * \brief grow the buffer up front so the first ticks don't have to
+     */
+    void reserve(size_t capacity_bytes);
+    /**
+     * \brief forget the previous contents but keep the memory around for the next write
+     */
+    void clear();
+    /**
+     * \brief move the read cursor back to the start so the contents can be restored again
+     */
+    void rewind();
+    size_t size_bytes() const { return write_position; }
+    size_t capacity_bytes() const { return buffer.size(); }
+    uint64_t number_of_growths() const { return growth_count; }
+
+  private:
+    std::vector<uint8_t> buffer;
+    size_t write_position = 0;
+    size_t read_position = 0;
+    bool failed = false;
+    uint64_t growth_count = 0;
+};
+
+/**
+ * \brief only bodies that are awake change, so only those are saved every tick. static bodies are never awake.
+ */
+class ActiveBodyStateFilter : public JPH::StateRecorderFilter {
+  public:
+    bool ShouldSaveBody(const JPH::Body &inBody) const override { return inBody.IsActive(); }
+};
+
+/**
+ * \brief records the physics world (rigid bodies and characters) once per client tick into a fixed ring of reusable
+ * buffers, the tick number maps directly to a slot so restoring any tick still in the ring is O(1).
+ *
+ * a tick only holds the bodies that were awake. a body that falls asleep has its resting state saved once on the side,
+ * together with the ticks it slept through, so a body that was asleep at the restored tick and has woken up since can
+ * be put back to sleep where it was. those go into a small ring per body index that's allocated up front for every
+ * body the physics system can hold, bodies falling asleep and waking up only ever reuse it.
+ *
+ * \note the characters are not part of the jolt physics system, so they get written after the physics system state,
+ * prefixed by their client id
+ */
+class WorldStateRecorder {
+  public:
+    /**
+     * \param max_bodies the most bodies the physics system holds at once, see JPH::PhysicsSystem::GetMaxBodies
+     */
+    WorldStateRecorder(size_t capacity_in_ticks, size_t max_bodies, size_t initial_bytes_per_tick = 16 * 1024);
+
+    /**
+     * \brief save the current state of the world under the next tick number, and return that tick number
+     */
+    uint64_t record_next(Physics &physics);
+    /**
+     * \brief save the current state of the world under a specific tick, used to overwrite history during
+     * reconciliation
+     */
+    void record(uint64_t tick, Physics &physics);
+    /**
+     * \return true if the world was put back into the state it was in at the given tick
+     */
+    bool restore(uint64_t tick, Physics &physics);
+    bool has_tick(uint64_t tick) const;
+
+    bool empty() const { return !any_recorded; }
+    uint64_t most_recent_tick() const { return latest_tick; }
+    size_t capacity() const { return slots.size(); }
+    uint64_t total_buffer_growths() const;
+
+  private:
+    struct Slot {
+        uint64_t tick = 0;
+        bool valid = false;
+        PooledStateRecorder recorder;
+        std::vector<JPH::BodyID> active_bodies; // the bodies in recorder, woken up again when this tick is restored
+    };
+
+    static constexpr uint64_t still_asleep = UINT64_MAX;
+    /**
+     * \brief the state a body slept in from asleep_since up to, but not including, awake_from
+     */
+    struct RestingState {
+        uint64_t asleep_since = 0;
+        uint64_t awake_from = still_asleep;
+        PooledStateRecorder recorder;
+    };
+
+    /**
+     * \brief jolt keeps a body awake for at least half a second before it can fall asleep again, so at 60Hz the 160
+     * ticks the client keeps see no more than 6 resting states of one body. if there are more the oldest is
+     * overwritten, restoring that far back then leaves that body where it is.
+     */
+    static constexpr size_t resting_states_per_body = 8;
+    static constexpr size_t resting_state_bytes = 256; // a single body's state, so the ring doesn't grow once used
+
+    /**
+     * \brief where a body's resting states are in resting_states, oldest first
+     */
+    struct RestingStateRing {
+        uint32_t body_key = JPH::BodyID::cInvalidBodyID; // the index and sequence number of the body they belong to
+        size_t oldest = 0;
+        size_t count = 0;
+    };
+
+    RestingState &resting_state_at(size_t body_index, size_t i) {
+        const RestingStateRing &ring = body_to_resting_states[body_index];
+        return resting_states[body_index * resting_states_per_body + (ring.oldest + i) % resting_states_per_body];
+    }
+    RestingState &newest_resting_state(size_t body_index) {
+        return resting_state_at(body_index, body_to_resting_states[body_index].count - 1);
+    }
+    /**
+     * \brief takes the slot after the newest one, the oldest one if the ring is full
+     */
+    RestingState &push_resting_state(size_t body_index);
+
+    void record_resting_states(uint64_t tick, Physics &physics, Slot &slot);
+    void restore_resting_states(uint64_t tick, Physics &physics);
+
+    Slot &slot_for_tick(uint64_t tick) { return slots[tick % slots.size()]; }
+    const Slot &slot_for_tick(uint64_t tick) const { return slots[tick % slots.size()]; }
+
+    std::vector<Slot> slots;
+    ActiveBodyStateFilter active_body_filter;
+    // by body index, only the ones covering ticks in the ring are kept
+    std::vector<RestingStateRing> body_to_resting_states;
+    std::vector<RestingState> resting_states; // resting_states_per_body of them for each body index
+    JPH::BodyIDVector body_ids; // scratch
+    uint64_t latest_tick = 0;
+    bool any_recorded = false;
+};
+
+#endif // WORLD_STATE_RECORDER_HPP
@@ -0,0 +1,215 @@
+#include "character_collision.hpp"
+#include "Jolt/Physics/Collision/CollideShape.h"
+#include "Jolt/Physics/Collision/CollisionDispatch.h"
+#include "Jolt/Physics/Collision/ShapeCast.h"
+#include <cmath>
+
+SpatialHashCharacterCollision::Cell SpatialHashCharacterCollision::cell_of(JPH::Vec3Arg position) const {
+    return {static_cast<int32_t>(std::floor(position.GetX() / cell_size)),
+            static_cast<int32_t>(std::floor(position.GetY() / cell_size)),
+            static_cast<int32_t>(std::floor(position.GetZ() / cell_size))};
+}
+
+uint32_t SpatialHashCharacterCollision::bucket_of(const Cell &cell) const {
+    uint32_t hash = static_cast<uint32_t>(cell.x) * 73856093u ^ static_cast<uint32_t>(cell.y) * 19349663u ^
+                    static_cast<uint32_t>(cell.z) * 83492791u;
+    return hash & bucket_mask;
+}
+
+/**
+ * \brief a counting sort of the characters by bucket, the arrays keep their capacity so this doesn't allocate once the
+ * player count has settled
+ */
+void SpatialHashCharacterCollision::rebuild(
+    const std::unordered_map<uint64_t, JPH::Ref<JPH::CharacterVirtual>> &client_id_to_physics_character) {
+    size_t num_characters = client_id_to_physics_character.size();
+
+    // about two buckets per character keeps unrelated cells from sharing a bucket most of the time
+    uint32_t num_buckets = 1;
+    while (num_buckets < 2 * num_characters) {
+        num_buckets <<= 1;
+    }
+    bucket_mask = num_buckets - 1;
+    bucket_starts.assign(num_buckets + 1, 0);
+
+    unsorted_entries.resize(num_characters);
+    entry_buckets.resize(num_characters);
+    max_half_extent = JPH::Vec3::sZero();
+
+    size_t i = 0;
+    for (const auto &[client_id, character] : client_id_to_physics_character) {
+        Entry &entry = unsorted_entries[i];
+        entry.character = character.GetPtr();
+        entry.center_of_mass_transform = character->GetCenterOfMassTransform();
+        entry.bounds = character->GetShape()->GetWorldSpaceBounds(entry.center_of_mass_transform, JPH::Vec3::sOne());
+        entry.bounds.ExpandBy(JPH::Vec3::sReplicate(character->GetCharacterPadding()));
+        entry.cell = cell_of(entry.bounds.GetCenter());
+        max_half_extent = JPH::Vec3::sMax(max_half_extent, entry.bounds.GetExtent());
+
+        entry_buckets[i] = bucket_of(entry.cell);
+        bucket_starts[entry_buckets[i] + 1]++;
+        i++;
+    }
+
+    for (uint32_t bucket = 0; bucket < num_buckets; bucket++) {
+        bucket_starts[bucket + 1] += bucket_starts[bucket];
+    }
+
+    // a character reaches its own half extent, the margin and its movement past its center, the one it touches is at
+    // most another half extent further
+    colour_block_size = 2.0f * max_half_extent.ReduceMax() + query_margin + max_step_displacement;
+
+    entries.resize(num_characters);
+    next_bucket_slots.assign(bucket_starts.begin(), bucket_starts.end() - 1);
+    for (size_t j = 0; j < num_characters; j++) {
+        entries[next_bucket_slots[entry_buckets[j]]++] = unsorted_entries[j];
+    }
+}
+
+void SpatialHashCharacterCollision::forget(const JPH::CharacterVirtual *character) {
+    for (Entry &entry : entries) {
+        if (entry.character == character) {
+            entry.character = nullptr;
+        }
+    }
+}
+
+uint32_t SpatialHashCharacterCollision::colour_of(const JPH::CharacterVirtual &character,
+                                                  float displacement_bound) const {
+    if (displacement_bound > max_step_displacement) {
+        return solo_colour;
+    }
+    JPH::Vec3 center =
+        character.GetShape()->GetWorldSpaceBounds(character.GetCenterOfMassTransform(), JPH::Vec3::sOne()).GetCenter();
+    auto parity = [&](float coordinate) {
+        return static_cast<uint32_t>(static_cast<int32_t>(std::floor(coordinate / colour_block_size)) & 1);
+    };
+    return parity(center.GetX()) | parity(center.GetY()) << 1 | parity(center.GetZ()) << 2;
+}
+
+template <typename Test>
+void SpatialHashCharacterCollision::for_each_nearby(const JPH::CharacterVirtual *querying_character,
+                                                    const JPH::AABox &query_bounds, const Test &test) const {
+    if (entries.empty()) {
+        return;
+    }
+
+    // entries are filed under their center, one whose center is up to max_half_extent outside the query can still
+    // overlap it
+    Cell min_cell = cell_of(query_bounds.mMin - max_half_extent);
+    Cell max_cell = cell_of(query_bounds.mMax + max_half_extent);
+
+    uint64_t tests = 0;
+    auto test_entry = [&](const Entry &entry) {
+        if (entry.character == nullptr || entry.character == querying_character ||
+            !entry.bounds.Overlaps(query_bounds)) {
+            return true;
+        }
+        tests++;
+        return test(entry);
+    };
+
+    // a query that spans more cells than there are characters, like a very long cast, is cheaper to check against
+    // everyone
+    uint64_t num_cells = uint64_t(max_cell.x - min_cell.x + 1) * uint64_t(max_cell.y - min_cell.y + 1) *
+                         uint64_t(max_cell.z - min_cell.z + 1);
+    if (num_cells > entries.size()) {
+        for (const Entry &entry : entries) {
+            if (!test_entry(entry)) {
+                break;
+            }
+        }
+        narrow_phase_tests.fetch_add(tests, std::memory_order_relaxed);
+        return;
+    }
+
+    for (int32_t x = min_cell.x; x <= max_cell.x; x++) {
+        for (int32_t y = min_cell.y; y <= max_cell.y; y++) {
+            for (int32_t z = min_cell.z; z <= max_cell.z; z++) {
+                Cell cell{x, y, z};
+                uint32_t bucket = bucket_of(cell);
+                for (uint32_t i = bucket_starts[bucket]; i < bucket_starts[bucket + 1]; i++) {
+                    const Entry &entry = entries[i];
+                    // a bucket can hold several cells, the ones that aren't this cell are visited with their own cell
+                    if (!(entry.cell == cell)) {
+                        continue;
+                    }
+                    if (!test_entry(entry)) {
+                        narrow_phase_tests.fetch_add(tests, std::memory_order_relaxed);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+    narrow_phase_tests.fetch_add(tests, std::memory_order_relaxed);
+}
+
+/**
+ * \brief the same narrow phase as CharacterVsCharacterCollisionSimple::CollideCharacter, only against nearby characters
+ */
+void SpatialHashCharacterCollision::CollideCharacter(const JPH::CharacterVirtual *inCharacter,
+                                                     JPH::RMat44Arg inCenterOfMassTransform,
+                                                     const JPH::CollideShapeSettings &inCollideShapeSettings,
+                                                     JPH::RVec3Arg inBaseOffset,
+                                                     JPH::CollideShapeCollector &ioCollector) const {
+    const JPH::Shape *shape = inCharacter->GetShape();
+    JPH::Mat44 transform = inCenterOfMassTransform.PostTranslated(-inBaseOffset).ToMat44();
+
+    JPH::AABox query_bounds = shape->GetWorldSpaceBounds(inCenterOfMassTransform, JPH::Vec3::sOne());
+    query_bounds.ExpandBy(JPH::Vec3::sReplicate(inCollideShapeSettings.mMaxSeparationDistance));
+
+    JPH::CollideShapeSettings settings = inCollideShapeSettings;
+    for_each_nearby(inCharacter, query_bounds, [&](const Entry &entry) {
+        if (ioCollector.ShouldEarlyOut()) {
+            return false;
+        }
+        // the collector needs to know which character we're colliding with
+        ioCollector.SetUserData(reinterpret_cast<uint64_t>(entry.character));
+
+        JPH::Mat44 other_transform = entry.center_of_mass_transform.PostTranslated(-inBaseOffset).ToMat44();
+        // the other character's padding is added so its outer shell is found, CharacterVirtual corrects for it later
+        settings.mMaxSeparationDistance =
+            inCollideShapeSettings.mMaxSeparationDistance + entry.character->GetCharacterPadding();
+        JPH::CollisionDispatch::sCollideShapeVsShape(shape, entry.character->GetShape(), JPH::Vec3::sOne(),
+                                                     JPH::Vec3::sOne(), transform, other_transform,
+                                                     JPH::SubShapeIDCreator(), JPH::SubShapeIDCreator(), settings,
+                                                     ioCollector);
+        return true;
+    });
+    ioCollector.SetUserData(0);
+}
+
+/**
+ * \brief the same narrow phase as CharacterVsCharacterCollisionSimple::CastCharacter, only against characters near the
+ * swept shape
+ */
+void SpatialHashCharacterCollision::CastCharacter(const JPH::CharacterVirtual *inCharacter,
+                                                  JPH::RMat44Arg inCenterOfMassTransform, JPH::Vec3Arg inDirection,
+                                                  const JPH::ShapeCastSettings &inShapeCastSettings,
+                                                  JPH::RVec3Arg inBaseOffset,
+                                                  JPH::CastShapeCollector &ioCollector) const {
+    const JPH::Shape *shape = inCharacter->GetShape();
+    JPH::Mat44 transform = inCenterOfMassTransform.PostTranslated(-inBaseOffset).ToMat44();
+    JPH::ShapeCast shape_cast(shape, JPH::Vec3::sOne(), transform, inDirection);
+
+    JPH::AABox query_bounds = shape->GetWorldSpaceBounds(inCenterOfMassTransform, JPH::Vec3::sOne());
+    JPH::AABox end_bounds = query_bounds;
+    end_bounds.Translate(inDirection);
+    query_bounds.Encapsulate(end_bounds);
+
+    for_each_nearby(inCharacter, query_bounds, [&](const Entry &entry) {
+        if (ioCollector.ShouldEarlyOut()) {
+            return false;
+        }
+        ioCollector.SetUserData(reinterpret_cast<uint64_t>(entry.character));
+
+        JPH::Mat44 other_transform = entry.center_of_mass_transform.PostTranslated(-inBaseOffset).ToMat44();
+        JPH::CollisionDispatch::sCastShapeVsShapeWorldSpace(shape_cast, inShapeCastSettings,
+                                                            entry.character->GetShape(), JPH::Vec3::sOne(), {},
+                                                            other_transform, JPH::SubShapeIDCreator(),
+                                                            JPH::SubShapeIDCreator(), ioCollector);
+        return true;
+    });
+    ioCollector.SetUserData(0);
+}
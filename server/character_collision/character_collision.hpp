@@ -0,0 +1,110 @@
+#ifndef CHARACTER_COLLISION_HPP
+#define CHARACTER_COLLISION_HPP
+
+// jolt_implementation.hpp has no include guard, so only the jolt headers themselves are pulled in here
+#include <Jolt/Jolt.h>
+#include "Jolt/Physics/Character/CharacterVirtual.h"
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief lets characters collide with each other, but instead of testing every character against every other one like
+ * jolt's CharacterVsCharacterCollisionSimple does, the characters are put in a spatial hash at the start of the step
+ * and a character only tests the ones in the cells around it, which keeps a step linear in the number of characters
+ * as long as they aren't all standing in the same spot.
+ *
+ * every character is inserted into the one cell its center is in, a query looks in every cell its box touches after
+ * growing the box by the biggest character, so nobody is missed and nobody is found twice.
+ *
+ * the other characters are tested at where they were when the hash was rebuilt, not where they are right now. a
+ * character moving into one that has already moved this step sees it one step behind, which at our speeds is a few
+ * centimeters. jolt still reads the other character's velocity when it resolves a contact, so two characters that can
+ * touch must not be updated at the same time, colour_of tells which ones can be.
+ */
+class SpatialHashCharacterCollision : public JPH::CharacterVsCharacterCollision {
+  public:
+    /**
+     * \brief query_margin is how far past its own bounds a character looks without moving, that's the predictive
+     * contacts plus sticking to the floor. max_step_displacement is how far a character may move in one step and still
+     * get a colour.
+     */
+    explicit SpatialHashCharacterCollision(float cell_size = 2.0f, float query_margin = 0.75f,
+                                           float max_step_displacement = 2.0f)
+        : cell_size(cell_size), query_margin(query_margin), max_step_displacement(max_step_displacement) {}
+
+    /**
+     * \brief call once per step before any character is updated, and not while one is
+     */
+    void rebuild(const std::unordered_map<uint64_t, JPH::Ref<JPH::CharacterVirtual>> &client_id_to_physics_character);
+    /**
+     * \brief stops a character that's about to be destroyed from being tested against before the next rebuild
+     */
+    void forget(const JPH::CharacterVirtual *character);
+
+    static constexpr uint32_t num_colours = 8;
+    static constexpr uint32_t solo_colour = num_colours;
+    /**
+     * \brief the world is cut into blocks wider than any two characters can reach across in one step, and the blocks
+     * are coloured like a 3d checkerboard. two characters of the same colour are at least a block apart, so they can be
+     * updated at the same time without either one reading the other. a character that might move further than
+     * max_step_displacement gets solo_colour and has to be updated while nobody else is.
+     *
+     * only valid between rebuild and the first update, the character has to still be where the hash saw it
+     */
+    uint32_t colour_of(const JPH::CharacterVirtual &character, float displacement_bound) const;
+
+    void CollideCharacter(const JPH::CharacterVirtual *inCharacter, JPH::RMat44Arg inCenterOfMassTransform,
+                          const JPH::CollideShapeSettings &inCollideShapeSettings, JPH::RVec3Arg inBaseOffset,
+                          JPH::CollideShapeCollector &ioCollector) const override;
+    void CastCharacter(const JPH::CharacterVirtual *inCharacter, JPH::RMat44Arg inCenterOfMassTransform,
+                       JPH::Vec3Arg inDirection, const JPH::ShapeCastSettings &inShapeCastSettings,
+                       JPH::RVec3Arg inBaseOffset, JPH::CastShapeCollector &ioCollector) const override;
+
+    /**
+     * \return how many characters the last queries had to run the narrow phase against, to see how well the hash is
+     * doing its job
+     */
+    uint64_t get_narrow_phase_tests() const { return narrow_phase_tests.load(std::memory_order_relaxed); }
+
+  private:
+    struct Cell {
+        int32_t x, y, z;
+        bool operator==(const Cell &other) const { return x == other.x && y == other.y && z == other.z; }
+    };
+
+    struct Entry {
+        const JPH::CharacterVirtual *character;
+        JPH::RMat44 center_of_mass_transform;
+        JPH::AABox bounds; // includes the character padding
+        Cell cell;
+    };
+
+    Cell cell_of(JPH::Vec3Arg position) const;
+    uint32_t bucket_of(const Cell &cell) const;
+
+    /**
+     * \brief calls test with every entry whose bounds overlap query_bounds, other than the querying character
+     */
+    template <typename Test>
+    void for_each_nearby(const JPH::CharacterVirtual *querying_character, const JPH::AABox &query_bounds,
+                         const Test &test) const;
+
+    float cell_size;
+    float query_margin;
+    float max_step_displacement;
+    float colour_block_size = 1.0f;
+    // every entry sorted by bucket, the entries in bucket b are entries[bucket_starts[b], bucket_starts[b + 1])
+    std::vector<Entry> entries;
+    std::vector<uint32_t> bucket_starts;
+    // scratch for the counting sort
+    std::vector<Entry> unsorted_entries;
+    std::vector<uint32_t> entry_buckets;
+    std::vector<uint32_t> next_bucket_slots;
+    uint32_t bucket_mask = 0;
+    JPH::Vec3 max_half_extent = JPH::Vec3::sZero();
+    mutable std::atomic<uint64_t> narrow_phase_tests = 0;
+};
+
+#endif // CHARACTER_COLLISION_HPP
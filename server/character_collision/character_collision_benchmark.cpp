@@ -0,0 +1,139 @@
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "../model_loading/model_loading.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+/**
+ * \brief steps a tight crowd of characters that all walk into the middle for a while, once for every player count, so
+ * you can see how a character step scales with the number of players when they're bunched up. with -naive every
+ * character tests every other one like jolt's CharacterVsCharacterCollisionSimple does, to compare against.
+ */
+
+void parse_command_line_arguments(int argc, char *argv[], std::string &map_path, std::vector<size_t> &player_counts,
+                                  int &ticks, bool &naive) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-map" && i + 1 < argc) {
+            map_path = argv[++i];
+        } else if (arg == "-players" && i + 1 < argc) {
+            // a comma separated list, like 50,100,200
+            player_counts.clear();
+            std::stringstream counts(argv[++i]);
+            std::string count;
+            while (std::getline(counts, count, ',')) {
+                player_counts.push_back(std::stoul(count));
+            }
+        } else if (arg == "-ticks" && i + 1 < argc) {
+            ticks = std::stoi(argv[++i]);
+        } else if (arg == "-naive") {
+            naive = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-map <path to obj>] [-players <n,n,...>] [-ticks <n>] [-naive]"
+                      << std::endl;
+            exit(1);
+        }
+    }
+}
+
+/**
+ * \brief lines the characters up in a square with a little room between them, centered on the origin
+ */
+void place_crowd(Physics &physics, size_t num_players) {
+    const float spacing = 1.2f;
+    size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(num_players))));
+    float offset = 0.5f * spacing * (side - 1);
+    for (size_t i = 0; i < num_players; i++) {
+        physics.create_character(i);
+        float x = spacing * (i % side) - offset;
+        float z = spacing * (i / side) - offset;
+        physics.client_id_to_physics_character[i]->SetPosition(JPH::RVec3(x, 2.0f, z));
+    }
+}
+
+/**
+ * \brief everyone walks towards the middle, so the crowd keeps pushing into itself
+ */
+void walk_to_center(Physics &physics, float delta_time) {
+    const float walk_speed = 4.0f;
+    for (auto &[client_id, character] : physics.client_id_to_physics_character) {
+        JPH::Vec3 to_center = -JPH::Vec3(character->GetPosition());
+        to_center.SetY(0.0f);
+        JPH::Vec3 velocity =
+            to_center.LengthSq() > 1e-6f ? to_center.Normalized() * walk_speed : JPH::Vec3::sZero();
+        float vertical_velocity = character->IsSupported()
+                                      ? 0.0f
+                                      : character->GetLinearVelocity().GetY() +
+                                            physics.physics_system.GetGravity().GetY() * delta_time;
+        velocity.SetY(vertical_velocity);
+        character->SetLinearVelocity(velocity);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string map_path = "../assets/maps/ground_test.obj";
+    std::vector<size_t> player_counts = {25, 50, 100, 200, 400, 800};
+    int ticks = 120;
+    bool naive = false;
+    parse_command_line_arguments(argc, argv, map_path, player_counts, ticks, naive);
+
+    spdlog::set_level(spdlog::level::off);
+
+    const float delta_time = 1.0f / 60.0f;
+    Model map(map_path);
+
+    std::cout << fmt::format("{} collision, {} ticks per player count\n", naive ? "naive" : "spatial hash", ticks);
+    std::cout << fmt::format("{:>8} {:>14} {:>22} {:>22}\n", "players", "tick ms", "us per character",
+                             "tests per character");
+
+    for (size_t num_players : player_counts) {
+        Physics physics;
+        physics.load_model_into_physics_world(&map);
+        place_crowd(physics, num_players);
+
+        JPH::CharacterVsCharacterCollisionSimple naive_collision;
+        if (naive) {
+            for (auto &[client_id, character] : physics.client_id_to_physics_character) {
+                naive_collision.Add(character.GetPtr());
+                character->SetCharacterVsCharacterCollision(&naive_collision);
+            }
+        }
+
+        uint64_t tests_before = physics.character_collision.get_narrow_phase_tests();
+        double total_tick_time_ms = 0;
+        for (int tick = 0; tick < ticks; tick++) {
+            walk_to_center(physics, delta_time);
+
+            auto tick_start_time = std::chrono::steady_clock::now();
+            // the naive collision has nothing to prepare, rebuilding the hash anyway would bill it to the baseline
+            if (!naive) {
+                physics.prepare_character_collision();
+            }
+            for (auto &[client_id, character] : physics.client_id_to_physics_character) {
+                physics.update_specific_character(delta_time, client_id);
+            }
+            total_tick_time_ms +=
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tick_start_time).count();
+        }
+
+        double average_tick_time_ms = total_tick_time_ms / ticks;
+        uint64_t tests = physics.character_collision.get_narrow_phase_tests() - tests_before;
+        std::cout << fmt::format("{:>8} {:>14.3f} {:>22.2f} {:>22}\n", num_players, average_tick_time_ms,
+                                 1000.0 * average_tick_time_ms / num_players,
+                                 naive ? "-" : fmt::format("{:.1f}", double(tests) / (ticks * num_players)));
+
+        if (naive) {
+            for (auto &[client_id, character] : physics.client_id_to_physics_character) {
+                character->SetCharacterVsCharacterCollision(nullptr);
+                naive_collision.Remove(character.GetPtr());
+            }
+        }
+    }
+
+    return 0;
+}
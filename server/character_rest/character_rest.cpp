@@ -0,0 +1,94 @@
+#include "character_rest.hpp"
+#include "../character_update/character_update.hpp"
+
+bool has_movement_input(const NetworkedInputSnapshot &input_snapshot) {
+    return input_snapshot.forward_pressed || input_snapshot.backward_pressed || input_snapshot.left_pressed ||
+           input_snapshot.right_pressed || input_snapshot.jump_pressed;
+}
+
+/**
+ * \brief counts how long the character has been still after it was stepped, and puts it to rest once it's been still
+ * for long enough
+ */
+static void update_rest_state(JPH::CharacterVirtual &character, CharacterRestState &rest_state,
+                              bool had_movement_input) {
+    JPH::Vec3 velocity = character.GetLinearVelocity();
+    float horizontal_speed_squared = velocity.GetX() * velocity.GetX() + velocity.GetZ() * velocity.GetZ();
+    const float rest_speed = character_rest::rest_speed_meters_per_second;
+
+    // standing on something that moves isn't resting, even when the character itself isn't walking
+    bool still = !had_movement_input && character.GetGroundState() == JPH::CharacterVirtual::EGroundState::OnGround &&
+                 horizontal_speed_squared < rest_speed * rest_speed &&
+                 character.GetGroundVelocity().LengthSq() < rest_speed * rest_speed;
+
+    rest_state.ticks_still = still ? rest_state.ticks_still + 1 : 0;
+    if (rest_state.ticks_still >= character_rest::ticks_still_before_rest) {
+        rest_state.resting = true;
+        // what's left of the velocity would otherwise be sent out and extrapolated by the clients forever
+        character.SetLinearVelocity(JPH::Vec3::sZero());
+    }
+}
+
+bool rest_through_input(CharacterRestState &rest_state, Camera &camera, Mouse &mouse,
+                        const NetworkedInputSnapshot &input_snapshot) {
+    if (!rest_state.resting || has_movement_input(input_snapshot)) {
+        return false;
+    }
+    if (update_player_camera(camera, mouse, input_snapshot)) {
+        rest_state.changed_since_capture = true;
+    }
+    return true;
+}
+
+void step_moved_character(Physics &physics, uint64_t client_id, JPH::Ref<JPH::CharacterVirtual> &character,
+                          CharacterRestState &rest_state, bool had_movement_input, double time_since_last_update,
+                          JPH::TempAllocator *temp_allocator) {
+    rest_state.resting = false;
+    if (temp_allocator != nullptr) {
+        physics.update_specific_character(time_since_last_update, client_id, *temp_allocator);
+    } else {
+        physics.update_specific_character(time_since_last_update, client_id);
+    }
+    rest_state.changed_since_capture = true;
+    update_rest_state(*character, rest_state, had_movement_input);
+}
+
+bool apply_input_to_character(Physics &physics, uint64_t client_id, JPH::Ref<JPH::CharacterVirtual> &character,
+                              CharacterRestState &rest_state, Camera &camera, Mouse &mouse,
+                              NetworkedInputSnapshot &input_snapshot, float movement_acceleration,
+                              double time_since_last_update, JPH::TempAllocator *temp_allocator) {
+    if (rest_through_input(rest_state, camera, mouse, input_snapshot)) {
+        return false;
+    }
+    update_player_camera_and_velocity(character, camera, mouse, input_snapshot, movement_acceleration,
+                                      time_since_last_update, physics.physics_system.GetGravity());
+    step_moved_character(physics, client_id, character, rest_state, has_movement_input(input_snapshot),
+                         time_since_last_update, temp_allocator);
+    return true;
+}
+
+void wake_touched_characters(Physics &physics, const JPH::CharacterVirtual &stepped_character) {
+    for (const JPH::CharacterVirtual::Contact &contact : stepped_character.GetActiveContacts()) {
+        if (contact.mCharacterB == nullptr) {
+            continue;
+        }
+        auto client_id = physics.physics_character_to_client_id.find(contact.mCharacterB);
+        if (client_id == physics.physics_character_to_client_id.end()) {
+            continue;
+        }
+        CharacterRestState &rest_state = physics.client_id_to_rest_state[client_id->second];
+        rest_state.resting = false;
+        rest_state.ticks_still = 0;
+    }
+}
+
+bool should_replicate_character(CharacterRestState &rest_state, uint64_t client_id, uint64_t capture) {
+    rest_state.unchanged_captures = rest_state.changed_since_capture ? 0 : rest_state.unchanged_captures + 1;
+    rest_state.changed_since_capture = false;
+
+    if (!rest_state.resting || rest_state.unchanged_captures < character_rest::captures_before_unchanged) {
+        return true;
+    }
+    // spread out over the period by id, so the refreshes don't all land in the same game state
+    return (capture + client_id) % character_rest::resting_refresh_period_captures == 0;
+}
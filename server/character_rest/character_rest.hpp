@@ -0,0 +1,65 @@
+#ifndef CHARACTER_REST_HPP
+#define CHARACTER_REST_HPP
+
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "../interaction/camera/camera.hpp"
+#include "../interaction/mouse/mouse.hpp"
+#include <cstdint>
+
+/**
+ * \brief most players in a lobby are standing around. a character that has been on the ground without any movement
+ * input and barely moving for ticks_still_before_rest ticks is put to rest: its velocity is zeroed and it isn't stepped
+ * anymore until an input with movement keys comes in or another character bumps into it. its camera still follows the
+ * mouse.
+ *
+ * a resting character that hasn't changed for captures_before_unchanged captures is left out of the game states,
+ * except every resting_refresh_period_captures captures so that clients that lost it or joined late still get it.
+ * the rest state of every character is kept in Physics::client_id_to_rest_state.
+ */
+namespace character_rest {
+constexpr float rest_speed_meters_per_second = 0.05f;
+constexpr uint32_t ticks_still_before_rest = 10;
+// a few sends even to a client that only gets every fourth tick, so a lost packet doesn't leave it moving
+constexpr uint32_t captures_before_unchanged = 12;
+constexpr uint64_t resting_refresh_period_captures = 60;
+} // namespace character_rest
+
+bool has_movement_input(const NetworkedInputSnapshot &input_snapshot);
+
+/**
+ * \brief a resting character whose input doesn't move it only has its camera turned
+ * \return true if that's what happened, the character then mustn't be stepped for this input
+ */
+bool rest_through_input(CharacterRestState &rest_state, Camera &camera, Mouse &mouse,
+                        const NetworkedInputSnapshot &input_snapshot);
+
+/**
+ * \brief steps a character whose velocity has already been updated for the input, and checks if it can rest now
+ * \param temp_allocator the physics' own one is used if this is null, which is only ok if nothing else is stepping
+ */
+void step_moved_character(Physics &physics, uint64_t client_id, JPH::Ref<JPH::CharacterVirtual> &character,
+                          CharacterRestState &rest_state, bool had_movement_input, double time_since_last_update,
+                          JPH::TempAllocator *temp_allocator);
+
+/**
+ * \brief applies one input to a character, rest_through_input and then the velocity update and step_moved_character
+ * \return true if the character was stepped
+ */
+bool apply_input_to_character(Physics &physics, uint64_t client_id, JPH::Ref<JPH::CharacterVirtual> &character,
+                              CharacterRestState &rest_state, Camera &camera, Mouse &mouse,
+                              NetworkedInputSnapshot &input_snapshot, float movement_acceleration,
+                              double time_since_last_update, JPH::TempAllocator *temp_allocator);
+
+/**
+ * \brief wakes every resting character that the stepped character is touching
+ * \note changes other characters' rest state, so don't run it while characters are being stepped in parallel
+ */
+void wake_touched_characters(Physics &physics, const JPH::CharacterVirtual &stepped_character);
+
+/**
+ * \brief called once per character per game state capture
+ * \return false if the character can be left out of this capture
+ */
+bool should_replicate_character(CharacterRestState &rest_state, uint64_t client_id, uint64_t capture);
+
+#endif // CHARACTER_REST_HPP
@@ -0,0 +1,33 @@
+#include "character_update.hpp"
+
+bool update_player_camera(Camera &camera, Mouse &mouse, const NetworkedInputSnapshot &input_snapshot) {
+    auto [change_in_yaw_angle, change_in_pitch_angle] =
+        mouse.get_yaw_pitch_deltas(input_snapshot.mouse_position_x, input_snapshot.mouse_position_y);
+    if (change_in_yaw_angle == 0 && change_in_pitch_angle == 0) {
+        return false;
+    }
+    camera.update_look_direction(change_in_yaw_angle, change_in_pitch_angle);
+    return true;
+}
+
+CharacterMovementState character_movement_state(const JPH::CharacterVirtual &character, Camera &camera,
+                                                const NetworkedInputSnapshot &input_snapshot) {
+    glm::vec3 input_direction =
+        camera.input_snapshot_to_input_direction(input_snapshot.forward_pressed, input_snapshot.backward_pressed,
+                                                 input_snapshot.right_pressed, input_snapshot.left_pressed);
+    return character_movement_state(character, input_direction, input_snapshot.jump_pressed);
+}
+
+void update_player_camera_and_velocity(JPH::Ref<JPH::CharacterVirtual> &character, Camera &camera, Mouse &mouse,
+                                       NetworkedInputSnapshot &input_snapshot, float movement_acceleration,
+                                       double time_since_last_update, JPH::Vec3 gravity) {
+    update_player_camera(camera, mouse, input_snapshot);
+
+    CharacterMovementState state = character_movement_state(*character, camera, input_snapshot);
+    CharacterMovementSettings settings;
+    settings.acceleration = movement_acceleration;
+    float gravity_components[3] = {gravity.GetX(), gravity.GetY(), gravity.GetZ()};
+    integrate_character_velocity(state, settings, (float)time_since_last_update, gravity_components);
+
+    character->SetLinearVelocity(JPH::Vec3(state.velocity[0], state.velocity[1], state.velocity[2]));
+}
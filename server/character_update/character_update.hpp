@@ -0,0 +1,30 @@
+#ifndef CHARACTER_UPDATE_HPP
+#define CHARACTER_UPDATE_HPP
+
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "../interaction/camera/camera.hpp"
+#include "../interaction/mouse/mouse.hpp"
+#include "character_movement/character_movement.hpp"
+#include "character_movement/character_movement_jolt.hpp"
+
+/**
+ * \brief turns the camera by how far the mouse moved since the last input
+ * \return false if the mouse didn't move, the camera is then left as it was
+ */
+bool update_player_camera(Camera &camera, Mouse &mouse, const NetworkedInputSnapshot &input_snapshot);
+
+/**
+ * \brief copies what one input's movement depends on out of jolt and the camera, for the shared movement code, see
+ * character_movement_jolt.hpp
+ */
+CharacterMovementState character_movement_state(const JPH::CharacterVirtual &character, Camera &camera,
+                                                const NetworkedInputSnapshot &input_snapshot);
+
+/**
+ * \brief turns the camera and integrates the character's velocity for one input, see character_movement.hpp
+ */
+void update_player_camera_and_velocity(JPH::Ref<JPH::CharacterVirtual> &character, Camera &camera, Mouse &mouse,
+                                       NetworkedInputSnapshot &input_snapshot, float movement_acceleration,
+                                       double time_since_last_update, JPH::Vec3 gravity);
+
+#endif
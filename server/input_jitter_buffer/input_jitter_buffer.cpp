@@ -0,0 +1,64 @@
+#include "input_jitter_buffer.hpp"
+#include <algorithm>
+#include <cmath>
+
+bool InputJitterBuffer::push(const NetworkedInputSnapshot &input_snapshot, uint64_t sequence, uint64_t received_at,
+                             double tick_period_ns) {
+    if (received_any && tick_period_ns > 0 && sequence > last_sequence) {
+        // lost inputs leave a gap in the sequence, the input after them is still on time
+        double expected_ns = static_cast<double>(sequence - last_sequence) * tick_period_ns;
+        double transit_change_ns = static_cast<double>(received_at - last_received_at) - expected_ns;
+        jitter_ns += (std::abs(transit_change_ns) - jitter_ns) * jitter_smoothing;
+        target_depth =
+            std::min<size_t>(std::lround(depth_per_jitter * jitter_ns / tick_period_ns), max_target_depth);
+    }
+    received_any = true;
+    last_sequence = sequence;
+    last_received_at = received_at;
+
+    bool dropped = false;
+    if (num_inputs == capacity) {
+        first_input = (first_input + 1) % capacity;
+        num_inputs--;
+        dropped = true;
+    }
+    inputs[(first_input + num_inputs) % capacity] = input_snapshot;
+    num_inputs++;
+    return !dropped;
+}
+
+size_t InputJitterBuffer::release(ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue, bool &starved) {
+    starved = false;
+    if (filling) {
+        if (num_inputs <= target_depth) {
+            return 0;
+        }
+        filling = false;
+    }
+
+    if (num_inputs == 0) {
+        starved = true;
+        filling = true;
+        ticks_above_target_depth = 0;
+        return 0;
+    }
+
+    pop_into(input_snapshot_queue);
+    if (num_inputs <= target_depth) {
+        ticks_above_target_depth = 0;
+        return 1;
+    }
+    // a burst or a depth that just went down, the inputs that piled up would be latency for good otherwise
+    if (++ticks_above_target_depth < catch_up_after_ticks) {
+        return 1;
+    }
+    ticks_above_target_depth = 0;
+    pop_into(input_snapshot_queue);
+    return 2;
+}
+
+void InputJitterBuffer::pop_into(ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue) {
+    input_snapshot_queue.push(inputs[first_input]);
+    first_input = (first_input + 1) % capacity;
+    num_inputs--;
+}
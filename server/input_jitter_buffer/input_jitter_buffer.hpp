@@ -0,0 +1,72 @@
+#ifndef INPUT_JITTER_BUFFER_HPP
+#define INPUT_JITTER_BUFFER_HPP
+
+#include "networked_input_snapshot/networked_input_snapshot.hpp"
+#include "thread_safe_queue.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \brief holds a client's inputs back for a few ticks, so that when they arrive unevenly the character still gets one
+ * every tick. without it a late input leaves its tick without one, the character coasts, and the next tick takes two,
+ * and the client mispredicts both.
+ *
+ * how many inputs are kept back follows the jitter the inputs arrive with, measured the way rtp does: every input
+ * should arrive a tick after the one before it, the smoothed difference to that is the jitter. a client whose inputs
+ * arrive evenly keeps none back and gets no extra latency.
+ *
+ * the depth is reached by the client running ahead a tick for every input it should keep back, it's told the depth for
+ * that. a client that doesn't is held back a tick once it has run dry instead, and when more inputs pile up than the
+ * depth asks for for a while, an extra one is taken to catch up.
+ *
+ * simulation thread only.
+ */
+class InputJitterBuffer {
+  public:
+    /**
+     * \param sequence the input's sequence number, inputs come in in order
+     * \param received_at steady clock nanoseconds when the io thread got the input
+     * \param tick_period_ns how long the server's ticks take, 0 if that isn't known yet, the jitter isn't measured then
+     * \return false if the buffer was full and the oldest input had to be dropped
+     */
+    bool push(const NetworkedInputSnapshot &input_snapshot, uint64_t sequence, uint64_t received_at,
+              double tick_period_ns);
+    /**
+     * \brief moves the inputs this tick takes to input_snapshot_queue, normally one
+     * \param starved set if the buffer ran dry and there's no input for this tick
+     * \return how many inputs were moved
+     */
+    size_t release(ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue, bool &starved);
+
+    size_t get_target_depth() const { return target_depth; }
+    double get_jitter_ns() const { return jitter_ns; }
+    size_t size() const { return num_inputs; }
+
+    static constexpr size_t capacity = 16;
+    static constexpr size_t max_target_depth = 4;
+    static constexpr double jitter_smoothing = 1.0 / 16.0;
+    // inputs kept back per tick of jitter. the jitter is an average and it's the latest inputs that starve a tick, so
+    // this leaves a good margin
+    static constexpr double depth_per_jitter = 4.0;
+    // more inputs than the depth for this many ticks in a row and one more is taken
+    static constexpr size_t catch_up_after_ticks = 30;
+
+  private:
+    void pop_into(ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue);
+
+    std::array<NetworkedInputSnapshot, capacity> inputs;
+    size_t first_input = 0;
+    size_t num_inputs = 0;
+
+    bool filling = true; // nothing is released until the buffer is deeper than the target depth
+    size_t target_depth = 0;
+    size_t ticks_above_target_depth = 0;
+
+    bool received_any = false;
+    uint64_t last_sequence = 0;
+    uint64_t last_received_at = 0;
+    double jitter_ns = 0;
+};
+
+#endif // INPUT_JITTER_BUFFER_HPP
@@ -0,0 +1,126 @@
+#include "input_journal.hpp"
+#include <cstring>
+#include <stdexcept>
+
+InputJournal::InputJournal(const std::string &file_path) : file(file_path, std::ios::binary | std::ios::trunc) {
+    if (!file.is_open()) {
+        throw std::runtime_error("couldn't open input journal for writing: " + file_path);
+    }
+    pending_bytes.reserve(flush_threshold_bytes * 2);
+
+    uint32_t snapshot_size = sizeof(NetworkedInputSnapshot);
+    write_bytes(magic, sizeof(magic));
+    write_bytes(&version, sizeof(version));
+    write_bytes(&snapshot_size, sizeof(snapshot_size));
+}
+
+InputJournal::~InputJournal() { flush(); }
+
+void InputJournal::record_tick_start(uint64_t tick, double delta_time_seconds) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    JournalRecordType type = JournalRecordType::TICK_START;
+    write_bytes(&type, sizeof(type));
+    write_bytes(&tick, sizeof(tick));
+    write_bytes(&delta_time_seconds, sizeof(delta_time_seconds));
+    seconds_since_flush += delta_time_seconds;
+    if (pending_bytes.size() >= flush_threshold_bytes || seconds_since_flush >= flush_period_seconds) {
+        flush_without_lock();
+    }
+}
+
+void InputJournal::record_connect(uint64_t client_id) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    JournalRecordType type = JournalRecordType::CONNECT;
+    write_bytes(&type, sizeof(type));
+    write_bytes(&client_id, sizeof(client_id));
+}
+
+void InputJournal::record_disconnect(uint64_t client_id) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    JournalRecordType type = JournalRecordType::DISCONNECT;
+    write_bytes(&type, sizeof(type));
+    write_bytes(&client_id, sizeof(client_id));
+    // a session that ends badly usually ends right after someone leaves, so that part is the one worth having on disk
+    flush_without_lock();
+}
+
+void InputJournal::record_input(const NetworkedInputSnapshot &input_snapshot) {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    JournalRecordType type = JournalRecordType::INPUT;
+    write_bytes(&type, sizeof(type));
+    write_bytes(&input_snapshot, sizeof(NetworkedInputSnapshot));
+}
+
+void InputJournal::flush() {
+    std::lock_guard<std::mutex> lock(journal_mutex);
+    flush_without_lock();
+}
+
+void InputJournal::write_bytes(const void *data, size_t num_bytes) {
+    const char *bytes = static_cast<const char *>(data);
+    pending_bytes.insert(pending_bytes.end(), bytes, bytes + num_bytes);
+}
+
+void InputJournal::flush_without_lock() {
+    seconds_since_flush = 0;
+    if (pending_bytes.empty()) {
+        return;
+    }
+    file.write(pending_bytes.data(), pending_bytes.size());
+    file.flush();
+    pending_bytes.clear(); // keeps its capacity
+}
+
+InputJournalReader::InputJournalReader(const std::string &file_path) : file(file_path, std::ios::binary) {
+    if (!file.is_open()) {
+        throw std::runtime_error("couldn't open input journal for reading: " + file_path);
+    }
+
+    char file_magic[4];
+    uint32_t file_version = 0;
+    uint32_t file_snapshot_size = 0;
+    file.read(file_magic, sizeof(file_magic));
+    file.read(reinterpret_cast<char *>(&file_version), sizeof(file_version));
+    file.read(reinterpret_cast<char *>(&file_snapshot_size), sizeof(file_snapshot_size));
+
+    if (!file || std::memcmp(file_magic, InputJournal::magic, sizeof(file_magic)) != 0) {
+        throw std::runtime_error("not an input journal: " + file_path);
+    }
+    if (file_version != InputJournal::version) {
+        throw std::runtime_error("input journal has version " + std::to_string(file_version) + " but expected " +
+                                 std::to_string(InputJournal::version));
+    }
+    if (file_snapshot_size != sizeof(NetworkedInputSnapshot)) {
+        throw std::runtime_error("input journal was recorded with a different NetworkedInputSnapshot layout");
+    }
+}
+
+bool InputJournalReader::read_next(JournalRecord &record) {
+    JournalRecordType type;
+    if (!file.read(reinterpret_cast<char *>(&type), sizeof(type))) {
+        return false;
+    }
+    record.type = type;
+
+    switch (type) {
+    case JournalRecordType::TICK_START:
+        file.read(reinterpret_cast<char *>(&record.tick), sizeof(record.tick));
+        file.read(reinterpret_cast<char *>(&record.delta_time_seconds), sizeof(record.delta_time_seconds));
+        current_tick = record.tick;
+        break;
+    case JournalRecordType::CONNECT:
+    case JournalRecordType::DISCONNECT:
+        file.read(reinterpret_cast<char *>(&record.client_id), sizeof(record.client_id));
+        break;
+    case JournalRecordType::INPUT:
+        file.read(reinterpret_cast<char *>(&record.input_snapshot), sizeof(NetworkedInputSnapshot));
+        record.client_id = record.input_snapshot.client_id;
+        break;
+    default:
+        throw std::runtime_error("input journal contains an unknown record type, it is probably corrupt");
+    }
+    record.tick = current_tick;
+
+    // a server that was killed mid write leaves a truncated last record, treat it as the end
+    return static_cast<bool>(file);
+}
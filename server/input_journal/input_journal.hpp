@@ -0,0 +1,94 @@
+#ifndef INPUT_JOURNAL_HPP
+#define INPUT_JOURNAL_HPP
+
+#include "../networked_input_snapshot/networked_input_snapshot.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * \brief a compact binary log of everything the simulation consumed, so that a session can be replayed exactly.
+ *
+ * layout:
+ *   header: "MWEJ" | u32 version | u32 sizeof(NetworkedInputSnapshot)
+ *   records: u8 type followed by its payload
+ *     TICK_START: u64 tick | f64 delta time in seconds, every record after it belongs to this tick
+ *     CONNECT / DISCONNECT: u64 client id
+ *     INPUT: the raw NetworkedInputSnapshot exactly as the physics step consumed it
+ *
+ * \note the tick number is only written once per tick rather than in every record, ticks with no events cost 17 bytes
+ *
+ * records are buffered and written out once 64 KiB are pending, once a second of ticks has passed since the last
+ * write, on every disconnect and when the journal is destroyed. so a server that's killed loses at most the last second.
+ */
+enum class JournalRecordType : uint8_t {
+    TICK_START = 0,
+    CONNECT = 1,
+    DISCONNECT = 2,
+    INPUT = 3,
+};
+
+class InputJournal {
+  public:
+    static constexpr char magic[4] = {'M', 'W', 'E', 'J'};
+    static constexpr uint32_t version = 1;
+
+    /**
+     * \throws std::runtime_error if the file can't be opened for writing
+     */
+    explicit InputJournal(const std::string &file_path);
+    ~InputJournal();
+
+    InputJournal(const InputJournal &) = delete;
+    InputJournal &operator=(const InputJournal &) = delete;
+
+    void record_tick_start(uint64_t tick, double delta_time_seconds);
+    void record_connect(uint64_t client_id);
+    void record_disconnect(uint64_t client_id);
+    void record_input(const NetworkedInputSnapshot &input_snapshot);
+    void flush();
+
+  private:
+    void write_bytes(const void *data, size_t num_bytes);
+    void flush_without_lock();
+
+    std::ofstream file;
+    std::vector<char> pending_bytes; // written out in large chunks so the tick loop isn't doing file io every record
+    const size_t flush_threshold_bytes = 64 * 1024;
+    const double flush_period_seconds = 1.0; // of simulated time, summed from the ticks' delta times
+    double seconds_since_flush = 0;
+    std::mutex journal_mutex; // connects come from the network step, inputs from the physics step
+};
+
+struct JournalRecord {
+    JournalRecordType type;
+    uint64_t tick = 0;
+    double delta_time_seconds = 0;
+    uint64_t client_id = 0;
+    NetworkedInputSnapshot input_snapshot;
+};
+
+/**
+ * \brief reads a journal written by InputJournal back one record at a time
+ */
+class InputJournalReader {
+  public:
+    /**
+     * \throws std::runtime_error if the file doesn't exist or was written with an incompatible layout
+     */
+    explicit InputJournalReader(const std::string &file_path);
+
+    /**
+     * \return false once there are no more complete records
+     */
+    bool read_next(JournalRecord &record);
+
+  private:
+    std::ifstream file;
+    uint64_t current_tick = 0; // records other than TICK_START are tagged with the tick they occurred in
+};
+
+#endif // INPUT_JOURNAL_HPP
@@ -8,6 +8,12 @@
 #include "Jolt/Physics/Collision/Shape/CapsuleShape.h"
 #include "Jolt/Physics/Collision/Shape/ConvexHullShape.h"
 #include "Jolt/Physics/Collision/Shape/MeshShape.h"
+#include "Jolt/Physics/Collision/CollisionCollectorImpl.h"
+#include "Jolt/Physics/Collision/RayCast.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <stdexcept>
 
 //// Disable common warnings triggered by Jolt, you can use
@@ -49,6 +55,16 @@ void Physics::initialize_engine() {
 
 void Physics::initialize_world_objects() {
 
+    // a grid around where everyone used to spawn, characters are 1 m wide
+    const int spawn_grid_side = 8;
+    const float spawn_spacing = 1.5f;
+    for (int x = 0; x < spawn_grid_side; x++) {
+        for (int z = 0; z < spawn_grid_side; z++) {
+            spawn_points.push_back(JPH::RVec3(spawn_spacing * (x - 0.5f * (spawn_grid_side - 1)), 10.0f,
+                                              spawn_spacing * (z - 0.5f * (spawn_grid_side - 1))));
+        }
+    }
+
     physics_system.SetGravity(JPH::Vec3(0, -40.0, 0));
 
     JPH::BodyInterface &body_interface = physics_system.GetBodyInterface();
@@ -73,80 +89,239 @@ void Physics::initialize_world_objects() {
     body_interface.SetLinearVelocity(ball->GetID(), JPH::Vec3(0.0f, -5.0f, 0.0f));
 }
 
+/**
+ * \brief turns one mesh of a model into a mesh shape, this is most of the time it takes to load a map
+ */
+static JPH::ShapeRefC create_mesh_shape(const Mesh &mesh) {
+    JPH::TriangleList triangles;
+    triangles.reserve(mesh.indices.size() / 3);
+
+    assert(mesh.indices.size() % 3 == 0); // only contains triangles
+    for (size_t j = 0; j < mesh.indices.size(); j += 3) {
+        glm::vec3 temp_v1 = mesh.vertices[mesh.indices[j]].position;
+        glm::vec3 temp_v2 = mesh.vertices[mesh.indices[j + 1]].position;
+        glm::vec3 temp_v3 = mesh.vertices[mesh.indices[j + 2]].position;
+        triangles.push_back(JPH::Triangle(JPH::Float3(temp_v1.x, temp_v1.y, temp_v1.z),
+                                          JPH::Float3(temp_v2.x, temp_v2.y, temp_v2.z),
+                                          JPH::Float3(temp_v3.x, temp_v3.y, temp_v3.z)));
+    }
+
+    JPH::MeshShapeSettings settings = JPH::MeshShapeSettings(triangles);
+    JPH::Shape::ShapeResult result = settings.Create();
+    return result.IsValid() ? result.Get() : nullptr;
+}
+
 /**
  * \brief For every mesh in this model, we create a physics object that
  * represents the mesh
+ *
+ * the shapes are built on the job system, one job per thread that each take the next mesh that isn't done yet. the
+ * bodies are then added in one batch and the broadphase is optimized, otherwise the first ticks query a tree that was
+ * built up one insertion at a time. how long each part took and what that did to query times is logged.
  */
 void Physics::load_model_into_physics_world(Model *model) {
-
-    JPH::BodyInterface &body_interface = physics_system.GetBodyInterface();
-
-    for (int i = 0; i < model->meshes.size(); i++) {
-
-        Mesh mesh = model->meshes[i];
-
-        JPH::TriangleList triangles;
-
-        assert(mesh.indices.size() % 3 == 0); // only contains triangles
-        for (int j = 0; j < mesh.indices.size(); j += 3) {
-            unsigned int j1 = mesh.indices[j];
-            unsigned int j2 = mesh.indices[j + 1];
-            unsigned int j3 = mesh.indices[j + 2];
-
-            glm::vec3 temp_v1 = mesh.vertices[j1].position;
-            JPH::Float3 v1 = JPH::Float3(temp_v1.x, temp_v1.y, temp_v1.z);
-
-            glm::vec3 temp_v2 = mesh.vertices[j2].position;
-            JPH::Float3 v2 = JPH::Float3(temp_v2.x, temp_v2.y, temp_v2.z);
-
-            glm::vec3 temp_v3 = mesh.vertices[j3].position;
-            JPH::Float3 v3 = JPH::Float3(temp_v3.x, temp_v3.y, temp_v3.z);
-
-            JPH::Triangle tri = JPH::Triangle(v1, v2, v3);
-
-            triangles.push_back(tri);
+    auto load_start_time = std::chrono::steady_clock::now();
+    size_t num_meshes = model->meshes.size();
+
+    std::vector<JPH::ShapeRefC> mesh_shapes(num_meshes);
+    std::atomic<size_t> next_mesh = 0;
+    auto create_mesh_shapes = [&]() {
+        for (size_t i = next_mesh++; i < num_meshes; i = next_mesh++) {
+            mesh_shapes[i] = create_mesh_shape(model->meshes[i]);
         }
+    };
+    // the calling thread joins in while it waits
+    size_t num_jobs = std::min(num_meshes, static_cast<size_t>(std::max(job_system->GetMaxConcurrency() - 1, 0)));
+    JPH::JobSystem::Barrier *barrier = job_system->CreateBarrier();
+    for (size_t i = 0; i < num_jobs; i++) {
+        barrier->AddJob(job_system->CreateJob("create mesh shapes", JPH::Color::sGreen, create_mesh_shapes));
+    }
+    create_mesh_shapes();
+    job_system->WaitForJobs(barrier);
+    job_system->DestroyBarrier(barrier);
 
-        JPH::MeshShapeSettings settings = JPH::MeshShapeSettings(triangles);
-
-        JPH::Ref<JPH::Shape> mesh_shape;
-
-        // Create shape
-        JPH::Shape::ShapeResult result = settings.Create();
-        if (result.IsValid()) {
-            mesh_shape = result.Get();
-        } else {
+    for (const JPH::ShapeRefC &mesh_shape : mesh_shapes) {
+        if (mesh_shape == nullptr) {
             throw std::runtime_error("couldn't get resulting shape");
         }
+    }
+    auto shapes_created_time = std::chrono::steady_clock::now();
 
+    JPH::BodyInterface &body_interface = physics_system.GetBodyInterface();
+    std::vector<JPH::BodyID> mesh_body_ids;
+    JPH::AABox map_bounds;
+    for (const JPH::ShapeRefC &mesh_shape : mesh_shapes) {
         JPH::BodyCreationSettings mesh_settings(mesh_shape, JPH::RVec3(0.0, 0.0, 0.0), JPH::Quat::sIdentity(),
                                                 JPH::EMotionType::Static, Layers::NON_MOVING);
         JPH::Body *mesh_body = body_interface.CreateBody(mesh_settings); // Note that if we run out of bodies this can
                                                                          // return nullptr
-        body_interface.AddBody(mesh_body->GetID(), JPH::EActivation::DontActivate);
+        if (mesh_body == nullptr) {
+            throw std::runtime_error("ran out of bodies while loading the map");
+        }
+        mesh_body_ids.push_back(mesh_body->GetID());
         created_body_ids.push_back(mesh_body->GetID());
+        map_bounds.Encapsulate(mesh_shape->GetLocalBounds());
+    }
+    if (!mesh_body_ids.empty()) {
+        int num_bodies = static_cast<int>(mesh_body_ids.size());
+        JPH::BodyInterface::AddState add_state = body_interface.AddBodiesPrepare(mesh_body_ids.data(), num_bodies);
+        body_interface.AddBodiesFinalize(mesh_body_ids.data(), num_bodies, add_state, JPH::EActivation::DontActivate);
+    }
+    auto bodies_added_time = std::chrono::steady_clock::now();
+
+    double query_time_before_optimizing_ms = time_broad_phase_queries(map_bounds);
+    auto optimize_start_time = std::chrono::steady_clock::now();
+    physics_system.OptimizeBroadPhase();
+    auto optimized_time = std::chrono::steady_clock::now();
+    double query_time_after_optimizing_ms = time_broad_phase_queries(map_bounds);
+
+    using milliseconds = std::chrono::duration<double, std::milli>;
+    spdlog::info("loaded {} meshes: creating the shapes took {:.2f} ms on {} threads, adding the bodies {:.2f} ms, "
+                 "optimizing the broadphase {:.2f} ms",
+                 num_meshes, milliseconds(shapes_created_time - load_start_time).count(), num_jobs + 1,
+                 milliseconds(bodies_added_time - shapes_created_time).count(),
+                 milliseconds(optimized_time - optimize_start_time).count());
+    spdlog::info("{} broadphase ray casts over the map took {:.3f} ms before optimizing and {:.3f} ms after",
+                 broad_phase_probe_rays * broad_phase_probe_rays, query_time_before_optimizing_ms,
+                 query_time_after_optimizing_ms);
+}
+
+/**
+ * \brief casts a grid of rays straight down through the bounds against the broadphase only, to see how balanced its
+ * tree is
+ * \return how long the casts took in milliseconds
+ */
+double Physics::time_broad_phase_queries(const JPH::AABox &bounds) {
+    if (!bounds.IsValid()) {
+        return 0.0;
     }
+    const JPH::BroadPhaseQuery &broad_phase_query = physics_system.GetBroadPhaseQuery();
+    JPH::Vec3 size = bounds.GetSize();
+    JPH::AllHitCollisionCollector<JPH::RayCastBodyCollector> collector;
+
+    auto start_time = std::chrono::steady_clock::now();
+    for (int x = 0; x < broad_phase_probe_rays; x++) {
+        for (int z = 0; z < broad_phase_probe_rays; z++) {
+            JPH::Vec3 origin(bounds.mMin.GetX() + size.GetX() * (x + 0.5f) / broad_phase_probe_rays,
+                             bounds.mMax.GetY() + 1.0f,
+                             bounds.mMin.GetZ() + size.GetZ() * (z + 0.5f) / broad_phase_probe_rays);
+            JPH::RayCast ray{origin, JPH::Vec3(0.0f, -(size.GetY() + 2.0f), 0.0f)};
+            collector.Reset();
+            broad_phase_query.CastRay(ray, collector);
+        }
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
 }
 
 /**
- * \brief create character controller for a user
+ * \brief create character controller for a user, taken from the warm pool if there's one left in it
  * \todo do I have to account for dynamic memory? Come back when you know what
  * ref is
  */
 void Physics::create_character(uint64_t client_id) {
-    JPH::Ref<JPH::CharacterVirtualSettings> settings = new JPH::CharacterVirtualSettings();
-    settings->mShape = new JPH::CapsuleShape(0.5f * this->character_height, this->character_radius);
-    settings->mSupportingVolume = JPH::Plane(JPH::Vec3::sAxisY(),
-                                             -this->character_radius); // Accept contacts that touch the
-                                                                       // lower sphere of the capsule
+    JPH::Ref<JPH::CharacterVirtual> character;
+    if (!idle_characters.empty()) {
+        character = idle_characters.back();
+        idle_characters.pop_back();
+    } else {
+        character = new_character();
+    }
+    // joiners that arrive together are spread out so they don't spawn inside each other
+    character->SetPosition(spawn_points[next_spawn_point]);
+    next_spawn_point = (next_spawn_point + 1) % spawn_points.size();
+    character->SetLinearVelocity(JPH::Vec3::sZero());
+
+    client_id_to_physics_character[client_id] = character;
+    client_id_to_rest_state[client_id] = CharacterRestState();
+    physics_character_to_client_id[character.GetPtr()] = client_id;
+}
+
+/**
+ * \brief the character goes back into the pool rather than being destroyed, the next joiner gets it
+ */
+void Physics::delete_character(uint64_t client_id) {
+    auto character = client_id_to_physics_character.find(client_id);
+    if (character != client_id_to_physics_character.end()) {
+        character_collision.forget(character->second.GetPtr());
+        physics_character_to_client_id.erase(character->second.GetPtr());
+        client_id_to_rest_state.erase(client_id);
+        idle_characters.push_back(character->second);
+        client_id_to_physics_character.erase(character);
+    }
+}
+
+void Physics::warm_character_pool(size_t num_characters) {
+    while (idle_characters.size() < num_characters) {
+        idle_characters.push_back(new_character());
+    }
+}
+
+JPH::Ref<JPH::CharacterVirtual> Physics::new_character() {
+    if (character_settings == nullptr) {
+        character_settings = new JPH::CharacterVirtualSettings();
+        character_settings->mShape = new JPH::CapsuleShape(0.5f * this->character_height, this->character_radius);
+        // Accept contacts that touch the lower sphere of the capsule
+        character_settings->mSupportingVolume = JPH::Plane(JPH::Vec3::sAxisY(), -this->character_radius);
+    }
 
     JPH::Ref<JPH::CharacterVirtual> character =
-        new JPH::CharacterVirtual(settings, JPH::RVec3(0.0f, 10.0f, 0.0f), JPH::Quat::sIdentity(), &physics_system);
+        new JPH::CharacterVirtual(character_settings, spawn_points[0], JPH::Quat::sIdentity(), &physics_system);
+    character->SetCharacterVsCharacterCollision(&character_collision);
+    return character;
+}
 
-    client_id_to_physics_character[client_id] = character;
+void Physics::prepare_character_collision() { character_collision.rebuild(client_id_to_physics_character); }
+
+/**
+ * \brief fnv-1a over the bytes of the value
+ */
+template <typename T> static void hash_bytes(uint64_t &hash, const T &value) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
 }
 
-void Physics::delete_character(uint64_t client_id) { client_id_to_physics_character.erase(client_id); }
+template <typename Vector> static void hash_vector(uint64_t &hash, const Vector &vector) {
+    hash_bytes(hash, vector.GetX());
+    hash_bytes(hash, vector.GetY());
+    hash_bytes(hash, vector.GetZ());
+}
+
+static void hash_rotation(uint64_t &hash, const JPH::Quat &rotation) {
+    hash_bytes(hash, rotation.GetX());
+    hash_bytes(hash, rotation.GetY());
+    hash_bytes(hash, rotation.GetZ());
+    hash_bytes(hash, rotation.GetW());
+}
+
+uint64_t Physics::state_hash() {
+    uint64_t hash = 14695981039346656037ull;
+
+    JPH::BodyInterface &body_interface = physics_system.GetBodyInterface();
+    for (const JPH::BodyID &body_id : created_body_ids) {
+        hash_vector(hash, body_interface.GetPosition(body_id));
+        hash_rotation(hash, body_interface.GetRotation(body_id));
+        hash_vector(hash, body_interface.GetLinearVelocity(body_id));
+        hash_vector(hash, body_interface.GetAngularVelocity(body_id));
+    }
+
+    // the map's order depends on its history, the ids' doesn't
+    std::vector<uint64_t> client_ids;
+    for (const auto &pair : client_id_to_physics_character) {
+        client_ids.push_back(pair.first);
+    }
+    std::sort(client_ids.begin(), client_ids.end());
+    for (uint64_t client_id : client_ids) {
+        const JPH::CharacterVirtual &character = *client_id_to_physics_character[client_id];
+        hash_bytes(hash, client_id);
+        hash_vector(hash, character.GetPosition());
+        hash_rotation(hash, character.GetRotation());
+        hash_vector(hash, character.GetLinearVelocity());
+    }
+    return hash;
+}
 
 /**
  * \brief updates the objects part of this physics simulation
@@ -164,6 +339,7 @@ void Physics::update(float delta_time) {
     // update_settings.mWalkStairsStepUp = character->GetUp() *
     // update_settings.mWalkStairsStepUp.Length();
     //
+    prepare_character_collision();
     for (const auto &pair : client_id_to_physics_character) {
         JPH::Ref<JPH::CharacterVirtual> character = pair.second;
         character->ExtendedUpdate(delta_time, -character->GetUp() * physics_system.GetGravity().Length(),
@@ -175,6 +351,11 @@ void Physics::update(float delta_time) {
 }
 
 void Physics::update_specific_character(float delta_time, uint64_t client_id_of_character) {
+    update_specific_character(delta_time, client_id_of_character, *temp_allocator);
+}
+
+void Physics::update_specific_character(float delta_time, uint64_t client_id_of_character,
+                                        JPH::TempAllocator &character_temp_allocator) {
 
     // Safely access and call the function if the key exists
     auto potential_character_pair = client_id_to_physics_character.find(client_id_of_character);
@@ -185,12 +366,19 @@ void Physics::update_specific_character(float delta_time, uint64_t client_id_of_
         requested_character->ExtendedUpdate(
             delta_time, -requested_character->GetUp() * physics_system.GetGravity().Length(), update_settings,
             physics_system.GetDefaultBroadPhaseLayerFilter(Layers::MOVING),
-            physics_system.GetDefaultLayerFilter(Layers::MOVING), {}, {}, *temp_allocator);
+            physics_system.GetDefaultLayerFilter(Layers::MOVING), {}, {}, character_temp_allocator);
     } else {
         std::cout << "tried to update specific character in physics, but couldn't find them in the map" << std::endl;
     }
 }
 
+/**
+ * \brief steps the rigid bodies without touching the characters, jolt spreads this over its own job system
+ */
+void Physics::update_world(float delta_time) {
+    physics_system.Update(delta_time, cCollisionSteps, temp_allocator, job_system);
+}
+
 void Physics::clean_up_world() {
     JPH::BodyInterface &body_interface = physics_system.GetBodyInterface();
 
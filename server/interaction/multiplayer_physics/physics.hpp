@@ -10,6 +10,18 @@
 #include "Jolt/Physics/Character/CharacterVirtual.h"
 #include "../../thread_safe_queue.hpp"
 #include "../../networked_input_snapshot/networked_input_snapshot.hpp"
+#include "../../character_collision/character_collision.hpp"
+
+/**
+ * \brief whether a character is resting and so isn't being stepped, see character_rest.hpp
+ */
+struct CharacterRestState {
+    bool resting = false;
+    uint32_t ticks_still = 0;
+    // set whenever anything that gets sent about the character changes, cleared by the game state capture
+    bool changed_since_capture = true;
+    uint32_t unchanged_captures = 0;
+};
 
 class Physics {
   public:
@@ -22,17 +34,46 @@ class Physics {
 
     JPH::BodyID sphere_id; // should be removed in a real program
     std::unordered_map<uint64_t, JPH::Ref<JPH::CharacterVirtual>> client_id_to_physics_character;
+    // created and removed along with the characters, so stepping characters in parallel can update their own entry
+    std::unordered_map<uint64_t, CharacterRestState> client_id_to_rest_state;
+    std::unordered_map<const JPH::CharacterVirtual *, uint64_t> physics_character_to_client_id;
     // JPH::Ref<JPH::CharacterVirtual> character;
 
     void load_model_into_physics_world(Model *model);
     void create_character(uint64_t client_id);
     void delete_character(uint64_t client_id);
+    /**
+     * \brief constructs characters up front, so a burst of joins only has to take them out of the pool
+     */
+    void warm_character_pool(size_t num_characters);
     void update_specific_character(float delta_time, uint64_t client_id_of_character);
+    /**
+     * \brief the temp allocator isn't thread safe, so characters that get updated at the same time each need their own
+     */
+    void update_specific_character(float delta_time, uint64_t client_id_of_character,
+                                   JPH::TempAllocator &character_temp_allocator);
+    void update_world(float delta_time);
+    /**
+     * \brief characters collide with each other as they were when this was last called, call it once per step before
+     * updating any character
+     */
+    void prepare_character_collision();
+    /**
+     * \brief a hash of where every body and character is and how it's moving, two worlds that went through the same
+     * ticks have the same one down to the bit
+     */
+    uint64_t state_hash();
+
+    SpatialHashCharacterCollision character_collision;
 
   private:
     void initialize_engine();
     void initialize_world_objects();
     void clean_up_world();
+    double time_broad_phase_queries(const JPH::AABox &bounds);
+    JPH::Ref<JPH::CharacterVirtual> new_character();
+
+    static constexpr int broad_phase_probe_rays = 64; // per side of the grid
 
     const unsigned int cMaxBodies = 1024;
     const unsigned int cNumBodyMutexes = 0;
@@ -53,6 +94,12 @@ class Physics {
     ObjectLayerPairFilterImpl object_vs_object_layer_filter;
 
     std::vector<JPH::BodyID> created_body_ids;
+
+    // every character shares these settings and so the same capsule shape
+    JPH::Ref<JPH::CharacterVirtualSettings> character_settings;
+    std::vector<JPH::Ref<JPH::CharacterVirtual>> idle_characters;
+    std::vector<JPH::RVec3> spawn_points;
+    size_t next_spawn_point = 0;
 };
 
 #endif
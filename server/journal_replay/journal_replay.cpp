@@ -0,0 +1,68 @@
+#include "journal_replay.hpp"
+#include "../physics_step/physics_step.hpp"
+#include "../input_journal/input_journal.hpp"
+
+#include <chrono>
+#include <unordered_map>
+
+ReplayStatistics replay_journal(const std::string &journal_path, Physics &physics, float movement_acceleration) {
+    std::unordered_map<uint64_t, Camera> client_id_to_camera;
+    std::unordered_map<uint64_t, Mouse> client_id_to_mouse;
+    std::unordered_map<uint64_t, uint64_t> client_id_to_cihtems_of_last_server_processed_input_snapshot;
+    PhysicsStep physics_step(physics, client_id_to_camera, client_id_to_mouse,
+                             client_id_to_cihtems_of_last_server_processed_input_snapshot, movement_acceleration);
+
+    InputJournalReader journal_reader(journal_path);
+    JournalRecord record;
+    ReplayStatistics statistics;
+
+    bool tick_pending = false;
+    uint64_t pending_tick = 0;
+    double pending_tick_delta_time_seconds = 0;
+
+    auto run_pending_tick = [&]() {
+        auto tick_start_time = std::chrono::steady_clock::now();
+        physics_step.run(pending_tick_delta_time_seconds);
+        std::chrono::duration<double, std::milli> tick_time = std::chrono::steady_clock::now() - tick_start_time;
+
+        statistics.total_tick_time_ms += tick_time.count();
+        if (tick_time.count() > statistics.slowest_tick_time_ms) {
+            statistics.slowest_tick_time_ms = tick_time.count();
+            statistics.slowest_tick = pending_tick;
+        }
+        statistics.ticks_replayed++;
+    };
+
+    // the server records the start of a tick, then everything the network and physics step consumed during it, so a
+    // tick is only run once the next one starts
+    while (journal_reader.read_next(record)) {
+        switch (record.type) {
+        case JournalRecordType::TICK_START:
+            if (tick_pending) {
+                run_pending_tick();
+            }
+            tick_pending = true;
+            pending_tick = record.tick;
+            pending_tick_delta_time_seconds = record.delta_time_seconds;
+            break;
+        case JournalRecordType::CONNECT:
+            client_id_to_camera[record.client_id] = Camera();
+            client_id_to_mouse[record.client_id] = Mouse();
+            physics.create_character(record.client_id);
+            break;
+        case JournalRecordType::DISCONNECT:
+            physics.delete_character(record.client_id);
+            client_id_to_mouse.erase(record.client_id);
+            client_id_to_camera.erase(record.client_id);
+            break;
+        case JournalRecordType::INPUT:
+            physics.input_snapshot_queue.push(record.input_snapshot);
+            statistics.inputs_replayed++;
+            break;
+        }
+    }
+    if (tick_pending) {
+        run_pending_tick();
+    }
+    return statistics;
+}
@@ -0,0 +1,28 @@
+#ifndef JOURNAL_REPLAY_HPP
+#define JOURNAL_REPLAY_HPP
+
+#include "../interaction/multiplayer_physics/physics.hpp"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * \brief how long the ticks of a replay took
+ */
+struct ReplayStatistics {
+    uint64_t ticks_replayed = 0;
+    uint64_t inputs_replayed = 0;
+    double total_tick_time_ms = 0;
+    double slowest_tick_time_ms = 0;
+    uint64_t slowest_tick = 0;
+};
+
+/**
+ * \brief feeds every tick of a journal recorded by the server with -journal through the same PhysicsStep the server
+ * uses, back to back without any sleeping
+ * \param physics a world with the map the journal was recorded on and no characters in it yet
+ * \throws std::runtime_error if the journal can't be read, see InputJournalReader
+ */
+ReplayStatistics replay_journal(const std::string &journal_path, Physics &physics, float movement_acceleration);
+
+#endif // JOURNAL_REPLAY_HPP
@@ -0,0 +1,268 @@
+#include "enet.h"
+#include "compact_input_snapshot/compact_input_snapshot.hpp"
+#include "join_accept/join_accept.hpp"
+#include "time_sync/time_sync.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief connects a swarm of bots to a server and has them walk around like players would, to see how one server
+ * process holds up with hundreds of connections. it reports once a second how many bots are connected and admitted and
+ * how much the server is sending them.
+ *
+ * the bots are spread over several sockets: a server with several hosts sharing a port through SO_REUSEPORT spreads
+ * clients over its hosts by their address, so bots that shared a socket would all land on the same host. for a server
+ * started with -separate-ports, -ports n connects the sockets round robin to n consecutive ports instead.
+ *
+ * the bots never acknowledge their inputs, so every input goes out as a keyframe, a few bytes more than a real client.
+ */
+
+// the server's channels, the time sync is the last one
+constexpr size_t num_channels = time_sync::channel + 1;
+
+struct Bot {
+    ENetPeer *peer = nullptr;
+    bool connected = false;
+    bool admitted = false; // got its join accept, the server takes its inputs from now on
+    InputSnapshotEncoder input_snapshot_encoder;
+    InputState input;
+    int ticks_until_input_change = 0;
+};
+
+struct BotSocket {
+    ENetHost *host = nullptr;
+    std::vector<Bot> bots;
+};
+
+struct LoadStatistics {
+    std::atomic<uint64_t> connected_bots = 0;
+    std::atomic<uint64_t> admitted_bots = 0;
+    std::atomic<uint64_t> packets_received = 0;
+    std::atomic<uint64_t> bytes_received = 0;
+    std::atomic<uint64_t> packets_sent = 0;
+};
+
+void parse_command_line_arguments(int argc, char *argv[], std::string &server_address, unsigned int &port,
+                                  size_t &num_ports, size_t &num_bots, size_t &num_sockets, size_t &num_threads,
+                                  int &seconds) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-address" && i + 1 < argc) {
+            server_address = argv[++i];
+        } else if (arg == "-port" && i + 1 < argc) {
+            port = std::stoul(argv[++i]);
+        } else if (arg == "-ports" && i + 1 < argc) {
+            num_ports = std::stoul(argv[++i]);
+        } else if (arg == "-bots" && i + 1 < argc) {
+            num_bots = std::stoul(argv[++i]);
+        } else if (arg == "-sockets" && i + 1 < argc) {
+            num_sockets = std::stoul(argv[++i]);
+        } else if (arg == "-threads" && i + 1 < argc) {
+            num_threads = std::stoul(argv[++i]);
+        } else if (arg == "-seconds" && i + 1 < argc) {
+            seconds = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [-address <server ip>] [-port <n>] [-ports <n>] [-bots <n>] [-sockets <n>] [-threads <n>]"
+                      << " [-seconds <n>]" << std::endl;
+            exit(1);
+        }
+    }
+}
+
+/**
+ * \brief walks in a random direction for a random while, sometimes jumping, and slowly turns the camera
+ */
+void update_bot_input(Bot &bot, std::mt19937 &random) {
+    if (bot.ticks_until_input_change-- <= 0) {
+        std::uniform_int_distribution<int> keys(0, 31);
+        std::uniform_int_distribution<int> ticks(30, 180);
+        int pressed = keys(random);
+        bot.input.left_pressed = pressed & compact_input_snapshot::left_bit;
+        bot.input.right_pressed = pressed & compact_input_snapshot::right_bit;
+        bot.input.forward_pressed = pressed & compact_input_snapshot::forward_bit;
+        bot.input.backward_pressed = pressed & compact_input_snapshot::backward_bit;
+        bot.input.jump_pressed = pressed & compact_input_snapshot::jump_bit;
+        bot.ticks_until_input_change = ticks(random);
+    }
+    std::uniform_real_distribution<float> mouse_step(-2.0f, 2.0f);
+    bot.input.mouse_position_x += mouse_step(random);
+    bot.input.mouse_position_y += mouse_step(random);
+}
+
+void handle_bot_event(ENetEvent &event, LoadStatistics &statistics) {
+    Bot *bot = static_cast<Bot *>(event.peer->data);
+    switch (event.type) {
+    case ENET_EVENT_TYPE_CONNECT:
+        bot->connected = true;
+        statistics.connected_bots++;
+        break;
+
+    case ENET_EVENT_TYPE_RECEIVE:
+        statistics.packets_received++;
+        statistics.bytes_received += event.packet->dataLength;
+        if (event.channelID == join_accept::channel && !bot->admitted) {
+            bot->admitted = true;
+            statistics.admitted_bots++;
+        }
+        enet_packet_destroy(event.packet);
+        break;
+
+    case ENET_EVENT_TYPE_DISCONNECT:
+    case ENET_EVENT_TYPE_DISCONNECT_TIMEOUT:
+        if (bot->connected) {
+            statistics.connected_bots--;
+        }
+        if (bot->admitted) {
+            statistics.admitted_bots--;
+        }
+        bot->connected = false;
+        bot->admitted = false;
+        break;
+
+    case ENET_EVENT_TYPE_NONE:
+        break;
+    }
+}
+
+/**
+ * \brief runs the bots of some of the sockets at the tick rate
+ */
+void run_bots(std::vector<BotSocket *> sockets, int tick_rate_hz, const std::atomic<bool> &running,
+              LoadStatistics &statistics, unsigned int seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> encoded_input;
+    auto tick_period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / tick_rate_hz));
+    auto next_tick = std::chrono::steady_clock::now();
+
+    while (running) {
+        for (BotSocket *socket : sockets) {
+            ENetEvent event;
+            while (enet_host_service(socket->host, &event, 0) > 0) {
+                handle_bot_event(event, statistics);
+            }
+
+            for (Bot &bot : socket->bots) {
+                if (!bot.admitted) {
+                    continue;
+                }
+                update_bot_input(bot, random);
+                bot.input_snapshot_encoder.encode(bot.input, encoded_input);
+                ENetPacket *packet = enet_packet_create(encoded_input.data(), encoded_input.size(), 0);
+                if (enet_peer_send(bot.peer, 0, packet) < 0) {
+                    enet_packet_destroy(packet);
+                } else {
+                    statistics.packets_sent++;
+                }
+            }
+            enet_host_flush(socket->host);
+        }
+
+        next_tick += tick_period;
+        std::this_thread::sleep_until(next_tick);
+    }
+
+    for (BotSocket *socket : sockets) {
+        for (Bot &bot : socket->bots) {
+            enet_peer_disconnect_now(bot.peer, 0);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string server_address = "127.0.0.1";
+    unsigned int port = 7777;
+    size_t num_ports = 1;
+    size_t num_bots = 512;
+    size_t num_sockets = 64;
+    size_t num_threads = 4;
+    int seconds = 60;
+    parse_command_line_arguments(argc, argv, server_address, port, num_ports, num_bots, num_sockets, num_threads,
+                                 seconds);
+
+    const int tick_rate_hz = 60;
+    num_sockets = std::clamp<size_t>(num_sockets, 1, num_bots);
+    num_threads = std::clamp<size_t>(num_threads, 1, num_sockets);
+
+    if (enet_initialize() != 0) {
+        std::cerr << "couldn't initialize enet" << std::endl;
+        return 1;
+    }
+
+    // the bots are only added once every socket exists, so the vector doesn't move the bots that peers point to
+    std::vector<BotSocket> sockets(num_sockets);
+    for (size_t i = 0; i < num_sockets; i++) {
+        size_t bots_on_socket = num_bots / num_sockets + (i < num_bots % num_sockets ? 1 : 0);
+        sockets[i].host = enet_host_create(nullptr, bots_on_socket, num_channels, 0, 0);
+        if (sockets[i].host == nullptr) {
+            std::cerr << "couldn't create socket " << i << std::endl;
+            return 1;
+        }
+        sockets[i].bots.resize(bots_on_socket);
+
+        ENetAddress address = {0};
+        enet_address_set_host(&address, server_address.c_str());
+        address.port = port + i % num_ports;
+        for (Bot &bot : sockets[i].bots) {
+            bot.peer = enet_host_connect(sockets[i].host, &address, num_channels, 0);
+            if (bot.peer == nullptr) {
+                std::cerr << "couldn't start connecting a bot on socket " << i << std::endl;
+                return 1;
+            }
+            bot.peer->data = &bot;
+        }
+    }
+
+    LoadStatistics statistics;
+    std::atomic<bool> running = true;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+        std::vector<BotSocket *> sockets_of_thread;
+        for (size_t i = t; i < num_sockets; i += num_threads) {
+            sockets_of_thread.push_back(&sockets[i]);
+        }
+        threads.emplace_back(run_bots, sockets_of_thread, tick_rate_hz, std::cref(running), std::ref(statistics),
+                             static_cast<unsigned int>(t));
+    }
+
+    std::cout << fmt::format("{} bots on {} sockets to {}:{}{}, {} threads\n", num_bots, num_sockets, server_address,
+                             port, num_ports > 1 ? fmt::format("-{}", port + num_ports - 1) : "", num_threads);
+    std::cout << fmt::format("{:>8} {:>10} {:>10} {:>14} {:>14} {:>14}\n", "second", "connected", "admitted",
+                             "packets in/s", "kB in/s", "packets out/s");
+
+    uint64_t last_packets_received = 0, last_bytes_received = 0, last_packets_sent = 0;
+    for (int second = 1; second <= seconds; second++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t packets_received = statistics.packets_received, bytes_received = statistics.bytes_received,
+                 packets_sent = statistics.packets_sent;
+        std::cout << fmt::format("{:>8} {:>10} {:>10} {:>14} {:>14.1f} {:>14}\n", second,
+                                 statistics.connected_bots.load(), statistics.admitted_bots.load(),
+                                 packets_received - last_packets_received,
+                                 (bytes_received - last_bytes_received) / 1000.0, packets_sent - last_packets_sent);
+        last_packets_received = packets_received;
+        last_bytes_received = bytes_received;
+        last_packets_sent = packets_sent;
+    }
+
+    running = false;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    for (BotSocket &socket : sockets) {
+        enet_host_flush(socket.host);
+        enet_host_destroy(socket.host);
+    }
+    enet_deinitialize();
+    return 0;
+}
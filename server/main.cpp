@@ -1,12 +1,24 @@
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <memory>
+#include <iostream>
+#include <iterator>
 #include "server.hpp"
 #include "networked_input_snapshot/networked_input_snapshot.hpp"
-#include "rate_limited_loop/rate_limited_loop.hpp"
 #include "interaction/multiplayer_physics/physics.hpp"
 #include "interaction/camera/camera.hpp"
 #include "model_loading/model_loading.hpp"
 #include "math/conversions.hpp"
 #include "interaction/mouse/mouse.hpp"
+#include "physics_step/physics_step.hpp"
+#include "input_journal/input_journal.hpp"
+#include "tick_pipeline/tick_pipeline.hpp"
+#include "world_streaming/world_streaming.hpp"
+#include "work_stealing_thread_pool/work_stealing_thread_pool.hpp"
+#include "metrics/metrics.hpp"
+#include "allocation_tracker/allocation_tracker.hpp"
 
 #include "formatting/formatting.hpp"
 
@@ -21,87 +33,69 @@
 #include "spdlog/sinks/basic_file_sink.h"
 #include "thread_safe_queue.hpp"
 
-void update_player_camera_and_velocity(JPH::Ref<JPH::CharacterVirtual> &character, Camera &camera, Mouse &mouse,
-                                       NetworkedInputSnapshot &input_snapshot, float movement_acceleration,
-                                       double time_since_last_update, JPH::Vec3 gravity) {
-    auto [change_in_yaw_angle, change_in_pitch_angle] =
-        mouse.get_yaw_pitch_deltas(input_snapshot.mouse_position_x, input_snapshot.mouse_position_y);
-    camera.update_look_direction(change_in_yaw_angle, change_in_pitch_angle);
-
-    // printf("    updating character velocity with change in yaw: %f pitch: %f\n", change_in_yaw_angle,
-    //        change_in_pitch_angle);
-
-    JPH::Vec3 character_position = character->GetPosition();
-
-    // printf("character position: %f %f %f\n", character_position.GetX(), character_position.GetY(),
-    //        character_position.GetZ());
-
-    // in jolt y is z
-    glm::vec3 updated_velocity = convert_vec3_from_jolt_to_glm(character->GetLinearVelocity());
-
-    glm::vec3 input_vec =
-        camera.input_snapshot_to_input_direction(input_snapshot.forward_pressed, input_snapshot.backward_pressed,
-                                                 input_snapshot.right_pressed, input_snapshot.left_pressed);
-
-    updated_velocity += input_vec * movement_acceleration * (float)time_since_last_update;
-    glm::vec3 current_xz_velocity = glm::vec3(updated_velocity.x, 0.0f, updated_velocity.z);
-    glm::vec3 y_axis = glm::vec3(0, 1, 0);
-    float friction = 0.983f;
-    updated_velocity *= friction; // friction
-    if (character->GetGroundState() == JPH::CharacterVirtual::EGroundState::OnGround) {
-        updated_velocity.y = 0; // empty out vertical velocity while on ground
-        if (input_snapshot.jump_pressed) {
-            updated_velocity +=
-                (float)1200 * convert_vec3_from_jolt_to_glm(character->GetUp()) * (float)time_since_last_update;
+// set by SIGINT and SIGTERM, the tick loop stops after its tick so everything is torn down in order and the input
+// journal gets written out
+static std::atomic<bool> stop_requested = false;
+
+static void request_stop(int signal_number) {
+    stop_requested = true;
+    // a second one kills the server right away, in case it doesn't get to stop on its own
+    std::signal(signal_number, SIG_DFL);
+}
+
+static const MetricSnapshot *find_metric(const std::vector<MetricSnapshot> &snapshots, const std::string &name,
+                                         const std::string &labels = "") {
+    for (const MetricSnapshot &snapshot : snapshots) {
+        if (snapshot.name == name && snapshot.labels == labels) {
+            return &snapshot;
         }
     }
+    return nullptr;
+}
 
-    glm::vec3 glm_gravity = convert_vec3_from_jolt_to_glm(gravity);
-    // apply gravity
-    updated_velocity += glm_gravity * (float)time_since_last_update;
+static double metric_value(const std::vector<MetricSnapshot> &snapshots, const std::string &name,
+                           const std::string &labels = "") {
+    const MetricSnapshot *snapshot = find_metric(snapshots, name, labels);
+    return snapshot == nullptr ? 0 : snapshot->value;
+}
 
-    character->SetLinearVelocity(convert_vec3_from_glm_to_jolt(updated_velocity));
+// labels look like {graph="simulation",stage="ingest"}
+static std::string label_value(const std::string &labels, const std::string &label) {
+    std::string key = label + "=\"";
+    size_t start = labels.find(key);
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += key.size();
+    return labels.substr(start, labels.find('"', start) - start);
 }
 
-std::function<void(double)> physics_step_closure(
-    NetworkedInputSnapshot *input_snapshot, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
-    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
-    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
-    float movement_acceleration) {
-    return [input_snapshot, physics, &client_id_to_camera, &client_id_to_mouse, movement_acceleration,
-            &client_id_to_cihtems_of_last_server_processed_input_snapshot](double time_since_last_update) {
-        std::ostringstream input_snapshot_queue_application_stream;
-        while (!physics->input_snapshot_queue.empty()) {
-            // InputSnapshot popped_input_snapshot = physics->input_snapshot_queue.front();
-            NetworkedInputSnapshot popped_input_snapshot = physics->input_snapshot_queue.pop();
-            uint64_t client_id = popped_input_snapshot.client_id;
-            // printf("    draining queue and updating player %lu\n", client_id);
-            JPH::Ref<JPH::CharacterVirtual> &physics_character = physics->client_id_to_physics_character[client_id];
-            Camera &camera = client_id_to_camera[client_id];
-            Mouse &mouse = client_id_to_mouse[client_id];
-
-            update_player_camera_and_velocity(physics_character, camera, mouse, popped_input_snapshot,
-                                              movement_acceleration, time_since_last_update,
-                                              physics->physics_system.GetGravity());
-
-            client_id_to_cihtems_of_last_server_processed_input_snapshot[client_id] =
-                popped_input_snapshot.client_input_history_insertion_time_epoch_ms;
-
-            input_snapshot_queue_application_stream << popped_input_snapshot;
-            std::string struct_string = input_snapshot_queue_application_stream.str();
-
-            spdlog::info("just updated player velocity using IS: \n{}", popped_input_snapshot);
-
-            physics->update_specific_character(time_since_last_update, client_id);
+/**
+ * \brief turns a counter into a per second rate, averaged over at least a second so it doesn't flicker
+ */
+class CounterRate {
+  public:
+    double update(double counter_value) {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - last_update_time;
+        if (elapsed.count() >= 1.0) {
+            rate_per_second = (counter_value - last_counter_value) / elapsed.count();
+            last_counter_value = counter_value;
+            last_update_time = now;
         }
+        return rate_per_second;
+    }
 
-        // physics->update(time_since_last_update);
-
-        spdlog::info("physics tick with delta: {} game state: \n{}", time_since_last_update, *physics);
-    };
-}
+  private:
+    double last_counter_value = 0;
+    double rate_per_second = 0;
+    std::chrono::steady_clock::time_point last_update_time = std::chrono::steady_clock::now();
+};
 
-int start_terminal_interface(double *physics_rate_hz, double *game_state_send_rate_hz) {
+/**
+ * \brief shows the server's metrics live until the stop button is pressed
+ */
+int start_terminal_interface(const MetricsRegistry &metrics) {
     using namespace ftxui;
 
     // for each small menu on the stats page there is an option to open it in
@@ -128,27 +122,92 @@ int start_terminal_interface(double *physics_rate_hz, double *game_state_send_ra
 
     auto main_container = Container::Vertical({Container::Horizontal({tab_selection, exit_button})});
 
+    CounterRate tick_rate;
+    CounterRate game_state_send_rate;
+
     auto main_renderer = Renderer(main_container, [&] {
+        std::vector<MetricSnapshot> snapshots = metrics.snapshot();
+
+        Elements tick_elements;
+        tick_elements.push_back(text("server tick") | bold);
+        tick_elements.push_back(
+            text(fmt::format("rate {:.1f}Hz", tick_rate.update(metric_value(snapshots, "server_ticks_total")))));
+        if (const MetricSnapshot *tick_duration = find_metric(snapshots, "server_tick_duration_ms")) {
+            tick_elements.push_back(
+                text(fmt::format("duration mean {:.2f}ms p99 <{:.2f}ms", tick_duration->mean, tick_duration->p99)));
+        }
+        tick_elements.push_back(
+            text(fmt::format("input queue depth {}", metric_value(snapshots, "server_input_queue_depth"))));
+        tick_elements.push_back(separator());
+        tick_elements.push_back(text(fmt::format("{:<10} {:<18} {:>9} {:>9}", "graph", "stage", "mean ms", "p99 ms")));
+        for (const MetricSnapshot &snapshot : snapshots) {
+            if (snapshot.name == "server_stage_duration_ms") {
+                tick_elements.push_back(text(fmt::format("{:<10} {:<18} {:>9.3f} {:>9.3f}",
+                                                         label_value(snapshot.labels, "graph"),
+                                                         label_value(snapshot.labels, "stage"), snapshot.mean,
+                                                         snapshot.p99)));
+            }
+        }
+        tick_elements.push_back(separator());
+        tick_elements.push_back(text("network send") | bold);
+        tick_elements.push_back(text(fmt::format(
+            "game state send rate {:.1f}Hz",
+            game_state_send_rate.update(metric_value(snapshots, "server_game_states_sent_total")))));
+        tick_elements.push_back(
+            text(fmt::format("malformed packets {}", metric_value(snapshots, "server_malformed_packets_total"))));
+        tick_elements.push_back(separator());
+        tick_elements.push_back(text("input latency, reported by clients") | bold);
+        std::string room_labels = fmt::format("{{room=\"{}\",quantile=", room_name);
+        tick_elements.push_back(text(fmt::format(
+            "input to ack p50 {:.1f}ms p99 {:.1f}ms",
+            metric_value(snapshots, "room_input_to_ack_latency_ms", room_labels + "\"0.5\"}"),
+            metric_value(snapshots, "room_input_to_ack_latency_ms", room_labels + "\"0.99\"}"))));
+        tick_elements.push_back(text(fmt::format(
+            "ack to render p50 {:.1f}ms p99 {:.1f}ms",
+            metric_value(snapshots, "room_ack_to_render_latency_ms", room_labels + "\"0.5\"}"),
+            metric_value(snapshots, "room_ack_to_render_latency_ms", room_labels + "\"0.99\"}"))));
+
+        Elements client_elements;
+        client_elements.push_back(text(fmt::format("connected players ({})",
+                                                   metric_value(snapshots, "server_connected_clients"))) |
+                                  bold);
+        client_elements.push_back(text(fmt::format("{:>6} {:>8} {:>6} {:>4} {:>10} {:>10} {:>8} {:>11} {:>13}",
+                                                   "client", "rtt ms", "loss", "tier", "sent kB", "recv kB",
+                                                   "dropped", "corrections", "ack p99 ms")));
+        for (const MetricSnapshot &snapshot : snapshots) {
+            if (snapshot.name != "client_round_trip_time_ms") {
+                continue;
+            }
+            const std::string &labels = snapshot.labels;
+            std::string p99_labels = labels.substr(0, labels.size() - 1) + ",quantile=\"0.99\"}";
+            client_elements.push_back(text(fmt::format(
+                "{:>6} {:>8.1f} {:>6.3f} {:>4} {:>10.1f} {:>10.1f} {:>8} {:>11} {:>13.1f}",
+                label_value(labels, "client"), snapshot.value,
+                metric_value(snapshots, "client_packet_loss_fraction", labels),
+                metric_value(snapshots, "client_send_tier", labels),
+                metric_value(snapshots, "client_sent_bytes_total", labels) / 1000,
+                metric_value(snapshots, "client_received_bytes_total", labels) / 1000,
+                metric_value(snapshots, "client_dropped_inputs_total", labels),
+                metric_value(snapshots, "client_reconcile_corrections_total", labels),
+                metric_value(snapshots, "client_input_to_ack_latency_ms", p99_labels))));
+        }
+
         return vbox({
             text("frag-z server") | bold | hcenter,
             hbox({tab_selection->Render() | flex, exit_button->Render()}),
             hbox({
-                vbox({
-                    text("physics loop thread"),
-                    text("rate " + std::to_string(*physics_rate_hz) + "Hz") | flex,
-                    separator(),
-                    text("network send"),
-                    text("game state send rate " + std::to_string(*physics_rate_hz) + "Hz") | flex,
-                }),
+                vbox(std::move(tick_elements)),
+                separator(),
+                vbox(std::move(client_elements)) | flex,
                 separator(),
                 vbox({
                     center(text("game events log")) | flex,
                     separator(),
                     center(text("log level selection menu")),
                     text("-> current map"),
-                }) | flex,
-                separator(),
-                vbox({text("connected players") | flex, separator(), text("map rotation") | flex}),
+                    separator(),
+                    text("map rotation") | flex,
+                }),
             }) | border |
                 flex,
         });
@@ -157,6 +216,9 @@ int start_terminal_interface(double *physics_rate_hz, double *game_state_send_ra
     std::atomic<bool> refresh_ui_continue = true;
     std::thread refresh_ui([&] {
         while (refresh_ui_continue) {
+            if (stop_requested) {
+                screen.Exit();
+            }
             using namespace std::chrono_literals;
             std::this_thread::sleep_for(0.05s); // 20Hz, doesn't have to be fast.
             // After updating the state, request a new frame to be drawn. This is done
@@ -172,6 +234,24 @@ int start_terminal_interface(double *physics_rate_hz, double *game_state_send_ra
     return EXIT_SUCCESS;
 }
 
+/**
+ * \brief runs the tick loop on this thread, or with use_tui on its own thread while the terminal interface runs on this
+ * one, closing the interface stops the loop
+ * \return non-zero if the allocation check failed
+ */
+int run_tick_loop(const std::function<void()> &tick_loop, std::atomic<bool> &running, bool use_tui,
+                  const MetricsRegistry &metrics, const TickAllocationMonitor &allocation_monitor) {
+    if (!use_tui) {
+        tick_loop();
+        return allocation_monitor.exit_code();
+    }
+    std::thread tick_loop_thread(tick_loop);
+    int exit_code = start_terminal_interface(metrics);
+    running = false;
+    tick_loop_thread.join();
+    return exit_code != EXIT_SUCCESS ? exit_code : allocation_monitor.exit_code();
+}
+
 void create_logger_system() {
 
     auto file_sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>("logs.txt", true);
@@ -203,9 +283,25 @@ void create_logger_system() {
     spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%F] [%l] %v");
 }
 
-int start_multithreaded_setup() {
-
-    ServerNetwork server_network;
+/**
+ * \param input_journal if non-null, every tick, connect, disconnect and consumed input gets recorded into it
+ * \param metrics_path the server's metrics are written here as prometheus text every second
+ * \param stream_world if true only the chunks of the map near a player are kept in the physics world
+ * \param host_settings how many enet hosts serve the clients and where
+ * \param snapshot_byte_budget the most a client is sent per game state
+ * \param allocation_tracking_settings whether the ticks' allocations are counted or checked, see TickAllocationMonitor
+ */
+int start_linear_setup(InputJournal *input_journal, const std::string &metrics_path, bool use_tui,
+                       const std::string &map_path, bool stream_world, const NetworkHostSettings &host_settings,
+                       size_t snapshot_byte_budget, const AllocationTrackingSettings &allocation_tracking_settings) {
+
+    ServerNetwork server_network(host_settings);
+    server_network.input_journal = input_journal;
+    server_network.snapshot_byte_budget = snapshot_byte_budget;
+    MetricsFileExporter metrics_exporter(server_network.metrics, metrics_path, std::chrono::seconds(1));
+    std::shared_ptr<Histogram> tick_duration_ms =
+        server_network.metrics.histogram("server_tick_duration_ms", "time to simulate a tick, without sending it");
+    std::shared_ptr<Counter> ticks = server_network.metrics.counter("server_ticks_total", "ticks simulated");
     NetworkedInputSnapshot input_snapshot;
     std::unordered_map<uint64_t, Camera> client_id_to_camera;
     std::unordered_map<uint64_t, Mouse> client_id_to_mouse;
@@ -215,143 +311,314 @@ int start_multithreaded_setup() {
     const int network_send_rate_hz = 60;
 
     Physics physics;
-    Model map("../assets/maps/ground_test.obj");
-    physics.load_model_into_physics_world(&map);
+    physics.warm_character_pool(server_network.get_max_clients());
+    // jolt's allocator is only registered by the physics
+    TickAllocationMonitor allocation_monitor(allocation_tracking_settings);
+    if (allocation_tracker::is_enabled()) {
+        allocation_tracker::install_jolt_hooks();
+    }
+    Model map(map_path);
+    std::unique_ptr<WorldStreaming> world_streaming;
+    if (stream_world) {
+        world_streaming = std::make_unique<WorldStreaming>(physics, map, server_network.metrics);
+    } else {
+        physics.load_model_into_physics_world(&map);
+    }
+
+    std::function<void(double)> physics_step = physics_step_closure(
+        &input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
+        client_id_to_cihtems_of_last_server_processed_input_snapshot, movement_acceleration, input_journal);
 
-    RateLimitedLoop physics_loop;
-    std::function<void(double)> physics_step =
-        physics_step_closure(&input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
-                             client_id_to_cihtems_of_last_server_processed_input_snapshot, movement_acceleration);
     std::function<bool()> termination_condition = []() { return false; };
-    std::function<void()> start_loop = [&]() {
-        physics_loop.start(physics_rate_hz, physics_step, termination_condition);
-    };
-    std::thread physics_thread(start_loop);
-    physics_thread.detach();
 
-    RateLimitedLoop network_loop;
     std::function<void(double)> network_step = server_network.network_step_closure(
         network_send_rate_hz, &input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
         client_id_to_cihtems_of_last_server_processed_input_snapshot, physics.input_snapshot_queue);
 
-    std::function start_network_loop = [&]() {
-        network_loop.start(network_send_rate_hz, network_step, termination_condition);
+    const uint32_t target_frame_duration_ms = 1000 / 60; // Target frame duration in milliseconds (16.67 ms)
+    auto previous_frame_time = std::chrono::high_resolution_clock::now();
+
+    uint64_t tick = 0;
+    std::atomic<bool> running = true;
+
+    auto tick_loop = [&]() {
+        allocation_tracker::set_thread_name("tick");
+        while (running && !stop_requested) {
+            auto current_frame_time = std::chrono::high_resolution_clock::now();
+            // only put together when it's logged, and on the stack unless it outgrows the buffer
+            bool log_tick = spdlog::should_log(spdlog::level::info);
+            fmt::memory_buffer server_tick_message;
+            if (log_tick) {
+                fmt::format_to(std::back_inserter(server_tick_message), "started server tick at {}\n",
+                               current_frame_time.time_since_epoch().count());
+            }
+
+            std::chrono::duration<double> delta_time = current_frame_time - previous_frame_time;
+            double delta_time_seconds = delta_time.count(); // Delta time in seconds
+            previous_frame_time = current_frame_time;
+
+            if (input_journal != nullptr) {
+                input_journal->record_tick_start(tick, delta_time_seconds);
+            }
+            server_network.mark_tick_start(tick);
+            tick++;
+
+            // collect new input snapshots
+            network_step(delta_time_seconds);
+
+            // Update physics with delta time in seconds
+            physics_step(delta_time_seconds);
+            if (world_streaming != nullptr) {
+                world_streaming->update();
+            }
+            tick_duration_ms->observe(std::chrono::duration<double, std::milli>(
+                                          std::chrono::high_resolution_clock::now() - current_frame_time)
+                                          .count());
+            ticks->add();
+
+            // send out the new changes
+            server_network.send_game_state(&physics, client_id_to_camera,
+                                           client_id_to_cihtems_of_last_server_processed_input_snapshot);
+
+            // Calculate elapsed time after physics
+            auto after_update_and_render_time = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> elapsed_update_time =
+                after_update_and_render_time - current_frame_time;
+
+            if (log_tick) {
+                fmt::format_to(std::back_inserter(server_tick_message), "spent {} milliseconds on physics tick\n",
+                               elapsed_update_time.count());
+            }
+
+            // // Calculate remaining time for network events processing
+            // uint32_t remaining_time_for_network = target_frame_duration_ms;
+            // if (elapsed_update_time.count() < target_frame_duration_ms) {
+            //     remaining_time_for_network -= static_cast<uint32_t>(elapsed_update_time.count());
+            // } else {
+            //     // our physics step took incredibly long, this is bad...
+            // }
+
+            // Send network events with remaining time in milliseconds
+            // network_step(remaining_time_for_network);
+
+            // auto after_network_step = std::chrono::high_resolution_clock::now();
+            // std::chrono::duration<double, std::milli> elapsed_network_time =
+            //     after_network_step - after_update_and_render_time;
+
+            // server_tick_message += fmt::format("spent {} ms on network tick, budget was {} ms\n",
+            //                                    elapsed_network_time.count(), remaining_time_for_network);
+
+            // Calculate total elapsed time for the frame
+            auto frame_end_time = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> elapsed_frame_time = frame_end_time - current_frame_time;
+
+            // Calculate sleep time to maintain 60 Hz frequency
+            auto sleep_duration = std::chrono::milliseconds(target_frame_duration_ms) - elapsed_frame_time;
+            bool sleeping = sleep_duration > std::chrono::milliseconds(0);
+            if (log_tick) {
+                fmt::format_to(std::back_inserter(server_tick_message),
+                               "remaining frame time after physics and network is {} {}", sleep_duration.count(),
+                               sleeping ? "since non-negative time remaining, sleeping\n"
+                                        : "since negative time remaining we've gone over budget, not sleeping\n");
+            }
+            if (sleeping) {
+                std::this_thread::sleep_for(sleep_duration);
+            }
+            if (log_tick) {
+                auto end_time = std::chrono::high_resolution_clock::now();
+                fmt::format_to(std::back_inserter(server_tick_message), "woke up, end of server tick at {}",
+                               end_time.time_since_epoch().count());
+                spdlog::info(fmt::string_view(server_tick_message.data(), server_tick_message.size()));
+            }
+
+            if (!allocation_monitor.end_tick(tick)) {
+                running = false;
+            }
+        }
     };
 
-    // auto start_network_loop = [&]() {
-    //     server_network.start_network_loop(
-    //         network_send_rate_hz, &input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
-    //         client_id_to_cihtems_of_last_server_processed_input_snapshot, physics.input_snapshot_queue);
-    // };
-
-    bool using_tui = false;
-    double temp_network_freq = -1.0;
-    std::thread server_receive_loop_thread(start_network_loop);
-    if (using_tui) {
-        server_receive_loop_thread.detach();
-        return start_terminal_interface(&physics_loop.stopwatch.average_frequency, &temp_network_freq);
-    } else {
-        server_receive_loop_thread.join();
-    }
-    return 0;
+    return run_tick_loop(tick_loop, running, use_tui, server_network.metrics, allocation_monitor);
 }
 
-int start_linear_setup() {
-
-    ServerNetwork server_network;
+/**
+ * \brief the same tick as the linear setup, but run as task graphs on a work stealing pool so that characters are
+ * stepped in parallel and the game state of one tick is encoded and sent while the next one is simulated, see
+ * TickPipeline. both go through the same PhysicsStep, so a journal of either replays the same.
+ *
+ * \param input_journal if non-null, every tick, connect, disconnect and consumed input gets recorded into it
+ * \param metrics_path the server's metrics are written here as prometheus text every second
+ * \param stream_world if true only the chunks of the map near a player are kept in the physics world
+ * \param host_settings how many enet hosts serve the clients and where
+ * \param snapshot_byte_budget the most a client is sent per game state
+ * \param allocation_tracking_settings whether the ticks' allocations are counted or checked, see TickAllocationMonitor
+ */
+int start_task_graph_setup(InputJournal *input_journal, const std::string &metrics_path, bool use_tui,
+                           const std::string &map_path, bool stream_world, const NetworkHostSettings &host_settings,
+                           size_t snapshot_byte_budget,
+                           const AllocationTrackingSettings &allocation_tracking_settings) {
+
+    ServerNetwork server_network(host_settings);
+    server_network.input_journal = input_journal;
+    server_network.snapshot_byte_budget = snapshot_byte_budget;
+    MetricsFileExporter metrics_exporter(server_network.metrics, metrics_path, std::chrono::seconds(1));
     NetworkedInputSnapshot input_snapshot;
     std::unordered_map<uint64_t, Camera> client_id_to_camera;
     std::unordered_map<uint64_t, Mouse> client_id_to_mouse;
     std::unordered_map<uint64_t, uint64_t> client_id_to_cihtems_of_last_server_processed_input_snapshot;
     const float movement_acceleration = 15.0f;
-    const int physics_rate_hz = 60;
     const int network_send_rate_hz = 60;
 
     Physics physics;
-    Model map("../assets/maps/ground_test.obj");
-    physics.load_model_into_physics_world(&map);
-
-    std::function<void(double)> physics_step =
-        physics_step_closure(&input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
-                             client_id_to_cihtems_of_last_server_processed_input_snapshot, movement_acceleration);
-
-    std::function<bool()> termination_condition = []() { return false; };
+    physics.warm_character_pool(server_network.get_max_clients());
+    // jolt's allocator is only registered by the physics
+    TickAllocationMonitor allocation_monitor(allocation_tracking_settings);
+    if (allocation_tracker::is_enabled()) {
+        allocation_tracker::install_jolt_hooks();
+    }
+    Model map(map_path);
+    std::unique_ptr<WorldStreaming> world_streaming;
+    if (stream_world) {
+        world_streaming = std::make_unique<WorldStreaming>(physics, map, server_network.metrics);
+    } else {
+        physics.load_model_into_physics_world(&map);
+    }
 
     std::function<void(double)> network_step = server_network.network_step_closure(
         network_send_rate_hz, &input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
         client_id_to_cihtems_of_last_server_processed_input_snapshot, physics.input_snapshot_queue);
 
+    // the main thread only waits on the graphs, so it doesn't get a core
+    size_t num_workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    WorkStealingThreadPool pool(num_workers);
+    TickPipeline tick_pipeline(pool, server_network, physics, client_id_to_camera, client_id_to_mouse,
+                               client_id_to_cihtems_of_last_server_processed_input_snapshot, network_step,
+                               movement_acceleration, input_journal, world_streaming.get());
+
     const uint32_t target_frame_duration_ms = 1000 / 60; // Target frame duration in milliseconds (16.67 ms)
     auto previous_frame_time = std::chrono::high_resolution_clock::now();
+    uint64_t tick = 0;
+    std::atomic<bool> running = true;
+
+    auto tick_loop = [&]() {
+        allocation_tracker::set_thread_name("tick");
+        while (running && !stop_requested) {
+            auto current_frame_time = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> delta_time = current_frame_time - previous_frame_time;
+            double delta_time_seconds = delta_time.count(); // Delta time in seconds
+            previous_frame_time = current_frame_time;
+
+            server_network.mark_tick_start(tick);
+            tick_pipeline.run_tick(tick, delta_time_seconds);
+            tick++;
+
+            // the game state of this tick may still be going out while we sleep, that's the point
+            auto frame_end_time = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> elapsed_frame_time = frame_end_time - current_frame_time;
+            auto sleep_duration = std::chrono::milliseconds(target_frame_duration_ms) - elapsed_frame_time;
+            if (sleep_duration > std::chrono::milliseconds(0)) {
+                std::this_thread::sleep_for(sleep_duration);
+            } else {
+                spdlog::warn("tick {} went over budget, the simulation took {} ms", tick, elapsed_frame_time.count());
+            }
+
+            if (!allocation_monitor.end_tick(tick)) {
+                running = false;
+            }
+        }
+    };
 
-    std::string server_tick_message;
-
-    while (true) {
-        auto current_frame_time = std::chrono::high_resolution_clock::now();
-        server_tick_message = fmt::format("started server tick at {}\n", current_frame_time.time_since_epoch().count());
-
-        std::chrono::duration<double> delta_time = current_frame_time - previous_frame_time;
-        double delta_time_seconds = delta_time.count(); // Delta time in seconds
-        previous_frame_time = current_frame_time;
-
-        // collect new input snapshots
-        network_step(delta_time_seconds);
-
-        // Update physics with delta time in seconds
-        physics_step(delta_time_seconds);
-
-        // send out the new changes
-        server_network.send_game_state(&physics, client_id_to_camera,
-                                       client_id_to_cihtems_of_last_server_processed_input_snapshot);
-
-        // Calculate elapsed time after physics
-        auto after_update_and_render_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> elapsed_update_time =
-            after_update_and_render_time - current_frame_time;
-
-        server_tick_message += fmt::format("spent {} milliseconds on physics tick\n", elapsed_update_time.count());
-
-        // // Calculate remaining time for network events processing
-        // uint32_t remaining_time_for_network = target_frame_duration_ms;
-        // if (elapsed_update_time.count() < target_frame_duration_ms) {
-        //     remaining_time_for_network -= static_cast<uint32_t>(elapsed_update_time.count());
-        // } else {
-        //     // our physics step took incredibly long, this is bad...
-        // }
-
-        // Send network events with remaining time in milliseconds
-        // network_step(remaining_time_for_network);
-
-        // auto after_network_step = std::chrono::high_resolution_clock::now();
-        // std::chrono::duration<double, std::milli> elapsed_network_time =
-        //     after_network_step - after_update_and_render_time;
-
-        // server_tick_message += fmt::format("spent {} ms on network tick, budget was {} ms\n",
-        //                                    elapsed_network_time.count(), remaining_time_for_network);
-
-        // Calculate total elapsed time for the frame
-        auto frame_end_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> elapsed_frame_time = frame_end_time - current_frame_time;
+    return run_tick_loop(tick_loop, running, use_tui, server_network.metrics, allocation_monitor);
+}
 
-        // Calculate sleep time to maintain 60 Hz frequency
-        auto sleep_duration = std::chrono::milliseconds(target_frame_duration_ms) - elapsed_frame_time;
-        server_tick_message +=
-            fmt::format("remaining frame time after physics and network is {} ", sleep_duration.count());
-        if (sleep_duration > std::chrono::milliseconds(0)) {
-            server_tick_message += "since non-negative time remaining, sleeping\n";
-            std::this_thread::sleep_for(sleep_duration);
+void parse_command_line_arguments(int argc, char *argv[], std::string &journal_path, std::string &metrics_path,
+                                  bool &use_linear_setup, bool &use_tui, std::string &map_path, bool &stream_world,
+                                  NetworkHostSettings &host_settings, size_t &snapshot_byte_budget,
+                                  AllocationTrackingSettings &allocation_tracking_settings) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-journal" && i + 1 < argc) {
+            journal_path = argv[++i];
+        } else if (arg == "-metrics" && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (arg == "-linear") {
+            use_linear_setup = true;
+        } else if (arg == "-tui") {
+            use_tui = true;
+        } else if (arg == "-map" && i + 1 < argc) {
+            map_path = argv[++i];
+        } else if (arg == "-stream-world") {
+            stream_world = true;
+        } else if (arg == "-hosts" && i + 1 < argc) {
+            host_settings.num_hosts = std::stoul(argv[++i]);
+        } else if (arg == "-peers-per-host" && i + 1 < argc) {
+            host_settings.peers_per_host = std::stoul(argv[++i]);
+        } else if (arg == "-port" && i + 1 < argc) {
+            host_settings.port = std::stoul(argv[++i]);
+        } else if (arg == "-separate-ports") {
+            host_settings.reuse_port = false;
+        } else if (arg == "-snapshot-bytes" && i + 1 < argc) {
+            snapshot_byte_budget = std::stoul(argv[++i]);
+        } else if (arg == "-count-allocations") {
+            allocation_tracking_settings.count = true;
+        } else if (arg == "-check-allocations" && i + 1 < argc) {
+            allocation_tracking_settings.check = true;
+            allocation_tracking_settings.check_ticks = std::stoull(argv[++i]);
+        } else if (arg == "-allocation-warm-up" && i + 1 < argc) {
+            allocation_tracking_settings.warm_up_ticks = std::stoull(argv[++i]);
         } else {
-            server_tick_message += "since negative time remaining we've gone over budget, not sleeping\n";
+            std::cerr << "Usage: " << argv[0]
+                      << " [-journal <path to record inputs into>] [-metrics <path to write metrics to>]"
+                      << " [-linear] [-tui] [-map <path to obj>] [-stream-world]"
+                      << " [-hosts <n>] [-peers-per-host <n>] [-port <n>] [-separate-ports]"
+                      << " [-snapshot-bytes <most bytes per game state and client>]"
+                      << " [-count-allocations] [-check-allocations <ticks>] [-allocation-warm-up <ticks>]"
+                      << std::endl;
+            exit(1);
         }
-        auto end_time = std::chrono::high_resolution_clock::now();
-        server_tick_message += fmt::format("woke up, end of server tick at {}", end_time.time_since_epoch().count());
-        spdlog::info(server_tick_message);
     }
-
-    return 0;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    std::string journal_path;
+    std::string metrics_path = "metrics.prom";
+    bool use_linear_setup = false; // runs every stage of a tick one after the other on the main thread
+    bool use_tui = false;
+    std::string map_path = "../assets/maps/ground_test.obj";
+    // only the chunks of the map near a player are in the physics world, see WorldStreaming
+    bool stream_world = false;
+    // more hosts spread the packet io over more threads, each host can take up to 4095 peers
+    NetworkHostSettings host_settings;
+    // bounds the bandwidth every client takes, the characters that don't fit wait their turn by priority
+    size_t snapshot_byte_budget = ServerNetwork::default_snapshot_byte_budget;
+    // counts what every tick allocates and where, or fails once a tick after the warm up allocates at all
+    AllocationTrackingSettings allocation_tracking_settings;
+    parse_command_line_arguments(argc, argv, journal_path, metrics_path, use_linear_setup, use_tui, map_path,
+                                 stream_world, host_settings, snapshot_byte_budget, allocation_tracking_settings);
+
     create_logger_system();
-    start_linear_setup();
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    if (allocation_tracking_settings.check) {
+        // every log line allocates, the check is about what the ticks do otherwise
+        spdlog::set_level(spdlog::level::warn);
+    }
+
+    std::unique_ptr<InputJournal> input_journal;
+    if (!journal_path.empty()) {
+        input_journal = std::make_unique<InputJournal>(journal_path);
+        spdlog::info("recording inputs into journal {}", journal_path);
+    }
+
+    int exit_code;
+    if (use_linear_setup) {
+        exit_code = start_linear_setup(input_journal.get(), metrics_path, use_tui, map_path, stream_world,
+                                       host_settings, snapshot_byte_budget, allocation_tracking_settings);
+    } else {
+        exit_code = start_task_graph_setup(input_journal.get(), metrics_path, use_tui, map_path, stream_world,
+                                           host_settings, snapshot_byte_budget, allocation_tracking_settings);
+    }
+    if (allocation_tracking_settings.check) {
+        std::cerr << "allocation check " << (exit_code == 0 ? "passed" : "failed") << ", see logs.txt" << std::endl;
+    }
+    return exit_code;
 }
@@ -0,0 +1,236 @@
+#include "metrics.hpp"
+#include "allocation_tracker/allocation_tracker.hpp"
+#include "spdlog/fmt/fmt.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+
+// atomic<double> has no fetch_add before c++20, a compare exchange loop is still lock free
+static void atomic_add(std::atomic<double> &target, double amount) {
+    double current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + amount, std::memory_order_relaxed)) {
+    }
+}
+
+void Gauge::add(double amount) { atomic_add(value, amount); }
+
+Histogram::Histogram(double first_bucket_upper_bound, size_t num_buckets)
+    : first_bucket_upper_bound(first_bucket_upper_bound), num_buckets(num_buckets),
+      bucket_counts(new std::atomic<uint64_t>[num_buckets + 1]) {
+    for (size_t i = 0; i <= num_buckets; i++) {
+        bucket_counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double value, uint64_t times) {
+    size_t bucket = 0;
+    if (value > first_bucket_upper_bound) {
+        // the bucket is the smallest i with value <= first * 2^i, that's ceil(log2(value / first))
+        int exponent;
+        double mantissa = std::frexp(value / first_bucket_upper_bound, &exponent);
+        bucket = mantissa == 0.5 ? exponent - 1 : exponent;
+        bucket = std::min(bucket, num_buckets);
+    }
+    bucket_counts[bucket].fetch_add(times, std::memory_order_relaxed);
+    count.fetch_add(times, std::memory_order_relaxed);
+    atomic_add(sum, value * times);
+}
+
+double Histogram::get_bucket_upper_bound(size_t bucket) const {
+    if (bucket >= num_buckets) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return std::ldexp(first_bucket_upper_bound, static_cast<int>(bucket));
+}
+
+uint64_t Histogram::get_bucket_count(size_t bucket) const {
+    return bucket_counts[bucket].load(std::memory_order_relaxed);
+}
+
+double Histogram::estimate_quantile(double quantile) const {
+    uint64_t total = get_count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(quantile * total));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+        seen += get_bucket_count(bucket);
+        if (seen >= rank) {
+            return get_bucket_upper_bound(bucket);
+        }
+    }
+    return get_bucket_upper_bound(num_buckets - 1);
+}
+
+static std::string format_labels(const MetricLabels &labels) {
+    if (labels.empty()) {
+        return "";
+    }
+    std::string formatted = "{";
+    for (size_t i = 0; i < labels.size(); i++) {
+        formatted += fmt::format("{}{}=\"{}\"", i == 0 ? "" : ",", labels[i].first, labels[i].second);
+    }
+    return formatted + "}";
+}
+
+std::shared_ptr<Metric> MetricsRegistry::find_or_create(const std::string &name, const std::string &help,
+                                                        MetricType type, const MetricLabels &labels,
+                                                        const std::function<std::shared_ptr<Metric>()> &create) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    MetricFamily &family = name_to_family[name];
+    if (family.labels_to_metric.empty()) {
+        family.help = help;
+        family.type = type;
+    }
+    std::shared_ptr<Metric> &metric = family.labels_to_metric[format_labels(labels)];
+    if (metric == nullptr) {
+        metric = create();
+    }
+    return metric;
+}
+
+std::shared_ptr<Counter> MetricsRegistry::counter(const std::string &name, const std::string &help,
+                                                  const MetricLabels &labels) {
+    return std::static_pointer_cast<Counter>(find_or_create(name, help, MetricType::COUNTER, labels,
+                                                            []() { return std::make_shared<Counter>(); }));
+}
+
+std::shared_ptr<Gauge> MetricsRegistry::gauge(const std::string &name, const std::string &help,
+                                              const MetricLabels &labels) {
+    return std::static_pointer_cast<Gauge>(
+        find_or_create(name, help, MetricType::GAUGE, labels, []() { return std::make_shared<Gauge>(); }));
+}
+
+std::shared_ptr<Histogram> MetricsRegistry::histogram(const std::string &name, const std::string &help,
+                                                      const MetricLabels &labels, double first_bucket_upper_bound,
+                                                      size_t num_buckets) {
+    return std::static_pointer_cast<Histogram>(
+        find_or_create(name, help, MetricType::HISTOGRAM, labels, [first_bucket_upper_bound, num_buckets]() {
+            return std::make_shared<Histogram>(first_bucket_upper_bound, num_buckets);
+        }));
+}
+
+void MetricsRegistry::remove_metrics_with_label(const std::string &label, const std::string &value) {
+    std::string label_text = fmt::format("{}=\"{}\"", label, value);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto &name_and_family : name_to_family) {
+        auto &labels_to_metric = name_and_family.second.labels_to_metric;
+        for (auto it = labels_to_metric.begin(); it != labels_to_metric.end();) {
+            bool has_label = it->first.find("{" + label_text) != std::string::npos ||
+                             it->first.find("," + label_text) != std::string::npos;
+            it = has_label ? labels_to_metric.erase(it) : std::next(it);
+        }
+    }
+}
+
+// prometheus wants the le label merged in with the others
+static std::string labels_with_bucket(const std::string &labels, const std::string &upper_bound) {
+    if (labels.empty()) {
+        return fmt::format("{{le=\"{}\"}}", upper_bound);
+    }
+    return fmt::format("{},le=\"{}\"}}", labels.substr(0, labels.size() - 1), upper_bound);
+}
+
+std::string MetricsRegistry::to_prometheus_text() const {
+    std::string text;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const auto &[name, family] : name_to_family) {
+        if (family.labels_to_metric.empty()) {
+            continue;
+        }
+        const char *type_name = family.type == MetricType::COUNTER ? "counter"
+                                : family.type == MetricType::GAUGE ? "gauge"
+                                                                   : "histogram";
+        text += fmt::format("# HELP {} {}\n# TYPE {} {}\n", name, family.help, name, type_name);
+
+        for (const auto &[labels, metric] : family.labels_to_metric) {
+            switch (family.type) {
+            case MetricType::COUNTER:
+                text += fmt::format("{}{} {}\n", name, labels, static_cast<const Counter &>(*metric).get());
+                break;
+            case MetricType::GAUGE:
+                text += fmt::format("{}{} {}\n", name, labels, static_cast<const Gauge &>(*metric).get());
+                break;
+            case MetricType::HISTOGRAM: {
+                const Histogram &histogram = static_cast<const Histogram &>(*metric);
+                uint64_t cumulative_count = 0;
+                for (size_t bucket = 0; bucket < histogram.get_num_buckets(); bucket++) {
+                    cumulative_count += histogram.get_bucket_count(bucket);
+                    text += fmt::format(
+                        "{}_bucket{} {}\n", name,
+                        labels_with_bucket(labels, fmt::format("{}", histogram.get_bucket_upper_bound(bucket))),
+                        cumulative_count);
+                }
+                cumulative_count += histogram.get_bucket_count(histogram.get_num_buckets());
+                text += fmt::format("{}_bucket{} {}\n", name, labels_with_bucket(labels, "+Inf"), cumulative_count);
+                text += fmt::format("{}_sum{} {}\n", name, labels, histogram.get_sum());
+                text += fmt::format("{}_count{} {}\n", name, labels, histogram.get_count());
+            } break;
+            }
+        }
+    }
+    return text;
+}
+
+std::vector<MetricSnapshot> MetricsRegistry::snapshot() const {
+    std::vector<MetricSnapshot> snapshots;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const auto &[name, family] : name_to_family) {
+        for (const auto &[labels, metric] : family.labels_to_metric) {
+            MetricSnapshot snapshot = {name, labels, family.type, 0, 0, 0, 0};
+            switch (family.type) {
+            case MetricType::COUNTER:
+                snapshot.value = static_cast<double>(static_cast<const Counter &>(*metric).get());
+                break;
+            case MetricType::GAUGE:
+                snapshot.value = static_cast<const Gauge &>(*metric).get();
+                break;
+            case MetricType::HISTOGRAM: {
+                const Histogram &histogram = static_cast<const Histogram &>(*metric);
+                snapshot.value = static_cast<double>(histogram.get_count());
+                snapshot.mean = histogram.get_count() == 0 ? 0 : histogram.get_sum() / histogram.get_count();
+                snapshot.p50 = histogram.estimate_quantile(0.5);
+                snapshot.p99 = histogram.estimate_quantile(0.99);
+            } break;
+            }
+            snapshots.push_back(snapshot);
+        }
+    }
+    return snapshots;
+}
+
+MetricsFileExporter::MetricsFileExporter(const MetricsRegistry &registry, std::string path,
+                                         std::chrono::milliseconds period)
+    : registry(registry), path(std::move(path)), period(period), exporter_thread([this]() { export_loop(); }) {}
+
+MetricsFileExporter::~MetricsFileExporter() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex);
+        stopping = true;
+    }
+    stop_requested.notify_all();
+    exporter_thread.join();
+}
+
+void MetricsFileExporter::export_loop() {
+    // writing the text out allocates, but it's once a second on its own thread and not part of any tick
+    allocation_tracker::PauseScope pause;
+    std::unique_lock<std::mutex> lock(stop_mutex);
+    while (!stop_requested.wait_for(lock, period, [this]() { return stopping; })) {
+        write_file();
+    }
+    write_file(); // whatever happened since the last write
+}
+
+void MetricsFileExporter::write_file() {
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::trunc);
+        file << registry.to_prometheus_text();
+    }
+    std::rename(temporary_path.c_str(), path.c_str());
+}
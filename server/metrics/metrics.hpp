@@ -0,0 +1,157 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief counters, gauges and histograms that any thread can update without taking a lock, and that can be read out
+ * as prometheus text or rendered in the terminal interface.
+ *
+ * only creating and removing a metric goes through the registry's mutex, so a metric should be looked up once and
+ * the returned pointer kept around. metrics are handed out as shared pointers so that code still holding one after it
+ * was removed (say a game state still going out to a client that just left) keeps working, its updates are just no
+ * longer exported.
+ */
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+enum class MetricType { COUNTER, GAUGE, HISTOGRAM };
+
+class Metric {
+  public:
+    virtual ~Metric() = default;
+};
+
+/**
+ * \brief only ever goes up
+ */
+class Counter : public Metric {
+  public:
+    void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> value = 0;
+};
+
+/**
+ * \brief a value that can go up and down
+ */
+class Gauge : public Metric {
+  public:
+    void set(double new_value) { value.store(new_value, std::memory_order_relaxed); }
+    void add(double amount);
+    double get() const { return value.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<double> value = 0;
+};
+
+/**
+ * \brief counts observations into buckets whose upper bounds double each time, starting at first_bucket_upper_bound,
+ * plus one for everything larger. doubling buckets cover a wide range with few buckets and keep the relative error
+ * of a quantile estimate under 2x, which is plenty to see where time goes.
+ */
+class Histogram : public Metric {
+  public:
+    Histogram(double first_bucket_upper_bound, size_t num_buckets);
+
+    void observe(double value, uint64_t times = 1);
+
+    size_t get_num_buckets() const { return num_buckets; } // not counting the overflow bucket
+    double get_bucket_upper_bound(size_t bucket) const;
+    uint64_t get_bucket_count(size_t bucket) const; // the overflow bucket is at index get_num_buckets()
+    uint64_t get_count() const { return count.load(std::memory_order_relaxed); }
+    double get_sum() const { return sum.load(std::memory_order_relaxed); }
+    /**
+     * \return the upper bound of the bucket the quantile falls into, the largest finite bound if it's in the overflow
+     */
+    double estimate_quantile(double quantile) const;
+
+  private:
+    double first_bucket_upper_bound;
+    size_t num_buckets;
+    std::unique_ptr<std::atomic<uint64_t>[]> bucket_counts;
+    std::atomic<uint64_t> count = 0;
+    std::atomic<double> sum = 0;
+};
+
+/**
+ * \brief a copy of the current value of one metric, used to show metrics without holding on to the registry lock
+ */
+struct MetricSnapshot {
+    std::string name;
+    std::string labels; // formatted like {client="3"}, empty if there are none
+    MetricType type;
+    double value; // the count for histograms
+    double mean;  // histograms only
+    double p50;
+    double p99;
+};
+
+class MetricsRegistry {
+  public:
+    std::shared_ptr<Counter> counter(const std::string &name, const std::string &help, const MetricLabels &labels = {});
+    std::shared_ptr<Gauge> gauge(const std::string &name, const std::string &help, const MetricLabels &labels = {});
+    std::shared_ptr<Histogram> histogram(const std::string &name, const std::string &help,
+                                         const MetricLabels &labels = {}, double first_bucket_upper_bound = 0.015625,
+                                         size_t num_buckets = 16);
+
+    /**
+     * \brief removes every metric that has this label with this value, for things that go away like clients
+     */
+    void remove_metrics_with_label(const std::string &label, const std::string &value);
+
+    std::string to_prometheus_text() const;
+    std::vector<MetricSnapshot> snapshot() const;
+
+  private:
+    struct MetricFamily {
+        std::string help;
+        MetricType type;
+        std::map<std::string, std::shared_ptr<Metric>> labels_to_metric;
+    };
+
+    std::shared_ptr<Metric> find_or_create(const std::string &name, const std::string &help, MetricType type,
+                                           const MetricLabels &labels,
+                                           const std::function<std::shared_ptr<Metric>()> &create);
+
+    mutable std::mutex registry_mutex;
+    std::map<std::string, MetricFamily> name_to_family;
+};
+
+/**
+ * \brief writes the registry out as prometheus text every period, through a temporary file that gets renamed over
+ * the old one so a scraper never reads half a file
+ */
+class MetricsFileExporter {
+  public:
+    MetricsFileExporter(const MetricsRegistry &registry, std::string path, std::chrono::milliseconds period);
+    ~MetricsFileExporter();
+
+  private:
+    void export_loop();
+    void write_file();
+
+    const MetricsRegistry &registry;
+    std::string path;
+    std::chrono::milliseconds period;
+
+    std::mutex stop_mutex;
+    std::condition_variable stop_requested;
+    bool stopping = false;
+    std::thread exporter_thread;
+};
+
+#endif // METRICS_HPP
@@ -0,0 +1,239 @@
+#include "network_host.hpp"
+#include "spdlog/spdlog.h"
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+
+NetworkHost::NetworkHost(size_t index, unsigned int port, size_t max_peers, bool reuse_port, MetricsRegistry &metrics)
+    : index(index), port(port), host(create_host(port, max_peers, reuse_port)) {
+    if (host == nullptr) {
+        throw std::runtime_error("couldn't create enet host " + std::to_string(index) + " on port " +
+                                 std::to_string(port));
+    }
+
+    MetricLabels labels = {{"host", std::to_string(index)}};
+    connected_peers_gauge = metrics.gauge("server_host_connected_peers", "peers connected to the host", labels);
+    packets_received = metrics.counter("server_host_packets_received_total", "packets the host received", labels);
+    bytes_received = metrics.counter("server_host_bytes_received_total", "bytes the host received", labels);
+    packets_sent = metrics.counter("server_host_packets_sent_total", "packets handed to the host's peers", labels);
+    bytes_sent = metrics.counter("server_host_bytes_sent_total", "bytes handed to the host's peers", labels);
+    dropped_events = metrics.counter("server_host_dropped_events_total",
+                                     "received packets dropped because the simulation wasn't keeping up", labels);
+    dropped_sends = metrics.counter("server_host_dropped_sends_total",
+                                    "packets dropped because the io thread wasn't keeping up", labels);
+
+    io_thread = std::thread(&NetworkHost::run, this);
+}
+
+NetworkHost::~NetworkHost() {
+    running = false;
+    io_thread.join();
+
+    // whatever nobody got to, the packets in there are owned by the queues
+    for (HostEvent *event = events.front(); event != nullptr; event = events.front()) {
+        if (event->packet != nullptr) {
+            enet_packet_destroy(event->packet);
+        }
+        events.pop();
+    }
+    send_queued_packets();
+    enet_host_destroy(host);
+}
+
+ENetHost *NetworkHost::create_host(unsigned int port, size_t max_peers, bool reuse_port) {
+    ENetAddress address = {0};
+    address.host = ENET_HOST_ANY;
+    address.port = port;
+
+    if (!reuse_port) {
+        return enet_host_create(&address, max_peers, channels, 0, 0);
+    }
+
+    // enet_host_create binds right away, which is too late to ask for SO_REUSEPORT, so the host is created without an
+    // address and its socket is bound here
+    ENetHost *host = enet_host_create(nullptr, max_peers, channels, 0, 0);
+    if (host == nullptr) {
+        return nullptr;
+    }
+    int enable = 1;
+    if (setsockopt(host->socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0 ||
+        enet_socket_bind(host->socket, &address) != 0) {
+        enet_host_destroy(host);
+        return nullptr;
+    }
+    host->address = address;
+    return host;
+}
+
+bool NetworkHost::send(ENetPeer *peer, uint32_t connect_id, uint8_t channel, ENetPacket *packet) {
+    HostSend *queued_send = sends.begin_push();
+    if (queued_send == nullptr) {
+        enet_packet_destroy(packet);
+        dropped_sends->add();
+        return false;
+    }
+    *queued_send = {peer, connect_id, channel, false, packet};
+    sends.finish_push();
+    return true;
+}
+
+void NetworkHost::hold_shared(ENetPacket *packet) {
+    // the io thread hasn't seen the packet yet, after this enet can't destroy it before it's released
+    packet->referenceCount++;
+}
+
+bool NetworkHost::send_shared(ENetPeer *peer, uint32_t connect_id, uint8_t channel, ENetPacket *packet) {
+    HostSend *queued_send = sends.begin_push();
+    if (queued_send == nullptr) {
+        dropped_sends->add();
+        return false;
+    }
+    *queued_send = {peer, connect_id, channel, true, packet};
+    sends.finish_push();
+    return true;
+}
+
+void NetworkHost::release_shared(ENetPacket *packet) {
+    HostSend *queued_send;
+    // the release can't be dropped or the packet would leak, the io thread empties the queue every millisecond
+    while ((queued_send = sends.begin_push()) == nullptr) {
+        std::this_thread::yield();
+    }
+    *queued_send = {nullptr, 0, 0, true, packet};
+    sends.finish_push();
+}
+
+/**
+ * \brief io thread only
+ */
+void NetworkHost::send_queued_packets() {
+    bool sent_any = false;
+    for (HostSend *queued_send = sends.front(); queued_send != nullptr; queued_send = sends.front()) {
+        ENetPacket *packet = queued_send->packet;
+        if (queued_send->peer == nullptr) {
+            if (--packet->referenceCount == 0) {
+                enet_packet_destroy(packet);
+            }
+        } else {
+            // the peer might have disconnected, or even been reused by someone else, since this was queued
+            ENetPeer *peer = queued_send->peer;
+            bool same_connection =
+                peer->state == ENET_PEER_STATE_CONNECTED && peer->connectID == queued_send->connect_id;
+            size_t length = packet->dataLength;
+            if (same_connection && enet_peer_send(peer, queued_send->channel, packet) == 0) {
+                packets_sent->add();
+                bytes_sent->add(length);
+                sent_any = true;
+            } else if (!queued_send->shared) {
+                enet_packet_destroy(packet);
+            }
+        }
+        sends.pop();
+    }
+
+    if (sent_any) {
+        enet_host_flush(host); // a game state shouldn't wait for the next service
+    }
+}
+
+bool NetworkHost::push_event(const HostEvent &event, bool wait_for_room) {
+    HostEvent *queued_event;
+    while ((queued_event = events.begin_push()) == nullptr) {
+        if (!wait_for_room || !running.load(std::memory_order_relaxed)) {
+            dropped_events->add();
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    *queued_event = event;
+    events.finish_push();
+    return true;
+}
+
+void NetworkHost::handle_enet_event(ENetEvent &event) {
+    switch (event.type) {
+    case ENET_EVENT_TYPE_CONNECT: {
+        num_connected_peers.fetch_add(1, std::memory_order_relaxed);
+        connected_peers_gauge->add(1);
+        HostEvent connect;
+        connect.type = HostEventType::CONNECT;
+        connect.peer = event.peer;
+        connect.connect_id = event.peer->connectID;
+        // the simulation has to see every connect and disconnect or it would lose track of who is connected
+        push_event(connect, true);
+    } break;
+
+    case ENET_EVENT_TYPE_RECEIVE: {
+        packets_received->add();
+        bytes_received->add(event.packet->dataLength);
+        HostEvent receive;
+        receive.type = HostEventType::RECEIVE;
+        receive.peer = event.peer;
+        receive.connect_id = event.peer->connectID;
+        receive.channel = event.channelID;
+        receive.packet = event.packet;
+        receive.received_at = std::chrono::steady_clock::now().time_since_epoch().count();
+        if (!push_event(receive, false)) {
+            enet_packet_destroy(event.packet);
+        }
+    } break;
+
+    case ENET_EVENT_TYPE_DISCONNECT:
+    case ENET_EVENT_TYPE_DISCONNECT_TIMEOUT: {
+        num_connected_peers.fetch_sub(1, std::memory_order_relaxed);
+        connected_peers_gauge->add(-1);
+        HostEvent disconnect;
+        disconnect.type = HostEventType::DISCONNECT;
+        disconnect.peer = event.peer;
+        disconnect.connect_id = event.peer->connectID;
+        push_event(disconnect, true);
+    } break;
+
+    case ENET_EVENT_TYPE_NONE:
+        break;
+    }
+}
+
+/**
+ * \brief the simulation can't read the link statistics off the peers itself since enet writes them while servicing
+ */
+void NetworkHost::publish_link_statistics() {
+    for (size_t i = 0; i < host->peerCount; i++) {
+        ENetPeer *peer = &host->peers[i];
+        if (peer->state != ENET_PEER_STATE_CONNECTED) {
+            continue;
+        }
+        HostEvent link_statistics;
+        link_statistics.type = HostEventType::LINK_STATISTICS;
+        link_statistics.peer = peer;
+        link_statistics.connect_id = peer->connectID;
+        link_statistics.link_statistics = read_link_statistics(peer);
+        if (!push_event(link_statistics, false)) {
+            return; // the next ones will do
+        }
+    }
+}
+
+void NetworkHost::run() {
+    spdlog::info("network host {} is serving up to {} peers on port {}", index, host->peerCount, port);
+
+    auto time_of_last_link_statistics = std::chrono::steady_clock::now();
+    ENetEvent event;
+    while (running.load(std::memory_order_relaxed)) {
+        send_queued_packets();
+
+        // waits for a moment if nothing has come in, then takes everything that came in with it
+        int result = enet_host_service(host, &event, service_timeout_ms);
+        while (result > 0) {
+            handle_enet_event(event);
+            result = enet_host_check_events(host, &event);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - time_of_last_link_statistics >= std::chrono::milliseconds(link_statistics_period_ms)) {
+            publish_link_statistics();
+            time_of_last_link_statistics = now;
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef NETWORK_HOST_HPP
+#define NETWORK_HOST_HPP
+
+#include "enet.h"
+#include "spsc_queue/spsc_queue.hpp"
+#include "../send_scheduler/send_scheduler.hpp"
+#include "../metrics/metrics.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+enum class HostEventType { CONNECT, RECEIVE, DISCONNECT, LINK_STATISTICS };
+
+/**
+ * \brief something that happened on a host's io thread, waiting for the simulation to handle it
+ */
+struct HostEvent {
+    HostEventType type = HostEventType::RECEIVE;
+    ENetPeer *peer = nullptr;
+    // enet reuses peer slots, this tells apart the connections that had the same peer
+    uint32_t connect_id = 0;
+    uint8_t channel = 0;
+    ENetPacket *packet = nullptr;   // RECEIVE only, whoever handles the event destroys it
+    uint64_t received_at = 0;       // RECEIVE only, steady clock nanoseconds when enet handed it to the io thread
+    LinkStatistics link_statistics; // LINK_STATISTICS only
+};
+
+/**
+ * \brief a packet the simulation wants sent. a null peer marks the end of a packet that was shared between peers, it's
+ * destroyed then unless enet still holds on to it.
+ */
+struct HostSend {
+    ENetPeer *peer = nullptr;
+    uint32_t connect_id = 0;
+    uint8_t channel = 0;
+    bool shared = false;
+    ENetPacket *packet = nullptr;
+};
+
+struct NetworkHostSettings {
+    size_t num_hosts = 1;
+    size_t peers_per_host = 32;
+    unsigned int port = 7777;
+    // every host binds the same port with SO_REUSEPORT and the kernel spreads the clients over them by their address,
+    // otherwise host i binds port + i and the clients have to be spread over the ports
+    bool reuse_port = true;
+};
+
+/**
+ * \brief one enet host serviced by its own io thread. enet isn't thread safe, so only that thread ever touches the
+ * host and its peers. what it receives goes to the simulation through an event queue and what the simulation wants
+ * sent comes back through a send queue, both single producer single consumer and lock free, so a few of these can do
+ * the packet io of thousands of peers next to one simulation.
+ *
+ * the simulation side may be called from different threads, but only from one at a time.
+ */
+class NetworkHost {
+  public:
+    NetworkHost(size_t index, unsigned int port, size_t max_peers, bool reuse_port, MetricsRegistry &metrics);
+    ~NetworkHost();
+
+    NetworkHost(const NetworkHost &) = delete;
+    NetworkHost &operator=(const NetworkHost &) = delete;
+
+    /**
+     * \return the oldest event that hasn't been handled, or nullptr if there is none. it stays valid until pop_event
+     */
+    HostEvent *front_event() { return events.front(); }
+    void pop_event() { events.pop(); }
+
+    /**
+     * \brief queues the packet for the io thread, which takes ownership of it
+     * \return false if the queue is full, the packet is destroyed then
+     */
+    bool send(ENetPeer *peer, uint32_t connect_id, uint8_t channel, ENetPacket *packet);
+    /**
+     * \brief a packet that goes to many peers of this host is created once, handed out with send_shared and then
+     * released once, which destroys it as soon as no peer has it queued anymore
+     */
+    void hold_shared(ENetPacket *packet);
+    bool send_shared(ENetPeer *peer, uint32_t connect_id, uint8_t channel, ENetPacket *packet);
+    void release_shared(ENetPacket *packet);
+
+    size_t get_index() const { return index; }
+    unsigned int get_port() const { return port; }
+    size_t get_num_connected_peers() const { return num_connected_peers.load(std::memory_order_relaxed); }
+
+    // game states, join accepts and client reports, entity lifecycle events, time sync
+    static constexpr size_t channels = 4;
+    // a tick's events and sends of a few hundred peers, a burst on top of that is dropped rather than waited on
+    static constexpr size_t events_capacity = 4096;
+    static constexpr size_t sends_capacity = 4096;
+    // how long the io thread waits for a packet before checking the send queue again, bounds how long a send waits
+    static constexpr uint32_t service_timeout_ms = 1;
+    static constexpr uint32_t link_statistics_period_ms = 100;
+
+  private:
+    static ENetHost *create_host(unsigned int port, size_t max_peers, bool reuse_port);
+    void run();
+    void send_queued_packets();
+    void handle_enet_event(ENetEvent &event);
+    bool push_event(const HostEvent &event, bool wait_for_room);
+    void publish_link_statistics();
+
+    size_t index;
+    unsigned int port;
+    ENetHost *host;
+    std::atomic<size_t> num_connected_peers = 0;
+
+    SpscQueue<HostEvent, events_capacity> events; // produced by the io thread
+    SpscQueue<HostSend, sends_capacity> sends;    // consumed by the io thread
+
+    std::shared_ptr<Gauge> connected_peers_gauge;
+    std::shared_ptr<Counter> packets_received;
+    std::shared_ptr<Counter> bytes_received;
+    std::shared_ptr<Counter> packets_sent;
+    std::shared_ptr<Counter> bytes_sent;
+    std::shared_ptr<Counter> dropped_events;
+    std::shared_ptr<Counter> dropped_sends;
+
+    std::atomic<bool> running = true;
+    std::thread io_thread; // last, so everything it uses exists before it starts
+};
+
+#endif // NETWORK_HOST_HPP
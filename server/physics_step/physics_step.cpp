@@ -0,0 +1,200 @@
+#include "physics_step.hpp"
+#include "../character_update/character_update.hpp"
+#include "../formatting/formatting.hpp"
+#include "spdlog/spdlog.h"
+#include <memory>
+
+PhysicsStep::PhysicsStep(
+    Physics &physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+    float movement_acceleration, InputJournal *input_journal)
+    : physics(physics), client_id_to_camera(client_id_to_camera), client_id_to_mouse(client_id_to_mouse),
+      client_id_to_cihtems_of_last_server_processed_input_snapshot(
+          client_id_to_cihtems_of_last_server_processed_input_snapshot),
+      movement_acceleration(movement_acceleration), input_journal(input_journal) {}
+
+void PhysicsStep::run(double delta_time_seconds) {
+    apply_inputs(delta_time_seconds);
+    integrate_movement();
+    colour_characters();
+    for (const std::vector<size_t> &batch_indices : colour_batch_indices) {
+        for (size_t batch_index : batch_indices) {
+            step_character(batch_index, nullptr);
+        }
+    }
+    wake_touched_characters();
+    step_world();
+}
+
+/**
+ * \brief sorts this tick's inputs by character, a character's inputs have to be applied in order but different
+ * characters don't depend on each other, so each character can be stepped on its own worker
+ */
+void PhysicsStep::apply_inputs(double delta_time_seconds) {
+    tick++;
+    this->delta_time_seconds = delta_time_seconds;
+
+    for (size_t i = 0; i < num_character_input_batches; i++) {
+        character_input_batches[i].input_snapshots.clear();
+    }
+    num_character_input_batches = 0;
+    // clearing the map would free its nodes only to allocate them again below, so entries from an earlier tick are
+    // told apart by their tick instead, and only the ones of characters that are gone get erased
+    if (client_id_to_batch_index.size() > physics.client_id_to_physics_character.size()) {
+        for (auto entry = client_id_to_batch_index.begin(); entry != client_id_to_batch_index.end();) {
+            if (!physics.client_id_to_physics_character.count(entry->first)) {
+                entry = client_id_to_batch_index.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+    }
+
+    while (!physics.input_snapshot_queue.empty()) {
+        NetworkedInputSnapshot input_snapshot = physics.input_snapshot_queue.pop();
+        uint64_t client_id = input_snapshot.client_id;
+
+        auto character_it = physics.client_id_to_physics_character.find(client_id);
+        if (character_it == physics.client_id_to_physics_character.end()) {
+            continue; // the client left after sending this
+        }
+
+        if (input_journal != nullptr) {
+            input_journal->record_input(input_snapshot);
+        }
+
+        BatchIndex &batch_index = client_id_to_batch_index[client_id];
+        if (batch_index.tick != tick) {
+            if (num_character_input_batches == character_input_batches.size()) {
+                character_input_batches.emplace_back();
+            }
+            CharacterInputBatch &batch = character_input_batches[num_character_input_batches];
+            batch.client_id = client_id;
+            batch.character = character_it->second;
+            batch.camera = &client_id_to_camera[client_id];
+            batch.mouse = &client_id_to_mouse[client_id];
+            batch.rest_state = &physics.client_id_to_rest_state[client_id];
+            batch_index = {tick, num_character_input_batches++};
+        }
+        character_input_batches[batch_index.index].input_snapshots.push_back(input_snapshot);
+
+        client_id_to_cihtems_of_last_server_processed_input_snapshot[client_id] =
+            input_snapshot.client_input_history_insertion_time_epoch_ms;
+    }
+
+    // the characters get stepped soon, they all collide with each other as they are now
+    physics.prepare_character_collision();
+}
+
+/**
+ * \brief nearly every character has exactly one input per tick, the velocities for those are integrated for everyone in
+ * one pass of the shared batch kernel. the inputs after the first depend on where the first one's step left the
+ * character, those go through the scalar path in the character step, which gives bit identical results.
+ */
+void PhysicsStep::integrate_movement() {
+    first_input_movement_batch_indices.clear();
+    for (size_t i = 0; i < num_character_input_batches; i++) {
+        CharacterInputBatch &batch = character_input_batches[i];
+        NetworkedInputSnapshot &input_snapshot = batch.input_snapshots.front();
+        batch.first_input_moves = !rest_through_input(*batch.rest_state, *batch.camera, *batch.mouse, input_snapshot);
+        if (batch.first_input_moves) {
+            update_player_camera(*batch.camera, *batch.mouse, input_snapshot);
+            first_input_movement_batch_indices.push_back(i);
+        }
+    }
+
+    first_input_movement.resize(first_input_movement_batch_indices.size());
+    for (size_t i = 0; i < first_input_movement_batch_indices.size(); i++) {
+        CharacterInputBatch &batch = character_input_batches[first_input_movement_batch_indices[i]];
+        first_input_movement.set(
+            i, character_movement_state(*batch.character, *batch.camera, batch.input_snapshots.front()));
+    }
+
+    CharacterMovementSettings settings;
+    settings.acceleration = movement_acceleration;
+    JPH::Vec3 gravity = physics.physics_system.GetGravity();
+    float gravity_components[3] = {gravity.GetX(), gravity.GetY(), gravity.GetZ()};
+    integrate_character_velocities(first_input_movement, settings, (float)delta_time_seconds, gravity_components);
+
+    for (size_t i = 0; i < first_input_movement_batch_indices.size(); i++) {
+        float velocity[3];
+        first_input_movement.get_velocity(i, velocity);
+        character_input_batches[first_input_movement_batch_indices[i]].character->SetLinearVelocity(
+            JPH::Vec3(velocity[0], velocity[1], velocity[2]));
+    }
+}
+
+/**
+ * \brief sorts the characters that have inputs by their colour, see SpatialHashCharacterCollision::colour_of. every
+ * input after the first can at most add its acceleration, a jump and gravity to a character's speed, which bounds how
+ * far the character can get this tick.
+ */
+void PhysicsStep::colour_characters() {
+    for (std::vector<size_t> &batch_indices : colour_batch_indices) {
+        batch_indices.clear();
+    }
+
+    CharacterMovementSettings settings;
+    float delta_time = static_cast<float>(delta_time_seconds);
+    float max_speed_gain_per_input =
+        (movement_acceleration + settings.jump_acceleration + physics.physics_system.GetGravity().Length()) *
+        delta_time;
+    for (size_t i = 0; i < num_character_input_batches; i++) {
+        CharacterInputBatch &batch = character_input_batches[i];
+        float speed = batch.character->GetLinearVelocity().Length();
+        float displacement_bound = 0.0f;
+        for (size_t j = 0; j < batch.input_snapshots.size(); j++) {
+            displacement_bound += speed * delta_time;
+            speed += max_speed_gain_per_input;
+        }
+        colour_batch_indices[physics.character_collision.colour_of(*batch.character, displacement_bound)].push_back(i);
+    }
+}
+
+/**
+ * \brief steps one character through all of its inputs, the first one's velocity is already integrated
+ */
+void PhysicsStep::step_character(size_t batch_index, JPH::TempAllocator *temp_allocator) {
+    CharacterInputBatch &batch = character_input_batches[batch_index];
+
+    batch.stepped = batch.first_input_moves;
+    if (batch.first_input_moves) {
+        step_moved_character(physics, batch.client_id, batch.character, *batch.rest_state,
+                             has_movement_input(batch.input_snapshots.front()), delta_time_seconds, temp_allocator);
+    }
+    for (size_t i = 1; i < batch.input_snapshots.size(); i++) {
+        batch.stepped |= apply_input_to_character(physics, batch.client_id, batch.character, *batch.rest_state,
+                                                  *batch.camera, *batch.mouse, batch.input_snapshots[i],
+                                                  movement_acceleration, delta_time_seconds, temp_allocator);
+    }
+}
+
+/**
+ * \brief a resting character isn't stepped, so it can't notice being walked into itself, the one walking into it wakes
+ * it instead
+ */
+void PhysicsStep::wake_touched_characters() {
+    for (size_t i = 0; i < num_character_input_batches; i++) {
+        if (character_input_batches[i].stepped) {
+            ::wake_touched_characters(physics, *character_input_batches[i].character);
+        }
+    }
+}
+
+void PhysicsStep::step_world() { physics.update_world(static_cast<float>(delta_time_seconds)); }
+
+std::function<void(double)> physics_step_closure(
+    NetworkedInputSnapshot *input_snapshot, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+    float movement_acceleration, InputJournal *input_journal) {
+    // the closure gets copied around, every copy has to step with the same batches
+    auto physics_step = std::make_shared<PhysicsStep>(*physics, client_id_to_camera, client_id_to_mouse,
+                                                      client_id_to_cihtems_of_last_server_processed_input_snapshot,
+                                                      movement_acceleration, input_journal);
+    return [physics_step, physics](double time_since_last_update) {
+        physics_step->run(time_since_last_update);
+        spdlog::debug("physics tick with delta: {} game state: \n{}", time_since_last_update, *physics);
+    };
+}
@@ -0,0 +1,110 @@
+#ifndef PHYSICS_STEP_HPP
+#define PHYSICS_STEP_HPP
+
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "../interaction/camera/camera.hpp"
+#include "../interaction/mouse/mouse.hpp"
+#include "../input_journal/input_journal.hpp"
+#include "../character_rest/character_rest.hpp"
+#include "character_movement/character_movement.hpp"
+
+#include <array>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief the inputs of one character that arrived since the last tick, in the order they arrived
+ */
+struct CharacterInputBatch {
+    uint64_t client_id;
+    JPH::Ref<JPH::CharacterVirtual> character;
+    Camera *camera;
+    Mouse *mouse;
+    CharacterRestState *rest_state;
+    std::vector<NetworkedInputSnapshot> input_snapshots;
+    bool stepped; // false if the character rested through every input
+    bool first_input_moves; // the velocity for the first input has already been integrated with everyone else's
+};
+
+/**
+ * \brief everything a tick does to the physics world, split into stages that have to run in this order:
+ *
+ *   apply inputs -> integrate movement -> colour characters -> step character, colour by colour -> wake touched ->
+ *   step world
+ *
+ * the characters of one colour don't touch each other, so the ones of a colour can be stepped in parallel, see
+ * SpatialHashCharacterCollision::colour_of. everything that simulates a tick goes through here, the task graph server
+ * runs the stages as tasks, the linear server and the replay one after the other with run. so a journal recorded by
+ * either replays into the same world.
+ */
+class PhysicsStep {
+  public:
+    /**
+     * \param input_journal if non-null every consumed snapshot is recorded to it, so the session can be replayed
+     */
+    PhysicsStep(Physics &physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+                std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+                std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+                float movement_acceleration, InputJournal *input_journal = nullptr);
+
+    /**
+     * \brief runs every stage on this thread, stepping the characters with the physics' own temp allocator
+     */
+    void run(double delta_time_seconds);
+
+    /**
+     * \brief drains the input snapshot queue and sorts its inputs by character, starts the tick
+     */
+    void apply_inputs(double delta_time_seconds);
+    void integrate_movement();
+    void colour_characters();
+    /**
+     * \return the batches to step for a colour, the ones of SpatialHashCharacterCollision::solo_colour have to be
+     * stepped one after the other
+     */
+    const std::vector<size_t> &batches_of_colour(uint32_t colour) const { return colour_batch_indices[colour]; }
+    /**
+     * \param temp_allocator the physics' own one is used if this is null, which is only ok if nothing else is stepping
+     */
+    void step_character(size_t batch_index, JPH::TempAllocator *temp_allocator);
+    void wake_touched_characters();
+    void step_world();
+
+  private:
+    Physics &physics;
+    std::unordered_map<uint64_t, Camera> &client_id_to_camera;
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse;
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot;
+    float movement_acceleration;
+    InputJournal *input_journal;
+
+    uint64_t tick = 0; // counts the calls to apply_inputs
+    double delta_time_seconds = 0;
+
+    // only the first num_character_input_batches are used this tick, the rest keep their capacity for later ticks
+    std::vector<CharacterInputBatch> character_input_batches;
+    size_t num_character_input_batches = 0;
+    struct BatchIndex {
+        uint64_t tick = UINT64_MAX; // the entry only counts during the tick it was made in
+        size_t index = 0;
+    };
+    std::unordered_map<uint64_t, BatchIndex> client_id_to_batch_index;
+    // the first input of every character that moves this tick, gathered so their velocities are integrated in one pass
+    CharacterMovementArrays first_input_movement;
+    std::vector<size_t> first_input_movement_batch_indices;
+    // the batches of every colour, the last one holds the characters that have to be stepped alone
+    std::array<std::vector<size_t>, SpatialHashCharacterCollision::num_colours + 1> colour_batch_indices;
+};
+
+/**
+ * \brief runs a PhysicsStep on every call
+ * \param input_journal if non-null every consumed snapshot is recorded to it, so the session can be replayed
+ */
+std::function<void(double)> physics_step_closure(
+    NetworkedInputSnapshot *input_snapshot, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+    float movement_acceleration, InputJournal *input_journal = nullptr);
+
+#endif // PHYSICS_STEP_HPP
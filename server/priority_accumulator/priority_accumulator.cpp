@@ -0,0 +1,73 @@
+#include "priority_accumulator.hpp"
+#include <algorithm>
+#include <cmath>
+
+float PriorityAccumulator::priority(const NetworkedCharacterData *viewer, const NetworkedCharacterData &character,
+                                    const PriorityWeights &weights) {
+    float speed = std::sqrt(character.character_x_velocity * character.character_x_velocity +
+                            character.character_y_velocity * character.character_y_velocity +
+                            character.character_z_velocity * character.character_z_velocity);
+    float speed_factor = 1.0f + weights.speed_weight * speed;
+    if (viewer == nullptr) {
+        return speed_factor;
+    }
+
+    float dx = character.character_x_position - viewer->character_x_position;
+    float dy = character.character_y_position - viewer->character_y_position;
+    float dz = character.character_z_position - viewer->character_z_position;
+    float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+    float distance_factor = weights.half_priority_distance_meters /
+                            (weights.half_priority_distance_meters + distance);
+
+    // the angles are in degrees, like on the wire
+    const float radians_per_degree = 3.14159265f / 180.0f;
+    float yaw = viewer->camera_yaw_angle * radians_per_degree;
+    float pitch = viewer->camera_pitch_angle * radians_per_degree;
+    float look_x = std::cos(yaw) * std::cos(pitch), look_y = std::sin(pitch), look_z = std::sin(yaw) * std::cos(pitch);
+    float cosine_to_character =
+        distance > 0.0f ? (look_x * dx + look_y * dy + look_z * dz) / distance : 1.0f;
+    float view_factor = 1.0f + weights.in_view_weight * std::max(cosine_to_character, 0.0f);
+
+    return distance_factor * speed_factor * view_factor;
+}
+
+void PriorityAccumulator::select(const NetworkedCharacterData *viewer, uint64_t viewer_client_id,
+                                 const std::vector<NetworkedCharacterData> &characters, size_t max_characters,
+                                 const PriorityWeights &weights, std::vector<size_t> &selected) {
+    selection_count++;
+    candidates.clear();
+    for (size_t i = 0; i < characters.size(); i++) {
+        const NetworkedCharacterData &character = characters[i];
+        if (character.client_id == viewer_client_id) {
+            continue;
+        }
+        Entry &entry = client_id_to_entry[character.client_id];
+        entry.accumulated_priority += priority(viewer, character, weights);
+        entry.last_selection = selection_count;
+        candidates.emplace_back(entry.accumulated_priority, i);
+    }
+
+    selected.clear();
+    size_t num_selected = std::min(max_characters, candidates.size());
+    // only which ones make it matters, not their order
+    std::nth_element(candidates.begin(), candidates.begin() + num_selected, candidates.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (size_t i = 0; i < num_selected; i++) {
+        size_t index = candidates[i].second;
+        client_id_to_entry[characters[index].client_id].accumulated_priority = 0.0f;
+        selected.push_back(index);
+    }
+
+    // characters that left, or are resting and left out of the game state, would otherwise stay around forever
+    if (client_id_to_entry.size() > candidates.size()) {
+        for (auto entry = client_id_to_entry.begin(); entry != client_id_to_entry.end();) {
+            if (entry->second.last_selection != selection_count) {
+                entry = client_id_to_entry.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+    }
+}
+
+void PriorityAccumulator::reset() { client_id_to_entry.clear(); }
@@ -0,0 +1,61 @@
+#ifndef PRIORITY_ACCUMULATOR_HPP
+#define PRIORITY_ACCUMULATOR_HPP
+
+#include "networked_character_data/networked_character_data.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief how much a character matters to a viewer this tick, a character at rest right next to the viewer and
+ * outside of its view has a priority of 1
+ */
+struct PriorityWeights {
+    // a character this far from the viewer has half the priority of one right next to it
+    float half_priority_distance_meters = 16.0f;
+    // every m/s a character moves at adds this much on top
+    float speed_weight = 0.25f;
+    // a character straight ahead of where the viewer looks gets this much on top, one behind it nothing
+    float in_view_weight = 1.0f;
+};
+
+/**
+ * \brief decides which characters go into a game state that can't take all of them. every character's priority for
+ * the viewer is added to what it has accumulated every tick it isn't sent, and the ones with the most accumulated go
+ * out and start over from zero. so characters that are close, fast or in view are sent nearly every tick, and the
+ * others still come up every so often instead of starving.
+ *
+ * there is one per client, it's only used by the encoding of that client's game states, which never overlap.
+ */
+class PriorityAccumulator {
+  public:
+    /**
+     * \brief accumulates this tick's priorities and fills selected with the indices into characters of the
+     * max_characters that are sent. the viewer's own character is never selected, it's always sent anyway
+     * \param viewer the viewer's own character, or nullptr if it isn't known, then only speed counts
+     */
+    void select(const NetworkedCharacterData *viewer, uint64_t viewer_client_id,
+                const std::vector<NetworkedCharacterData> &characters, size_t max_characters,
+                const PriorityWeights &weights, std::vector<size_t> &selected);
+    /**
+     * \brief everyone was sent, nobody has been waiting
+     */
+    void reset();
+
+    static float priority(const NetworkedCharacterData *viewer, const NetworkedCharacterData &character,
+                          const PriorityWeights &weights);
+
+  private:
+    struct Entry {
+        float accumulated_priority = 0.0f;
+        uint64_t last_selection = 0; // to forget characters that are gone
+    };
+
+    std::unordered_map<uint64_t, Entry> client_id_to_entry;
+    uint64_t selection_count = 0;
+    std::vector<std::pair<float, size_t>> candidates; // scratch, accumulated priority and index into characters
+};
+
+#endif // PRIORITY_ACCUMULATOR_HPP
@@ -0,0 +1,66 @@
+#include "../journal_replay/journal_replay.hpp"
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "../model_loading/model_loading.hpp"
+#include "../formatting/formatting.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <iostream>
+
+/**
+ * \brief headless replay of a journal recorded by the server with -journal, see replay_journal. it doubles as a
+ * benchmark made out of a real session.
+ */
+
+void parse_command_line_arguments(int argc, char *argv[], std::string &journal_path, std::string &map_path) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-journal" && i + 1 < argc) {
+            journal_path = argv[++i];
+        } else if (arg == "-map" && i + 1 < argc) {
+            map_path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " -journal <path> [-map <path to obj>]" << std::endl;
+            exit(1);
+        }
+    }
+
+    if (journal_path.empty()) {
+        std::cerr << "Error: a journal is required." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " -journal <path> [-map <path to obj>]" << std::endl;
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string journal_path;
+    std::string map_path = "../assets/maps/ground_test.obj";
+    parse_command_line_arguments(argc, argv, journal_path, map_path);
+
+    // the physics step logs every input, we only care about how long it takes
+    spdlog::set_level(spdlog::level::off);
+
+    const float movement_acceleration = 15.0f;
+
+    Physics physics;
+    Model map(map_path);
+    physics.load_model_into_physics_world(&map);
+
+    auto replay_start_time = std::chrono::steady_clock::now();
+    ReplayStatistics statistics = replay_journal(journal_path, physics, movement_acceleration);
+    std::chrono::duration<double, std::milli> replay_time = std::chrono::steady_clock::now() - replay_start_time;
+
+    std::cout << fmt::format("replayed {} ticks and {} inputs in {:.3f} ms\n", statistics.ticks_replayed,
+                             statistics.inputs_replayed, replay_time.count());
+    if (statistics.ticks_replayed > 0) {
+        std::cout << fmt::format("average tick {:.4f} ms, slowest tick was {} at {:.4f} ms\n",
+                                 statistics.total_tick_time_ms / statistics.ticks_replayed, statistics.slowest_tick,
+                                 statistics.slowest_tick_time_ms);
+    }
+    // printed so that two replays (or a replay and the server log) can be diffed to check for determinism
+    std::cout << fmt::format("final game state hash: {:016x}\n", physics.state_hash());
+    std::cout << fmt::format("final game state: \n{}", physics) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "server.hpp"
+#include "tick_pipeline/tick_pipeline.hpp"
+#include "work_stealing_thread_pool/work_stealing_thread_pool.hpp"
+#include "journal_replay/journal_replay.hpp"
+
+#include "spdlog/sinks/null_sink.h"
+#include "spdlog/spdlog.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+/**
+ * \brief records a session with the task graph setup's TickPipeline into a journal, replays the journal into a fresh
+ * world and checks that both end up in the same state, down to the bit. clients join, leave, come back and now and
+ * then send more than one input a tick, so every stage of a tick has something to do. exits with 1 if the states
+ * differ.
+ *
+ * takes the map to load as its only argument, without one the characters fall forever, which still has to replay.
+ */
+
+constexpr unsigned int port = 7791;
+constexpr uint64_t num_ticks = 600;
+constexpr uint64_t num_clients = 6;
+constexpr uint64_t client_that_rejoins = 3;
+constexpr float movement_acceleration = 15.0f;
+
+/**
+ * \brief stands in for the network step, clients join and leave on fixed ticks and send inputs out of a seeded random
+ * walk. everything is journaled and applied the way ServerNetwork does it.
+ */
+struct ScriptedClients {
+    Physics &physics;
+    std::unordered_map<uint64_t, Camera> &client_id_to_camera;
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse;
+    InputJournal &input_journal;
+
+    std::mt19937 random{42};
+    std::unordered_map<uint64_t, NetworkedInputSnapshot> client_id_to_input; // the keys are held for a while
+    uint64_t tick = 0;
+
+    void connect(uint64_t client_id) {
+        input_journal.record_connect(client_id);
+        client_id_to_camera[client_id] = Camera();
+        client_id_to_mouse[client_id] = Mouse();
+        physics.create_character(client_id);
+        client_id_to_input[client_id] = NetworkedInputSnapshot();
+        client_id_to_input[client_id].client_id = client_id;
+    }
+
+    void disconnect(uint64_t client_id) {
+        input_journal.record_disconnect(client_id);
+        physics.delete_character(client_id);
+        client_id_to_mouse.erase(client_id);
+        client_id_to_camera.erase(client_id);
+        client_id_to_input.erase(client_id);
+    }
+
+    void send_input(NetworkedInputSnapshot &input_snapshot) {
+        std::bernoulli_distribution change_keys(0.05);
+        std::bernoulli_distribution coin(0.5);
+        std::normal_distribution<float> mouse_movement(0.0f, 8.0f);
+        if (change_keys(random)) {
+            input_snapshot.left_pressed = coin(random);
+            input_snapshot.right_pressed = coin(random);
+            input_snapshot.forward_pressed = coin(random);
+            input_snapshot.backward_pressed = coin(random);
+            input_snapshot.jump_pressed = coin(random);
+        }
+        input_snapshot.mouse_position_x += mouse_movement(random);
+        input_snapshot.mouse_position_y += mouse_movement(random);
+        input_snapshot.client_input_history_insertion_time_epoch_ms++;
+        physics.input_snapshot_queue.push(input_snapshot);
+    }
+
+    void network_step(double) {
+        for (uint64_t client_id = 1; client_id <= num_clients; client_id++) {
+            if (tick == 5 * client_id) {
+                connect(client_id);
+            }
+        }
+        if (tick == 200) {
+            disconnect(client_that_rejoins);
+        }
+        if (tick == 300) {
+            connect(client_that_rejoins);
+        }
+
+        // the order of an unordered map isn't part of what's being tested, the clients send in the order of their ids
+        for (uint64_t client_id = 1; client_id <= num_clients; client_id++) {
+            auto input_it = client_id_to_input.find(client_id);
+            if (input_it == client_id_to_input.end()) {
+                continue;
+            }
+            // a client that had a hitch sends what it held back all at once
+            int num_inputs = tick % 7 == client_id ? 3 : 1;
+            for (int i = 0; i < num_inputs; i++) {
+                send_input(input_it->second);
+            }
+        }
+        tick++;
+    }
+};
+
+static std::unique_ptr<Model> load_map(Physics &physics, const std::string &map_path) {
+    if (map_path.empty()) {
+        return nullptr;
+    }
+    auto map = std::make_unique<Model>(map_path);
+    physics.load_model_into_physics_world(map.get());
+    return map;
+}
+
+/**
+ * \return the state hash of the world after the session
+ */
+static uint64_t record(const std::string &journal_path, const std::string &map_path) {
+    NetworkHostSettings host_settings;
+    host_settings.num_hosts = 1;
+    host_settings.peers_per_host = 4;
+    host_settings.port = port;
+    ServerNetwork server_network(host_settings);
+    std::unordered_map<uint64_t, Camera> client_id_to_camera;
+    std::unordered_map<uint64_t, Mouse> client_id_to_mouse;
+    std::unordered_map<uint64_t, uint64_t> client_id_to_cihtems_of_last_server_processed_input_snapshot;
+
+    Physics physics;
+    std::unique_ptr<Model> map = load_map(physics, map_path);
+    InputJournal input_journal(journal_path);
+    ScriptedClients clients{physics, client_id_to_camera, client_id_to_mouse, input_journal};
+
+    WorkStealingThreadPool pool(3);
+    TickPipeline tick_pipeline(
+        pool, server_network, physics, client_id_to_camera, client_id_to_mouse,
+        client_id_to_cihtems_of_last_server_processed_input_snapshot,
+        [&clients](double delta_time_seconds) { clients.network_step(delta_time_seconds); }, movement_acceleration,
+        &input_journal);
+
+    for (uint64_t tick = 0; tick < num_ticks; tick++) {
+        // ticks are never quite on time, the journal has to carry the delta times as they were
+        double delta_time_seconds = 1.0 / 60.0 + 0.001 * static_cast<double>(tick % 3);
+        server_network.mark_tick_start(tick);
+        tick_pipeline.run_tick(tick, delta_time_seconds);
+    }
+    tick_pipeline.wait_for_output();
+    return physics.state_hash();
+}
+
+/**
+ * \return the state hash of the world after the replay
+ */
+static uint64_t replay(const std::string &journal_path, const std::string &map_path, ReplayStatistics &statistics) {
+    Physics physics;
+    std::unique_ptr<Model> map = load_map(physics, map_path);
+    statistics = replay_journal(journal_path, physics, movement_acceleration);
+    return physics.state_hash();
+}
+
+int main(int argc, char *argv[]) {
+    std::string map_path = argc > 1 ? argv[1] : "";
+
+    // the server logs to these, nothing of it matters here
+    auto null_sink = std::make_shared<spdlog::sinks::null_sink_mt>();
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("main", null_sink));
+    spdlog::register_logger(std::make_shared<spdlog::logger>("network", null_sink));
+    spdlog::register_logger(std::make_shared<spdlog::logger>("update", null_sink));
+
+    std::string journal_path = (std::filesystem::temp_directory_path() / "replay_determinism_test.journal").string();
+
+    // jolt's factory is global, so only one world can be around at a time
+    uint64_t recorded_hash = record(journal_path, map_path);
+    ReplayStatistics statistics;
+    uint64_t replayed_hash = replay(journal_path, map_path, statistics);
+    std::filesystem::remove(journal_path);
+
+    if (statistics.ticks_replayed != num_ticks || statistics.inputs_replayed == 0) {
+        std::printf("replayed %lu ticks and %lu inputs out of a session of %lu ticks\n", statistics.ticks_replayed,
+                    statistics.inputs_replayed, num_ticks);
+        return 1;
+    }
+    if (recorded_hash != replayed_hash) {
+        std::printf("the replay ended in state %016lx, the recorded session in %016lx\n", replayed_hash,
+                    recorded_hash);
+        return 1;
+    }
+
+    std::printf("a journal of the task graph setup replays into the same state, %lu ticks and %lu inputs\n",
+                statistics.ticks_replayed, statistics.inputs_replayed);
+    return 0;
+}
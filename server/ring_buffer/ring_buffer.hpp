@@ -0,0 +1,63 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief a double ended queue in one vector that's used round and round. unlike a std::deque, which allocates and frees
+ * a block every so many elements as they pass through it, this only allocates when it has to grow past the most it
+ * ever held, so a queue that's filled and emptied every tick stops allocating after the first few.
+ *
+ * not thread safe, whoever uses it locks around it.
+ */
+template <typename T> class RingBuffer {
+  public:
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    T &front() { return slots[head]; }
+    const T &front() const { return slots[head]; }
+    T &back() { return slots[(head + count - 1) & (slots.size() - 1)]; }
+    const T &back() const { return slots[(head + count - 1) & (slots.size() - 1)]; }
+
+    void push_back(T item) {
+        if (count == slots.size()) {
+            grow();
+        }
+        slots[(head + count) & (slots.size() - 1)] = std::move(item);
+        count++;
+    }
+
+    /**
+     * \brief the slot is reset, so whatever the element owned is let go of right away
+     */
+    void pop_front() {
+        slots[head] = T();
+        head = (head + 1) & (slots.size() - 1);
+        count--;
+    }
+    void pop_back() {
+        back() = T();
+        count--;
+    }
+
+  private:
+    void grow() {
+        std::vector<T> grown(slots.empty() ? initial_capacity : slots.size() * 2);
+        for (size_t i = 0; i < count; i++) {
+            grown[i] = std::move(slots[(head + i) & (slots.size() - 1)]);
+        }
+        slots = std::move(grown);
+        head = 0;
+    }
+
+    static constexpr size_t initial_capacity = 16; // the capacity is always a power of two, so indices wrap with a mask
+
+    std::vector<T> slots;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+#endif // RING_BUFFER_HPP
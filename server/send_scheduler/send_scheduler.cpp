@@ -0,0 +1,44 @@
+#include "send_scheduler.hpp"
+
+LinkStatistics read_link_statistics(const ENetPeer *peer) {
+    return {peer->roundTripTime, static_cast<float>(peer->packetLoss) / ENET_PEER_PACKET_LOSS_SCALE,
+            static_cast<float>(peer->packetThrottle) / ENET_PEER_PACKET_THROTTLE_SCALE};
+}
+
+size_t ClientSendSchedule::tier_for_link(const LinkStatistics &link_statistics) {
+    for (size_t tier = 0; tier < send_tiers.size(); tier++) {
+        const SendTier &send_tier = send_tiers[tier];
+        if (link_statistics.round_trip_time_ms <= send_tier.max_round_trip_time_ms &&
+            link_statistics.packet_loss_fraction <= send_tier.max_packet_loss_fraction &&
+            link_statistics.throttle_fraction >= send_tier.min_throttle_fraction) {
+            return tier;
+        }
+    }
+    return send_tiers.size() - 1;
+}
+
+void ClientSendSchedule::update_link_statistics(const LinkStatistics &link_statistics) {
+    size_t supported_tier = tier_for_link(link_statistics);
+
+    if (supported_tier > current_tier) { // the link got worse, back off right away
+        current_tier = supported_tier;
+        ticks_link_supported_better_tier = 0;
+    } else if (supported_tier < current_tier) {
+        ticks_link_supported_better_tier++;
+        if (ticks_link_supported_better_tier >= ticks_required_before_upgrade) {
+            current_tier--; // only go up one tier at a time, the next one has to be earned again
+            ticks_link_supported_better_tier = 0;
+        }
+    } else {
+        ticks_link_supported_better_tier = 0;
+    }
+}
+
+bool ClientSendSchedule::claim_send_for_tick(uint64_t tick) {
+    if (has_sent && tick - tick_of_last_send < send_tiers[current_tier].ticks_between_sends) {
+        return false;
+    }
+    has_sent = true;
+    tick_of_last_send = tick;
+    return true;
+}
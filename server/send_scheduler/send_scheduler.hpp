@@ -0,0 +1,70 @@
+#ifndef SEND_SCHEDULER_HPP
+#define SEND_SCHEDULER_HPP
+
+#include "enet.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+/**
+ * \brief what enet currently thinks of a peer's connection, normalized so the thresholds read naturally
+ */
+struct LinkStatistics {
+    uint32_t round_trip_time_ms;
+    float packet_loss_fraction; // 0 means nothing lost, 1 means everything lost
+    float throttle_fraction;    // 1 means enet sends everything, lower means it has started dropping unreliable data
+};
+
+LinkStatistics read_link_statistics(const ENetPeer *peer);
+
+/**
+ * \brief how often and how much we send to a client whose link is in a certain condition
+ */
+struct SendTier {
+    uint32_t ticks_between_sends;
+    size_t max_snapshot_bytes; // every part of a game state together
+    // the link has to be at least this good to be put into this tier
+    uint32_t max_round_trip_time_ms;
+    float max_packet_loss_fraction;
+    float min_throttle_fraction;
+};
+
+// tier 0 is a healthy link at the full tick rate, each following tier is for a worse link
+constexpr std::array<SendTier, 4> send_tiers = {{
+    {1, std::numeric_limits<size_t>::max(), 100, 0.02f, 0.9f},
+    {2, 1536, 150, 0.05f, 0.75f},
+    {3, 768, 250, 0.10f, 0.5f},
+    {4, 384, std::numeric_limits<uint32_t>::max(), 1.0f, 0.0f},
+}};
+
+/**
+ * \brief decides per client whether a game state goes out this tick and how many bytes it may take.
+ *
+ * \note moving to a worse tier happens immediately, but moving back to a better tier requires the link to have been
+ * good enough for that tier for ticks_required_before_upgrade ticks in a row, otherwise a link that hovers around a
+ * threshold would flap between rates.
+ */
+class ClientSendSchedule {
+  public:
+    void update_link_statistics(const LinkStatistics &link_statistics);
+    /**
+     * \brief returns true at most once per tick, and marks the send as having happened
+     */
+    bool claim_send_for_tick(uint64_t tick);
+
+    size_t snapshot_byte_budget() const { return send_tiers[current_tier].max_snapshot_bytes; }
+    size_t get_current_tier() const { return current_tier; }
+
+    static constexpr uint32_t ticks_required_before_upgrade = 120;
+
+  private:
+    static size_t tier_for_link(const LinkStatistics &link_statistics);
+
+    size_t current_tier = 0;
+    uint32_t ticks_link_supported_better_tier = 0;
+    bool has_sent = false;
+    uint64_t tick_of_last_send = 0;
+};
+
+#endif // SEND_SCHEDULER_HPP
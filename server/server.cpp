@@ -4,102 +4,115 @@
 #include "thread_safe_queue.hpp"
 #include "networked_character_data/networked_character_data.hpp"
 #include "formatting/formatting.hpp"
+#include "character_rest/character_rest.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include "spdlog/fmt/ranges.h" // allows for easy formatting of vectors
 
-uint64_t UniqueIDGenerator::generate() { return counter.fetch_add(1, std::memory_order_relaxed); };
-
-void set_inputs_to_false(NetworkedInputSnapshot *input_snapshot) {
-    input_snapshot->left_pressed = false;
-    input_snapshot->right_pressed = false;
-    input_snapshot->forward_pressed = false;
-    input_snapshot->backward_pressed = false;
-    input_snapshot->jump_pressed = false;
-}
-
-void write_binary_input_snapshot_to_input_snapshot(unsigned int binary_input_snapshot,
-                                                   NetworkedInputSnapshot *input_snapshot) {
-    std::string temp[5] = {"l", "r", "f", "b", "j"};
-
-    set_inputs_to_false(input_snapshot);
-
-    for (int i = 0; i < 5; i++) {
-        if (binary_input_snapshot & (1 << i)) {
-            std::string message = temp[i] + " pressed\n";
-            printf("%s", message.c_str());
-            switch (i) {
-            case 0:
-                input_snapshot->left_pressed = true;
-                break;
-            case 1:
-                input_snapshot->right_pressed = true;
-                break;
-            case 2:
-                input_snapshot->forward_pressed = true;
-                break;
-            case 3:
-                input_snapshot->backward_pressed = true;
-                break;
-            case 4:
-                input_snapshot->jump_pressed = true;
-                break;
-            }
-        }
+uint64_t UniqueIDGenerator::generate() {
+    std::lock_guard<std::mutex> lock(generator_mutex);
+    if (!released_ids.empty()) {
+        uint64_t id = released_ids.top();
+        released_ids.pop();
+        return id;
     }
+    return counter++;
+};
+
+void UniqueIDGenerator::release(uint64_t id) {
+    std::lock_guard<std::mutex> lock(generator_mutex);
+    released_ids.push(id);
 }
 
-ServerNetwork::ServerNetwork() {
+ServerNetwork::ServerNetwork(const NetworkHostSettings &host_settings) : host_settings(host_settings) {
     if (enet_initialize() != 0) {
-        printf("An error occurred while initializing ENet.\n");
-        std::runtime_error("An error occurred while initializing ENet.\n");
-        // return 1;
+        throw std::runtime_error("An error occurred while initializing ENet.");
     }
 
-    ENetAddress address = {0};
-
-    address.host = ENET_HOST_ANY; /* Bind the server to the default localhost. */
-    address.port = this->port;    /* Bind the server to port 7777. */
-
-    int MAX_CLIENTS = 32;
-
-    /* create a server */
-    ENetHost *server = enet_host_create(&address, MAX_CLIENTS, 2, 0, 0);
-
-    if (server == NULL) {
-        printf("An error occurred while trying to create an ENet server host.\n");
-        std::runtime_error("An error occurred while trying to create an ENet server host.\n");
-        // return 1;
+    // a single host has no one to share its port with
+    bool reuse_port = host_settings.reuse_port && host_settings.num_hosts > 1;
+    for (size_t i = 0; i < host_settings.num_hosts; i++) {
+        unsigned int host_port = reuse_port ? host_settings.port : host_settings.port + i;
+        hosts.push_back(
+            std::make_unique<NetworkHost>(i, host_port, host_settings.peers_per_host, reuse_port, metrics));
+        full_game_update_packets.emplace_back();
+        entity_lifecycle_packets.push_back(nullptr);
     }
-
-    this->server = server;
+    time_of_last_connection_distribution_log = std::chrono::steady_clock::now();
+
+    connected_client_count = metrics.gauge("server_connected_clients", "clients currently connected");
+    game_states_sent = metrics.counter("server_game_states_sent_total", "game states sent, counting every client");
+    malformed_packets =
+        metrics.counter("server_malformed_packets_total", "packets that couldn't be decoded and were dropped");
+    pending_join_count = metrics.gauge("server_pending_joins", "connected clients waiting to be admitted");
+    joins_admitted = metrics.counter("server_joins_admitted_total", "clients admitted into the world");
+    entity_lifecycle_events_sent =
+        metrics.counter("server_entity_lifecycle_events_total", "spawns and despawns told to the clients");
+
+    MetricLabels room_labels = {{"room", room_name}};
+    room_input_to_acknowledgement_latency_ms = create_latency_quantile_gauges(
+        "room_input_to_ack_latency_ms", "time from an input being captured to the client seeing it acknowledged",
+        room_labels);
+    room_acknowledgement_to_render_latency_ms = create_latency_quantile_gauges(
+        "room_ack_to_render_latency_ms", "time from the client seeing an acknowledgement to rendering it",
+        room_labels);
+    // the quantiles above are since the server started, these can be windowed by the scraper
+    room_input_to_acknowledgement_latency_histogram = metrics.histogram(
+        "room_input_to_ack_latency_histogram_ms", "input to acknowledgement latencies reported by clients",
+        room_labels, 0.25, 16);
+    room_acknowledgement_to_render_latency_histogram = metrics.histogram(
+        "room_ack_to_render_latency_histogram_ms", "acknowledgement to render latencies reported by clients",
+        room_labels, 0.25, 16);
 
     spdlog::get("network")->info("server has been initialized");
 }
 
 void initialize_enet() {}
 
-void ServerNetwork::remove_client_data_from_engine(ENetEvent disconnect_event, Physics *physics,
+void ServerNetwork::remove_client_data_from_engine(ENetPeer *peer, Physics *physics,
                                                    std::unordered_map<uint64_t, Camera> &client_id_to_camera,
                                                    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse) {
-    // the for loop has to happen because we need to figure out what client disconnected.
-    for (auto it = connected_clients.begin(); it != connected_clients.end(); ++it) {
-        if (it->second.peer == disconnect_event.peer) {
-            Client matching_client = it->second;
-            uint64_t id_of_disconnected_client = matching_client.uniqueID;
-            std::cout << "Client with ID " << id_of_disconnected_client << " disconnected." << std::endl;
-
-            physics->delete_character(id_of_disconnected_client);
-            client_id_to_mouse.erase(id_of_disconnected_client);
-            client_id_to_camera.erase(id_of_disconnected_client);
-            connected_clients.erase(id_of_disconnected_client);
+    Client *disconnected_client = find_client(peer);
+    if (disconnected_client == nullptr) {
+        return;
+    }
+    uint64_t id_of_disconnected_client = disconnected_client->uniqueID;
+    std::cout << "Client with ID " << id_of_disconnected_client << " disconnected." << std::endl;
 
-            break;
+    // a client that left before it was admitted never got a character, it's just forgotten
+    if (disconnected_client->admitted) {
+        if (input_journal != nullptr) {
+            input_journal->record_disconnect(id_of_disconnected_client);
         }
+        physics->delete_character(id_of_disconnected_client);
+        client_id_to_mouse.erase(id_of_disconnected_client);
+        client_id_to_camera.erase(id_of_disconnected_client);
+        pending_entity_lifecycle_events.push_back(
+            {EntityLifecycleEventType::DESPAWN, static_cast<uint16_t>(id_of_disconnected_client)});
     }
+    client_id_to_send_schedule.erase(id_of_disconnected_client);
+    client_id_to_priority_accumulator.erase(id_of_disconnected_client);
+    client_id_to_input_decoder.erase(id_of_disconnected_client);
+    client_id_to_input_jitter_buffer.erase(id_of_disconnected_client);
+    client_id_to_metrics.erase(id_of_disconnected_client);
+    metrics.remove_metrics_with_label("client", std::to_string(id_of_disconnected_client));
+    connected_client_count->add(-1);
+    connected_clients.erase(id_of_disconnected_client);
+    peer_to_client_id.erase(peer);
+    id_generator.release(id_of_disconnected_client);
+}
+
+Client *ServerNetwork::find_client(ENetPeer *peer) {
+    auto client_id = peer_to_client_id.find(peer);
+    if (client_id == peer_to_client_id.end()) {
+        return nullptr;
+    }
+    return &connected_clients[client_id->second];
 }
 
 std::function<void(double)> ServerNetwork::network_step_closure(
@@ -117,12 +130,18 @@ std::function<void(double)> ServerNetwork::network_step_closure(
         // // time variable
         // send_game_state(physics, client_id_to_camera, client_id_to_cihtems_of_last_server_processed_input_snapshot);
 
-        ENetEvent event;
-
-        while (enet_host_service(this->server, &event, 0) > 0) { // handle any events that have been waiting
-            spdlog::info("initial enet_host_service calls");
-            handle_network_event(event, input_snapshot, physics, client_id_to_camera, client_id_to_mouse,
-                                 client_id_to_cihtems_of_last_server_processed_input_snapshot, input_snapshot_queue);
+        std::lock_guard<std::mutex> lock(host_mutex);
+        handle_host_events(input_snapshot, physics, client_id_to_camera, client_id_to_mouse,
+                           client_id_to_cihtems_of_last_server_processed_input_snapshot, input_snapshot_queue);
+        release_buffered_inputs(input_snapshot_queue);
+        admit_pending_joins(physics, client_id_to_camera, client_id_to_mouse,
+                            client_id_to_cihtems_of_last_server_processed_input_snapshot);
+        send_entity_lifecycle_events();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - time_of_last_connection_distribution_log >= connection_distribution_log_period) {
+            log_connection_distribution();
+            time_of_last_connection_distribution_log = now;
         }
 
         // // Set a small sleep duration in milliseconds
@@ -177,70 +196,250 @@ std::function<void(double)> ServerNetwork::network_step_closure(
     };
 }
 
-void ServerNetwork::handle_network_event(
-    ENetEvent &event, NetworkedInputSnapshot *input_snapshot, Physics *physics,
+void ServerNetwork::handle_host_events(
+    NetworkedInputSnapshot *input_snapshot, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+    ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue) {
+
+    for (std::unique_ptr<NetworkHost> &host : hosts) {
+        // at most a queue's worth, so a host that keeps receiving can't keep us here
+        for (size_t i = 0; i < NetworkHost::events_capacity; i++) {
+            HostEvent *event = host->front_event();
+            if (event == nullptr) {
+                break;
+            }
+            handle_host_event(*host, *event, input_snapshot, physics, client_id_to_camera, client_id_to_mouse,
+                              client_id_to_cihtems_of_last_server_processed_input_snapshot, input_snapshot_queue);
+            host->pop_event();
+        }
+    }
+}
+
+void ServerNetwork::handle_host_event(
+    NetworkHost &host, HostEvent &event, NetworkedInputSnapshot *input_snapshot, Physics *physics,
     std::unordered_map<uint64_t, Camera> &client_id_to_camera, std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
     std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
     ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue) {
 
     switch (event.type) {
-    case ENET_EVENT_TYPE_CONNECT: {
-        printf("A new client connected from %x:%u.\n", event.peer->address.host, event.peer->address.port);
+    case HostEventType::CONNECT: {
         uint64_t new_id = id_generator.generate();
-        ENetPacket *packet =
-            enet_packet_create(reinterpret_cast<const void *>(&new_id), sizeof(new_id), ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(event.peer, 0, packet);
-
-        // create data for the newly connected 0
-        connected_clients[new_id] = {event.peer, new_id};
-        Camera camera;
-        Mouse mouse;
-        client_id_to_camera[new_id] = camera;
-        client_id_to_mouse[new_id] = mouse;
-        physics->create_character(new_id);
-
-        /* Store any relevant client information here. */
-        // event.peer->data = (void *)"Client information";
-        //
-        // printf("peer id: %d\n", enet_peer_get_id(event.peer));
+        printf("A new client connected to host %zu, it's client %lu.\n", host.get_index(), new_id);
+
+        // create data for the newly connected client, its character only comes once it's admitted
+        connected_clients[new_id] = {event.peer, new_id, &host, event.connect_id};
+        peer_to_client_id[event.peer] = new_id;
+        client_id_to_send_schedule[new_id] = ClientSendSchedule();
+        client_id_to_priority_accumulator[new_id] = std::make_shared<PriorityAccumulator>();
+        client_id_to_input_decoder[new_id] = InputSnapshotDecoder();
+        client_id_to_input_jitter_buffer[new_id] = InputJitterBuffer();
+        client_id_to_metrics[new_id] = create_client_metrics(new_id);
+        connected_client_count->add(1);
+        pending_joins.push_back(new_id);
+        pending_join_count->set(static_cast<double>(pending_joins.size()));
     } break;
 
-    case ENET_EVENT_TYPE_RECEIVE: {
-        bool packet_is_input_snapshot = true;
-        if (packet_is_input_snapshot) {
-            NetworkedInputSnapshot received_input_snapshot =
-                *reinterpret_cast<NetworkedInputSnapshot *>(event.packet->data);
-
-            spdlog::get("network")->info("Just received input snapshot {}", received_input_snapshot);
+    case HostEventType::RECEIVE: {
+        Client *sending_client = find_client(event.peer);
+        if (sending_client != nullptr) {
+            ClientMetrics &client_metrics = *client_id_to_metrics[sending_client->uniqueID];
+            client_metrics.bytes_received->add(event.packet->dataLength);
+            client_metrics.packets_received->add();
+        }
 
-            // printf("<~~~ received id: %lu l: %b r: %b f: %b b: %b, j: %b, msx: %f, msy: %f \n",
-            //        received_input_snapshot.client_id, received_input_snapshot.left_pressed,
-            //        received_input_snapshot.right_pressed, received_input_snapshot.forward_pressed,
-            //        received_input_snapshot.backward_pressed, received_input_snapshot.jump_pressed,
-            //        received_input_snapshot.mouse_position_x, received_input_snapshot.mouse_position_y);
-            input_snapshot_queue.push(received_input_snapshot);
+        NetworkedInputSnapshot received_input_snapshot;
+        if (sending_client != nullptr && event.channel == client_report::channel) {
+            handle_client_report(sending_client->uniqueID, event.packet->data, event.packet->dataLength);
+        } else if (sending_client != nullptr && event.channel == time_sync::channel) {
+            handle_time_sync_request(*sending_client, event);
+        } else if (sending_client != nullptr && sending_client->admitted &&
+                   decode_input_snapshot(sending_client->uniqueID, event.packet->data, event.packet->dataLength,
+                                         received_input_snapshot)) {
+
+            spdlog::get("network")->trace("Just received input snapshot {}", received_input_snapshot);
+            // the sequence number stands in for the insertion time, see decode_input_snapshot
+            if (!client_id_to_input_jitter_buffer[sending_client->uniqueID].push(
+                    received_input_snapshot, received_input_snapshot.client_input_history_insertion_time_epoch_ms,
+                    event.received_at, smoothed_tick_period_ns)) {
+                client_id_to_metrics[sending_client->uniqueID]->dropped_inputs->add();
+            }
         }
         /* Clean up the packet now that we're done using it. */
         enet_packet_destroy(event.packet);
     } break;
 
-    case ENET_EVENT_TYPE_DISCONNECT:
-        printf("%s disconnected.\n", event.peer->data);
-        /* Reset the peer's client information. */
-        remove_client_data_from_engine(event, physics, client_id_to_camera, client_id_to_mouse);
-        event.peer->data = NULL;
+    case HostEventType::DISCONNECT:
+        remove_client_data_from_engine(event.peer, physics, client_id_to_camera, client_id_to_mouse);
         break;
 
-    case ENET_EVENT_TYPE_DISCONNECT_TIMEOUT:
-        // printf("%s disconnected due to timeout.\n", event.peer->data);
-        /* Reset the peer's client information. */
-        remove_client_data_from_engine(event, physics, client_id_to_camera, client_id_to_mouse);
-        event.peer->data = NULL;
-        break;
+    case HostEventType::LINK_STATISTICS: {
+        Client *client = find_client(event.peer);
+        // published before the peer's disconnect was handled, for a connection that's already gone
+        if (client != nullptr && client->connect_id == event.connect_id) {
+            client->link_statistics = event.link_statistics;
+        }
+    } break;
+    }
+}
 
-    case ENET_EVENT_TYPE_NONE:
-        break;
+void ServerNetwork::log_connection_distribution() {
+    if (!spdlog::should_log(spdlog::level::info)) {
+        return; // gathering the counts allocates, which a tick shouldn't do for nothing
+    }
+    std::vector<size_t> connections_per_host;
+    size_t total_connections = 0;
+    size_t most_connections = 0;
+    for (const std::unique_ptr<NetworkHost> &host : hosts) {
+        size_t connections = host->get_num_connected_peers();
+        connections_per_host.push_back(connections);
+        total_connections += connections;
+        most_connections = std::max(most_connections, connections);
+    }
+    if (total_connections == 0) {
+        return;
+    }
+    double average_connections = static_cast<double>(total_connections) / hosts.size();
+    spdlog::info("connections per host {}, {} in total, the busiest host has {:.2f}x the average",
+                 connections_per_host, total_connections, most_connections / average_connections);
+}
+
+/**
+ * \brief admits at most max_joins_per_tick of the waiting clients, in the order they connected. a burst of joins is
+ * spread over a few ticks that way instead of making one tick create a pile of characters and encode the world for
+ * each of them. has to be called with the host mutex held.
+ */
+void ServerNetwork::admit_pending_joins(
+    Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot) {
+
+    size_t num_admitted = 0;
+    while (!pending_joins.empty() && num_admitted < max_joins_per_tick) {
+        uint64_t client_id = pending_joins.front();
+        pending_joins.pop_front();
+
+        auto client = connected_clients.find(client_id);
+        if (client == connected_clients.end() || client->second.admitted) {
+            continue; // it left while it was waiting, and its id might already belong to someone else
+        }
+
+        if (input_journal != nullptr) {
+            input_journal->record_connect(client_id);
+        }
+        client_id_to_camera[client_id] = Camera();
+        client_id_to_mouse[client_id] = Mouse();
+        // ids are handed out again, the last owner's acknowledgement would be resolved against this client's inputs
+        client_id_to_cihtems_of_last_server_processed_input_snapshot[client_id] = 0;
+        physics->create_character(client_id);
+        client->second.admitted = true;
+        pending_entity_lifecycle_events.push_back({EntityLifecycleEventType::SPAWN, static_cast<uint16_t>(client_id)});
+
+        send_join_accept(client->second, physics, client_id_to_camera,
+                         client_id_to_cihtems_of_last_server_processed_input_snapshot);
+        joins_admitted->add();
+        num_admitted++;
     }
+    pending_join_count->set(static_cast<double>(pending_joins.size()));
+}
+
+/**
+ * \brief tells every admitted client about the characters that spawned and despawned since the last call, in one
+ * reliable message that's shared between the clients of a host. a client that was just admitted gets the events too,
+ * the spawns of characters that are in its join accept already don't hurt. has to be called with the host mutex held.
+ */
+void ServerNetwork::send_entity_lifecycle_events() {
+    if (pending_entity_lifecycle_events.empty()) {
+        return;
+    }
+    encode_entity_lifecycle_events(pending_entity_lifecycle_events, encoded_entity_lifecycle_events);
+    entity_lifecycle_events_sent->add(pending_entity_lifecycle_events.size());
+    pending_entity_lifecycle_events.clear();
+
+    std::fill(entity_lifecycle_packets.begin(), entity_lifecycle_packets.end(), nullptr);
+    for (const auto &[client_id, client] : connected_clients) {
+        if (!client.admitted) {
+            continue; // it gets the world as it is when it's admitted
+        }
+        ENetPacket *&packet = entity_lifecycle_packets[client.host->get_index()];
+        if (packet == nullptr) {
+            packet = enet_packet_create(encoded_entity_lifecycle_events.data(), encoded_entity_lifecycle_events.size(),
+                                        ENET_PACKET_FLAG_RELIABLE);
+            client.host->hold_shared(packet);
+        }
+        if (client.host->send_shared(client.peer, client.connect_id, entity_lifecycle::channel, packet)) {
+            ClientMetrics &client_metrics = *client_id_to_metrics[client_id];
+            client_metrics.bytes_sent->add(encoded_entity_lifecycle_events.size());
+            client_metrics.packets_sent->add();
+        }
+    }
+    for (size_t i = 0; i < hosts.size(); i++) {
+        if (entity_lifecycle_packets[i] != nullptr) {
+            hosts[i]->release_shared(entity_lifecycle_packets[i]);
+        }
+    }
+}
+
+/**
+ * \brief hands every client's inputs for this tick to the simulation, called once per tick after the host events are
+ * handled
+ */
+void ServerNetwork::release_buffered_inputs(ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue) {
+    for (auto &[client_id, input_jitter_buffer] : client_id_to_input_jitter_buffer) {
+        bool starved;
+        input_jitter_buffer.release(input_snapshot_queue, starved);
+
+        ClientMetrics &client_metrics = *client_id_to_metrics[client_id];
+        if (starved) {
+            client_metrics.starved_input_ticks->add();
+        }
+        client_metrics.input_jitter_ms->set(input_jitter_buffer.get_jitter_ns() / 1e6);
+        client_metrics.input_buffer_depth->set(static_cast<double>(input_jitter_buffer.get_target_depth()));
+    }
+}
+
+/**
+ * \brief sends the client its id and every character as it is right now, reliably, so the client can show the world
+ * right away instead of waiting on game states that might be budgeted or leave resting characters out
+ */
+void ServerNetwork::send_join_accept(
+    const Client &client, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot) {
+
+    join_accept_characters.clear();
+    for (const auto &[client_id, character] : physics->client_id_to_physics_character) {
+        join_accept_characters.push_back(
+            networked_character_data(client_id, *character, client_id_to_camera[client_id],
+                                     client_id_to_cihtems_of_last_server_processed_input_snapshot[client_id]));
+    }
+    encode_game_update(join_accept_characters, join_accept_codec, join_accept_arrays, encoded_join_accept_characters);
+    encode_join_accept(client.uniqueID, encoded_join_accept_characters, encoded_join_accept);
+
+    ENetPacket *packet =
+        enet_packet_create(encoded_join_accept.data(), encoded_join_accept.size(), ENET_PACKET_FLAG_RELIABLE);
+    if (!client.host->send(client.peer, client.connect_id, join_accept::channel, packet)) {
+        return;
+    }
+    ClientMetrics &client_metrics = *client_id_to_metrics[client.uniqueID];
+    client_metrics.bytes_sent->add(encoded_join_accept.size());
+    client_metrics.packets_sent->add();
+}
+
+NetworkedCharacterData ServerNetwork::networked_character_data(
+    uint64_t client_id, const JPH::CharacterVirtual &character, const Camera &camera,
+    uint64_t cihtems_of_last_server_processed_input_snapshot) {
+    JPH::Vec3 character_position = character.GetPosition();
+    JPH::Vec3 character_velocity = character.GetLinearVelocity();
+    return {client_id,
+            cihtems_of_last_server_processed_input_snapshot,
+            character_position.GetX(),
+            character_position.GetY(),
+            character_position.GetZ(),
+            character_velocity.GetX(),
+            character_velocity.GetY(),
+            character_velocity.GetZ(),
+            camera.yaw_angle,
+            camera.pitch_angle};
 }
 
 int ServerNetwork::start_network_loop(
@@ -249,75 +448,21 @@ int ServerNetwork::start_network_loop(
     std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
     ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue) {
 
-    ENetEvent event;
-
     bool first_iteration = true;
     std::chrono::high_resolution_clock::time_point time_of_last_game_update_send;
     float send_period_sec = 1.0 / send_frequency_hz;
-    int send_period_ms = send_period_sec * 1000;
 
     while (true) {
-        /* Wait for an event. (WARNING: blocking, which is ok, since this is in it's own thread) */
-        if (enet_host_service(this->server, &event, send_period_ms) > 0) {
-            switch (event.type) {
-            case ENET_EVENT_TYPE_CONNECT: {
-                printf("A new client connected from %x:%u.\n", event.peer->address.host, event.peer->address.port);
-                uint64_t new_id = id_generator.generate();
-                ENetPacket *packet = enet_packet_create(reinterpret_cast<const void *>(&new_id), sizeof(new_id),
-                                                        ENET_PACKET_FLAG_RELIABLE);
-                enet_peer_send(event.peer, 0, packet);
-
-                // create data for the newly connected player
-                connected_clients[new_id] = {event.peer, new_id};
-                Camera camera;
-                Mouse mouse;
-                client_id_to_camera[new_id] = camera;
-                client_id_to_mouse[new_id] = mouse;
-                physics->create_character(new_id);
-
-                /* Store any relevant client information here. */
-                // event.peer->data = (void *)"Client information";
-                //
-                // printf("peer id: %d\n", enet_peer_get_id(event.peer));
-            } break;
-
-            case ENET_EVENT_TYPE_RECEIVE: {
-                bool packet_is_input_snapshot = true;
-                if (packet_is_input_snapshot) {
-                    NetworkedInputSnapshot received_input_snapshot =
-                        *reinterpret_cast<NetworkedInputSnapshot *>(event.packet->data);
-
-                    spdlog::get("network")->info("Just received input snapshot {}", received_input_snapshot);
-
-                    // printf("<~~~ received id: %lu l: %b r: %b f: %b b: %b, j: %b, msx: %f, msy: %f \n",
-                    //        received_input_snapshot.client_id, received_input_snapshot.left_pressed,
-                    //        received_input_snapshot.right_pressed, received_input_snapshot.forward_pressed,
-                    //        received_input_snapshot.backward_pressed, received_input_snapshot.jump_pressed,
-                    //        received_input_snapshot.mouse_position_x, received_input_snapshot.mouse_position_y);
-                    input_snapshot_queue.push(received_input_snapshot);
-                }
-                /* Clean up the packet now that we're done using it. */
-                enet_packet_destroy(event.packet);
-            } break;
-
-            case ENET_EVENT_TYPE_DISCONNECT:
-                printf("%s disconnected.\n", event.peer->data);
-                /* Reset the peer's client information. */
-                remove_client_data_from_engine(event, physics, client_id_to_camera, client_id_to_mouse);
-                event.peer->data = NULL;
-                break;
-
-            case ENET_EVENT_TYPE_DISCONNECT_TIMEOUT:
-                // printf("%s disconnected due to timeout.\n", event.peer->data);
-                /* Reset the peer's client information. */
-                remove_client_data_from_engine(event, physics, client_id_to_camera, client_id_to_mouse);
-                event.peer->data = NULL;
-                break;
-
-            case ENET_EVENT_TYPE_NONE:
-                break;
-            }
-        }
+        std::unique_lock<std::mutex> lock(host_mutex);
+        handle_host_events(input_snapshot, physics, client_id_to_camera, client_id_to_mouse,
+                           client_id_to_cihtems_of_last_server_processed_input_snapshot, input_snapshot_queue);
+        release_buffered_inputs(input_snapshot_queue);
+        admit_pending_joins(physics, client_id_to_camera, client_id_to_mouse,
+                            client_id_to_cihtems_of_last_server_processed_input_snapshot);
+        send_entity_lifecycle_events();
+        lock.unlock();
+        // the hosts' io threads do the waiting on the sockets, this only has to come by often enough
+        std::this_thread::sleep_for(std::chrono::milliseconds(NetworkHost::service_timeout_ms));
 
         if (first_iteration) {
             time_of_last_game_update_send = std::chrono::high_resolution_clock::now();
@@ -337,8 +482,6 @@ int ServerNetwork::start_network_loop(
         }
     }
 
-    enet_host_destroy(server);
-    enet_deinitialize();
     return 0;
 }
 
@@ -348,44 +491,453 @@ int ServerNetwork::start_network_loop(
  * at least one input snapshot, no because if it hasn't processed an input snapshot, it may just be as the player is
  * falling in after spawning for the first ttime, on the client if they haven't processed any yet, simply just don't do
  * reconciliation
+ *
+ * every client has its own send schedule driven by what enet measures on its link, a client on a bad link is sent to
+ * less often and gets a smaller game state, the full game state is only packed once and shared between every client
+ * that can take all of it.
  */
 void ServerNetwork::send_game_state(
     Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
     std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot) {
 
-    std::vector<NetworkedCharacterData> game_update;
+    capture_game_state(outgoing_game_state, physics, client_id_to_camera,
+                       client_id_to_cihtems_of_last_server_processed_input_snapshot);
+    encode_full_game_state(outgoing_game_state);
+    for (size_t i = 0; i < outgoing_game_state.num_recipients; i++) {
+        encode_game_state_for_recipient(outgoing_game_state, i);
+    }
+    send_encoded_game_state(outgoing_game_state);
+}
+
+/**
+ * \brief copies out everything that sending this tick's game state needs and decides which clients get sent what, so
+ * that after this returns the simulation is free to move on.
+ */
+void ServerNetwork::capture_game_state(
+    OutgoingGameState &outgoing, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot) {
+
+    outgoing.game_update.clear();
+    outgoing.left_out_characters.clear();
     // std::string game_updates_being_sent_out = "Sending game update :\n";
     for (const auto &pair : physics->client_id_to_physics_character) {
         uint64_t client_id = pair.first;
-        JPH::Ref<JPH::CharacterVirtual> character = pair.second;
-        Camera camera = client_id_to_camera[client_id];
-        uint64_t cihtems_of_last_server_processed_input_snapshot =
-            client_id_to_cihtems_of_last_server_processed_input_snapshot[client_id];
-        JPH::Vec3 character_position = character->GetPosition();
-        JPH::Vec3 character_velocity = character->GetLinearVelocity();
-        NetworkedCharacterData player_data = {client_id,
-                                              cihtems_of_last_server_processed_input_snapshot,
-                                              character_position.GetX(),
-                                              character_position.GetY(),
-                                              character_position.GetZ(),
-                                              character_velocity.GetX(),
-                                              character_velocity.GetY(),
-                                              character_velocity.GetZ(),
-                                              camera.yaw_angle,
-                                              camera.pitch_angle};
-
-        game_update.push_back(player_data);
+        NetworkedCharacterData player_data =
+            networked_character_data(client_id, *pair.second, client_id_to_camera[client_id],
+                                     client_id_to_cihtems_of_last_server_processed_input_snapshot[client_id]);
+
+        if (should_replicate_character(physics->client_id_to_rest_state[client_id], client_id, game_state_send_tick)) {
+            outgoing.game_update.push_back(player_data);
+        } else {
+            outgoing.left_out_characters.push_back(player_data);
+        }
         // game_updates_being_sent_out += fmt::format("{}", player_data);
     }
+    auto by_client_id = [](const NetworkedCharacterData &a, const NetworkedCharacterData &b) {
+        return a.client_id < b.client_id;
+    };
+    std::sort(outgoing.left_out_characters.begin(), outgoing.left_out_characters.end(), by_client_id);
+
+    spdlog::get("network")->info("Sending game update {}", outgoing.game_update);
 
-    spdlog::get("network")->info("Sending game update {}", game_update);
+    outgoing.tick = game_state_send_tick++;
+    outgoing.any_recipient_takes_full_game_update = false;
+    outgoing.num_recipients = 0;
+
+    std::lock_guard<std::mutex> lock(host_mutex); // clients connect and disconnect while host events are handled
+    for (const auto &pair : connected_clients) {
+        uint64_t client_id = pair.first;
+        const Client &client = pair.second;
+        if (!client.admitted) {
+            continue; // it gets the whole world in its join accept
+        }
+        ClientSendSchedule &send_schedule = client_id_to_send_schedule[client_id];
+
+        const LinkStatistics &link_statistics = client.link_statistics;
+        send_schedule.update_link_statistics(link_statistics);
+
+        std::shared_ptr<ClientMetrics> &client_metrics = client_id_to_metrics[client_id];
+        client_metrics->round_trip_time_ms->set(link_statistics.round_trip_time_ms);
+        client_metrics->packet_loss_fraction->set(link_statistics.packet_loss_fraction);
+        client_metrics->send_tier->set(static_cast<double>(send_schedule.get_current_tier()));
+
+        if (!send_schedule.claim_send_for_tick(outgoing.tick)) {
+            continue; // this client can't absorb a game state every tick, don't spend anything on it
+        }
+
+        if (outgoing.num_recipients == outgoing.recipients.size()) {
+            outgoing.recipients.emplace_back();
+        }
+        GameStateRecipient &recipient = outgoing.recipients[outgoing.num_recipients++];
+        recipient.client_id = client_id;
+        recipient.peer = client.peer;
+        recipient.host = client.host;
+        recipient.connect_id = client.connect_id;
+        size_t byte_budget = std::min(snapshot_byte_budget, send_schedule.snapshot_byte_budget());
+        recipient.receives_full_game_update = snapshot_parts_size(outgoing.game_update.size()) <= byte_budget;
+        recipient.budget = max_characters_within(byte_budget);
+        recipient.priority_accumulator = client_id_to_priority_accumulator[client_id];
+        recipient.metrics = client_metrics;
+
+        auto own_character = std::lower_bound(outgoing.left_out_characters.begin(),
+                                              outgoing.left_out_characters.end(), client_id,
+                                              [](const NetworkedCharacterData &character, uint64_t client_id) {
+                                                  return character.client_id < client_id;
+                                              });
+        recipient.own_character_left_out =
+            own_character != outgoing.left_out_characters.end() && own_character->client_id == client_id;
+        if (recipient.own_character_left_out) {
+            recipient.own_character_update.assign(1, *own_character);
+        }
+
+        if (recipient.receives_full_game_update) {
+            outgoing.any_recipient_takes_full_game_update = true;
+        }
+    }
+}
+
+/**
+ * \brief packs the game state every client that can take all of it shares, does nothing if nobody can
+ */
+void ServerNetwork::encode_full_game_state(OutgoingGameState &outgoing) {
+    if (outgoing.any_recipient_takes_full_game_update) {
+        encode_game_update_parts(outgoing.tick, outgoing.game_update, outgoing.character_data_codec,
+                                 outgoing.character_state_arrays, outgoing.encoded_game_update_parts);
+    }
+}
+
+/**
+ * \brief only touches the recipient's own scratch space, so different recipients can be encoded at the same time
+ */
+void ServerNetwork::encode_game_state_for_recipient(OutgoingGameState &outgoing, size_t recipient_index) {
+    GameStateRecipient &recipient = outgoing.recipients[recipient_index];
+    if (recipient.own_character_left_out) {
+        fill_character_state_arrays(recipient.own_character_update, recipient.character_state_arrays);
+        encode_extra_snapshot_part(static_cast<uint32_t>(outgoing.tick), recipient.character_state_arrays,
+                                   recipient.character_data_codec, recipient.encoded_own_character_update);
+    }
+    if (recipient.receives_full_game_update) {
+        recipient.priority_accumulator->reset(); // everyone is up to date
+        return;
+    }
+    fill_budgeted_game_update(outgoing.game_update, priority_weights, recipient);
+    encode_game_update_parts(outgoing.tick, recipient.budgeted_game_update, recipient.character_data_codec,
+                             recipient.character_state_arrays, recipient.encoded_game_update_parts);
+}
+
+/**
+ * \brief only queues the packets, the hosts' io threads send them. the bytes are counted once they're queued. every
+ * snapshot part is a packet of its own, so that enet doesn't fragment it.
+ */
+void ServerNetwork::send_encoded_game_state(OutgoingGameState &outgoing) {
+    std::lock_guard<std::mutex> lock(host_mutex);
+
+    // created the first time a client of a host can take the whole thing
+    const SnapshotParts &full_game_update_parts = outgoing.encoded_game_update_parts;
+    for (std::vector<ENetPacket *> &packets_of_host : full_game_update_packets) {
+        packets_of_host.clear();
+    }
+    for (size_t i = 0; i < outgoing.num_recipients; i++) {
+        GameStateRecipient &recipient = outgoing.recipients[i];
+        NetworkHost &host = *recipient.host;
+
+        if (recipient.own_character_left_out) {
+            // sent alongside the game state, enet puts both into the same datagram when the host is flushed
+            ENetPacket *own_character_packet = enet_packet_create(
+                recipient.encoded_own_character_update.data(), recipient.encoded_own_character_update.size(), 0);
+            if (host.send(recipient.peer, recipient.connect_id, 0, own_character_packet)) {
+                recipient.metrics->bytes_sent->add(recipient.encoded_own_character_update.size());
+                recipient.metrics->packets_sent->add();
+            }
+        }
+
+        if (recipient.receives_full_game_update) {
+            std::vector<ENetPacket *> &full_game_update_packets_of_host = full_game_update_packets[host.get_index()];
+            if (full_game_update_packets_of_host.empty()) {
+                for (size_t j = 0; j < full_game_update_parts.num_parts; j++) {
+                    const std::vector<uint8_t> &part = full_game_update_parts.parts[j];
+                    ENetPacket *part_packet = enet_packet_create(part.data(), part.size(), 0);
+                    host.hold_shared(part_packet);
+                    full_game_update_packets_of_host.push_back(part_packet);
+                }
+            }
+            for (size_t j = 0; j < full_game_update_parts.num_parts; j++) {
+                if (host.send_shared(recipient.peer, recipient.connect_id, 0, full_game_update_packets_of_host[j])) {
+                    recipient.metrics->bytes_sent->add(full_game_update_parts.parts[j].size());
+                    recipient.metrics->packets_sent->add();
+                }
+            }
+            game_states_sent->add();
+            continue;
+        }
+
+        const SnapshotParts &budgeted_parts = recipient.encoded_game_update_parts;
+        for (size_t j = 0; j < budgeted_parts.num_parts; j++) {
+            const std::vector<uint8_t> &part = budgeted_parts.parts[j];
+            ENetPacket *part_packet = enet_packet_create(part.data(), part.size(), 0);
+            if (host.send(recipient.peer, recipient.connect_id, 0, part_packet)) {
+                recipient.metrics->bytes_sent->add(part.size());
+                recipient.metrics->packets_sent->add();
+            }
+        }
+        game_states_sent->add();
+    }
+
+    for (size_t i = 0; i < hosts.size(); i++) {
+        for (ENetPacket *part_packet : full_game_update_packets[i]) {
+            hosts[i]->release_shared(part_packet);
+        }
+    }
+}
+
+/**
+ * \brief the client's own character always goes first because reconciliation depends on it, then the other characters
+ * by their accumulated priority as seen from the client's character
+ */
+void ServerNetwork::fill_budgeted_game_update(const std::vector<NetworkedCharacterData> &game_update,
+                                              const PriorityWeights &priority_weights, GameStateRecipient &recipient) {
+    recipient.budgeted_game_update.clear();
+
+    const NetworkedCharacterData *viewer =
+        recipient.own_character_left_out ? &recipient.own_character_update.front() : nullptr;
+    for (const NetworkedCharacterData &character_data : game_update) {
+        if (character_data.client_id == recipient.client_id) {
+            recipient.budgeted_game_update.push_back(character_data);
+            viewer = &character_data;
+            break;
+        }
+    }
+
+    size_t budget_for_others = recipient.budget - std::min(recipient.budget, recipient.budgeted_game_update.size());
+    recipient.priority_accumulator->select(viewer, recipient.client_id, game_update, budget_for_others,
+                                           priority_weights, recipient.selected_characters);
+    for (size_t index : recipient.selected_characters) {
+        recipient.budgeted_game_update.push_back(game_update[index]);
+    }
+}
+
+/**
+ * \brief puts the characters into the compact wire format, see compact_character_data.hpp for the layout and precision
+ */
+void ServerNetwork::fill_character_state_arrays(const std::vector<NetworkedCharacterData> &characters,
+                                                CharacterStateArrays &character_state_arrays) {
+    character_state_arrays.resize(characters.size());
+    for (size_t i = 0; i < characters.size(); i++) {
+        set_character_state(character_state_arrays, i, characters[i]);
+    }
+}
+
+void ServerNetwork::encode_game_update_parts(uint64_t tick, const std::vector<NetworkedCharacterData> &characters,
+                                             CompactCharacterDataCodec &character_data_codec,
+                                             CharacterStateArrays &character_state_arrays, SnapshotParts &encoded) {
+    fill_character_state_arrays(characters, character_state_arrays);
+    encode_snapshot_parts(static_cast<uint32_t>(tick), character_state_arrays, character_data_codec, encoded);
+}
+
+/**
+ * \brief the whole thing as one compact character state message, only for what's sent reliably
+ */
+void ServerNetwork::encode_game_update(const std::vector<NetworkedCharacterData> &characters,
+                                       CompactCharacterDataCodec &character_data_codec,
+                                       CharacterStateArrays &character_state_arrays, std::vector<uint8_t> &encoded) {
+    fill_character_state_arrays(characters, character_state_arrays);
+    character_data_codec.encode(character_state_arrays, encoded);
+}
+
+/**
+ * \brief turns a compact input message back into the snapshot the rest of the server works with, the sequence number
+ * takes the place of the insertion time so that it's what gets acknowledged in the game state.
+ *
+ * \return false if the message should be dropped, see InputSnapshotDecoder::decode
+ */
+bool ServerNetwork::decode_input_snapshot(uint64_t client_id, const uint8_t *data, size_t length,
+                                          NetworkedInputSnapshot &input_snapshot) {
+    auto decoder_it = client_id_to_input_decoder.find(client_id);
+    if (decoder_it == client_id_to_input_decoder.end()) {
+        return false;
+    }
+
+    InputState input_state;
+    uint64_t sequence;
+    if (!decoder_it->second.decode(data, length, input_state, sequence)) {
+        spdlog::get("network")->warn("dropping an input of {} bytes from client {}", length, client_id);
+        client_id_to_metrics[client_id]->dropped_inputs->add();
+        return false;
+    }
+
+    input_snapshot.client_id = client_id;
+    input_snapshot.left_pressed = input_state.left_pressed;
+    input_snapshot.right_pressed = input_state.right_pressed;
+    input_snapshot.forward_pressed = input_state.forward_pressed;
+    input_snapshot.backward_pressed = input_state.backward_pressed;
+    input_snapshot.jump_pressed = input_state.jump_pressed;
+    input_snapshot.mouse_position_x = input_state.mouse_position_x;
+    input_snapshot.mouse_position_y = input_state.mouse_position_y;
+    input_snapshot.client_input_history_insertion_time_epoch_ms = sequence;
+    input_snapshot.time_delta_used_for_client_side_processing_ms = 0; // the server steps with its own delta
+    return true;
+}
+
+void ServerNetwork::handle_client_report(uint64_t client_id, const uint8_t *data, size_t length) {
+    ClientReportType report_type;
+    if (!read_client_report_type(data, length, report_type)) {
+        malformed_packets->add();
+        return;
+    }
+
+    ClientMetrics &client_metrics = *client_id_to_metrics[client_id];
+    switch (report_type) {
+    case ClientReportType::RECONCILIATION: {
+        ReconciliationReport report;
+        if (!decode_reconciliation_report(data, length, report)) {
+            malformed_packets->add();
+            return;
+        }
+        client_metrics.reconciliations->add(report.reconciliations);
+        client_metrics.reconcile_corrections->add(report.corrections);
+        client_metrics.reconcile_correction_millimeters->add(
+            static_cast<uint64_t>(report.total_correction_meters * 1000));
+        client_metrics.max_reconcile_correction_meters->set(report.max_correction_meters);
+    } break;
+    case ClientReportType::INPUT_LATENCY: {
+        if (!decode_input_latency_report(data, length, input_latency_report)) {
+            malformed_packets->add();
+            return;
+        }
+        handle_input_latency_report(client_metrics, input_latency_report);
+    } break;
+    default:
+        malformed_packets->add();
+        break;
+    }
+}
+
+static void set_latency_quantile_gauges(LatencyQuantileGauges &gauges, const LatencyHistogram &latency_histogram) {
+    for (size_t i = 0; i < latency_quantiles.size(); i++) {
+        gauges[i]->set(latency_histogram.value_at_quantile(latency_quantiles[i]) / 1000.0);
+    }
+}
+
+// every bucket of the report goes in at the highest latency it stands for, the same as the quantiles
+static void observe_latencies(Histogram &histogram, const LatencyHistogram &latency_histogram) {
+    for (size_t bucket = 0; bucket < LatencyHistogram::num_buckets; bucket++) {
+        uint32_t bucket_count = latency_histogram.get_bucket_count(bucket);
+        if (bucket_count != 0) {
+            histogram.observe(LatencyHistogram::bucket_highest_value(bucket) / 1000.0, bucket_count);
+        }
+    }
+}
+
+void ServerNetwork::handle_input_latency_report(ClientMetrics &client_metrics, const InputLatencyReport &report) {
+    client_metrics.input_to_acknowledgement_latency.add(report.input_to_acknowledgement);
+    client_metrics.acknowledgement_to_render_latency.add(report.acknowledgement_to_render);
+    set_latency_quantile_gauges(client_metrics.input_to_acknowledgement_latency_ms,
+                                client_metrics.input_to_acknowledgement_latency);
+    set_latency_quantile_gauges(client_metrics.acknowledgement_to_render_latency_ms,
+                                client_metrics.acknowledgement_to_render_latency);
+
+    room_input_to_acknowledgement_latency.add(report.input_to_acknowledgement);
+    room_acknowledgement_to_render_latency.add(report.acknowledgement_to_render);
+    set_latency_quantile_gauges(room_input_to_acknowledgement_latency_ms, room_input_to_acknowledgement_latency);
+    set_latency_quantile_gauges(room_acknowledgement_to_render_latency_ms, room_acknowledgement_to_render_latency);
+    observe_latencies(*room_input_to_acknowledgement_latency_histogram, report.input_to_acknowledgement);
+    observe_latencies(*room_acknowledgement_to_render_latency_histogram, report.acknowledgement_to_render);
+}
+
+LatencyQuantileGauges ServerNetwork::create_latency_quantile_gauges(const std::string &name, const std::string &help,
+                                                                    const MetricLabels &labels) {
+    LatencyQuantileGauges gauges;
+    for (size_t i = 0; i < latency_quantiles.size(); i++) {
+        MetricLabels labels_with_quantile = labels;
+        labels_with_quantile.emplace_back("quantile", fmt::format("{}", latency_quantiles[i]));
+        gauges[i] = metrics.gauge(name, help, labels_with_quantile);
+    }
+    return gauges;
+}
+
+void ServerNetwork::mark_tick_start(uint64_t tick) {
+    uint64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    if (latest_tick_started_at != 0 && tick == latest_tick + 1) {
+        double tick_period_ns = static_cast<double>(now - latest_tick_started_at);
+        smoothed_tick_period_ns = smoothed_tick_period_ns == 0
+                                      ? tick_period_ns
+                                      : smoothed_tick_period_ns + tick_period_smoothing *
+                                                                      (tick_period_ns - smoothed_tick_period_ns);
+    }
+    latest_tick = tick;
+    latest_tick_started_at = now;
+}
+
+/**
+ * \brief answers right away, the time the request came in was taken by the io thread so that the time it waited for
+ * the tick doesn't count as network time
+ */
+void ServerNetwork::handle_time_sync_request(const Client &client, const HostEvent &event) {
+    ClientMetrics &client_metrics = *client_id_to_metrics[client.uniqueID];
+    if (!decode_time_sync_request(event.packet->data, event.packet->dataLength, time_sync_request)) {
+        malformed_packets->add();
+        return;
+    }
+    client_metrics.tick_phase_error_ms->set(time_sync_request.tick_phase_error_ms);
+
+    TimeSyncResponse response;
+    response.client_sent_at = time_sync_request.client_sent_at;
+    response.server_received_at = event.received_at;
+    response.tick = latest_tick;
+    response.tick_started_at = latest_tick_started_at;
+    response.tick_period_ns = static_cast<uint32_t>(smoothed_tick_period_ns);
+    response.input_buffer_depth =
+        static_cast<uint8_t>(client_id_to_input_jitter_buffer[client.uniqueID].get_target_depth());
+    response.server_sent_at = std::chrono::steady_clock::now().time_since_epoch().count();
+    encode_time_sync_response(response, encoded_time_sync_response);
+
+    ENetPacket *packet =
+        enet_packet_create(encoded_time_sync_response.data(), encoded_time_sync_response.size(), 0);
+    if (client.host->send(client.peer, client.connect_id, time_sync::channel, packet)) {
+        client_metrics.bytes_sent->add(encoded_time_sync_response.size());
+        client_metrics.packets_sent->add();
+    }
+}
 
-    // Convert the vector to raw data
-    size_t game_update_size = game_update.size() * sizeof(NetworkedCharacterData);
-    char *raw_data = new char[game_update_size];
-    std::memcpy(raw_data, game_update.data(), game_update_size);
-    ENetPacket *packet = enet_packet_create(raw_data, game_update_size, 0);
-    enet_host_broadcast(this->server, 0, packet);
-    enet_host_flush(this->server);
-    delete[] raw_data;
+std::shared_ptr<ClientMetrics> ServerNetwork::create_client_metrics(uint64_t client_id) {
+    MetricLabels labels = {{"client", std::to_string(client_id)}};
+    auto client_metrics = std::make_shared<ClientMetrics>();
+    client_metrics->bytes_sent = metrics.counter("client_sent_bytes_total", "bytes of game state sent", labels);
+    client_metrics->packets_sent = metrics.counter("client_sent_packets_total", "game state packets sent", labels);
+    client_metrics->bytes_received = metrics.counter("client_received_bytes_total", "bytes received", labels);
+    client_metrics->packets_received = metrics.counter("client_received_packets_total", "packets received", labels);
+    client_metrics->dropped_inputs =
+        metrics.counter("client_dropped_inputs_total",
+                        "inputs that were stale, couldn't be decoded or didn't fit into the jitter buffer", labels);
+    client_metrics->round_trip_time_ms =
+        metrics.gauge("client_round_trip_time_ms", "round trip time as measured by enet", labels);
+    client_metrics->packet_loss_fraction =
+        metrics.gauge("client_packet_loss_fraction", "packet loss as measured by enet", labels);
+    client_metrics->send_tier = metrics.gauge("client_send_tier", "the send tier the link supports, 0 is best", labels);
+    client_metrics->tick_phase_error_ms =
+        metrics.gauge("client_tick_phase_error_ms",
+                      "how much later than wanted the client's inputs arrive in the server's tick, negative is early",
+                      labels);
+    client_metrics->input_jitter_ms =
+        metrics.gauge("client_input_jitter_ms", "how unevenly the client's inputs arrive, smoothed", labels);
+    client_metrics->input_buffer_depth = metrics.gauge(
+        "client_input_buffer_depth", "how many of the client's inputs are kept back against jitter", labels);
+    client_metrics->starved_input_ticks = metrics.counter(
+        "client_starved_input_ticks_total", "ticks the client's character went without an input it should have had",
+        labels);
+    client_metrics->reconciliations =
+        metrics.counter("client_reconciliations_total", "reconciliations the client reported", labels);
+    client_metrics->reconcile_corrections = metrics.counter(
+        "client_reconcile_corrections_total", "reconciliations that visibly moved the client's character", labels);
+    client_metrics->reconcile_correction_millimeters =
+        metrics.counter("client_reconcile_correction_millimeters_total",
+                        "how far reconciliations moved the client's character in total", labels);
+    client_metrics->max_reconcile_correction_meters = metrics.gauge(
+        "client_max_reconcile_correction_meters", "largest correction in the client's most recent report", labels);
+    client_metrics->input_to_acknowledgement_latency_ms = create_latency_quantile_gauges(
+        "client_input_to_ack_latency_ms", "time from an input being captured to the client seeing it acknowledged",
+        labels);
+    client_metrics->acknowledgement_to_render_latency_ms = create_latency_quantile_gauges(
+        "client_ack_to_render_latency_ms", "time from the client seeing an acknowledgement to rendering it", labels);
+    return client_metrics;
 }
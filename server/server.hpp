@@ -7,30 +7,147 @@
 #include "interaction/multiplayer_physics/physics.hpp"
 #include "interaction/camera/camera.hpp"
 #include "thread_safe_queue.hpp"
+#include "input_journal/input_journal.hpp"
+#include "send_scheduler/send_scheduler.hpp"
+#include "priority_accumulator/priority_accumulator.hpp"
+#include "input_jitter_buffer/input_jitter_buffer.hpp"
+#include "networked_character_data/networked_character_data.hpp"
+#include "compact_character_data/compact_character_data.hpp"
+#include "compact_input_snapshot/compact_input_snapshot.hpp"
+#include "client_report/client_report.hpp"
+#include "join_accept/join_accept.hpp"
+#include "entity_lifecycle/entity_lifecycle.hpp"
+#include "time_sync/time_sync.hpp"
+#include "snapshot_parts/snapshot_parts.hpp"
+#include "metrics/metrics.hpp"
+#include "network_host/network_host.hpp"
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <queue>
 
 // A simple structure to represent a client with a unique ID
 struct Client {
     ENetPeer *peer;
     uint64_t uniqueID;
+    NetworkHost *host; // the one whose io thread the peer belongs to
+    uint32_t connect_id;
+    bool admitted = false; // until then it has no character and its inputs are dropped
+    LinkStatistics link_statistics = {0, 0.0f, 1.0f}; // the latest the host published
 };
 
-// A class to generate unique IDs for each connected client
+/**
+ * \brief generates ids for each connected client, ids of clients that have left are handed out again (lowest first) so
+ * that they stay small and dense, which lets the compact wire format send them in 16 bits.
+ */
 class UniqueIDGenerator {
   public:
-    UniqueIDGenerator() : counter(0) {}
     uint64_t generate();
+    void release(uint64_t id);
 
   private:
-    std::atomic<uint64_t>
-        counter; // atomic so that if two requests come in it's guarenteed that they get different values, probably not
-                 // needed atm because this isn't being acces through multiple threads
+    std::mutex generator_mutex; // connects and disconnects could come from different threads
+    uint64_t counter = 0;
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> released_ids;
 };
 
+// the latency quantiles that are exported, next to the room wide latency histograms that can be windowed
+constexpr std::array<double, 4> latency_quantiles = {0.5, 0.9, 0.99, 0.999};
+using LatencyQuantileGauges = std::array<std::shared_ptr<Gauge>, latency_quantiles.size()>;
+
+// the server runs a single room, its latencies are labeled with this so they read the same once there are more
+constexpr const char *room_name = "main";
+
+/**
+ * \brief the metrics kept for every connected client, all labeled with its id
+ */
+struct ClientMetrics {
+    std::shared_ptr<Counter> bytes_sent;
+    std::shared_ptr<Counter> packets_sent;
+    std::shared_ptr<Counter> bytes_received;
+    std::shared_ptr<Counter> packets_received;
+    std::shared_ptr<Counter> dropped_inputs;
+    std::shared_ptr<Gauge> round_trip_time_ms;
+    std::shared_ptr<Gauge> packet_loss_fraction;
+    std::shared_ptr<Gauge> send_tier;
+    std::shared_ptr<Gauge> tick_phase_error_ms; // reported by the client along with its time sync requests
+    std::shared_ptr<Gauge> input_jitter_ms;
+    std::shared_ptr<Gauge> input_buffer_depth;
+    std::shared_ptr<Counter> starved_input_ticks;
+    // reported by the client itself
+    std::shared_ptr<Counter> reconciliations;
+    std::shared_ptr<Counter> reconcile_corrections;
+    std::shared_ptr<Counter> reconcile_correction_millimeters;
+    std::shared_ptr<Gauge> max_reconcile_correction_meters;
+    // every input latency report of the client since it connected, only touched while handling its reports
+    LatencyHistogram input_to_acknowledgement_latency;
+    LatencyHistogram acknowledgement_to_render_latency;
+    LatencyQuantileGauges input_to_acknowledgement_latency_ms;
+    LatencyQuantileGauges acknowledgement_to_render_latency_ms;
+};
+
+/**
+ * \brief one client's share of an outgoing game state
+ */
+struct GameStateRecipient {
+    uint64_t client_id;
+    ENetPeer *peer;
+    NetworkHost *host;
+    uint32_t connect_id;
+    bool receives_full_game_update;
+    size_t budget; // how many characters fit into the client's byte budget
+    // still picks what goes out after the client left while its game state goes out
+    std::shared_ptr<PriorityAccumulator> priority_accumulator;
+    std::shared_ptr<ClientMetrics> metrics; // still counts after the client left while its game state goes out
+    // a resting character is left out of the game state, but its owner still needs the acknowledgements in it
+    bool own_character_left_out;
+    std::vector<NetworkedCharacterData> own_character_update;
+    std::vector<uint8_t> encoded_own_character_update; // an extra snapshot part
+    // scratch space, kept between ticks so that encoding doesn't allocate once it has grown
+    std::vector<NetworkedCharacterData> budgeted_game_update;
+    std::vector<size_t> selected_characters;
+    CompactCharacterDataCodec character_data_codec;
+    CharacterStateArrays character_state_arrays;
+    SnapshotParts encoded_game_update_parts;
+};
+
+/**
+ * \brief the game state of one tick and who gets what of it. encoding and sending only read from here and not from the
+ * physics world, so the next tick can be simulated while this one is still going out. recipients don't share any
+ * scratch space so each one can be encoded on its own thread.
+ */
+struct OutgoingGameState {
+    uint64_t tick = 0;
+    std::vector<NetworkedCharacterData> game_update;
+    // resting characters that haven't changed in a while and were left out of game_update, sorted by client id. a
+    // vector rather than a map, since it's filled anew every tick and a map would allocate a node for every entry
+    std::vector<NetworkedCharacterData> left_out_characters;
+    bool any_recipient_takes_full_game_update = false;
+    CompactCharacterDataCodec character_data_codec;
+    CharacterStateArrays character_state_arrays;
+    SnapshotParts encoded_game_update_parts;
+    // only the first num_recipients are used this tick, the rest are kept around for their scratch space
+    std::vector<GameStateRecipient> recipients;
+    size_t num_recipients = 0;
+};
+
+/**
+ * \brief the server's side of the networking. the packet io happens on the io threads of one or more NetworkHosts,
+ * everything here runs on the simulation's threads and only talks to the hosts through their queues.
+ */
 class ServerNetwork {
   public:
-    ServerNetwork();
-    unsigned int port = 7777;
-    ENetHost *server;
+    explicit ServerNetwork(const NetworkHostSettings &host_settings = NetworkHostSettings());
+    size_t get_max_clients() const { return host_settings.num_hosts * host_settings.peers_per_host; }
+    // connected clients are only given a character this many at a time, the rest wait for the next ticks
+    size_t max_joins_per_tick = 4;
+    // no client is sent more than this per game state, on top of what its send tier allows. characters that don't fit
+    // are picked by the client's priority accumulator
+    static constexpr size_t default_snapshot_byte_budget = 4 * snapshot_parts::max_part_bytes;
+    size_t snapshot_byte_budget = default_snapshot_byte_budget;
+    PriorityWeights priority_weights;
+    InputJournal *input_journal = nullptr; // when set, connects and disconnects are recorded for replay
 
     std::function<void(double)> network_step_closure(
         int send_frequency_hz, NetworkedInputSnapshot *input_snapshot, Physics *physics,
@@ -39,8 +156,11 @@ class ServerNetwork {
         std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
         ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue);
 
-    void handle_network_event(
-        ENetEvent &event, NetworkedInputSnapshot *input_snapshot, Physics *physics,
+    /**
+     * \brief handles what the hosts have received since the last call
+     */
+    void handle_host_events(
+        NetworkedInputSnapshot *input_snapshot, Physics *physics,
         std::unordered_map<uint64_t, Camera> &client_id_to_camera,
         std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
         std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
@@ -57,12 +177,128 @@ class ServerNetwork {
         Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
         std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot);
 
-    void remove_client_data_from_engine(ENetEvent disconnect_event, Physics *physics,
+    // send_game_state split up into its stages, used when the stages get scheduled individually
+    void capture_game_state(
+        OutgoingGameState &outgoing, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+        std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot);
+    void encode_full_game_state(OutgoingGameState &outgoing);
+    void encode_game_state_for_recipient(OutgoingGameState &outgoing, size_t recipient_index);
+    void send_encoded_game_state(OutgoingGameState &outgoing);
+
+    // the client maps are changed while handling host events and read by the game state stages, which can run at the
+    // same time, and the hosts' send queues take one producer at a time. anything that touches either has to hold this
+    std::mutex host_mutex;
+
+    MetricsRegistry metrics;
+
+    /**
+     * \brief call from the tick loop right before a tick starts, clients are told when ticks start so they can send
+     * their inputs to arrive right before the tick that takes them
+     */
+    void mark_tick_start(uint64_t tick);
+
+    /**
+     * \brief logs how many clients every host has, so an uneven spread over the hosts shows up
+     */
+    void log_connection_distribution();
+
+    void remove_client_data_from_engine(ENetPeer *peer, Physics *physics,
                                         std::unordered_map<uint64_t, Camera> &client_id_to_camera,
                                         std::unordered_map<uint64_t, Mouse> &client_id_to_mouse);
     std::unordered_map<uint64_t, Client> connected_clients; // Mapping unique IDs to clients
+    // inputs don't carry the client id, the peer tells us who sent them. peers of different hosts are different objects
+    std::unordered_map<ENetPeer *, uint64_t> peer_to_client_id;
+    std::unordered_map<uint64_t, ClientSendSchedule> client_id_to_send_schedule;
+    std::unordered_map<uint64_t, std::shared_ptr<PriorityAccumulator>> client_id_to_priority_accumulator;
+    std::unordered_map<uint64_t, InputSnapshotDecoder> client_id_to_input_decoder;
+    std::unordered_map<uint64_t, InputJitterBuffer> client_id_to_input_jitter_buffer;
+    std::unordered_map<uint64_t, std::shared_ptr<ClientMetrics>> client_id_to_metrics;
+    std::deque<uint64_t> pending_joins; // connected but not admitted yet, in the order they connected
+
   private:
+    void handle_host_event(
+        NetworkHost &host, HostEvent &event, NetworkedInputSnapshot *input_snapshot, Physics *physics,
+        std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+        std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+        std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+        ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue);
+    Client *find_client(ENetPeer *peer);
+    void admit_pending_joins(
+        Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+        std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+        std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot);
+    void send_entity_lifecycle_events();
+    void release_buffered_inputs(ThreadSafeQueue<NetworkedInputSnapshot> &input_snapshot_queue);
+    void send_join_accept(
+        const Client &client, Physics *physics, std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+        std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot);
+    static NetworkedCharacterData networked_character_data(uint64_t client_id, const JPH::CharacterVirtual &character,
+                                                           const Camera &camera,
+                                                           uint64_t cihtems_of_last_server_processed_input_snapshot);
+    static void fill_budgeted_game_update(const std::vector<NetworkedCharacterData> &game_update,
+                                          const PriorityWeights &priority_weights, GameStateRecipient &recipient);
+    static void fill_character_state_arrays(const std::vector<NetworkedCharacterData> &characters,
+                                            CharacterStateArrays &character_state_arrays);
+    static void encode_game_update_parts(uint64_t tick, const std::vector<NetworkedCharacterData> &characters,
+                                         CompactCharacterDataCodec &character_data_codec,
+                                         CharacterStateArrays &character_state_arrays, SnapshotParts &encoded);
+    static void encode_game_update(const std::vector<NetworkedCharacterData> &characters,
+                                   CompactCharacterDataCodec &character_data_codec,
+                                   CharacterStateArrays &character_state_arrays, std::vector<uint8_t> &encoded);
+    bool decode_input_snapshot(uint64_t client_id, const uint8_t *data, size_t length,
+                               NetworkedInputSnapshot &input_snapshot);
+    void handle_client_report(uint64_t client_id, const uint8_t *data, size_t length);
+    void handle_time_sync_request(const Client &client, const HostEvent &event);
+    std::shared_ptr<ClientMetrics> create_client_metrics(uint64_t client_id);
+    void handle_input_latency_report(ClientMetrics &client_metrics, const InputLatencyReport &report);
+    LatencyQuantileGauges create_latency_quantile_gauges(const std::string &name, const std::string &help,
+                                                         const MetricLabels &labels);
+
+    NetworkHostSettings host_settings;
+    std::vector<std::unique_ptr<NetworkHost>> hosts;
+    std::chrono::steady_clock::time_point time_of_last_connection_distribution_log;
+    static constexpr std::chrono::seconds connection_distribution_log_period = std::chrono::seconds(10);
+    // one per host and snapshot part, an enet packet can't be shared between peers of different hosts since their io
+    // threads would both count its references
+    std::vector<std::vector<ENetPacket *>> full_game_update_packets;
+    std::vector<ENetPacket *> entity_lifecycle_packets; // one per host as well
+
+    // the spawns and despawns since they were last sent, only touched while the host mutex is held
+    std::vector<EntityLifecycleEvent> pending_entity_lifecycle_events;
+    std::vector<uint8_t> encoded_entity_lifecycle_events;
+
     UniqueIDGenerator id_generator;
+    uint64_t game_state_send_tick = 0;
+    OutgoingGameState outgoing_game_state; // used by send_game_state, kept so its buffers get reused
+    // scratch for the join accepts, only used while the host mutex is held
+    std::vector<NetworkedCharacterData> join_accept_characters;
+    CompactCharacterDataCodec join_accept_codec;
+    CharacterStateArrays join_accept_arrays;
+    std::vector<uint8_t> encoded_join_accept_characters;
+    std::vector<uint8_t> encoded_join_accept;
+
+    std::shared_ptr<Gauge> connected_client_count;
+    std::shared_ptr<Counter> game_states_sent;
+    std::shared_ptr<Counter> malformed_packets;
+    std::shared_ptr<Gauge> pending_join_count;
+    std::shared_ptr<Counter> joins_admitted;
+    std::shared_ptr<Counter> entity_lifecycle_events_sent;
+
+    LatencyHistogram room_input_to_acknowledgement_latency;
+    LatencyHistogram room_acknowledgement_to_render_latency;
+    LatencyQuantileGauges room_input_to_acknowledgement_latency_ms;
+    LatencyQuantileGauges room_acknowledgement_to_render_latency_ms;
+    std::shared_ptr<Histogram> room_input_to_acknowledgement_latency_histogram;
+    std::shared_ptr<Histogram> room_acknowledgement_to_render_latency_histogram;
+    InputLatencyReport input_latency_report; // decoded into, it's a few kilobytes
+
+    // written by the tick loop between ticks, only read while handling host events in a tick
+    uint64_t latest_tick = 0;
+    uint64_t latest_tick_started_at = 0; // steady clock nanoseconds
+    double smoothed_tick_period_ns = 0;  // the tick loop sleeps for what's left of the tick, so it's never exact
+    static constexpr double tick_period_smoothing = 0.05;
+    TimeSyncRequest time_sync_request;
+    std::vector<uint8_t> encoded_time_sync_response;
 };
 
 #endif // MWE_NETWORKING_SERVER_HPP
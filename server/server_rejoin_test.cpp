@@ -0,0 +1,180 @@
+#include "server.hpp"
+#include "physics_step/physics_step.hpp"
+#include "compact_input_snapshot/compact_input_snapshot.hpp"
+#include "join_accept/join_accept.hpp"
+
+#include "spdlog/sinks/null_sink.h"
+#include "spdlog/spdlog.h"
+
+#include <cstdio>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief connects a client to an in process server over loopback, has one of its inputs processed, disconnects it and
+ * connects again. ids are handed out again lowest first, so the second connection gets the same id, and its join
+ * accept mustn't carry the acknowledgement of the first one's input. exits with 1 if it does.
+ */
+
+constexpr unsigned int port = 7790;
+constexpr int max_steps = 2000; // one millisecond each, so nothing waits for more than 2 seconds
+
+struct TestServer {
+    ServerNetwork server_network;
+    NetworkedInputSnapshot input_snapshot;
+    std::unordered_map<uint64_t, Camera> client_id_to_camera;
+    std::unordered_map<uint64_t, Mouse> client_id_to_mouse;
+    std::unordered_map<uint64_t, uint64_t> client_id_to_cihtems_of_last_server_processed_input_snapshot;
+    Physics physics;
+    std::function<void(double)> network_step;
+    std::function<void(double)> physics_step;
+    uint64_t tick = 0;
+
+    explicit TestServer(const NetworkHostSettings &host_settings) : server_network(host_settings) {
+        network_step = server_network.network_step_closure(
+            60, &input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
+            client_id_to_cihtems_of_last_server_processed_input_snapshot, physics.input_snapshot_queue);
+        physics_step =
+            physics_step_closure(&input_snapshot, &physics, client_id_to_camera, client_id_to_mouse,
+                                 client_id_to_cihtems_of_last_server_processed_input_snapshot, 15.0f);
+    }
+
+    void run_tick() {
+        const double delta_time_seconds = 1.0 / 60.0;
+        server_network.mark_tick_start(tick++);
+        network_step(delta_time_seconds);
+        physics_step(delta_time_seconds);
+    }
+};
+
+struct TestClient {
+    ENetHost *host = nullptr;
+    ENetPeer *peer = nullptr;
+    bool received_join_accept = false;
+    bool disconnected = false;
+    uint64_t client_id = 0;
+    CompactCharacterDataCodec character_data_codec;
+    CharacterStateArrays characters;
+
+    TestClient() {
+        host = enet_host_create(nullptr, 1, NetworkHost::channels, 0, 0);
+        ENetAddress address;
+        enet_address_set_host(&address, "127.0.0.1");
+        address.port = port;
+        peer = enet_host_connect(host, &address, NetworkHost::channels, 0);
+    }
+    ~TestClient() { enet_host_destroy(host); }
+
+    void service() {
+        ENetEvent event;
+        while (enet_host_service(host, &event, 1) > 0) {
+            if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+                if (event.channelID == join_accept::channel &&
+                    decode_join_accept(event.packet->data, event.packet->dataLength, character_data_codec, client_id,
+                                       characters)) {
+                    received_join_accept = true;
+                }
+                enet_packet_destroy(event.packet);
+            } else if (event.type == ENET_EVENT_TYPE_DISCONNECT) {
+                disconnected = true;
+            }
+        }
+    }
+};
+
+/**
+ * \brief runs the server and services the client until the condition holds
+ * \return false if it didn't in time
+ */
+static bool step_until(TestServer &server, TestClient &client, const std::function<bool()> &condition) {
+    for (int i = 0; i < max_steps; i++) {
+        if (condition()) {
+            return true;
+        }
+        server.run_tick();
+        client.service();
+    }
+    return condition();
+}
+
+/**
+ * \return where the client's own character is in its join accept, or characters.size() if it isn't in there
+ */
+static size_t own_character_index(const TestClient &client) {
+    for (size_t i = 0; i < client.characters.size(); i++) {
+        if (client.characters.entity_ids[i] == client.client_id) {
+            return i;
+        }
+    }
+    return client.characters.size();
+}
+
+int main() {
+    // the server logs to these, nothing of it matters here
+    auto null_sink = std::make_shared<spdlog::sinks::null_sink_mt>();
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("main", null_sink));
+    spdlog::register_logger(std::make_shared<spdlog::logger>("network", null_sink));
+    spdlog::register_logger(std::make_shared<spdlog::logger>("update", null_sink));
+
+    NetworkHostSettings host_settings;
+    host_settings.num_hosts = 1;
+    host_settings.peers_per_host = 4;
+    host_settings.port = port;
+    TestServer server(host_settings);
+
+    uint64_t first_client_id;
+    {
+        TestClient client;
+        if (!step_until(server, client, [&]() { return client.received_join_accept; })) {
+            std::printf("the first connection was never admitted\n");
+            return 1;
+        }
+        first_client_id = client.client_id;
+
+        InputSnapshotEncoder input_snapshot_encoder;
+        std::vector<uint8_t> encoded_input;
+        InputState input;
+        input.forward_pressed = true;
+        input_snapshot_encoder.encode(input, encoded_input);
+        enet_peer_send(client.peer, 0, enet_packet_create(encoded_input.data(), encoded_input.size(),
+                                                          ENET_PACKET_FLAG_RELIABLE));
+        auto &acknowledgements = server.client_id_to_cihtems_of_last_server_processed_input_snapshot;
+        if (!step_until(server, client, [&]() { return acknowledgements[first_client_id] != 0; })) {
+            std::printf("the first connection's input was never processed\n");
+            return 1;
+        }
+
+        enet_peer_disconnect(client.peer, 0);
+        bool disconnected = step_until(
+            server, client, [&]() { return client.disconnected && server.server_network.connected_clients.empty(); });
+        if (!disconnected) {
+            std::printf("the first connection never went away\n");
+            return 1;
+        }
+    }
+
+    TestClient client;
+    if (!step_until(server, client, [&]() { return client.received_join_accept; })) {
+        std::printf("the second connection was never admitted\n");
+        return 1;
+    }
+    if (client.client_id != first_client_id) {
+        std::printf("the second connection got id %lu rather than the first one's %lu, nothing to test\n",
+                    client.client_id, first_client_id);
+        return 1;
+    }
+    size_t own_index = own_character_index(client);
+    if (own_index == client.characters.size()) {
+        std::printf("the join accept doesn't have the client's own character\n");
+        return 1;
+    }
+    uint32_t acknowledged_input = client.characters.acknowledged_inputs[own_index];
+    if (acknowledged_input != 0) {
+        std::printf("the second connection was sent the first one's acknowledged input %u\n", acknowledged_input);
+        return 1;
+    }
+
+    std::printf("a client that gets a recycled id starts without an acknowledged input\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "task_graph.hpp"
+#include "spdlog/fmt/fmt.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+// how much a single run moves the average, small so that one slow tick doesn't hide the trend
+constexpr double average_weight_of_latest_run = 0.05;
+
+static double milliseconds_between(std::chrono::steady_clock::time_point start,
+                                   std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static void record_duration(StageTiming &timing, double duration_ms) {
+    timing.last_duration_ms = duration_ms;
+    timing.average_duration_ms = timing.average_duration_ms == 0
+                                     ? duration_ms
+                                     : timing.average_duration_ms +
+                                           average_weight_of_latest_run * (duration_ms - timing.average_duration_ms);
+    timing.max_duration_ms = std::max(timing.max_duration_ms, duration_ms);
+}
+
+TaskGraph::TaskGraph(std::string name) : name(std::move(name)) {}
+
+TaskId TaskGraph::add_task(const std::string &name, std::function<void()> work) {
+    auto task = std::make_unique<Task>();
+    task->name = name;
+    task->work = std::move(work);
+    tasks.push_back(std::move(task));
+    return tasks.size() - 1;
+}
+
+TaskId TaskGraph::add_parallel_task(const std::string &name, std::function<size_t()> get_count,
+                                    std::function<void(size_t)> work) {
+    auto task = std::make_unique<Task>();
+    task->name = name;
+    task->get_count = std::move(get_count);
+    task->parallel_work = std::move(work);
+    tasks.push_back(std::move(task));
+    return tasks.size() - 1;
+}
+
+void TaskGraph::add_dependency(TaskId before, TaskId after) {
+    tasks[before]->successors.push_back(after);
+    tasks[after]->num_predecessors++;
+}
+
+void TaskGraph::launch(WorkStealingThreadPool &pool) {
+    {
+        std::lock_guard<std::mutex> lock(running_mutex);
+        if (running) {
+            throw std::logic_error("task graph " + name + " was launched while it was still running");
+        }
+        running = !tasks.empty();
+    }
+    if (tasks.empty()) {
+        return;
+    }
+
+    this->pool = &pool;
+    launch_time = std::chrono::steady_clock::now();
+    remaining_tasks.store(tasks.size(), std::memory_order_relaxed);
+    for (auto &task : tasks) {
+        task->remaining_predecessors.store(task->num_predecessors, std::memory_order_relaxed);
+    }
+
+    // the counters have to be reset for every task before any of them can start and decrement one
+    for (TaskId task = 0; task < tasks.size(); task++) {
+        if (tasks[task]->num_predecessors == 0) {
+            schedule(task);
+        }
+    }
+}
+
+void TaskGraph::wait() {
+    std::unique_lock<std::mutex> lock(running_mutex);
+    finished.wait(lock, [this]() { return !running; });
+}
+
+bool TaskGraph::is_running() {
+    std::lock_guard<std::mutex> lock(running_mutex);
+    return running;
+}
+
+void TaskGraph::schedule(TaskId task) {
+    pool->submit([this, task]() { run(task); });
+}
+
+void TaskGraph::run(TaskId task_id) {
+    Task &task = *tasks[task_id];
+    task.start_time = std::chrono::steady_clock::now();
+    task.timing.started_after_launch_ms = milliseconds_between(launch_time, task.start_time);
+
+    if (!task.get_count) {
+        task.work();
+        finish(task_id);
+        return;
+    }
+
+    size_t count = task.get_count();
+    if (count == 0) {
+        finish(task_id);
+        return;
+    }
+    task.remaining_parts.store(count, std::memory_order_relaxed);
+    // this worker takes the first part itself instead of going back through the queue
+    for (size_t i = 1; i < count; i++) {
+        // the task and the part share one word, so the closure is two words and fits into the std::function itself
+        // instead of allocating on every submit
+        uint64_t part = static_cast<uint64_t>(task_id) << 32 | static_cast<uint32_t>(i);
+        pool->submit([this, part]() { run_part(part >> 32, part & 0xffffffff); });
+    }
+    run_part(task_id, 0);
+}
+
+void TaskGraph::run_part(TaskId task_id, size_t part) {
+    Task &task = *tasks[task_id];
+    task.parallel_work(part);
+    if (task.remaining_parts.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        finish(task_id);
+    }
+}
+
+void TaskGraph::finish(TaskId task_id) {
+    Task &task = *tasks[task_id];
+    auto end_time = std::chrono::steady_clock::now();
+    record_duration(task.timing, milliseconds_between(task.start_time, end_time));
+
+    for (TaskId successor : task.successors) {
+        if (tasks[successor]->remaining_predecessors.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            schedule(successor);
+        }
+    }
+
+    if (remaining_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        last_duration_ms = milliseconds_between(launch_time, end_time);
+        std::lock_guard<std::mutex> lock(running_mutex);
+        running = false;
+        finished.notify_all();
+    }
+}
+
+const std::string &TaskGraph::get_task_name(TaskId task) const { return tasks[task]->name; }
+
+const StageTiming &TaskGraph::get_stage_timing(TaskId task) const { return tasks[task]->timing; }
+
+void TaskGraph::reset_max_durations() {
+    for (auto &task : tasks) {
+        task->timing.max_duration_ms = 0;
+    }
+}
+
+void TaskGraph::format_timing_report(fmt::memory_buffer &report) const {
+    fmt::format_to(std::back_inserter(report), "{} took {:.3f} ms\n", name, last_duration_ms);
+    for (const auto &task : tasks) {
+        const StageTiming &timing = task->timing;
+        fmt::format_to(std::back_inserter(report),
+                       "    {:<24} start +{:.3f} ms, took {:.3f} ms (average {:.3f}, max {:.3f})\n", task->name,
+                       timing.started_after_launch_ms, timing.last_duration_ms, timing.average_duration_ms,
+                       timing.max_duration_ms);
+    }
+}
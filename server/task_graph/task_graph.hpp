@@ -0,0 +1,96 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include "../work_stealing_thread_pool/work_stealing_thread_pool.hpp"
+#include "spdlog/fmt/fmt.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using TaskId = size_t;
+
+/**
+ * \brief how long a stage of a task graph took, times are in milliseconds
+ */
+struct StageTiming {
+    double started_after_launch_ms = 0; // how long after the graph was launched the stage could start
+    double last_duration_ms = 0;
+    double average_duration_ms = 0; // exponential moving average, recent runs count the most
+    double max_duration_ms = 0;     // since the last reset_max_durations
+};
+
+/**
+ * \brief a set of tasks with dependencies between them that can be launched over and over, each launch runs every task
+ * once as soon as everything it depends on is done.
+ *
+ * the graph is built once up front and then launched every tick, so a launch doesn't build anything, it only resets
+ * counters. launching doesn't block, call wait to block until every task is done. a graph can only be running once at
+ * a time, but different graphs can run at the same time on the same pool.
+ */
+class TaskGraph {
+  public:
+    explicit TaskGraph(std::string name);
+
+    TaskId add_task(const std::string &name, std::function<void()> work);
+    /**
+     * \brief a task that runs work(i) for i in [0, get_count()) spread over the workers. the count is only asked for
+     * once the task's dependencies are done, so it can depend on what they produced
+     */
+    TaskId add_parallel_task(const std::string &name, std::function<size_t()> get_count,
+                             std::function<void(size_t)> work);
+    void add_dependency(TaskId before, TaskId after);
+
+    void launch(WorkStealingThreadPool &pool);
+    void wait();
+    bool is_running();
+
+    const std::string &get_name() const { return name; }
+    double get_last_duration_ms() const { return last_duration_ms; }
+    const std::string &get_task_name(TaskId task) const;
+    const StageTiming &get_stage_timing(TaskId task) const;
+    size_t get_num_tasks() const { return tasks.size(); }
+    void reset_max_durations();
+
+    /**
+     * \brief appends one line per stage to the report, meant for the logs
+     */
+    void format_timing_report(fmt::memory_buffer &report) const;
+
+  private:
+    struct Task {
+        std::string name;
+        std::function<void()> work;
+        std::function<size_t()> get_count; // only set for parallel tasks
+        std::function<void(size_t)> parallel_work;
+        std::vector<TaskId> successors;
+        size_t num_predecessors = 0;
+
+        std::atomic<size_t> remaining_predecessors = 0;
+        std::atomic<size_t> remaining_parts = 0;
+        std::chrono::steady_clock::time_point start_time;
+        StageTiming timing;
+    };
+
+    void schedule(TaskId task);
+    void run(TaskId task);
+    void run_part(TaskId task, size_t part);
+    void finish(TaskId task);
+
+    std::string name;
+    std::vector<std::unique_ptr<Task>> tasks;
+    WorkStealingThreadPool *pool = nullptr;
+
+    std::chrono::steady_clock::time_point launch_time;
+    double last_duration_ms = 0;
+    std::atomic<size_t> remaining_tasks = 0;
+    std::mutex running_mutex;
+    std::condition_variable finished;
+    bool running = false;
+};
+
+#endif // TASK_GRAPH_HPP
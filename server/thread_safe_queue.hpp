@@ -1,10 +1,11 @@
 #ifndef THREAD_SAFE_QUEUE_H
 #define THREAD_SAFE_QUEUE_H
 
-#include <queue>
+#include "ring_buffer/ring_buffer.hpp"
 #include <mutex>
 #include <condition_variable>
 #include <stdexcept>
+#include <utility>
 
 template <typename T>
 class ThreadSafeQueue {
@@ -19,7 +20,7 @@ public:
     // Push an item onto the queue
     void push(const T& item) {
         std::lock_guard<std::mutex> lock(mutex_);
-        queue_.push(item);
+        queue_.push_back(item);
         cond_var_.notify_one();
     }
 
@@ -27,8 +28,8 @@ public:
     T pop() {
         std::unique_lock<std::mutex> lock(mutex_);
         cond_var_.wait(lock, [this] { return !queue_.empty(); });
-        T item = queue_.front();
-        queue_.pop();
+        T item = std::move(queue_.front());
+        queue_.pop_front();
         return item;
     }
 
@@ -54,7 +55,8 @@ public:
     }
 
 private:
-    std::queue<T> queue_;
+    // a ring rather than a std::queue, which allocates as items pass through it
+    RingBuffer<T> queue_;
     mutable std::mutex mutex_;
     std::condition_variable cond_var_;
 };
@@ -0,0 +1,168 @@
+#include "tick_pipeline.hpp"
+#include "../formatting/formatting.hpp"
+#include "spdlog/spdlog.h"
+#include <chrono>
+#include <utility>
+
+// characters only need a little scratch space for their contacts, the world step keeps using the physics' own allocator
+constexpr size_t character_temp_allocator_bytes = 1024 * 1024;
+
+TickPipeline::TickPipeline(
+    WorkStealingThreadPool &pool, ServerNetwork &server_network, Physics &physics,
+    std::unordered_map<uint64_t, Camera> &client_id_to_camera, std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+    std::function<void(double)> network_step, float movement_acceleration, InputJournal *input_journal,
+    WorldStreaming *world_streaming)
+    : pool(pool), server_network(server_network), physics(physics), client_id_to_camera(client_id_to_camera),
+      client_id_to_mouse(client_id_to_mouse),
+      client_id_to_cihtems_of_last_server_processed_input_snapshot(
+          client_id_to_cihtems_of_last_server_processed_input_snapshot),
+      network_step(std::move(network_step)), input_journal(input_journal),
+      physics_step(physics, client_id_to_camera, client_id_to_mouse,
+                   client_id_to_cihtems_of_last_server_processed_input_snapshot, movement_acceleration, input_journal),
+      world_streaming(world_streaming) {
+
+    for (size_t i = 0; i < pool.get_num_workers(); i++) {
+        worker_temp_allocators.push_back(std::make_unique<JPH::TempAllocatorImpl>(character_temp_allocator_bytes));
+    }
+
+    build_simulation_graph();
+    build_output_graph();
+
+    MetricsRegistry &metrics = server_network.metrics;
+    create_stage_metrics(simulation_graph, simulation_stage_histograms);
+    create_stage_metrics(output_graph, output_stage_histograms);
+    tick_duration_ms = metrics.histogram("server_tick_duration_ms", "time to simulate a tick, without sending it");
+    ticks = metrics.counter("server_ticks_total", "ticks simulated");
+    input_queue_depth =
+        metrics.gauge("server_input_queue_depth", "inputs waiting to be applied at the start of the last tick");
+}
+
+void TickPipeline::create_stage_metrics(const TaskGraph &graph,
+                                        std::vector<std::shared_ptr<Histogram>> &stage_histograms) {
+    for (TaskId task = 0; task < graph.get_num_tasks(); task++) {
+        stage_histograms.push_back(
+            server_network.metrics.histogram("server_stage_duration_ms", "time spent in one stage of a tick",
+                                             {{"graph", graph.get_name()}, {"stage", graph.get_task_name(task)}}));
+    }
+}
+
+void TickPipeline::observe_stage_durations(const TaskGraph &graph,
+                                           const std::vector<std::shared_ptr<Histogram>> &stage_histograms) {
+    for (TaskId task = 0; task < graph.get_num_tasks(); task++) {
+        stage_histograms[task]->observe(graph.get_stage_timing(task).last_duration_ms);
+    }
+}
+
+TickPipeline::~TickPipeline() { wait_for_output(); }
+
+void TickPipeline::build_simulation_graph() {
+    TaskId ingest_task = simulation_graph.add_task("ingest", [this]() { ingest(); });
+    TaskId apply_inputs_task = simulation_graph.add_task(
+        "apply inputs", [this]() { physics_step.apply_inputs(current_delta_time_seconds); });
+    TaskId integrate_movement_task =
+        simulation_graph.add_task("integrate movement", [this]() { physics_step.integrate_movement(); });
+    TaskId colour_characters_task =
+        simulation_graph.add_task("colour characters", [this]() { physics_step.colour_characters(); });
+    // one colour after the other, the characters within a colour are stepped in parallel
+    std::vector<TaskId> character_step_tasks;
+    for (uint32_t colour = 0; colour < SpatialHashCharacterCollision::num_colours; colour++) {
+        character_step_tasks.push_back(simulation_graph.add_parallel_task(
+            fmt::format("character step {}", colour),
+            [this, colour]() { return physics_step.batches_of_colour(colour).size(); },
+            [this, colour](size_t i) {
+                physics_step.step_character(physics_step.batches_of_colour(colour)[i],
+                                            worker_temp_allocators[pool.current_worker_index()].get());
+            }));
+    }
+    character_step_tasks.push_back(simulation_graph.add_task("character step solo", [this]() {
+        for (size_t batch_index : physics_step.batches_of_colour(SpatialHashCharacterCollision::solo_colour)) {
+            physics_step.step_character(batch_index, worker_temp_allocators[pool.current_worker_index()].get());
+        }
+    }));
+    TaskId wake_touched_task =
+        simulation_graph.add_task("wake touched", [this]() { physics_step.wake_touched_characters(); });
+    TaskId world_step_task = simulation_graph.add_task("world step", [this]() { physics_step.step_world(); });
+    TaskId capture_task = simulation_graph.add_task("capture", [this]() {
+        server_network.capture_game_state(*capturing_game_state, &physics, client_id_to_camera,
+                                          client_id_to_cihtems_of_last_server_processed_input_snapshot);
+    });
+
+    simulation_graph.add_dependency(ingest_task, apply_inputs_task);
+    simulation_graph.add_dependency(apply_inputs_task, integrate_movement_task);
+    simulation_graph.add_dependency(integrate_movement_task, colour_characters_task);
+    simulation_graph.add_dependency(colour_characters_task, character_step_tasks.front());
+    for (size_t i = 1; i < character_step_tasks.size(); i++) {
+        simulation_graph.add_dependency(character_step_tasks[i - 1], character_step_tasks[i]);
+    }
+    simulation_graph.add_dependency(character_step_tasks.back(), wake_touched_task);
+    simulation_graph.add_dependency(wake_touched_task, world_step_task);
+    simulation_graph.add_dependency(world_step_task, capture_task);
+
+    // only touches the static world, so it can run while the characters are being captured
+    if (world_streaming != nullptr) {
+        TaskId stream_world_task =
+            simulation_graph.add_task("stream world", [this]() { world_streaming->update(); });
+        simulation_graph.add_dependency(world_step_task, stream_world_task);
+    }
+}
+
+void TickPipeline::build_output_graph() {
+    TaskId encode_shared_task = output_graph.add_task(
+        "encode shared", [this]() { server_network.encode_full_game_state(*sending_game_state); });
+    TaskId encode_per_client_task = output_graph.add_parallel_task(
+        "encode per client", [this]() { return sending_game_state->num_recipients; },
+        [this](size_t recipient_index) {
+            server_network.encode_game_state_for_recipient(*sending_game_state, recipient_index);
+        });
+    TaskId send_task =
+        output_graph.add_task("send", [this]() { server_network.send_encoded_game_state(*sending_game_state); });
+
+    output_graph.add_dependency(encode_shared_task, send_task);
+    output_graph.add_dependency(encode_per_client_task, send_task);
+}
+
+void TickPipeline::run_tick(uint64_t tick, double delta_time_seconds) {
+    current_tick = tick;
+    current_delta_time_seconds = delta_time_seconds;
+
+    auto tick_start = std::chrono::steady_clock::now();
+    simulation_graph.launch(pool);
+    simulation_graph.wait();
+    tick_duration_ms->observe(
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tick_start).count());
+    ticks->add();
+    observe_stage_durations(simulation_graph, simulation_stage_histograms);
+
+    // the previous tick's game state has to be out before its buffers get handed to the next capture
+    output_graph.wait();
+    if (tick > 0) {
+        observe_stage_durations(output_graph, output_stage_histograms);
+    }
+
+    if (tick % timing_report_period_ticks == 0) {
+        // only put together when it's logged, the buffer keeps its memory from one report to the next
+        if (spdlog::should_log(spdlog::level::info)) {
+            timing_report.clear();
+            simulation_graph.format_timing_report(timing_report);
+            output_graph.format_timing_report(timing_report);
+            spdlog::info("tick {} stage timings:\n{}", tick,
+                         fmt::string_view(timing_report.data(), timing_report.size()));
+        }
+        simulation_graph.reset_max_durations();
+        output_graph.reset_max_durations();
+    }
+
+    std::swap(capturing_game_state, sending_game_state);
+    output_graph.launch(pool);
+}
+
+void TickPipeline::wait_for_output() { output_graph.wait(); }
+
+void TickPipeline::ingest() {
+    if (input_journal != nullptr) {
+        input_journal->record_tick_start(current_tick, current_delta_time_seconds);
+    }
+    network_step(current_delta_time_seconds);
+    input_queue_depth->set(static_cast<double>(physics.input_snapshot_queue.size()));
+}
@@ -0,0 +1,97 @@
+#ifndef TICK_PIPELINE_HPP
+#define TICK_PIPELINE_HPP
+
+#include "../server.hpp"
+#include "../task_graph/task_graph.hpp"
+#include "../work_stealing_thread_pool/work_stealing_thread_pool.hpp"
+#include "../input_journal/input_journal.hpp"
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "../interaction/camera/camera.hpp"
+#include "../interaction/mouse/mouse.hpp"
+#include "../physics_step/physics_step.hpp"
+#include "../world_streaming/world_streaming.hpp"
+#include <array>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief runs a server tick as two task graphs on a work stealing pool, the simulation's stages are the ones of
+ * PhysicsStep:
+ *
+ *   simulation: ingest -> apply inputs -> integrate movement -> colour characters -> character step per colour
+ *               (one part per character of that colour) -> character step solo -> wake touched -> world step ->
+ *               capture + stream world
+ *   output:     encode shared game state + encode per client (one part per client) -> send
+ *
+ * the capture stage copies the game state out of the physics world, so the output graph of tick N doesn't need the
+ * world anymore and runs in the background while tick N + 1 is simulated. the two graphs only meet at the client maps
+ * and the hosts' send queues, which are guarded by ServerNetwork::host_mutex.
+ *
+ * every stage is timed, a report is logged every timing_report_period_ticks ticks and every stage's duration goes into
+ * the server_stage_duration_ms histogram of the server's metrics.
+ */
+class TickPipeline {
+  public:
+    TickPipeline(WorkStealingThreadPool &pool, ServerNetwork &server_network, Physics &physics,
+                 std::unordered_map<uint64_t, Camera> &client_id_to_camera,
+                 std::unordered_map<uint64_t, Mouse> &client_id_to_mouse,
+                 std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot,
+                 std::function<void(double)> network_step, float movement_acceleration, InputJournal *input_journal,
+                 WorldStreaming *world_streaming = nullptr);
+    ~TickPipeline();
+
+    /**
+     * \brief simulates a tick and returns once the simulation is done, the game state it produced is sent in the
+     * background once the previous tick's game state has gone out
+     */
+    void run_tick(uint64_t tick, double delta_time_seconds);
+    void wait_for_output();
+
+    static constexpr uint64_t timing_report_period_ticks = 60;
+
+  private:
+    void build_simulation_graph();
+    void build_output_graph();
+
+    void ingest();
+    void create_stage_metrics(const TaskGraph &graph, std::vector<std::shared_ptr<Histogram>> &stage_histograms);
+    void observe_stage_durations(const TaskGraph &graph,
+                                 const std::vector<std::shared_ptr<Histogram>> &stage_histograms);
+
+    WorkStealingThreadPool &pool;
+    ServerNetwork &server_network;
+    Physics &physics;
+    std::unordered_map<uint64_t, Camera> &client_id_to_camera;
+    std::unordered_map<uint64_t, Mouse> &client_id_to_mouse;
+    std::unordered_map<uint64_t, uint64_t> &client_id_to_cihtems_of_last_server_processed_input_snapshot;
+    std::function<void(double)> network_step;
+    InputJournal *input_journal;
+    PhysicsStep physics_step;
+    WorldStreaming *world_streaming; // null if the whole map is loaded
+
+    TaskGraph simulation_graph{"simulation"};
+    TaskGraph output_graph{"output"};
+
+    uint64_t current_tick = 0;
+    double current_delta_time_seconds = 0;
+    fmt::memory_buffer timing_report;
+
+    // one per worker, indexed by WorkStealingThreadPool::current_worker_index
+    std::vector<std::unique_ptr<JPH::TempAllocatorImpl>> worker_temp_allocators;
+
+    // one is captured into by the simulation while the other is being sent out
+    std::array<OutgoingGameState, 2> outgoing_game_states;
+    OutgoingGameState *capturing_game_state = &outgoing_game_states[0];
+    OutgoingGameState *sending_game_state = &outgoing_game_states[1];
+
+    // indexed by TaskId
+    std::vector<std::shared_ptr<Histogram>> simulation_stage_histograms;
+    std::vector<std::shared_ptr<Histogram>> output_stage_histograms;
+    std::shared_ptr<Histogram> tick_duration_ms;
+    std::shared_ptr<Counter> ticks;
+    std::shared_ptr<Gauge> input_queue_depth;
+};
+
+#endif // TICK_PIPELINE_HPP
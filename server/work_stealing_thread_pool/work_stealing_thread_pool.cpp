@@ -0,0 +1,104 @@
+#include "work_stealing_thread_pool.hpp"
+#include "allocation_tracker/allocation_tracker.hpp"
+#include <algorithm>
+#include <cstdio>
+
+// lets a worker find its own queue without looking itself up
+static thread_local const WorkStealingThreadPool *pool_of_this_thread = nullptr;
+static thread_local size_t worker_index_of_this_thread = 0;
+
+WorkStealingThreadPool::WorkStealingThreadPool(size_t num_workers) {
+    num_workers = std::max<size_t>(num_workers, 1);
+    for (size_t i = 0; i < num_workers; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        workers.emplace_back([this, i]() { worker_loop(i); });
+    }
+}
+
+/**
+ * \brief tasks that were already submitted still get run before the workers exit
+ */
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+size_t WorkStealingThreadPool::current_worker_index() const {
+    return pool_of_this_thread == this ? worker_index_of_this_thread : workers.size();
+}
+
+void WorkStealingThreadPool::submit(std::function<void()> task) {
+    size_t queue_index = current_worker_index();
+    if (queue_index == workers.size()) {
+        queue_index = next_queue_for_outside_submits.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues[queue_index]->mutex);
+        queues[queue_index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        // incremented under the sleep mutex so a worker can't check for work and go to sleep in between
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        num_queued_tasks.fetch_add(1, std::memory_order_release);
+    }
+    work_available.notify_one();
+}
+
+bool WorkStealingThreadPool::pop_own_task(size_t worker_index, std::function<void()> &task) {
+    WorkerQueue &queue = *queues[worker_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingThreadPool::steal_task(size_t thief_index, std::function<void()> &task) {
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        WorkerQueue &victim = *queues[(thief_index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingThreadPool::worker_loop(size_t worker_index) {
+    pool_of_this_thread = this;
+    worker_index_of_this_thread = worker_index;
+    char name[32];
+    std::snprintf(name, sizeof(name), "worker %zu", worker_index);
+    allocation_tracker::set_thread_name(name);
+
+    std::function<void()> task;
+    while (true) {
+        if (pop_own_task(worker_index, task) || steal_task(worker_index, task)) {
+            num_queued_tasks.fetch_sub(1, std::memory_order_acq_rel);
+            task();
+            task = nullptr; // let go of whatever the task captured right away
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        work_available.wait(lock,
+                            [this]() { return stopping || num_queued_tasks.load(std::memory_order_acquire) > 0; });
+        if (stopping && num_queued_tasks.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
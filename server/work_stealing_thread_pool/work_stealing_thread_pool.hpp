@@ -0,0 +1,61 @@
+#ifndef WORK_STEALING_THREAD_POOL_HPP
+#define WORK_STEALING_THREAD_POOL_HPP
+
+#include "../ring_buffer/ring_buffer.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief a fixed set of worker threads, each with its own queue of tasks.
+ *
+ * a worker takes its newest task first (the data it just touched is probably still in cache) and when it runs out it
+ * steals the oldest task of another worker, so a burst of work submitted by one worker spreads itself out without
+ * every submit having to go through one shared queue. tasks submitted from outside the pool are dealt out round robin.
+ *
+ * a task that captures no more than two pointers' worth fits into the std::function itself, so submitting it doesn't
+ * allocate once the queues have grown to what a tick needs.
+ */
+class WorkStealingThreadPool {
+  public:
+    explicit WorkStealingThreadPool(size_t num_workers);
+    ~WorkStealingThreadPool();
+
+    WorkStealingThreadPool(const WorkStealingThreadPool &) = delete;
+    WorkStealingThreadPool &operator=(const WorkStealingThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    size_t get_num_workers() const { return workers.size(); }
+    /**
+     * \return the index of the worker of this pool that is calling, or get_num_workers() if it's not one of them,
+     * useful for giving every worker its own scratch space
+     */
+    size_t current_worker_index() const;
+
+  private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        RingBuffer<std::function<void()>> tasks;
+    };
+
+    void worker_loop(size_t worker_index);
+    bool pop_own_task(size_t worker_index, std::function<void()> &task);
+    bool steal_task(size_t thief_index, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_mutex;
+    std::condition_variable work_available;
+    std::atomic<size_t> num_queued_tasks = 0;
+    std::atomic<size_t> next_queue_for_outside_submits = 0;
+    bool stopping = false;
+};
+
+#endif // WORK_STEALING_THREAD_POOL_HPP
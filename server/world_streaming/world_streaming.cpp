@@ -0,0 +1,299 @@
+#include "world_streaming.hpp"
+#include "Jolt/Physics/Collision/Shape/MeshShape.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+JPH::ShapeRefC ChunkShapeCache::get(const ChunkCoordinate &coordinate) {
+    auto entry = coordinate_to_entry.find(coordinate);
+    if (entry == coordinate_to_entry.end()) {
+        return nullptr;
+    }
+    most_recently_used_first.splice(most_recently_used_first.begin(), most_recently_used_first,
+                                    entry->second.recency);
+    return entry->second.shape;
+}
+
+void ChunkShapeCache::put(const ChunkCoordinate &coordinate, JPH::ShapeRefC shape) {
+    auto entry = coordinate_to_entry.find(coordinate);
+    if (entry != coordinate_to_entry.end()) {
+        entry->second.shape = shape;
+        most_recently_used_first.splice(most_recently_used_first.begin(), most_recently_used_first,
+                                        entry->second.recency);
+        return;
+    }
+
+    if (coordinate_to_entry.size() == capacity) {
+        coordinate_to_entry.erase(most_recently_used_first.back());
+        most_recently_used_first.pop_back();
+    }
+    most_recently_used_first.push_front(coordinate);
+    coordinate_to_entry[coordinate] = {shape, most_recently_used_first.begin()};
+}
+
+WorldStreaming::WorldStreaming(Physics &physics, Model &map, MetricsRegistry &metrics,
+                               const WorldStreamingSettings &settings)
+    : physics(physics), settings(settings), shape_cache(settings.cached_shapes),
+      cooking_pool(settings.cooking_threads) {
+    split_into_chunks(map);
+
+    loaded_chunks_gauge = metrics.gauge("server_world_loaded_chunks", "map chunks whose collision is in the world");
+    cached_shapes_gauge = metrics.gauge("server_world_cached_chunk_shapes", "cooked chunk shapes in the cache");
+    chunks_cooked = metrics.counter("server_world_chunks_cooked_total", "chunk shapes cooked");
+    chunks_cooked_on_demand = metrics.counter("server_world_chunks_cooked_on_demand_total",
+                                              "chunk shapes a player was too close to to cook in the background");
+
+    spdlog::info("split the map into {} chunks of {} m", coordinate_to_chunk.size(), settings.chunk_size_meters);
+}
+
+WorldStreaming::~WorldStreaming() {
+    body_ids.clear();
+    for (const ChunkCoordinate &coordinate : loaded_chunk_coordinates) {
+        body_ids.push_back(coordinate_to_chunk[coordinate].body_id);
+    }
+    if (!body_ids.empty()) {
+        JPH::BodyInterface &body_interface = physics.physics_system.GetBodyInterface();
+        body_interface.RemoveBodies(body_ids.data(), static_cast<int>(body_ids.size()));
+        body_interface.DestroyBodies(body_ids.data(), static_cast<int>(body_ids.size()));
+    }
+}
+
+ChunkCoordinate WorldStreaming::chunk_of(float x, float z) const {
+    return {static_cast<int32_t>(std::floor(x / settings.chunk_size_meters)),
+            static_cast<int32_t>(std::floor(z / settings.chunk_size_meters))};
+}
+
+void WorldStreaming::split_into_chunks(Model &map) {
+    for (const Mesh &mesh : map.meshes) {
+        assert(mesh.indices.size() % 3 == 0); // only contains triangles
+        for (size_t j = 0; j < mesh.indices.size(); j += 3) {
+            glm::vec3 v1 = mesh.vertices[mesh.indices[j]].position;
+            glm::vec3 v2 = mesh.vertices[mesh.indices[j + 1]].position;
+            glm::vec3 v3 = mesh.vertices[mesh.indices[j + 2]].position;
+            JPH::Triangle triangle(JPH::Float3(v1.x, v1.y, v1.z), JPH::Float3(v2.x, v2.y, v2.z),
+                                   JPH::Float3(v3.x, v3.y, v3.z));
+
+            // a big floor triangle reaches into chunks far from its centroid, a player standing on it there would fall
+            // through if it were only in one of them
+            ChunkCoordinate min_chunk = chunk_of(std::min({v1.x, v2.x, v3.x}), std::min({v1.z, v2.z, v3.z}));
+            ChunkCoordinate max_chunk = chunk_of(std::max({v1.x, v2.x, v3.x}), std::max({v1.z, v2.z, v3.z}));
+            for (int32_t chunk_x = min_chunk.x; chunk_x <= max_chunk.x; chunk_x++) {
+                for (int32_t chunk_z = min_chunk.z; chunk_z <= max_chunk.z; chunk_z++) {
+                    coordinate_to_chunk[{chunk_x, chunk_z}].triangles.push_back(triangle);
+                }
+            }
+        }
+    }
+}
+
+template <typename Visit> void WorldStreaming::for_each_chunk_near(float x, float z, float radius, const Visit &visit) {
+    ChunkCoordinate min_chunk = chunk_of(x - radius, z - radius);
+    ChunkCoordinate max_chunk = chunk_of(x + radius, z + radius);
+    const float chunk_size = settings.chunk_size_meters;
+
+    for (int32_t chunk_x = min_chunk.x; chunk_x <= max_chunk.x; chunk_x++) {
+        for (int32_t chunk_z = min_chunk.z; chunk_z <= max_chunk.z; chunk_z++) {
+            ChunkCoordinate coordinate{chunk_x, chunk_z};
+            auto chunk = coordinate_to_chunk.find(coordinate);
+            if (chunk == coordinate_to_chunk.end()) {
+                continue; // nothing of the map is in there
+            }
+            // distance from the point to the chunk's square, zero if it's inside
+            float dx = std::max({chunk_x * chunk_size - x, 0.0f, x - (chunk_x + 1) * chunk_size});
+            float dz = std::max({chunk_z * chunk_size - z, 0.0f, z - (chunk_z + 1) * chunk_size});
+            if (dx * dx + dz * dz <= radius * radius) {
+                visit(coordinate, chunk->second);
+            }
+        }
+    }
+}
+
+JPH::ShapeRefC WorldStreaming::cook(const JPH::TriangleList &triangles) {
+    JPH::MeshShapeSettings mesh_settings(triangles);
+    JPH::Shape::ShapeResult result = mesh_settings.Create();
+    if (!result.IsValid()) {
+        throw std::runtime_error("couldn't get resulting shape");
+    }
+    return result.Get();
+}
+
+/**
+ * \brief whichever queued cook of a chunk runs first does the work, so a cook that was taken over by cook_on_demand, or
+ * one that is still queued from before the chunk was unloaded, finds nothing left to do
+ */
+void WorldStreaming::start_cooking(const ChunkCoordinate &coordinate, Chunk &chunk) {
+    chunk.cooking = true;
+    {
+        std::lock_guard<std::mutex> lock(cooked_chunks_mutex);
+        chunk.cook_state = CookState::queued;
+    }
+    Chunk *queued_chunk = &chunk;
+    cooking_pool.submit([this, coordinate, queued_chunk]() {
+        {
+            std::lock_guard<std::mutex> lock(cooked_chunks_mutex);
+            if (queued_chunk->cook_state != CookState::queued) {
+                return;
+            }
+            queued_chunk->cook_state = CookState::cooking;
+        }
+        JPH::ShapeRefC shape = cook(queued_chunk->triangles);
+        std::lock_guard<std::mutex> lock(cooked_chunks_mutex);
+        cooked_chunks.push_back({coordinate, shape});
+        queued_chunk->cook_state = CookState::idle;
+        cooked_chunks_changed.notify_all();
+    });
+}
+
+/**
+ * \brief cooks a chunk a player is too close to to wait for, unless a cooking thread is already in the middle of it,
+ * then that one is waited for instead of cooking the chunk twice. a cook that's only queued is taken over.
+ */
+void WorldStreaming::cook_on_demand(const ChunkCoordinate &coordinate, Chunk &chunk) {
+    bool cooked_in_background;
+    {
+        std::unique_lock<std::mutex> lock(cooked_chunks_mutex);
+        cooked_chunks_changed.wait(lock, [&]() { return chunk.cook_state != CookState::cooking; });
+        // also true for a cook that finished since the start of the update and just hasn't been collected
+        cooked_in_background = chunk.cooking && chunk.cook_state == CookState::idle;
+        chunk.cook_state = CookState::idle;
+    }
+    if (cooked_in_background) {
+        collect_cooked_chunks();
+        return;
+    }
+
+    chunk.cooking = false;
+    chunk.cooked_shape = cook(chunk.triangles);
+    collected_cooked_chunks.push_back({coordinate, chunk.cooked_shape});
+    shape_cache.put(coordinate, chunk.cooked_shape);
+    chunks_cooked->add();
+    chunks_cooked_on_demand->add();
+}
+
+/**
+ * \brief adds to collected_cooked_chunks, which is only emptied at the start of an update
+ */
+void WorldStreaming::collect_cooked_chunks() {
+    size_t first_new = collected_cooked_chunks.size();
+    {
+        std::lock_guard<std::mutex> lock(cooked_chunks_mutex);
+        collected_cooked_chunks.insert(collected_cooked_chunks.end(), cooked_chunks.begin(), cooked_chunks.end());
+        cooked_chunks.clear();
+    }
+    for (size_t i = first_new; i < collected_cooked_chunks.size(); i++) {
+        CookedChunk &cooked_chunk = collected_cooked_chunks[i];
+        Chunk &chunk = coordinate_to_chunk[cooked_chunk.coordinate];
+        chunk.cooking = false;
+        chunk.cooked_shape = cooked_chunk.shape;
+        shape_cache.put(cooked_chunk.coordinate, cooked_chunk.shape);
+        chunks_cooked->add();
+    }
+}
+
+void WorldStreaming::update() {
+    update_count++;
+    collected_cooked_chunks.clear();
+    collect_cooked_chunks();
+
+    wanted_chunks.clear();
+    for (const auto &[client_id, character] : physics.client_id_to_physics_character) {
+        JPH::RVec3 position = character->GetPosition();
+        float x = static_cast<float>(position.GetX());
+        float z = static_cast<float>(position.GetZ());
+
+        for_each_chunk_near(x, z, settings.unload_radius_meters,
+                            [&](const ChunkCoordinate &, Chunk &chunk) { chunk.last_kept_update = update_count; });
+        for_each_chunk_near(x, z, settings.load_radius_meters, [&](const ChunkCoordinate &coordinate, Chunk &chunk) {
+            if (chunk.last_wanted_update != update_count) {
+                chunk.last_wanted_update = update_count;
+                wanted_chunks.push_back(coordinate);
+            }
+        });
+        // only happens when a player spawns or teleports, a player walking in has been in the load radius for a while
+        for_each_chunk_near(x, z, settings.required_radius_meters,
+                            [&](const ChunkCoordinate &coordinate, Chunk &chunk) {
+                                if (!chunk.loaded && chunk.cooked_shape == nullptr &&
+                                    shape_cache.get(coordinate) == nullptr) {
+                                    cook_on_demand(coordinate, chunk);
+                                }
+                            });
+    }
+
+    add_chunk_bodies();
+    remove_chunk_bodies();
+    // from here on they're only in the cache
+    for (CookedChunk &cooked_chunk : collected_cooked_chunks) {
+        coordinate_to_chunk[cooked_chunk.coordinate].cooked_shape = nullptr;
+    }
+
+    loaded_chunks_gauge->set(static_cast<double>(loaded_chunk_coordinates.size()));
+    cached_shapes_gauge->set(static_cast<double>(shape_cache.size()));
+}
+
+/**
+ * \brief a wanted chunk that isn't cooked yet gets sent off to be cooked and is added in a later update
+ */
+void WorldStreaming::add_chunk_bodies() {
+    JPH::BodyInterface &body_interface = physics.physics_system.GetBodyInterface();
+    body_ids.clear();
+
+    for (const ChunkCoordinate &coordinate : wanted_chunks) {
+        Chunk &chunk = coordinate_to_chunk[coordinate];
+        if (chunk.loaded) {
+            continue;
+        }
+        JPH::ShapeRefC shape = chunk.cooked_shape != nullptr ? chunk.cooked_shape : shape_cache.get(coordinate);
+        if (shape == nullptr) {
+            if (!chunk.cooking) {
+                start_cooking(coordinate, chunk);
+            }
+            continue;
+        }
+
+        JPH::BodyCreationSettings chunk_settings(shape, JPH::RVec3(0.0, 0.0, 0.0), JPH::Quat::sIdentity(),
+                                                 JPH::EMotionType::Static, Layers::NON_MOVING);
+        JPH::Body *chunk_body = body_interface.CreateBody(chunk_settings);
+        if (chunk_body == nullptr) {
+            spdlog::warn("ran out of bodies, chunk ({}, {}) can't be loaded", coordinate.x, coordinate.z);
+            break;
+        }
+        chunk.body_id = chunk_body->GetID();
+        chunk.loaded = true;
+        body_ids.push_back(chunk.body_id);
+        loaded_chunk_coordinates.push_back(coordinate);
+    }
+
+    if (body_ids.empty()) {
+        return;
+    }
+    // one broadphase insertion for all of them instead of one per body
+    int num_bodies = static_cast<int>(body_ids.size());
+    JPH::BodyInterface::AddState add_state = body_interface.AddBodiesPrepare(body_ids.data(), num_bodies);
+    body_interface.AddBodiesFinalize(body_ids.data(), num_bodies, add_state, JPH::EActivation::DontActivate);
+}
+
+void WorldStreaming::remove_chunk_bodies() {
+    body_ids.clear();
+    size_t num_kept = 0;
+    for (const ChunkCoordinate &coordinate : loaded_chunk_coordinates) {
+        Chunk &chunk = coordinate_to_chunk[coordinate];
+        if (chunk.last_kept_update == update_count) {
+            loaded_chunk_coordinates[num_kept++] = coordinate;
+        } else {
+            chunk.loaded = false;
+            body_ids.push_back(chunk.body_id);
+        }
+    }
+    loaded_chunk_coordinates.resize(num_kept);
+
+    if (body_ids.empty()) {
+        return;
+    }
+    // the shapes stay in the cache, coming back to a chunk is only a body creation
+    JPH::BodyInterface &body_interface = physics.physics_system.GetBodyInterface();
+    int num_bodies = static_cast<int>(body_ids.size());
+    body_interface.RemoveBodies(body_ids.data(), num_bodies);
+    body_interface.DestroyBodies(body_ids.data(), num_bodies);
+}
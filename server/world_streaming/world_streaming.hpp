@@ -0,0 +1,158 @@
+#ifndef WORLD_STREAMING_HPP
+#define WORLD_STREAMING_HPP
+
+#include "../interaction/multiplayer_physics/physics.hpp"
+#include "../work_stealing_thread_pool/work_stealing_thread_pool.hpp"
+#include "../metrics/metrics.hpp"
+#include "Jolt/Geometry/Triangle.h"
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct ChunkCoordinate {
+    int32_t x, z;
+    bool operator==(const ChunkCoordinate &other) const { return x == other.x && z == other.z; }
+};
+
+struct ChunkCoordinateHash {
+    size_t operator()(const ChunkCoordinate &coordinate) const {
+        return std::hash<uint64_t>()((uint64_t(uint32_t(coordinate.x)) << 32) | uint32_t(coordinate.z));
+    }
+};
+
+/**
+ * \brief keeps the cooked mesh shapes of the chunks that were used most recently, so a chunk that a player walks out of
+ * and back into doesn't have to be cooked again. a shape that's evicted while its chunk is still loaded stays alive
+ * through the body's reference.
+ */
+class ChunkShapeCache {
+  public:
+    explicit ChunkShapeCache(size_t capacity) : capacity(capacity) {}
+
+    /**
+     * \return the shape, or null if it isn't cached, a hit makes it the most recently used one
+     */
+    JPH::ShapeRefC get(const ChunkCoordinate &coordinate);
+    void put(const ChunkCoordinate &coordinate, JPH::ShapeRefC shape);
+    size_t size() const { return coordinate_to_entry.size(); }
+
+  private:
+    struct Entry {
+        JPH::ShapeRefC shape;
+        std::list<ChunkCoordinate>::iterator recency; // position in most_recently_used_first
+    };
+
+    size_t capacity;
+    std::list<ChunkCoordinate> most_recently_used_first;
+    std::unordered_map<ChunkCoordinate, Entry, ChunkCoordinateHash> coordinate_to_entry;
+};
+
+struct WorldStreamingSettings {
+    float chunk_size_meters = 64.0f;
+    // chunks within this of a player are loaded, chunks further than the unload radius from every player are removed,
+    // the gap keeps a player walking along a chunk border from loading and unloading it over and over
+    float load_radius_meters = 96.0f;
+    float unload_radius_meters = 128.0f;
+    // a player this close to a chunk that isn't loaded yet can't wait for the background, it's cooked right away
+    float required_radius_meters = 8.0f;
+    size_t cached_shapes = 64;
+    size_t cooking_threads = 2;
+};
+
+/**
+ * \brief instead of putting the whole map into the physics world up front, the map is cut into square chunks on the xz
+ * plane and only the chunks near a player are in the world. so the broadphase and the cooked collision meshes scale
+ * with the area the players are in, not with the map.
+ *
+ * every triangle belongs to every chunk its bounds on the xz plane overlap, a triangle on a border ends up in the world
+ * twice when both chunks are loaded, which collides the same as once. the mesh shape of a chunk is cooked on a
+ * background thread once a player comes within the load radius, and kept in a ChunkShapeCache. every update the cooked
+ * chunks are added to the world in one batch with AddBodiesPrepare/AddBodiesFinalize, and the chunks nobody is near
+ * anymore are removed in one batch too.
+ *
+ * update has to be called from the thread that steps the world, and not while anything is being stepped. the physics
+ * has to outlive this.
+ */
+class WorldStreaming {
+  public:
+    WorldStreaming(Physics &physics, Model &map, MetricsRegistry &metrics,
+                   const WorldStreamingSettings &settings = WorldStreamingSettings());
+    ~WorldStreaming();
+
+    WorldStreaming(const WorldStreaming &) = delete;
+    WorldStreaming &operator=(const WorldStreaming &) = delete;
+
+    /**
+     * \brief loads and unloads chunks around where the characters are now
+     */
+    void update();
+
+    size_t get_num_chunks() const { return coordinate_to_chunk.size(); }
+    size_t get_num_loaded_chunks() const { return loaded_chunk_coordinates.size(); }
+
+  private:
+    enum class CookState { idle, queued, cooking };
+
+    struct Chunk {
+        JPH::TriangleList triangles;
+        bool cooking = false; // a cook was queued and its shape hasn't been collected yet
+        CookState cook_state = CookState::idle; // guarded by cooked_chunks_mutex
+        bool loaded = false;
+        JPH::BodyID body_id;
+        // set for the update it was cooked in, so it gets added even if the cache has already evicted it again
+        JPH::ShapeRefC cooked_shape;
+        uint64_t last_wanted_update = 0;
+        uint64_t last_kept_update = 0;
+    };
+
+    struct CookedChunk {
+        ChunkCoordinate coordinate;
+        JPH::ShapeRefC shape;
+    };
+
+    void split_into_chunks(Model &map);
+    ChunkCoordinate chunk_of(float x, float z) const;
+    /**
+     * \brief calls visit with every chunk whose square is within radius of the point on the xz plane
+     */
+    template <typename Visit> void for_each_chunk_near(float x, float z, float radius, const Visit &visit);
+    static JPH::ShapeRefC cook(const JPH::TriangleList &triangles);
+    void start_cooking(const ChunkCoordinate &coordinate, Chunk &chunk);
+    void cook_on_demand(const ChunkCoordinate &coordinate, Chunk &chunk);
+    void collect_cooked_chunks();
+    void add_chunk_bodies();
+    void remove_chunk_bodies();
+
+    Physics &physics;
+    WorldStreamingSettings settings;
+    // filled once in the constructor and never rehashed after, so the cooking threads can read the triangles
+    std::unordered_map<ChunkCoordinate, Chunk, ChunkCoordinateHash> coordinate_to_chunk;
+    ChunkShapeCache shape_cache;
+    uint64_t update_count = 0;
+    // so finding the chunks to unload doesn't have to look at the whole map
+    std::vector<ChunkCoordinate> loaded_chunk_coordinates;
+
+    // the chunks that were within the load radius this update, in the order they were found
+    std::vector<ChunkCoordinate> wanted_chunks;
+    // scratch for the batched adds and removes, kept between updates
+    std::vector<JPH::BodyID> body_ids;
+
+    std::mutex cooked_chunks_mutex;
+    std::condition_variable cooked_chunks_changed; // a cooking thread finished a chunk
+    std::vector<CookedChunk> cooked_chunks; // written by the cooking threads
+    std::vector<CookedChunk> collected_cooked_chunks; // the ones cooked since the last update
+
+    std::shared_ptr<Gauge> loaded_chunks_gauge;
+    std::shared_ptr<Gauge> cached_shapes_gauge;
+    std::shared_ptr<Counter> chunks_cooked;
+    std::shared_ptr<Counter> chunks_cooked_on_demand;
+
+    // last, so the cooking threads are joined before anything they write to is destroyed
+    WorkStealingThreadPool cooking_pool;
+};
+
+#endif // WORLD_STREAMING_HPP
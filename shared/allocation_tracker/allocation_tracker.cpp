@@ -0,0 +1,424 @@
+#include "allocation_tracker.hpp"
+#include "spdlog/spdlog.h"
+#include <Jolt/Jolt.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <execinfo.h>
+#include <new>
+#include <string>
+
+using namespace allocation_tracker;
+
+namespace {
+
+enum class AllocationKind { OPERATOR_NEW, JOLT };
+
+// record_call_site, count_allocation and the operator new or jolt hook that called it
+constexpr int skipped_frames = 3;
+
+struct CallSite {
+    std::array<void *, call_site_frames> frames = {};
+    int num_frames = 0;
+    std::atomic<uint64_t> count = 0;
+    // the monitor's, only touched at the end of a tick
+    uint64_t seen_count = 0;
+    uint64_t tick_count = 0;
+    uint64_t period_count = 0;
+};
+
+/**
+ * \brief written by its own thread only, the monitor reads the atomics
+ */
+struct ThreadAllocations {
+    std::atomic<bool> registered = false;
+    char name[32] = {};
+    std::atomic<uint64_t> operator_new_calls = 0;
+    std::atomic<uint64_t> jolt_calls = 0;
+    std::array<CallSite, max_call_sites_per_thread> call_sites;
+    std::atomic<size_t> num_call_sites = 0;
+    std::atomic<uint64_t> unrecorded_calls = 0; // the call site table was full
+
+    // the monitor's
+    uint64_t seen_operator_new_calls = 0, tick_operator_new_calls = 0, period_operator_new_calls = 0;
+    uint64_t seen_jolt_calls = 0, tick_jolt_calls = 0, period_jolt_calls = 0;
+    uint64_t seen_unrecorded_calls = 0, tick_unrecorded_calls = 0, period_unrecorded_calls = 0;
+};
+
+// all of this is constant initialized, operator new can be called before any constructor of ours has run
+std::array<ThreadAllocations, max_threads> thread_allocations;
+std::atomic<size_t> num_thread_allocations = 0;
+std::atomic<bool> enabled = false;
+
+thread_local ThreadAllocations *allocations_of_this_thread = nullptr;
+thread_local bool registration_failed = false;
+// also set while an allocation is counted, so that whatever the counting allocates itself isn't
+thread_local bool paused = false;
+
+ThreadAllocations *register_this_thread(const char *name) {
+    if (allocations_of_this_thread != nullptr || registration_failed) {
+        return allocations_of_this_thread;
+    }
+    size_t index = num_thread_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (index >= max_threads) {
+        registration_failed = true;
+        return nullptr;
+    }
+    ThreadAllocations &allocations = thread_allocations[index];
+    if (name != nullptr) {
+        std::snprintf(allocations.name, sizeof(allocations.name), "%s", name);
+    } else {
+        std::snprintf(allocations.name, sizeof(allocations.name), "thread %zu", index);
+    }
+    allocations.registered.store(true, std::memory_order_release);
+    allocations_of_this_thread = &allocations;
+    return &allocations;
+}
+
+__attribute__((noinline)) void record_call_site(ThreadAllocations &allocations) {
+    void *frames[skipped_frames + call_site_frames];
+    int num_frames = backtrace(frames, skipped_frames + call_site_frames) - skipped_frames;
+    if (num_frames <= 0) {
+        allocations.unrecorded_calls.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    void **site_frames = frames + skipped_frames;
+
+    size_t num_call_sites = allocations.num_call_sites.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < num_call_sites; i++) {
+        CallSite &call_site = allocations.call_sites[i];
+        if (call_site.num_frames == num_frames && std::equal(site_frames, site_frames + num_frames,
+                                                             call_site.frames.begin())) {
+            call_site.count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    if (num_call_sites == max_call_sites_per_thread) {
+        allocations.unrecorded_calls.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    CallSite &call_site = allocations.call_sites[num_call_sites];
+    std::copy(site_frames, site_frames + num_frames, call_site.frames.begin());
+    call_site.num_frames = num_frames;
+    call_site.count.store(1, std::memory_order_relaxed);
+    allocations.num_call_sites.store(num_call_sites + 1, std::memory_order_release);
+}
+
+__attribute__((noinline)) void count_allocation(AllocationKind kind) {
+    if (!enabled.load(std::memory_order_relaxed) || paused) {
+        return;
+    }
+    paused = true;
+    ThreadAllocations *allocations = register_this_thread(nullptr);
+    if (allocations != nullptr) {
+        std::atomic<uint64_t> &calls =
+            kind == AllocationKind::OPERATOR_NEW ? allocations->operator_new_calls : allocations->jolt_calls;
+        calls.fetch_add(1, std::memory_order_relaxed);
+        record_call_site(*allocations);
+    }
+    paused = false;
+}
+
+void *allocate(std::size_t size) {
+    size = std::max<std::size_t>(size, 1);
+    while (true) {
+        void *block = std::malloc(size);
+        if (block != nullptr) {
+            return block;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void *allocate_aligned(std::size_t size, std::align_val_t alignment) {
+    size = std::max<std::size_t>(size, 1);
+    std::size_t alignment_bytes = std::max(static_cast<std::size_t>(alignment), sizeof(void *));
+    while (true) {
+        void *block = nullptr;
+        if (posix_memalign(&block, alignment_bytes, size) == 0) {
+            return block;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+#ifndef JPH_DISABLE_CUSTOM_ALLOCATOR
+JPH::AllocateFunction jolt_allocate = nullptr;
+JPH::AlignedAllocateFunction jolt_aligned_allocate = nullptr;
+
+void *counted_jolt_allocate(size_t size) {
+    count_allocation(AllocationKind::JOLT);
+    return jolt_allocate(size);
+}
+
+void *counted_jolt_aligned_allocate(size_t size, size_t alignment) {
+    count_allocation(AllocationKind::JOLT);
+    return jolt_aligned_allocate(size, alignment);
+}
+
+#if defined(JPH_VERSION_MAJOR) && JPH_VERSION_MAJOR >= 5
+JPH::ReallocateFunction jolt_reallocate = nullptr;
+
+void *counted_jolt_reallocate(void *block, size_t old_size, size_t new_size) {
+    count_allocation(AllocationKind::JOLT);
+    return jolt_reallocate(block, old_size, new_size);
+}
+#endif
+#endif
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size) {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    return std::malloc(std::max<std::size_t>(size, 1));
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    return std::malloc(std::max<std::size_t>(size, 1));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    return allocate_aligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    return allocate_aligned(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    try {
+        return allocate_aligned(size, alignment);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    count_allocation(AllocationKind::OPERATOR_NEW);
+    try {
+        return allocate_aligned(size, alignment);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+// everything above comes from malloc or posix_memalign, both of which free takes back
+void operator delete(void *block) noexcept { std::free(block); }
+void operator delete[](void *block) noexcept { std::free(block); }
+void operator delete(void *block, std::size_t) noexcept { std::free(block); }
+void operator delete[](void *block, std::size_t) noexcept { std::free(block); }
+void operator delete(void *block, const std::nothrow_t &) noexcept { std::free(block); }
+void operator delete[](void *block, const std::nothrow_t &) noexcept { std::free(block); }
+void operator delete(void *block, std::align_val_t) noexcept { std::free(block); }
+void operator delete[](void *block, std::align_val_t) noexcept { std::free(block); }
+void operator delete(void *block, std::size_t, std::align_val_t) noexcept { std::free(block); }
+void operator delete[](void *block, std::size_t, std::align_val_t) noexcept { std::free(block); }
+void operator delete(void *block, std::align_val_t, const std::nothrow_t &) noexcept { std::free(block); }
+void operator delete[](void *block, std::align_val_t, const std::nothrow_t &) noexcept { std::free(block); }
+
+namespace allocation_tracker {
+
+void enable() {
+    // the first backtrace loads the unwinder, which shouldn't happen in the middle of counting something
+    void *frame;
+    backtrace(&frame, 1);
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+void install_jolt_hooks() {
+#ifndef JPH_DISABLE_CUSTOM_ALLOCATOR
+    if (JPH::Allocate == counted_jolt_allocate) {
+        return;
+    }
+    jolt_allocate = JPH::Allocate;
+    JPH::Allocate = counted_jolt_allocate;
+    jolt_aligned_allocate = JPH::AlignedAllocate;
+    JPH::AlignedAllocate = counted_jolt_aligned_allocate;
+#if defined(JPH_VERSION_MAJOR) && JPH_VERSION_MAJOR >= 5
+    jolt_reallocate = JPH::Reallocate;
+    JPH::Reallocate = counted_jolt_reallocate;
+#endif
+#endif
+}
+
+void set_thread_name(const char *name) {
+    bool was_paused = paused;
+    paused = true;
+    ThreadAllocations *allocations = register_this_thread(name);
+    if (allocations != nullptr && name != nullptr) {
+        // the thread may have allocated before it got here (enable runs before the tick thread names itself) and been
+        // registered as "thread N" then. a report printed while this is written can show half of each name, the last
+        // byte is never written by anything but a terminator so it can't run off the end
+        std::snprintf(allocations->name, sizeof(allocations->name), "%s", name);
+    }
+    paused = was_paused;
+}
+
+PauseScope::PauseScope() : was_paused(paused) { paused = true; }
+
+PauseScope::~PauseScope() { paused = was_paused; }
+
+} // namespace allocation_tracker
+
+TickAllocationMonitor::TickAllocationMonitor(const AllocationTrackingSettings &settings) : settings(settings) {
+    if (settings.count || settings.check) {
+        allocation_tracker::enable();
+    }
+}
+
+bool TickAllocationMonitor::end_tick(uint64_t tick) {
+    if (!settings.count && !settings.check) {
+        return true;
+    }
+    if (check_finished) {
+        return false; // a loop that takes a while to stop keeps asking
+    }
+    uint64_t allocations = collect();
+    ticks_seen++;
+    allocations_in_period += allocations;
+
+    if (settings.count && ticks_seen % settings.report_period_ticks == 0) {
+        log_report(Report::PERIOD, tick, allocations_in_period);
+    }
+    if (ticks_seen % settings.report_period_ticks == 0) {
+        allocations_in_period = 0;
+        for (size_t i = 0; i < std::min(num_thread_allocations.load(), max_threads); i++) {
+            ThreadAllocations &thread = thread_allocations[i];
+            thread.period_operator_new_calls = thread.period_jolt_calls = thread.period_unrecorded_calls = 0;
+            for (CallSite &call_site : thread.call_sites) {
+                call_site.period_count = 0;
+            }
+        }
+    }
+
+    if (!settings.check || ticks_seen <= settings.warm_up_ticks) {
+        return true;
+    }
+    if (allocations != 0) {
+        check_finished = true;
+        check_failed = true;
+        log_report(Report::TICK, tick, allocations);
+        spdlog::error("allocation check failed, tick {} allocated {} times after {} clean ticks", tick, allocations,
+                      ticks_checked);
+        return false;
+    }
+    if (++ticks_checked == settings.check_ticks) {
+        check_finished = true;
+        spdlog::warn("allocation check passed, {} ticks in a row didn't allocate", ticks_checked);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief takes what every thread allocated since the last call
+ * \return how many allocations that was in total
+ */
+uint64_t TickAllocationMonitor::collect() {
+    uint64_t total = 0;
+    size_t num_threads = std::min(num_thread_allocations.load(std::memory_order_acquire), max_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        ThreadAllocations &thread = thread_allocations[i];
+        if (!thread.registered.load(std::memory_order_acquire)) {
+            continue;
+        }
+        auto take = [](const std::atomic<uint64_t> &counter, uint64_t &seen, uint64_t &in_tick, uint64_t &in_period) {
+            uint64_t count = counter.load(std::memory_order_relaxed);
+            in_tick = count - seen;
+            in_period += in_tick;
+            seen = count;
+        };
+        take(thread.operator_new_calls, thread.seen_operator_new_calls, thread.tick_operator_new_calls,
+             thread.period_operator_new_calls);
+        take(thread.jolt_calls, thread.seen_jolt_calls, thread.tick_jolt_calls, thread.period_jolt_calls);
+        take(thread.unrecorded_calls, thread.seen_unrecorded_calls, thread.tick_unrecorded_calls,
+             thread.period_unrecorded_calls);
+        total += thread.tick_operator_new_calls + thread.tick_jolt_calls;
+
+        size_t num_call_sites = thread.num_call_sites.load(std::memory_order_acquire);
+        for (size_t j = 0; j < num_call_sites; j++) {
+            CallSite &call_site = thread.call_sites[j];
+            take(call_site.count, call_site.seen_count, call_site.tick_count, call_site.period_count);
+        }
+    }
+    return total;
+}
+
+/**
+ * \brief every thread that allocated and its call sites, most frequent first. allocates itself, which isn't counted
+ */
+void TickAllocationMonitor::log_report(Report report, uint64_t tick, uint64_t allocations) {
+    allocation_tracker::PauseScope pause;
+    constexpr size_t max_reported_call_sites = 8;
+    bool whole_period = report == Report::PERIOD;
+
+    std::string text = whole_period ? fmt::format("{} allocations in the {} ticks up to tick {}", allocations,
+                                                  settings.report_period_ticks, tick)
+                                    : fmt::format("{} allocations in tick {}", allocations, tick);
+    size_t num_threads = std::min(num_thread_allocations.load(std::memory_order_acquire), max_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        ThreadAllocations &thread = thread_allocations[i];
+        if (!thread.registered.load(std::memory_order_acquire)) {
+            continue;
+        }
+        uint64_t operator_new_calls = whole_period ? thread.period_operator_new_calls : thread.tick_operator_new_calls;
+        uint64_t jolt_calls = whole_period ? thread.period_jolt_calls : thread.tick_jolt_calls;
+        uint64_t unrecorded_calls = whole_period ? thread.period_unrecorded_calls : thread.tick_unrecorded_calls;
+        if (operator_new_calls + jolt_calls == 0) {
+            continue;
+        }
+        text += fmt::format("\n  {}: {} operator new, {} jolt, {} from call sites that weren't recorded", thread.name,
+                            operator_new_calls, jolt_calls, unrecorded_calls);
+
+        std::vector<const CallSite *> call_sites;
+        for (size_t j = 0; j < thread.num_call_sites.load(std::memory_order_acquire); j++) {
+            const CallSite &call_site = thread.call_sites[j];
+            if ((whole_period ? call_site.period_count : call_site.tick_count) != 0) {
+                call_sites.push_back(&call_site);
+            }
+        }
+        auto count_of = [whole_period](const CallSite *call_site) {
+            return whole_period ? call_site->period_count : call_site->tick_count;
+        };
+        std::sort(call_sites.begin(), call_sites.end(),
+                  [&](const CallSite *a, const CallSite *b) { return count_of(a) > count_of(b); });
+        call_sites.resize(std::min(call_sites.size(), max_reported_call_sites));
+
+        for (const CallSite *call_site : call_sites) {
+            text += fmt::format("\n    {}x", count_of(call_site));
+            char **symbols = backtrace_symbols(call_site->frames.data(), call_site->num_frames);
+            for (int frame = 0; frame < call_site->num_frames; frame++) {
+                text += frame == 0 ? " at " : "\n        from ";
+                text += symbols != nullptr ? symbols[frame] : fmt::format("{}", call_site->frames[frame]);
+            }
+            std::free(symbols);
+        }
+    }
+    spdlog::warn(text);
+}
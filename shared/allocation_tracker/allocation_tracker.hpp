@@ -0,0 +1,105 @@
+#ifndef ALLOCATION_TRACKER_HPP
+#define ALLOCATION_TRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \brief counts heap allocations per thread, to find what allocates in a tick that shouldn't. the global operator new
+ * is replaced by one that counts while tracking is on, and jolt's allocation hooks are wrapped the same way. every
+ * allocation also remembers the call stack it came from, so a report says where they happen.
+ *
+ * while tracking is off an allocation costs one relaxed load more than it would otherwise. the call sites read best
+ * from a build linked with -rdynamic, otherwise they're addresses that addr2line can resolve.
+ *
+ * enet allocates its packets with malloc, those aren't counted.
+ */
+namespace allocation_tracker {
+
+constexpr size_t max_threads = 128; // threads beyond this many aren't counted
+constexpr size_t max_call_sites_per_thread = 64;
+constexpr size_t call_site_frames = 6;
+
+/**
+ * \brief turns counting on for every thread, threads are registered with their first counted allocation
+ */
+void enable();
+bool is_enabled();
+/**
+ * \brief wraps jolt's allocation functions, jolt's own defaults have to be registered already
+ */
+void install_jolt_hooks();
+/**
+ * \brief what the calling thread is called in reports, it's cut short at 31 characters, replaces the "thread N" a
+ * thread that allocated before naming itself was given
+ */
+void set_thread_name(const char *name);
+
+/**
+ * \brief the calling thread's allocations aren't counted while one of these exists, for what only runs when something
+ * is reported anyway
+ */
+class PauseScope {
+  public:
+    PauseScope();
+    ~PauseScope();
+
+  private:
+    bool was_paused;
+};
+
+} // namespace allocation_tracker
+
+/**
+ * \brief set from the command line, what the tick loops do with the allocation tracker
+ */
+struct AllocationTrackingSettings {
+    // logs how often every thread allocated and where, every report_period_ticks ticks. the reports are warnings, so
+    // they still show when checking turns the logs down
+    bool count = false;
+    // fails as soon as a tick after the warm up allocates, and succeeds once check_ticks ticks in a row didn't. the
+    // warm up is for the vectors and maps to grow to what they need
+    bool check = false;
+    uint64_t warm_up_ticks = 600;
+    uint64_t check_ticks = 3600;
+    uint64_t report_period_ticks = 600;
+};
+
+/**
+ * \brief called by a tick loop at the end of every tick, takes what every thread allocated since the last tick. an
+ * allocation on another thread that's still busy with this tick, like the output graph of the server, counts toward
+ * the tick that ends after it.
+ *
+ * only one may exist at a time, since it keeps what it has seen in the tracker's per thread counts.
+ */
+class TickAllocationMonitor {
+  public:
+    /**
+     * \brief enables the tracker if the settings ask for counting or checking
+     */
+    explicit TickAllocationMonitor(const AllocationTrackingSettings &settings);
+
+    /**
+     * \return false once the loop should stop, because the check failed or is done
+     */
+    bool end_tick(uint64_t tick);
+    /**
+     * \return what the process should exit with, 1 if the check failed
+     */
+    int exit_code() const { return check_failed ? 1 : 0; }
+
+  private:
+    enum class Report { TICK, PERIOD };
+
+    uint64_t collect();
+    void log_report(Report report, uint64_t tick, uint64_t allocations);
+
+    AllocationTrackingSettings settings;
+    uint64_t ticks_seen = 0;
+    uint64_t ticks_checked = 0;
+    uint64_t allocations_in_period = 0;
+    bool check_finished = false;
+    bool check_failed = false;
+};
+
+#endif // ALLOCATION_TRACKER_HPP
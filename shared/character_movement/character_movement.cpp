@@ -0,0 +1,97 @@
+#include "character_movement.hpp"
+
+void CharacterMovementArrays::resize(size_t count) {
+    velocity_x.resize(count);
+    velocity_y.resize(count);
+    velocity_z.resize(count);
+    input_direction_x.resize(count);
+    input_direction_y.resize(count);
+    input_direction_z.resize(count);
+    up_x.resize(count);
+    up_y.resize(count);
+    up_z.resize(count);
+    on_ground.resize(count);
+    jump_pressed.resize(count);
+}
+
+void CharacterMovementArrays::set(size_t index, const CharacterMovementState &state) {
+    velocity_x[index] = state.velocity[0];
+    velocity_y[index] = state.velocity[1];
+    velocity_z[index] = state.velocity[2];
+    input_direction_x[index] = state.input_direction[0];
+    input_direction_y[index] = state.input_direction[1];
+    input_direction_z[index] = state.input_direction[2];
+    up_x[index] = state.up[0];
+    up_y[index] = state.up[1];
+    up_z[index] = state.up[2];
+    on_ground[index] = state.on_ground;
+    jump_pressed[index] = state.jump_pressed;
+}
+
+void CharacterMovementArrays::get_velocity(size_t index, float velocity[3]) const {
+    velocity[0] = velocity_x[index];
+    velocity[1] = velocity_y[index];
+    velocity[2] = velocity_z[index];
+}
+
+/**
+ * \brief one axis of the velocity update, both paths go through this so they can't get out of step. the branches are
+ * selects, which keeps the kernel loop vectorizable.
+ * \param vertical whether this is the y axis, whose velocity is emptied out on the ground
+ */
+static inline float integrate_axis(float velocity, float input_direction, float up, bool on_ground, bool jump_pressed,
+                                   bool vertical, float acceleration, float friction, float jump_acceleration,
+                                   float delta_time, float gravity) {
+    velocity = velocity + input_direction * acceleration * delta_time;
+    velocity = velocity * friction;
+    if (vertical) {
+        velocity = on_ground ? 0.0f : velocity;
+    }
+    float jump = jump_acceleration * up * delta_time;
+    velocity = on_ground && jump_pressed ? velocity + jump : velocity;
+    return velocity + gravity * delta_time;
+}
+
+void integrate_character_velocity(CharacterMovementState &state, const CharacterMovementSettings &settings,
+                                  float delta_time, const float gravity[3]) {
+    for (int axis = 0; axis < 3; axis++) {
+        state.velocity[axis] =
+            integrate_axis(state.velocity[axis], state.input_direction[axis], state.up[axis], state.on_ground,
+                           state.jump_pressed, axis == 1, settings.acceleration, settings.friction,
+                           settings.jump_acceleration, delta_time, gravity[axis]);
+    }
+}
+
+/**
+ * \brief one axis at a time over every character, like the compact character data kernels, a loop that writes all three
+ * velocity arrays has too many possible overlaps between its arrays for the compiler to check them all
+ */
+static void integrate_axis_of_characters(float *velocities, const float *input_directions, const float *ups,
+                                         const uint32_t *on_ground, const uint32_t *jump_pressed, size_t count,
+                                         bool vertical, const CharacterMovementSettings &settings, float delta_time,
+                                         float gravity) {
+    // copied out so the compiler doesn't have to assume the velocity stores change them
+    const float acceleration = settings.acceleration, friction = settings.friction;
+    const float jump_acceleration = settings.jump_acceleration;
+    for (size_t i = 0; i < count; i++) {
+        velocities[i] = integrate_axis(velocities[i], input_directions[i], ups[i], on_ground[i] != 0,
+                                       jump_pressed[i] != 0, vertical, acceleration, friction, jump_acceleration,
+                                       delta_time, gravity);
+    }
+}
+
+void integrate_character_velocities(CharacterMovementArrays &characters, const CharacterMovementSettings &settings,
+                                    float delta_time, const float gravity[3]) {
+    size_t count = characters.size();
+    const uint32_t *on_ground = characters.on_ground.data();
+    const uint32_t *jump_pressed = characters.jump_pressed.data();
+    integrate_axis_of_characters(characters.velocity_x.data(), characters.input_direction_x.data(),
+                                 characters.up_x.data(), on_ground, jump_pressed, count, false, settings, delta_time,
+                                 gravity[0]);
+    integrate_axis_of_characters(characters.velocity_y.data(), characters.input_direction_y.data(),
+                                 characters.up_y.data(), on_ground, jump_pressed, count, true, settings, delta_time,
+                                 gravity[1]);
+    integrate_axis_of_characters(characters.velocity_z.data(), characters.input_direction_z.data(),
+                                 characters.up_z.data(), on_ground, jump_pressed, count, false, settings, delta_time,
+                                 gravity[2]);
+}
@@ -0,0 +1,66 @@
+#ifndef CHARACTER_MOVEMENT_HPP
+#define CHARACTER_MOVEMENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief how a character's velocity changes with one input, shared by the client's prediction and the server so the two
+ * can't drift apart again.
+ *
+ * per input: the input direction is added as acceleration, everything is scaled by friction, a grounded character has
+ * its vertical velocity emptied out and gets the jump impulse along its up vector if jump is pressed, then gravity is
+ * added. nothing in here knows about jolt or glm, callers copy the vectors in and out as plain floats.
+ *
+ * there's a batch kernel that does this for many characters at once and a scalar reference path for one character.
+ * both do exactly the same float operations in the same order, and this file is compiled with -ffp-contract=off so
+ * the compiler can't fuse a multiply and add in one of them and not the other. that makes them bit identical, which
+ * matters because the client reconciles against what the server computed.
+ */
+struct CharacterMovementSettings {
+    float acceleration = 15.0f;
+    float friction = 0.983f; // velocity is scaled by this every input
+    float jump_acceleration = 1200.0f; // applied along the up vector for one input
+};
+
+/**
+ * \brief everything the movement of one character depends on, and its velocity afterwards
+ */
+struct CharacterMovementState {
+    float velocity[3];
+    float input_direction[3]; // from the camera, zero if no movement key is pressed
+    float up[3];
+    bool on_ground;
+    bool jump_pressed;
+};
+
+/**
+ * \brief the same as CharacterMovementState for many characters, one array per field so the kernel is a plain loop
+ */
+struct CharacterMovementArrays {
+    std::vector<float> velocity_x, velocity_y, velocity_z;
+    std::vector<float> input_direction_x, input_direction_y, input_direction_z;
+    std::vector<float> up_x, up_y, up_z;
+    std::vector<uint32_t> on_ground; // 0 or 1, as wide as the floats so the kernel vectorizes
+    std::vector<uint32_t> jump_pressed;
+
+    void resize(size_t count);
+    size_t size() const { return velocity_x.size(); }
+    void set(size_t index, const CharacterMovementState &state);
+    void get_velocity(size_t index, float velocity[3]) const;
+};
+
+/**
+ * \brief the scalar reference path, updates state.velocity
+ */
+void integrate_character_velocity(CharacterMovementState &state, const CharacterMovementSettings &settings,
+                                  float delta_time, const float gravity[3]);
+
+/**
+ * \brief integrates the velocity of every character in the arrays in one pass
+ */
+void integrate_character_velocities(CharacterMovementArrays &characters, const CharacterMovementSettings &settings,
+                                    float delta_time, const float gravity[3]);
+
+#endif // CHARACTER_MOVEMENT_HPP
@@ -0,0 +1,21 @@
+#include "character_movement_jolt.hpp"
+
+CharacterMovementState character_movement_state(const JPH::CharacterVirtual &character,
+                                                const glm::vec3 &input_direction, bool jump_pressed) {
+    JPH::Vec3 velocity = character.GetLinearVelocity();
+    JPH::Vec3 up = character.GetUp();
+
+    CharacterMovementState state;
+    state.velocity[0] = velocity.GetX();
+    state.velocity[1] = velocity.GetY();
+    state.velocity[2] = velocity.GetZ();
+    state.input_direction[0] = input_direction.x;
+    state.input_direction[1] = input_direction.y;
+    state.input_direction[2] = input_direction.z;
+    state.up[0] = up.GetX();
+    state.up[1] = up.GetY();
+    state.up[2] = up.GetZ();
+    state.on_ground = character.GetGroundState() == JPH::CharacterVirtual::EGroundState::OnGround;
+    state.jump_pressed = jump_pressed;
+    return state;
+}
@@ -0,0 +1,19 @@
+#ifndef CHARACTER_MOVEMENT_JOLT_HPP
+#define CHARACTER_MOVEMENT_JOLT_HPP
+
+#include "character_movement.hpp"
+// jolt_implementation.hpp has no include guard, so only the jolt headers themselves are pulled in here
+#include <Jolt/Jolt.h>
+#include "Jolt/Physics/Character/CharacterVirtual.h"
+#include <glm/glm.hpp>
+
+/**
+ * \brief copies what one input's movement depends on out of a jolt character, kept apart from character_movement.hpp
+ * so the movement itself stays plain floats. the client and the server both copy in through this, so the copies can't
+ * drift apart any more than the movement can.
+ * \param input_direction from the camera, zero if no movement key is pressed
+ */
+CharacterMovementState character_movement_state(const JPH::CharacterVirtual &character,
+                                                const glm::vec3 &input_direction, bool jump_pressed);
+
+#endif // CHARACTER_MOVEMENT_JOLT_HPP
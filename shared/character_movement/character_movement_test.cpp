@@ -0,0 +1,104 @@
+#include "character_movement.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/**
+ * \brief checks that the batch kernel gives bit identical velocities to the scalar path the client predicts with, for
+ * random characters, over many inputs in a row and for counts that don't fill up a vector register. exits with 1 on the
+ * first velocity that differs.
+ */
+
+static CharacterMovementState random_state(std::mt19937 &random) {
+    std::uniform_real_distribution<float> velocity(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::bernoulli_distribution coin(0.5);
+
+    CharacterMovementState state;
+    for (int axis = 0; axis < 3; axis++) {
+        state.velocity[axis] = velocity(random);
+        state.up[axis] = unit(random);
+    }
+    bool moving = coin(random);
+    for (int axis = 0; axis < 3; axis++) {
+        state.input_direction[axis] = moving ? unit(random) : 0.0f;
+    }
+    state.on_ground = coin(random);
+    state.jump_pressed = coin(random);
+    return state;
+}
+
+static bool same_bits(float a, float b) { return std::memcmp(&a, &b, sizeof(float)) == 0; }
+
+/**
+ * \return false if any velocity differs
+ */
+static bool check(size_t count, int inputs, const CharacterMovementSettings &settings, float delta_time,
+                  const float gravity[3], std::mt19937 &random) {
+    std::vector<CharacterMovementState> states(count);
+    CharacterMovementArrays arrays;
+    arrays.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        states[i] = random_state(random);
+        arrays.set(i, states[i]);
+    }
+
+    for (int input = 0; input < inputs; input++) {
+        for (CharacterMovementState &state : states) {
+            integrate_character_velocity(state, settings, delta_time, gravity);
+        }
+        integrate_character_velocities(arrays, settings, delta_time, gravity);
+
+        for (size_t i = 0; i < count; i++) {
+            float velocity[3];
+            arrays.get_velocity(i, velocity);
+            for (int axis = 0; axis < 3; axis++) {
+                if (!same_bits(velocity[axis], states[i].velocity[axis])) {
+                    std::printf("%zu characters, input %d: character %zu axis %d is %.9g batched but %.9g scalar\n",
+                                count, input, i, axis, velocity[axis], states[i].velocity[axis]);
+                    return false;
+                }
+            }
+        }
+
+        // the next input starts from the velocity both paths agree on, with fresh input
+        for (size_t i = 0; i < count; i++) {
+            CharacterMovementState next = random_state(random);
+            std::memcpy(next.velocity, states[i].velocity, sizeof(next.velocity));
+            states[i] = next;
+            arrays.set(i, next);
+        }
+    }
+    return true;
+}
+
+int main() {
+    std::mt19937 random(1234);
+
+    CharacterMovementSettings default_settings;
+    CharacterMovementSettings odd_settings;
+    odd_settings.acceleration = 7.3f;
+    odd_settings.friction = 0.91f;
+    odd_settings.jump_acceleration = 333.3f;
+
+    const float gravity[3] = {0.0f, -9.81f, 0.0f};
+    const float tilted_gravity[3] = {1.7f, -8.2f, -3.1f};
+
+    size_t counts[] = {0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 64, 255, 1000};
+    for (size_t count : counts) {
+        for (const CharacterMovementSettings *settings : {&default_settings, &odd_settings}) {
+            for (const float *g : {gravity, tilted_gravity}) {
+                for (float delta_time : {1.0f / 60.0f, 1.0f / 144.0f, 0.05f}) {
+                    if (!check(count, 120, *settings, delta_time, g, random)) {
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    std::printf("batched and scalar character movement are bit identical\n");
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "client_report.hpp"
+#include <algorithm>
+#include <cstring>
+
+constexpr size_t reconciliation_report_bytes = sizeof(uint8_t) + 2 * sizeof(uint32_t) + 2 * sizeof(float);
+
+void ReconciliationReport::add_reconciliation(float correction_meters) {
+    reconciliations++;
+    if (correction_meters > correction_threshold_meters) {
+        corrections++;
+        total_correction_meters += correction_meters;
+        max_correction_meters = std::max(max_correction_meters, correction_meters);
+    }
+}
+
+template <typename T> static inline void write_field(uint8_t *&cursor, const T &value) {
+    std::memcpy(cursor, &value, sizeof(T));
+    cursor += sizeof(T);
+}
+
+template <typename T> static inline void read_field(const uint8_t *&cursor, T &value) {
+    std::memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+}
+
+void encode_reconciliation_report(const ReconciliationReport &report, std::vector<uint8_t> &encoded) {
+    encoded.resize(reconciliation_report_bytes);
+    uint8_t *cursor = encoded.data();
+    write_field(cursor, static_cast<uint8_t>(ClientReportType::RECONCILIATION));
+    write_field(cursor, report.reconciliations);
+    write_field(cursor, report.corrections);
+    write_field(cursor, report.total_correction_meters);
+    write_field(cursor, report.max_correction_meters);
+}
+
+bool read_client_report_type(const uint8_t *data, size_t length, ClientReportType &type) {
+    if (length < sizeof(uint8_t)) {
+        return false;
+    }
+    type = static_cast<ClientReportType>(data[0]);
+    return true;
+}
+
+bool decode_reconciliation_report(const uint8_t *data, size_t length, ReconciliationReport &report) {
+    if (length != reconciliation_report_bytes || data[0] != static_cast<uint8_t>(ClientReportType::RECONCILIATION)) {
+        return false;
+    }
+    const uint8_t *cursor = data + sizeof(uint8_t);
+    read_field(cursor, report.reconciliations);
+    read_field(cursor, report.corrections);
+    read_field(cursor, report.total_correction_meters);
+    read_field(cursor, report.max_correction_meters);
+    return true;
+}
+
+void encode_input_latency_report(const InputLatencyReport &report, std::vector<uint8_t> &encoded) {
+    encoded.clear();
+    encoded.push_back(static_cast<uint8_t>(ClientReportType::INPUT_LATENCY));
+    report.input_to_acknowledgement.encode(encoded);
+    report.acknowledgement_to_render.encode(encoded);
+}
+
+bool decode_input_latency_report(const uint8_t *data, size_t length, InputLatencyReport &report) {
+    if (length < sizeof(uint8_t) || data[0] != static_cast<uint8_t>(ClientReportType::INPUT_LATENCY)) {
+        return false;
+    }
+    const uint8_t *cursor = data + sizeof(uint8_t);
+    const uint8_t *end = data + length;
+    return report.input_to_acknowledgement.decode(cursor, end) &&
+           report.acknowledgement_to_render.decode(cursor, end) && cursor == end;
+}
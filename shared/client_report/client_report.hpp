@@ -0,0 +1,65 @@
+#ifndef CLIENT_REPORT_HPP
+#define CLIENT_REPORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "latency_histogram/latency_histogram.hpp"
+
+/**
+ * \brief things the client measures about itself and periodically tells the server, so the server can show how the
+ * game feels from the client's side. reports go over their own channel so they never get mistaken for inputs.
+ *
+ * every report starts with a u8 ClientReportType, followed by the fields of that report in order.
+ */
+namespace client_report {
+constexpr uint8_t channel = 1;
+} // namespace client_report
+
+enum class ClientReportType : uint8_t {
+    RECONCILIATION = 0,
+    INPUT_LATENCY = 1,
+};
+
+/**
+ * \brief how often the server disagreed with our prediction since the last report
+ */
+struct ReconciliationReport {
+    uint32_t reconciliations = 0; // how many times the local character was reset to the server's state
+    uint32_t corrections = 0;     // how many of those moved the character by more than correction_threshold_meters
+    float total_correction_meters = 0;
+    float max_correction_meters = 0;
+
+    static constexpr float correction_threshold_meters = 0.01f;
+
+    void add_reconciliation(float correction_meters);
+};
+
+/**
+ * \brief how long our inputs took to have a visible effect since the last report, every input is counted once
+ */
+struct InputLatencyReport {
+    // from the input being captured to a game state that acknowledges it arriving
+    LatencyHistogram input_to_acknowledgement;
+    // from a game state acknowledging an input arriving to the first frame that shows it being done rendering
+    LatencyHistogram acknowledgement_to_render;
+};
+
+void encode_reconciliation_report(const ReconciliationReport &report, std::vector<uint8_t> &encoded);
+
+/**
+ * \return false if there isn't even a type
+ */
+bool read_client_report_type(const uint8_t *data, size_t length, ClientReportType &type);
+/**
+ * \return false if the data isn't a well formed reconciliation report
+ */
+bool decode_reconciliation_report(const uint8_t *data, size_t length, ReconciliationReport &report);
+
+void encode_input_latency_report(const InputLatencyReport &report, std::vector<uint8_t> &encoded);
+/**
+ * \return false if the data isn't a well formed input latency report
+ */
+bool decode_input_latency_report(const uint8_t *data, size_t length, InputLatencyReport &report);
+
+#endif // CLIENT_REPORT_HPP
@@ -0,0 +1,177 @@
+#include "compact_character_data.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace compact_character_data;
+
+void CharacterStateArrays::resize(size_t count) {
+    entity_ids.resize(count);
+    acknowledged_inputs.resize(count);
+    position_x.resize(count);
+    position_y.resize(count);
+    position_z.resize(count);
+    velocity_x.resize(count);
+    velocity_y.resize(count);
+    velocity_z.resize(count);
+    yaw.resize(count);
+    pitch.resize(count);
+}
+
+// the clamps are done in float before converting so that the loops stay branch free
+static inline uint32_t quantize_axis(float value, float minimum) {
+    float steps = (value - minimum) * position_steps_per_meter + 0.5f;
+    steps = std::min(std::max(steps, 0.0f), static_cast<float>(position_max_quantized));
+    return static_cast<uint32_t>(steps);
+}
+
+void quantize_positions(const float *x, const float *y, const float *z, uint64_t *packed, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t quantized_x = quantize_axis(x[i], position_min_x);
+        uint64_t quantized_y = quantize_axis(y[i], position_min_y);
+        uint64_t quantized_z = quantize_axis(z[i], position_min_z);
+        packed[i] = quantized_x | (quantized_y << position_bits) | (quantized_z << (2 * position_bits));
+    }
+}
+
+void dequantize_positions(const uint64_t *packed, float *x, float *y, float *z, size_t count) {
+    const float meters_per_step = 1.0f / position_steps_per_meter;
+    for (size_t i = 0; i < count; i++) {
+        x[i] = static_cast<float>(packed[i] & position_max_quantized) * meters_per_step + position_min_x;
+        y[i] = static_cast<float>((packed[i] >> position_bits) & position_max_quantized) * meters_per_step +
+               position_min_y;
+        z[i] = static_cast<float>((packed[i] >> (2 * position_bits)) & position_max_quantized) * meters_per_step +
+               position_min_z;
+    }
+}
+
+void quantize_velocities(const float *velocities, int16_t *quantized, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float steps = std::floor(velocities[i] * velocity_steps_per_meter_per_second + 0.5f);
+        steps = std::min(std::max(steps, static_cast<float>(INT16_MIN)), static_cast<float>(INT16_MAX));
+        quantized[i] = static_cast<int16_t>(steps);
+    }
+}
+
+void dequantize_velocities(const int16_t *quantized, float *velocities, size_t count) {
+    const float meters_per_second_per_step = 1.0f / velocity_steps_per_meter_per_second;
+    for (size_t i = 0; i < count; i++) {
+        velocities[i] = static_cast<float>(quantized[i]) * meters_per_second_per_step;
+    }
+}
+
+void quantize_yaws(const float *yaws_degrees, uint16_t *quantized, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float wrapped = yaws_degrees[i] - 360.0f * std::floor(yaws_degrees[i] * (1.0f / 360.0f));
+        // 360 degrees rounds up to 65536 which wraps back around to 0, which is the same angle
+        quantized[i] = static_cast<uint16_t>(static_cast<uint32_t>(wrapped * yaw_steps_per_degree + 0.5f));
+    }
+}
+
+void dequantize_yaws(const uint16_t *quantized, float *yaws_degrees, size_t count) {
+    const float degrees_per_step = 1.0f / yaw_steps_per_degree;
+    for (size_t i = 0; i < count; i++) {
+        yaws_degrees[i] = static_cast<float>(quantized[i]) * degrees_per_step;
+    }
+}
+
+void quantize_pitches(const float *pitches_degrees, uint16_t *quantized, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float steps = (pitches_degrees[i] + 90.0f) * pitch_steps_per_degree + 0.5f;
+        steps = std::min(std::max(steps, 0.0f), 65535.0f);
+        quantized[i] = static_cast<uint16_t>(steps);
+    }
+}
+
+void dequantize_pitches(const uint16_t *quantized, float *pitches_degrees, size_t count) {
+    const float degrees_per_step = 1.0f / pitch_steps_per_degree;
+    for (size_t i = 0; i < count; i++) {
+        pitches_degrees[i] = static_cast<float>(quantized[i]) * degrees_per_step - 90.0f;
+    }
+}
+
+void CompactCharacterDataCodec::resize_quantized(size_t count) {
+    quantized_positions.resize(count);
+    quantized_velocity_x.resize(count);
+    quantized_velocity_y.resize(count);
+    quantized_velocity_z.resize(count);
+    quantized_yaw.resize(count);
+    quantized_pitch.resize(count);
+}
+
+// appends the raw bytes of a whole array and advances the write cursor
+template <typename T> static inline void write_array(uint8_t *&cursor, const T *values, size_t count) {
+    std::memcpy(cursor, values, count * sizeof(T));
+    cursor += count * sizeof(T);
+}
+
+template <typename T> static inline void read_array(const uint8_t *&cursor, T *values, size_t count) {
+    std::memcpy(values, cursor, count * sizeof(T));
+    cursor += count * sizeof(T);
+}
+
+void CompactCharacterDataCodec::encode(const CharacterStateArrays &states, std::vector<uint8_t> &encoded) {
+    encode(states, 0, states.size(), 0, encoded);
+}
+
+void CompactCharacterDataCodec::encode(const CharacterStateArrays &states, size_t first, size_t count,
+                                       size_t prefix_bytes, std::vector<uint8_t> &encoded) {
+    count = std::min({count, states.size() - std::min(first, states.size()), max_characters});
+    resize_quantized(count);
+
+    quantize_positions(states.position_x.data() + first, states.position_y.data() + first,
+                       states.position_z.data() + first, quantized_positions.data(), count);
+    quantize_velocities(states.velocity_x.data() + first, quantized_velocity_x.data(), count);
+    quantize_velocities(states.velocity_y.data() + first, quantized_velocity_y.data(), count);
+    quantize_velocities(states.velocity_z.data() + first, quantized_velocity_z.data(), count);
+    quantize_yaws(states.yaw.data() + first, quantized_yaw.data(), count);
+    quantize_pitches(states.pitch.data() + first, quantized_pitch.data(), count);
+
+    encoded.resize(prefix_bytes + encoded_size(count));
+    uint8_t *cursor = encoded.data() + prefix_bytes;
+    uint16_t header_count = static_cast<uint16_t>(count);
+    write_array(cursor, &header_count, 1);
+    write_array(cursor, states.entity_ids.data() + first, count);
+    write_array(cursor, states.acknowledged_inputs.data() + first, count);
+    write_array(cursor, quantized_positions.data(), count);
+    write_array(cursor, quantized_velocity_x.data(), count);
+    write_array(cursor, quantized_velocity_y.data(), count);
+    write_array(cursor, quantized_velocity_z.data(), count);
+    write_array(cursor, quantized_yaw.data(), count);
+    write_array(cursor, quantized_pitch.data(), count);
+}
+
+bool CompactCharacterDataCodec::decode(const uint8_t *data, size_t length, CharacterStateArrays &states) {
+    if (length < header_bytes) {
+        return false;
+    }
+
+    const uint8_t *cursor = data;
+    uint16_t count = 0;
+    read_array(cursor, &count, 1);
+    if (length != encoded_size(count)) {
+        return false;
+    }
+
+    states.resize(count);
+    resize_quantized(count);
+
+    read_array(cursor, states.entity_ids.data(), count);
+    read_array(cursor, states.acknowledged_inputs.data(), count);
+    read_array(cursor, quantized_positions.data(), count);
+    read_array(cursor, quantized_velocity_x.data(), count);
+    read_array(cursor, quantized_velocity_y.data(), count);
+    read_array(cursor, quantized_velocity_z.data(), count);
+    read_array(cursor, quantized_yaw.data(), count);
+    read_array(cursor, quantized_pitch.data(), count);
+
+    dequantize_positions(quantized_positions.data(), states.position_x.data(), states.position_y.data(),
+                         states.position_z.data(), count);
+    dequantize_velocities(quantized_velocity_x.data(), states.velocity_x.data(), count);
+    dequantize_velocities(quantized_velocity_y.data(), states.velocity_y.data(), count);
+    dequantize_velocities(quantized_velocity_z.data(), states.velocity_z.data(), count);
+    dequantize_yaws(quantized_yaw.data(), states.yaw.data(), count);
+    dequantize_pitches(quantized_pitch.data(), states.pitch.data(), count);
+
+    return true;
+}
@@ -0,0 +1,142 @@
+#ifndef COMPACT_CHARACTER_DATA_HPP
+#define COMPACT_CHARACTER_DATA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief quantized wire format for the state of every character, replacing the raw NetworkedCharacterData structs.
+ *
+ * the raw struct is 48 bytes per character (u64 id, u64 acknowledgement, 6 floats, 2 float angles). the compact form is
+ * 24 bytes per character plus a 2 byte header:
+ *
+ *   field                bits   range                                      max absolute error
+ *   entity id            16     dense ids handed out by the server         exact
+ *   acknowledged input   32     low 32 bits of the input sequence number   exact, the client restores the high bits
+ *   position (x, y, z)   3x21   x, z in [-512, 512) y in [-256, 768) m     half a step of 1/2048 m plus float
+ *                                                                          rounding, under 0.3 mm
+ *   velocity (x, y, z)   3x16   [-128, 128) m/s, clamped                   1/512 m/s (~2 mm/s)
+ *   yaw                  16     any angle in degrees, wrapped to [0, 360)  half a step of 360/65536 deg, under
+ *                                                                          0.003 deg
+ *   pitch                16     [-90, 90] degrees                          180/131070 deg (~0.0014 deg)
+ *
+ * layout: u16 count | u16 ids[count] | u32 acks[count] | u64 positions[count] | i16 vx[count] | i16 vy[count] |
+ *         i16 vz[count] | u16 yaw[count] | u16 pitch[count]
+ *
+ * every field is stored as its own contiguous array so each quantize/dequantize kernel is a plain loop over one array,
+ * which the compiler can vectorize across all characters.
+ */
+namespace compact_character_data {
+
+constexpr float position_min_x = -512.0f;
+constexpr float position_min_y = -256.0f;
+constexpr float position_min_z = -512.0f;
+constexpr float position_extent = 1024.0f;
+constexpr uint32_t position_bits = 21;
+constexpr uint32_t position_max_quantized = (1u << position_bits) - 1;
+constexpr float position_steps_per_meter = (1u << position_bits) / position_extent;
+
+constexpr float velocity_steps_per_meter_per_second = 256.0f;
+constexpr float yaw_steps_per_degree = 65536.0f / 360.0f;
+constexpr float pitch_steps_per_degree = 65535.0f / 180.0f;
+
+constexpr size_t header_bytes = sizeof(uint16_t);
+constexpr size_t bytes_per_character = sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint64_t) + 3 * sizeof(int16_t) +
+                                       2 * sizeof(uint16_t);
+static_assert(bytes_per_character == 24, "the documented wire size is out of date");
+constexpr size_t raw_bytes_per_character = 2 * sizeof(uint64_t) + 8 * sizeof(float);
+static_assert(raw_bytes_per_character == 2 * bytes_per_character, "the compact form should be half the raw struct");
+
+constexpr size_t max_characters = UINT16_MAX;
+
+inline size_t encoded_size(size_t character_count) { return header_bytes + character_count * bytes_per_character; }
+
+} // namespace compact_character_data
+
+/**
+ * \brief the state of many characters as one array per field
+ */
+struct CharacterStateArrays {
+    std::vector<uint16_t> entity_ids;
+    std::vector<uint32_t> acknowledged_inputs;
+    std::vector<float> position_x, position_y, position_z;
+    std::vector<float> velocity_x, velocity_y, velocity_z;
+    std::vector<float> yaw, pitch;
+
+    void resize(size_t count);
+    size_t size() const { return entity_ids.size(); }
+};
+
+/**
+ * \brief copies a NetworkedCharacterData into the arrays at index. a template so this file doesn't need the server's or
+ * the client's copy of the struct. the id has to fit into 16 bits, which the server's dense ids do, and only the low 32
+ * bits of the acknowledged input are kept.
+ */
+template <typename CharacterData>
+void set_character_state(CharacterStateArrays &states, size_t index, const CharacterData &character_data) {
+    states.entity_ids[index] = static_cast<uint16_t>(character_data.client_id);
+    // the client knows the full value of its own inputs, the low bits are enough for it to find the one we mean
+    states.acknowledged_inputs[index] =
+        static_cast<uint32_t>(character_data.cihtems_of_last_server_processed_input_snapshot);
+    states.position_x[index] = character_data.character_x_position;
+    states.position_y[index] = character_data.character_y_position;
+    states.position_z[index] = character_data.character_z_position;
+    states.velocity_x[index] = character_data.character_x_velocity;
+    states.velocity_y[index] = character_data.character_y_velocity;
+    states.velocity_z[index] = character_data.character_z_velocity;
+    states.yaw[index] = character_data.camera_yaw_angle;
+    states.pitch[index] = character_data.camera_pitch_angle;
+}
+
+/**
+ * \brief the other way around
+ * \param acknowledged_input the full value, restored by the receiver from the low bits that were sent
+ */
+template <typename CharacterData>
+CharacterData get_character_state(const CharacterStateArrays &states, size_t index, uint64_t acknowledged_input) {
+    return {states.entity_ids[index], acknowledged_input,        states.position_x[index], states.position_y[index],
+            states.position_z[index], states.velocity_x[index], states.velocity_y[index], states.velocity_z[index],
+            states.yaw[index],        states.pitch[index]};
+}
+
+/**
+ * \brief packs and unpacks CharacterStateArrays, the quantized intermediate arrays are kept between calls so encoding
+ * and decoding don't allocate once they've grown to the usual player count.
+ */
+class CompactCharacterDataCodec {
+  public:
+    /**
+     * \brief replaces the contents of encoded with the compact form of states
+     */
+    void encode(const CharacterStateArrays &states, std::vector<uint8_t> &encoded);
+    /**
+     * \brief replaces the contents of encoded with prefix_bytes of room for the caller's own header, followed by the
+     * compact form of count of the states starting at first
+     */
+    void encode(const CharacterStateArrays &states, size_t first, size_t count, size_t prefix_bytes,
+                std::vector<uint8_t> &encoded);
+    /**
+     * \return false if the data isn't a well formed compact character state message
+     */
+    bool decode(const uint8_t *data, size_t length, CharacterStateArrays &states);
+
+  private:
+    void resize_quantized(size_t count);
+
+    std::vector<uint64_t> quantized_positions;
+    std::vector<int16_t> quantized_velocity_x, quantized_velocity_y, quantized_velocity_z;
+    std::vector<uint16_t> quantized_yaw, quantized_pitch;
+};
+
+// the kernels, one loop per field so that they vectorize
+void quantize_positions(const float *x, const float *y, const float *z, uint64_t *packed, size_t count);
+void dequantize_positions(const uint64_t *packed, float *x, float *y, float *z, size_t count);
+void quantize_velocities(const float *velocities, int16_t *quantized, size_t count);
+void dequantize_velocities(const int16_t *quantized, float *velocities, size_t count);
+void quantize_yaws(const float *yaws_degrees, uint16_t *quantized, size_t count);
+void dequantize_yaws(const uint16_t *quantized, float *yaws_degrees, size_t count);
+void quantize_pitches(const float *pitches_degrees, uint16_t *quantized, size_t count);
+void dequantize_pitches(const uint16_t *quantized, float *pitches_degrees, size_t count);
+
+#endif // COMPACT_CHARACTER_DATA_HPP
@@ -0,0 +1,216 @@
+#include "compact_character_data.hpp"
+#include "compact_input_snapshot/compact_input_snapshot.hpp"
+#include "networked_character_data/networked_character_data.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+/**
+ * \brief sends NetworkedCharacterData through the compact format and back the way the server and the client do, and
+ * checks that nothing moves further than compact_character_data.hpp promises, that what's outside the map is clamped to
+ * its edge, and that ids and acknowledged inputs come back as they went in. exits with 1 if anything doesn't.
+ */
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what, size_t index, double got, double expected) {
+    if (!condition) {
+        std::printf("character %zu: %s is %.9g but expected %.9g\n", index, what, got, expected);
+        failures++;
+    }
+}
+
+static void expect_near(const char *what, size_t index, double got, double expected, double max_error) {
+    expect(std::abs(got - expected) <= max_error, what, index, got, expected);
+}
+
+/**
+ * \brief the way the server fills the arrays and the client reads them, with the client's acknowledgement restored
+ */
+static std::vector<NetworkedCharacterData> round_trip(const std::vector<NetworkedCharacterData> &characters,
+                                                      const InputSnapshotEncoder *input_snapshot_encoder = nullptr) {
+    CharacterStateArrays sent;
+    sent.resize(characters.size());
+    for (size_t i = 0; i < characters.size(); i++) {
+        set_character_state(sent, i, characters[i]);
+    }
+
+    CompactCharacterDataCodec codec;
+    std::vector<uint8_t> encoded;
+    codec.encode(sent, encoded);
+    if (encoded.size() != compact_character_data::encoded_size(characters.size())) {
+        std::printf("%zu characters were encoded into %zu bytes\n", characters.size(), encoded.size());
+        failures++;
+    }
+
+    CharacterStateArrays received;
+    if (!codec.decode(encoded.data(), encoded.size(), received) || received.size() != characters.size()) {
+        std::printf("%zu characters didn't decode\n", characters.size());
+        failures++;
+        return {};
+    }
+
+    std::vector<NetworkedCharacterData> decoded;
+    for (size_t i = 0; i < received.size(); i++) {
+        uint64_t acknowledged_input = input_snapshot_encoder != nullptr
+                                          ? input_snapshot_encoder->restore_sequence(received.acknowledged_inputs[i])
+                                          : received.acknowledged_inputs[i];
+        decoded.push_back(get_character_state<NetworkedCharacterData>(received, i, acknowledged_input));
+    }
+    return decoded;
+}
+
+/**
+ * \brief the difference between two angles, going the short way around
+ */
+static double angle_difference(double a, double b) {
+    double difference = std::fmod(a - b, 360.0);
+    if (difference > 180.0) {
+        difference -= 360.0;
+    } else if (difference < -180.0) {
+        difference += 360.0;
+    }
+    return difference;
+}
+
+static void test_quantization_error(std::mt19937 &random) {
+    std::uniform_real_distribution<float> horizontal(-512.0f, 511.99f);
+    std::uniform_real_distribution<float> vertical(-256.0f, 767.99f);
+    std::uniform_real_distribution<float> velocity(-127.99f, 127.99f);
+    std::uniform_real_distribution<float> yaw(-720.0f, 720.0f);
+    std::uniform_real_distribution<float> pitch(-90.0f, 90.0f);
+
+    std::vector<NetworkedCharacterData> characters;
+    for (uint64_t id = 0; id < 1000; id++) {
+        characters.push_back({id, id * 7, horizontal(random), vertical(random), horizontal(random), velocity(random),
+                              velocity(random), velocity(random), yaw(random), pitch(random)});
+    }
+    std::vector<NetworkedCharacterData> decoded = round_trip(characters);
+
+    // the documented bounds
+    const double max_position_error = 0.0003;
+    const double max_velocity_error = 1.0 / 512.0;
+    const double max_yaw_error = 0.003;
+    const double max_pitch_error = 0.0014;
+    for (size_t i = 0; i < decoded.size(); i++) {
+        const NetworkedCharacterData &sent = characters[i];
+        const NetworkedCharacterData &received = decoded[i];
+        expect_near("x position", i, received.character_x_position, sent.character_x_position, max_position_error);
+        expect_near("y position", i, received.character_y_position, sent.character_y_position, max_position_error);
+        expect_near("z position", i, received.character_z_position, sent.character_z_position, max_position_error);
+        expect_near("x velocity", i, received.character_x_velocity, sent.character_x_velocity, max_velocity_error);
+        expect_near("y velocity", i, received.character_y_velocity, sent.character_y_velocity, max_velocity_error);
+        expect_near("z velocity", i, received.character_z_velocity, sent.character_z_velocity, max_velocity_error);
+        double yaw_error = angle_difference(received.camera_yaw_angle, sent.camera_yaw_angle);
+        expect(std::abs(yaw_error) <= max_yaw_error, "yaw", i, received.camera_yaw_angle, sent.camera_yaw_angle);
+        expect(received.camera_yaw_angle >= 0.0f && received.camera_yaw_angle < 360.0f, "wrapped yaw", i,
+               received.camera_yaw_angle, sent.camera_yaw_angle);
+        expect_near("pitch", i, received.camera_pitch_angle, sent.camera_pitch_angle, max_pitch_error);
+    }
+}
+
+static void test_clamping() {
+    using namespace compact_character_data;
+    const double position_step = 1.0 / position_steps_per_meter;
+    const double velocity_step = 1.0 / velocity_steps_per_meter_per_second;
+
+    std::vector<NetworkedCharacterData> characters = {
+        {0, 0, -600.0f, -300.0f, -10000.0f, -200.0f, -1000.0f, -128.0f, 0.0f, -120.0f},
+        {1, 0, 600.0f, 900.0f, 10000.0f, 200.0f, 1000.0f, 128.0f, 360.0f, 120.0f},
+    };
+    std::vector<NetworkedCharacterData> decoded = round_trip(characters);
+    if (decoded.size() != 2) {
+        return;
+    }
+
+    const NetworkedCharacterData &below = decoded[0];
+    expect_near("x position below the map", 0, below.character_x_position, position_min_x, 0.0);
+    expect_near("y position below the map", 0, below.character_y_position, position_min_y, 0.0);
+    expect_near("z position below the map", 0, below.character_z_position, position_min_z, 0.0);
+    expect_near("x velocity below the range", 0, below.character_x_velocity, -128.0, 0.0);
+    expect_near("y velocity below the range", 0, below.character_y_velocity, -128.0, 0.0);
+    expect_near("z velocity at the bottom of the range", 0, below.character_z_velocity, -128.0, 0.0);
+    expect_near("pitch below straight down", 0, below.camera_pitch_angle, -90.0, 0.0);
+
+    // the top of a range is one step short of it, the last step that fits into the bits
+    const NetworkedCharacterData &above = decoded[1];
+    expect_near("x position above the map", 1, above.character_x_position, position_min_x + position_extent,
+                position_step);
+    expect_near("y position above the map", 1, above.character_y_position, position_min_y + position_extent,
+                position_step);
+    expect_near("z position above the map", 1, above.character_z_position, position_min_z + position_extent,
+                position_step);
+    expect_near("x velocity above the range", 1, above.character_x_velocity, 128.0 - velocity_step, 0.0);
+    expect_near("y velocity above the range", 1, above.character_y_velocity, 128.0 - velocity_step, 0.0);
+    expect_near("z velocity at the top of the range", 1, above.character_z_velocity, 128.0 - velocity_step, 0.0);
+    expect_near("yaw of a full turn", 1, above.camera_yaw_angle, 0.0, 0.0);
+    expect_near("pitch above straight up", 1, above.camera_pitch_angle, 90.0, 0.0);
+}
+
+static void test_id_remapping() {
+    // the server hands out the lowest free id, so every id a full server can have has to make it through 16 bits
+    std::vector<NetworkedCharacterData> characters;
+    for (uint64_t id = 0; id < compact_character_data::max_characters; id++) {
+        characters.push_back({id, 0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f});
+    }
+    std::vector<NetworkedCharacterData> decoded = round_trip(characters);
+    for (size_t i = 0; i < decoded.size(); i++) {
+        expect(decoded[i].client_id == characters[i].client_id, "id", i, static_cast<double>(decoded[i].client_id),
+               static_cast<double>(characters[i].client_id));
+    }
+
+    // the acknowledgement is the client's own input sequence, it gets its high bits back from what it has sent since
+    InputSnapshotEncoder input_snapshot_encoder;
+    std::vector<uint8_t> encoded_input;
+    const uint64_t num_inputs = 300;
+    for (uint64_t i = 0; i < num_inputs; i++) {
+        input_snapshot_encoder.encode(InputState(), encoded_input);
+    }
+    characters.clear();
+    for (uint64_t sequence = 0; sequence <= num_inputs; sequence++) {
+        characters.push_back({0, sequence, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f});
+    }
+    decoded = round_trip(characters, &input_snapshot_encoder);
+    for (size_t i = 0; i < decoded.size(); i++) {
+        expect(decoded[i].cihtems_of_last_server_processed_input_snapshot ==
+                   characters[i].cihtems_of_last_server_processed_input_snapshot,
+               "acknowledged input", i, static_cast<double>(decoded[i].cihtems_of_last_server_processed_input_snapshot),
+               static_cast<double>(characters[i].cihtems_of_last_server_processed_input_snapshot));
+    }
+}
+
+static void test_malformed_messages() {
+    CharacterStateArrays states;
+    states.resize(3);
+    CompactCharacterDataCodec codec;
+    std::vector<uint8_t> encoded;
+    codec.encode(states, encoded);
+
+    CharacterStateArrays decoded;
+    if (codec.decode(encoded.data(), encoded.size() - 1, decoded) || codec.decode(encoded.data(), 1, decoded)) {
+        std::printf("a truncated message was decoded\n");
+        failures++;
+    }
+    encoded.push_back(0);
+    if (codec.decode(encoded.data(), encoded.size(), decoded)) {
+        std::printf("a message with trailing bytes was decoded\n");
+        failures++;
+    }
+}
+
+int main() {
+    std::mt19937 random(1234);
+    test_quantization_error(random);
+    test_clamping();
+    test_id_remapping();
+    test_malformed_messages();
+
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("compact character data round trips within its documented bounds\n");
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "compact_input_snapshot.hpp"
+#include <cmath>
+#include <cstring>
+
+using namespace compact_input_snapshot;
+
+static uint8_t pack_keys(const InputState &input) {
+    uint8_t keys = 0;
+    keys |= input.left_pressed ? left_bit : 0;
+    keys |= input.right_pressed ? right_bit : 0;
+    keys |= input.forward_pressed ? forward_bit : 0;
+    keys |= input.backward_pressed ? backward_bit : 0;
+    keys |= input.jump_pressed ? jump_bit : 0;
+    return keys;
+}
+
+static void unpack_keys(uint8_t keys, InputState &input) {
+    input.left_pressed = keys & left_bit;
+    input.right_pressed = keys & right_bit;
+    input.forward_pressed = keys & forward_bit;
+    input.backward_pressed = keys & backward_bit;
+    input.jump_pressed = keys & jump_bit;
+}
+
+// returns false when the delta doesn't fit into 16 bits
+static bool quantize_mouse_delta(float delta_pixels, int16_t &quantized) {
+    float steps = std::round(delta_pixels * mouse_steps_per_pixel);
+    if (steps < INT16_MIN || steps > INT16_MAX) {
+        return false;
+    }
+    quantized = static_cast<int16_t>(steps);
+    return true;
+}
+
+static float dequantize_mouse_delta(int16_t quantized) { return static_cast<float>(quantized) / mouse_steps_per_pixel; }
+
+uint64_t InputSnapshotEncoder::encode(const InputState &input, std::vector<uint8_t> &encoded) {
+    uint64_t sequence = next_sequence++;
+    uint16_t wire_sequence = static_cast<uint16_t>(sequence);
+    uint8_t keys = pack_keys(input);
+
+    const SentMousePosition &base = history[acknowledged_sequence % history_length];
+    bool base_usable = acknowledged_sequence != 0 && base.sequence == acknowledged_sequence &&
+                       sequence - acknowledged_sequence < history_length;
+
+    int16_t quantized_dx = 0, quantized_dy = 0;
+    bool delta_fits = base_usable &&
+                      quantize_mouse_delta(input.mouse_position_x - base.mouse_position_x, quantized_dx) &&
+                      quantize_mouse_delta(input.mouse_position_y - base.mouse_position_y, quantized_dy);
+
+    SentMousePosition &sent = history[sequence % history_length];
+    sent.sequence = sequence;
+
+    if (delta_fits) {
+        uint8_t base_distance = static_cast<uint8_t>(sequence - acknowledged_sequence);
+        encoded.resize(delta_message_bytes);
+        uint8_t *cursor = encoded.data();
+        std::memcpy(cursor, &wire_sequence, sizeof(wire_sequence));
+        cursor[2] = keys;
+        cursor[3] = base_distance;
+        std::memcpy(cursor + header_bytes, &quantized_dx, sizeof(quantized_dx));
+        std::memcpy(cursor + header_bytes + sizeof(quantized_dx), &quantized_dy, sizeof(quantized_dy));
+
+        // remember what the server will reconstruct, not the raw position, so that rounding never accumulates
+        sent.mouse_position_x = base.mouse_position_x + dequantize_mouse_delta(quantized_dx);
+        sent.mouse_position_y = base.mouse_position_y + dequantize_mouse_delta(quantized_dy);
+    } else {
+        encoded.resize(keyframe_message_bytes);
+        uint8_t *cursor = encoded.data();
+        std::memcpy(cursor, &wire_sequence, sizeof(wire_sequence));
+        cursor[2] = keys | keyframe_bit;
+        cursor[3] = 0;
+        std::memcpy(cursor + header_bytes, &input.mouse_position_x, sizeof(float));
+        std::memcpy(cursor + header_bytes + sizeof(float), &input.mouse_position_y, sizeof(float));
+
+        sent.mouse_position_x = input.mouse_position_x;
+        sent.mouse_position_y = input.mouse_position_y;
+    }
+
+    return sequence;
+}
+
+void InputSnapshotEncoder::acknowledge(uint64_t sequence) {
+    if (sequence > acknowledged_sequence && sequence < next_sequence) {
+        acknowledged_sequence = sequence;
+    }
+}
+
+uint64_t InputSnapshotEncoder::restore_sequence(uint32_t low_bits_of_sequence) const {
+    const uint64_t low_bits_mask = 0xFFFFFFFFull;
+    uint64_t most_recent_sequence = next_sequence - 1;
+    uint64_t restored_sequence = (most_recent_sequence & ~low_bits_mask) | low_bits_of_sequence;
+    if (restored_sequence > most_recent_sequence) {
+        if (restored_sequence <= low_bits_mask) {
+            return 0; // would have to be before our first input
+        }
+        restored_sequence -= low_bits_mask + 1;
+    }
+    return restored_sequence;
+}
+
+bool InputSnapshotDecoder::decode(const uint8_t *data, size_t length, InputState &input, uint64_t &sequence) {
+    if (length < header_bytes) {
+        return false;
+    }
+
+    uint16_t wire_sequence;
+    std::memcpy(&wire_sequence, data, sizeof(wire_sequence));
+    uint8_t keys = data[2];
+    uint8_t base_distance = data[3];
+    bool is_keyframe = keys & keyframe_bit;
+
+    if (length != (is_keyframe ? keyframe_message_bytes : delta_message_bytes)) {
+        return false;
+    }
+
+    // the sequence number we mean is the one closest to the most recent one we've seen with the same low 16 bits
+    int16_t distance_from_most_recent =
+        static_cast<int16_t>(wire_sequence - static_cast<uint16_t>(most_recent_sequence));
+    if (distance_from_most_recent <= 0) {
+        return false; // a duplicate or an input that got overtaken by a newer one
+    }
+    sequence = most_recent_sequence + distance_from_most_recent;
+
+    unpack_keys(keys, input);
+
+    if (is_keyframe) {
+        std::memcpy(&input.mouse_position_x, data + header_bytes, sizeof(float));
+        std::memcpy(&input.mouse_position_y, data + header_bytes + sizeof(float), sizeof(float));
+    } else {
+        uint64_t base_sequence = sequence - base_distance;
+        const SentMousePosition &base = history[base_sequence % history_length];
+        if (base_distance == 0 || base.sequence != base_sequence) {
+            return false;
+        }
+        int16_t quantized_dx, quantized_dy;
+        std::memcpy(&quantized_dx, data + header_bytes, sizeof(quantized_dx));
+        std::memcpy(&quantized_dy, data + header_bytes + sizeof(quantized_dx), sizeof(quantized_dy));
+        input.mouse_position_x = base.mouse_position_x + dequantize_mouse_delta(quantized_dx);
+        input.mouse_position_y = base.mouse_position_y + dequantize_mouse_delta(quantized_dy);
+    }
+
+    most_recent_sequence = sequence;
+    SentMousePosition &received = history[sequence % history_length];
+    received.sequence = sequence;
+    received.mouse_position_x = input.mouse_position_x;
+    received.mouse_position_y = input.mouse_position_y;
+
+    return true;
+}
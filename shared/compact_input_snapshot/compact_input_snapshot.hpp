@@ -0,0 +1,120 @@
+#ifndef COMPACT_INPUT_SNAPSHOT_HPP
+#define COMPACT_INPUT_SNAPSHOT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief wire format for the inputs a client sends every tick, replacing the raw NetworkedInputSnapshot struct.
+ *
+ * there are two kinds of message:
+ *
+ *   delta (8 bytes):     u16 sequence | u8 keys | u8 base distance | i16 mouse dx | i16 mouse dy
+ *   keyframe (12 bytes): u16 sequence | u8 keys with the keyframe bit set | u8 unused | f32 mouse x | f32 mouse y
+ *
+ * keys has one bit per key (left, right, forward, backward, jump from the lowest bit up) and the top bit marks a
+ * keyframe. the sequence number counts inputs per client, and the server sends it back as the acknowledged input.
+ *
+ * a delta message describes the mouse position relative to the input base distance inputs ago, which must be one the
+ * server has acknowledged. basing the deltas off of an acknowledged input instead of the previous one means a lost
+ * packet never breaks the chain, the server is guaranteed to still know the base. the deltas are in quarter pixels,
+ * and both sides continue from the position the server reconstructs rather than the raw one, so the mouse position
+ * the server sees is always within 1/8 of a pixel of the real one and that error doesn't build up over time.
+ *
+ * a keyframe carries the absolute mouse position and is sent whenever there is no usable base: before the first
+ * acknowledgement, when the acknowledged input is more than 255 inputs old, or when the delta wouldn't fit in 16 bits.
+ */
+namespace compact_input_snapshot {
+
+constexpr uint8_t left_bit = 1 << 0;
+constexpr uint8_t right_bit = 1 << 1;
+constexpr uint8_t forward_bit = 1 << 2;
+constexpr uint8_t backward_bit = 1 << 3;
+constexpr uint8_t jump_bit = 1 << 4;
+constexpr uint8_t keyframe_bit = 1 << 7;
+
+constexpr float mouse_steps_per_pixel = 4.0f;
+
+constexpr size_t header_bytes = sizeof(uint16_t) + 2 * sizeof(uint8_t);
+constexpr size_t delta_message_bytes = header_bytes + 2 * sizeof(int16_t);
+constexpr size_t keyframe_message_bytes = header_bytes + 2 * sizeof(float);
+static_assert(delta_message_bytes == 8, "the documented wire size is out of date");
+static_assert(keyframe_message_bytes == 12, "the documented wire size is out of date");
+
+// how many inputs each side remembers, a base can be at most this many inputs old
+constexpr size_t history_length = 256;
+
+} // namespace compact_input_snapshot
+
+/**
+ * \brief the part of an input snapshot that goes over the wire, kept free of the engine types so both sides can use it
+ */
+struct InputState {
+    bool left_pressed = false;
+    bool right_pressed = false;
+    bool forward_pressed = false;
+    bool backward_pressed = false;
+    bool jump_pressed = false;
+    float mouse_position_x = 0;
+    float mouse_position_y = 0;
+};
+
+/**
+ * \brief a sequence number and the mouse position the server reconstructed for it
+ */
+struct SentMousePosition {
+    uint64_t sequence = 0; // 0 marks an empty slot, real sequence numbers start at 1
+    float mouse_position_x = 0;
+    float mouse_position_y = 0;
+};
+
+/**
+ * \brief the client side, one per connection
+ */
+class InputSnapshotEncoder {
+  public:
+    /**
+     * \brief replaces the contents of encoded with the next input message
+     * \return the sequence number given to this input
+     */
+    uint64_t encode(const InputState &input, std::vector<uint8_t> &encoded);
+    /**
+     * \brief tells the encoder the server has processed this input so it can be used as a base, older
+     * acknowledgements than the current one are ignored since packets can arrive out of order
+     */
+    void acknowledge(uint64_t sequence);
+    /**
+     * \brief the server echoes back the low 32 bits of a sequence number, this restores the rest using the fact that
+     * it has to be one we already sent
+     * \return 0 if the value can't be one of ours
+     */
+    uint64_t restore_sequence(uint32_t low_bits_of_sequence) const;
+
+    uint64_t get_most_recent_sequence() const { return next_sequence - 1; }
+
+  private:
+    uint64_t next_sequence = 1;
+    uint64_t acknowledged_sequence = 0;
+    std::array<SentMousePosition, compact_input_snapshot::history_length> history;
+};
+
+/**
+ * \brief the server side, one per connected client
+ */
+class InputSnapshotDecoder {
+  public:
+    /**
+     * \brief decodes a message from the client
+     * \return false if the message is malformed, references a base we don't know, or is older than the last input we
+     * decoded, in all of those cases the input should be dropped
+     */
+    bool decode(const uint8_t *data, size_t length, InputState &input, uint64_t &sequence);
+
+  private:
+    uint64_t most_recent_sequence = 0;
+    std::array<SentMousePosition, compact_input_snapshot::history_length> history;
+};
+
+#endif // COMPACT_INPUT_SNAPSHOT_HPP
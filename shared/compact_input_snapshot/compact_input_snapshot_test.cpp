@@ -0,0 +1,241 @@
+#include "compact_input_snapshot.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+/**
+ * \brief sends inputs through the encoder and decoder the way a client and the server do, over a link that loses
+ * packets and acknowledges late, and checks that every input that arrives comes out with its sequence number, its keys
+ * and a mouse position within an eighth of a pixel. goes past the point where the 16 bit sequence on the wire wraps
+ * around, lets the acknowledgement fall out of the history and checks what restore_sequence makes of acknowledgements
+ * that can't be ours. exits with 1 if anything doesn't hold.
+ */
+
+static int failures = 0;
+
+static void fail(const char *what, uint64_t sequence) {
+    if (failures < 20) {
+        std::printf("input %lu: %s\n", sequence, what);
+    }
+    failures++;
+}
+
+static bool same_keys(const InputState &a, const InputState &b) {
+    return a.left_pressed == b.left_pressed && a.right_pressed == b.right_pressed &&
+           a.forward_pressed == b.forward_pressed && a.backward_pressed == b.backward_pressed &&
+           a.jump_pressed == b.jump_pressed;
+}
+
+static InputState random_input(std::mt19937 &random, float &mouse_x, float &mouse_y) {
+    std::bernoulli_distribution coin(0.5);
+    std::bernoulli_distribution rarely(0.01);
+    std::normal_distribution<float> mouse_movement(0.0f, 20.0f);
+    std::uniform_real_distribution<float> anywhere(-4000.0f, 4000.0f);
+
+    InputState input;
+    input.left_pressed = coin(random);
+    input.right_pressed = coin(random);
+    input.forward_pressed = coin(random);
+    input.backward_pressed = coin(random);
+    input.jump_pressed = coin(random);
+    // now and then the mouse jumps further than a delta can say
+    if (rarely(random)) {
+        mouse_x = anywhere(random);
+        mouse_y = anywhere(random);
+    } else {
+        mouse_x = std::fmax(-4000.0f, std::fmin(4000.0f, mouse_x + mouse_movement(random)));
+        mouse_y = std::fmax(-4000.0f, std::fmin(4000.0f, mouse_y + mouse_movement(random)));
+    }
+    input.mouse_position_x = mouse_x;
+    input.mouse_position_y = mouse_y;
+    return input;
+}
+
+/**
+ * \brief the client sends num_inputs inputs, the server acknowledges what it decoded acknowledgement_delay inputs later
+ * through restore_sequence, the way the client reads acknowledgements out of game states
+ */
+static void test_lossy_link(std::mt19937 &random, uint64_t num_inputs, double loss, size_t acknowledgement_delay) {
+    InputSnapshotEncoder encoder;
+    InputSnapshotDecoder decoder;
+    std::bernoulli_distribution lost(loss);
+    // the decoder reconstructs from an acknowledged base, both sides agree on it so the error stays below an eighth
+    const float max_mouse_error = 0.125f + 0.001f;
+
+    std::deque<uint64_t> acknowledgements_on_their_way;
+    std::vector<uint8_t> encoded;
+    float mouse_x = 0.0f, mouse_y = 0.0f;
+    uint64_t num_decoded = 0, num_keyframes = 0;
+    for (uint64_t i = 0; i < num_inputs; i++) {
+        InputState input = random_input(random, mouse_x, mouse_y);
+        uint64_t sequence = encoder.encode(input, encoded);
+        if (sequence != i + 1) {
+            fail("the encoder skipped a sequence number", sequence);
+        }
+        bool keyframe = encoded.size() == compact_input_snapshot::keyframe_message_bytes;
+        num_keyframes += keyframe;
+
+        if (!lost(random)) {
+            InputState decoded;
+            uint64_t decoded_sequence;
+            if (!decoder.decode(encoded.data(), encoded.size(), decoded, decoded_sequence)) {
+                fail("an input that arrived in order didn't decode", sequence);
+            } else {
+                num_decoded++;
+                if (decoded_sequence != sequence) {
+                    fail("decoded with the wrong sequence number", sequence);
+                }
+                if (!same_keys(decoded, input)) {
+                    fail("decoded with the wrong keys", sequence);
+                }
+                if (std::abs(decoded.mouse_position_x - input.mouse_position_x) > max_mouse_error ||
+                    std::abs(decoded.mouse_position_y - input.mouse_position_y) > max_mouse_error) {
+                    fail("the mouse position is off by more than an eighth of a pixel", sequence);
+                }
+                if (keyframe && (decoded.mouse_position_x != input.mouse_position_x ||
+                                 decoded.mouse_position_y != input.mouse_position_y)) {
+                    fail("a keyframe didn't carry the exact mouse position", sequence);
+                }
+                // it's decoded already, so it's older than anything that comes after and has to be turned away
+                if (decoder.decode(encoded.data(), encoded.size(), decoded, decoded_sequence)) {
+                    fail("a duplicate was decoded", sequence);
+                }
+                acknowledgements_on_their_way.push_back(decoded_sequence);
+            }
+        }
+
+        if (acknowledgements_on_their_way.size() > acknowledgement_delay) {
+            uint64_t acknowledged = acknowledgements_on_their_way.front();
+            acknowledgements_on_their_way.pop_front();
+            uint64_t restored = encoder.restore_sequence(static_cast<uint32_t>(acknowledged));
+            if (restored != acknowledged) {
+                fail("an acknowledgement didn't restore to the input it came from", acknowledged);
+            }
+            encoder.acknowledge(restored);
+        }
+    }
+
+    if (num_decoded == 0 || num_keyframes == num_inputs) {
+        std::printf("%lu inputs: %lu decoded, %lu keyframes, the deltas weren't tested\n", num_inputs, num_decoded,
+                    num_keyframes);
+        failures++;
+    }
+}
+
+/**
+ * \brief without acknowledgements newer than history_length inputs, the base is gone from the history and keyframes
+ * have to be sent instead of deltas
+ */
+static void test_stale_acknowledgement() {
+    const uint64_t history_length = compact_input_snapshot::history_length;
+    InputSnapshotEncoder encoder;
+    InputSnapshotDecoder decoder;
+    std::vector<uint8_t> encoded;
+    InputState input, decoded;
+    uint64_t sequence;
+
+    encoder.encode(input, encoded);
+    decoder.decode(encoded.data(), encoded.size(), decoded, sequence);
+    encoder.acknowledge(1);
+    for (uint64_t expected_sequence = 2; expected_sequence <= 2 * history_length; expected_sequence++) {
+        input.mouse_position_x += 1.0f;
+        encoder.encode(input, encoded);
+        bool base_usable = expected_sequence - 1 < history_length;
+        size_t expected_size = base_usable ? compact_input_snapshot::delta_message_bytes
+                                           : compact_input_snapshot::keyframe_message_bytes;
+        if (encoded.size() != expected_size) {
+            fail(base_usable ? "a delta from a base in the history wasn't sent"
+                             : "a delta from a base that fell out of the history was sent",
+                 expected_sequence);
+        }
+        if (!decoder.decode(encoded.data(), encoded.size(), decoded, sequence) || sequence != expected_sequence ||
+            decoded.mouse_position_x != input.mouse_position_x) {
+            fail("didn't decode while the acknowledgement was stale", expected_sequence);
+        }
+    }
+}
+
+/**
+ * \brief a delta from a base the server never got can't be decoded, neither can a message of the wrong size
+ */
+static void test_unknown_base_and_malformed_messages() {
+    InputSnapshotEncoder encoder;
+    InputSnapshotDecoder decoder;
+    std::vector<uint8_t> encoded;
+    InputState input, decoded;
+    uint64_t sequence;
+
+    encoder.encode(input, encoded);
+    decoder.decode(encoded.data(), encoded.size(), decoded, sequence);
+    encoder.encode(input, encoded); // lost on the way
+    encoder.acknowledge(2);         // which a broken server could still acknowledge
+    encoder.encode(input, encoded);
+    if (encoded.size() != compact_input_snapshot::delta_message_bytes) {
+        fail("didn't send a delta from the acknowledged input", 3);
+    } else if (decoder.decode(encoded.data(), encoded.size(), decoded, sequence)) {
+        fail("a delta from a base that never arrived was decoded", 3);
+    }
+
+    encoder.encode(input, encoded);
+    std::vector<uint8_t> truncated(encoded.begin(), encoded.end() - 1);
+    std::vector<uint8_t> too_long = encoded;
+    too_long.push_back(0);
+    if (decoder.decode(truncated.data(), truncated.size(), decoded, sequence) ||
+        decoder.decode(too_long.data(), too_long.size(), decoded, sequence) ||
+        decoder.decode(encoded.data(), 1, decoded, sequence)) {
+        fail("a message of the wrong size was decoded", 4);
+    }
+}
+
+/**
+ * \brief the server only echoes back the low 32 bits, anything that would be newer than what we've sent isn't ours
+ */
+static void test_restore_sequence() {
+    InputSnapshotEncoder encoder;
+    std::vector<uint8_t> encoded;
+    if (encoder.restore_sequence(1) != 0) {
+        fail("an acknowledgement was restored before anything was sent", 1);
+    }
+    const uint64_t num_inputs = 300;
+    for (uint64_t i = 0; i < num_inputs; i++) {
+        encoder.encode(InputState(), encoded);
+    }
+    for (uint64_t sequence = 1; sequence <= num_inputs; sequence++) {
+        if (encoder.restore_sequence(static_cast<uint32_t>(sequence)) != sequence) {
+            fail("an input we sent didn't restore", sequence);
+        }
+    }
+    for (uint64_t sequence : {num_inputs + 1, num_inputs + 1000, uint64_t(0xFFFFFFFF)}) {
+        if (encoder.restore_sequence(static_cast<uint32_t>(sequence)) != 0) {
+            fail("an acknowledgement newer than anything we sent was restored", sequence);
+        }
+    }
+
+    // an acknowledgement newer than the newest input can't move the base past what the server can know
+    encoder.acknowledge(num_inputs + 1);
+    encoder.encode(InputState(), encoded);
+    if (encoded.size() != compact_input_snapshot::keyframe_message_bytes) {
+        fail("an acknowledgement of an input that wasn't sent yet was used as a base", num_inputs + 1);
+    }
+}
+
+int main() {
+    std::mt19937 random(1234);
+    // past 65536 inputs, where the sequence number on the wire wraps around
+    test_lossy_link(random, 70000, 0.0, 3);
+    test_lossy_link(random, 70000, 0.1, 5);
+    test_lossy_link(random, 20000, 0.5, 40);
+    test_stale_acknowledgement();
+    test_unknown_base_and_malformed_messages();
+    test_restore_sequence();
+
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("compact input snapshots round trip within their documented bounds\n");
+    return 0;
+}
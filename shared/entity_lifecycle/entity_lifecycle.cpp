@@ -0,0 +1,40 @@
+#include "entity_lifecycle.hpp"
+#include <cstring>
+
+using namespace entity_lifecycle;
+
+void encode_entity_lifecycle_events(const std::vector<EntityLifecycleEvent> &events, std::vector<uint8_t> &encoded) {
+    uint16_t count = static_cast<uint16_t>(events.size());
+    encoded.resize(header_bytes + count * bytes_per_event);
+    std::memcpy(encoded.data(), &count, sizeof(count));
+
+    uint8_t *types = encoded.data() + header_bytes;
+    uint8_t *entity_ids = types + count;
+    for (size_t i = 0; i < count; i++) {
+        types[i] = static_cast<uint8_t>(events[i].type);
+        std::memcpy(entity_ids + i * sizeof(uint16_t), &events[i].entity_id, sizeof(uint16_t));
+    }
+}
+
+bool decode_entity_lifecycle_events(const uint8_t *data, size_t length, std::vector<EntityLifecycleEvent> &events) {
+    if (length < header_bytes) {
+        return false;
+    }
+    uint16_t count;
+    std::memcpy(&count, data, sizeof(count));
+    if (length != header_bytes + count * bytes_per_event) {
+        return false;
+    }
+
+    const uint8_t *types = data + header_bytes;
+    const uint8_t *entity_ids = types + count;
+    events.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        if (types[i] > static_cast<uint8_t>(EntityLifecycleEventType::DESPAWN)) {
+            return false;
+        }
+        events[i].type = static_cast<EntityLifecycleEventType>(types[i]);
+        std::memcpy(&events[i].entity_id, entity_ids + i * sizeof(uint16_t), sizeof(uint16_t));
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef ENTITY_LIFECYCLE_HPP
+#define ENTITY_LIFECYCLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief tells clients about characters coming into and leaving the world. game states only ever say where characters
+ * are, so without these a client would keep a player that left around forever, and since ids are handed out again, it
+ * couldn't tell a new player from a late game state about the old one.
+ *
+ * a message is every event of a tick, in the order they happened, sent reliably on a channel of its own:
+ *
+ * layout: u16 count | u8 type[count] | u16 entity id[count]
+ *
+ * the entity ids are the client ids, in 16 bits like in the compact character state message.
+ */
+namespace entity_lifecycle {
+constexpr uint8_t channel = 2;
+constexpr size_t header_bytes = sizeof(uint16_t);
+constexpr size_t bytes_per_event = sizeof(uint8_t) + sizeof(uint16_t);
+constexpr size_t max_events = UINT16_MAX;
+} // namespace entity_lifecycle
+
+enum class EntityLifecycleEventType : uint8_t {
+    SPAWN = 0,
+    DESPAWN = 1,
+};
+
+struct EntityLifecycleEvent {
+    EntityLifecycleEventType type;
+    uint16_t entity_id;
+};
+
+/**
+ * \brief replaces the contents of encoded with the events, there can't be more than max_events
+ */
+void encode_entity_lifecycle_events(const std::vector<EntityLifecycleEvent> &events, std::vector<uint8_t> &encoded);
+/**
+ * \return false if the data isn't a well formed lifecycle message
+ */
+bool decode_entity_lifecycle_events(const uint8_t *data, size_t length, std::vector<EntityLifecycleEvent> &events);
+
+#endif // ENTITY_LIFECYCLE_HPP
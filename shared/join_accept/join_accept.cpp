@@ -0,0 +1,20 @@
+#include "join_accept.hpp"
+#include <cstring>
+
+using namespace join_accept;
+
+void encode_join_accept(uint64_t client_id, const std::vector<uint8_t> &encoded_characters,
+                        std::vector<uint8_t> &encoded) {
+    encoded.resize(header_bytes + encoded_characters.size());
+    std::memcpy(encoded.data(), &client_id, sizeof(client_id));
+    std::memcpy(encoded.data() + header_bytes, encoded_characters.data(), encoded_characters.size());
+}
+
+bool decode_join_accept(const uint8_t *data, size_t length, CompactCharacterDataCodec &character_data_codec,
+                        uint64_t &client_id, CharacterStateArrays &characters) {
+    if (length < header_bytes) {
+        return false;
+    }
+    std::memcpy(&client_id, data, sizeof(client_id));
+    return character_data_codec.decode(data + header_bytes, length - header_bytes, characters);
+}
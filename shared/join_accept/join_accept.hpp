@@ -0,0 +1,34 @@
+#ifndef JOIN_ACCEPT_HPP
+#define JOIN_ACCEPT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "compact_character_data/compact_character_data.hpp"
+
+/**
+ * \brief the first thing a client gets once the server has admitted it: its id and the full state of every character,
+ * its own included, so it has a world to show before the first game state comes in.
+ *
+ * layout: u64 client id | a compact character state message, see compact_character_data.hpp
+ *
+ * it's sent reliably on the channel the client's reports go up on, nothing else comes down that channel.
+ */
+namespace join_accept {
+constexpr uint8_t channel = 1;
+constexpr size_t header_bytes = sizeof(uint64_t);
+} // namespace join_accept
+
+/**
+ * \brief replaces the contents of encoded with the join accept
+ * \param encoded_characters every character, already encoded with CompactCharacterDataCodec
+ */
+void encode_join_accept(uint64_t client_id, const std::vector<uint8_t> &encoded_characters,
+                        std::vector<uint8_t> &encoded);
+/**
+ * \return false if the data isn't a well formed join accept
+ */
+bool decode_join_accept(const uint8_t *data, size_t length, CompactCharacterDataCodec &character_data_codec,
+                        uint64_t &client_id, CharacterStateArrays &characters);
+
+#endif // JOIN_ACCEPT_HPP
@@ -0,0 +1,109 @@
+#include "latency_histogram.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+size_t LatencyHistogram::bucket_index(uint32_t latency_us) {
+    if (latency_us < sub_buckets_per_magnitude) {
+        return latency_us;
+    }
+    // the highest set bit picks the magnitude, the sub_bucket_bits below it pick the linear bucket inside of it
+    uint32_t highest_bit = 31 - __builtin_clz(latency_us);
+    uint32_t shift = highest_bit - sub_bucket_bits;
+    uint32_t sub_bucket = (latency_us >> shift) - sub_buckets_per_magnitude;
+    return sub_buckets_per_magnitude + shift * sub_buckets_per_magnitude + sub_bucket;
+}
+
+uint32_t LatencyHistogram::bucket_highest_value(size_t bucket) {
+    if (bucket < sub_buckets_per_magnitude) {
+        return static_cast<uint32_t>(bucket);
+    }
+    uint32_t shift = static_cast<uint32_t>((bucket - sub_buckets_per_magnitude) / sub_buckets_per_magnitude);
+    uint64_t sub_bucket = (bucket - sub_buckets_per_magnitude) % sub_buckets_per_magnitude;
+    uint64_t lowest_value = (sub_buckets_per_magnitude + sub_bucket) << shift;
+    return static_cast<uint32_t>(lowest_value + (1ull << shift) - 1);
+}
+
+void LatencyHistogram::record(uint32_t latency_us) {
+    bucket_counts[bucket_index(latency_us)]++;
+    count++;
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other) {
+    for (size_t i = 0; i < num_buckets; i++) {
+        bucket_counts[i] += other.bucket_counts[i];
+    }
+    count += other.count;
+}
+
+void LatencyHistogram::reset() {
+    bucket_counts.fill(0);
+    count = 0;
+}
+
+uint32_t LatencyHistogram::value_at_quantile(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; i++) {
+        seen += bucket_counts[i];
+        if (seen >= rank) {
+            return bucket_highest_value(i);
+        }
+    }
+    return bucket_highest_value(num_buckets - 1);
+}
+
+void LatencyHistogram::encode(std::vector<uint8_t> &encoded) const {
+    uint16_t num_used_buckets = 0;
+    for (uint32_t bucket_count : bucket_counts) {
+        num_used_buckets += bucket_count != 0;
+    }
+
+    size_t start = encoded.size();
+    encoded.resize(start + sizeof(uint16_t) + num_used_buckets * (sizeof(uint16_t) + sizeof(uint32_t)));
+    uint8_t *cursor = encoded.data() + start;
+    std::memcpy(cursor, &num_used_buckets, sizeof(uint16_t));
+    cursor += sizeof(uint16_t);
+    for (size_t i = 0; i < num_buckets; i++) {
+        if (bucket_counts[i] == 0) {
+            continue;
+        }
+        uint16_t index = static_cast<uint16_t>(i);
+        std::memcpy(cursor, &index, sizeof(uint16_t));
+        cursor += sizeof(uint16_t);
+        std::memcpy(cursor, &bucket_counts[i], sizeof(uint32_t));
+        cursor += sizeof(uint32_t);
+    }
+}
+
+bool LatencyHistogram::decode(const uint8_t *&cursor, const uint8_t *end) {
+    reset();
+    uint16_t num_used_buckets;
+    if (end - cursor < static_cast<ptrdiff_t>(sizeof(uint16_t))) {
+        return false;
+    }
+    std::memcpy(&num_used_buckets, cursor, sizeof(uint16_t));
+    cursor += sizeof(uint16_t);
+
+    if (end - cursor < static_cast<ptrdiff_t>(num_used_buckets * (sizeof(uint16_t) + sizeof(uint32_t)))) {
+        return false;
+    }
+    for (uint16_t i = 0; i < num_used_buckets; i++) {
+        uint16_t index;
+        uint32_t bucket_count;
+        std::memcpy(&index, cursor, sizeof(uint16_t));
+        cursor += sizeof(uint16_t);
+        std::memcpy(&bucket_count, cursor, sizeof(uint32_t));
+        cursor += sizeof(uint32_t);
+        if (index >= num_buckets) {
+            reset();
+            return false;
+        }
+        bucket_counts[index] += bucket_count;
+        count += bucket_count;
+    }
+    return true;
+}
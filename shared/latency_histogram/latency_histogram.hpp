@@ -0,0 +1,55 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief a histogram of latencies in microseconds in the style of an hdr histogram: every power of two is split into
+ * sub_buckets_per_magnitude linear buckets, so every recorded value is kept to within about 6% no matter if it's 50us
+ * or 5s, and quantiles can be read back out with that precision.
+ *
+ * histograms of the same layout can simply be added together, which is what lets the client send one every report
+ * and the server merge them per client and per room.
+ */
+class LatencyHistogram {
+  public:
+    static constexpr uint32_t sub_bucket_bits = 4;
+    static constexpr uint32_t sub_buckets_per_magnitude = 1u << sub_bucket_bits;
+    // values below sub_buckets_per_magnitude get a bucket each, then one magnitude per remaining bit of a u32
+    static constexpr size_t num_buckets =
+        sub_buckets_per_magnitude + (32 - sub_bucket_bits) * sub_buckets_per_magnitude;
+
+    void record(uint32_t latency_us);
+    void add(const LatencyHistogram &other);
+    void reset();
+
+    uint64_t get_count() const { return count; }
+    uint32_t get_bucket_count(size_t bucket) const { return bucket_counts[bucket]; }
+    /**
+     * \return the largest value that would land in the same bucket as the quantile, 0 if nothing was recorded
+     */
+    uint32_t value_at_quantile(double quantile) const;
+
+    /**
+     * \brief appends only the buckets that have something in them, a u16 for how many there are and then a u16 index
+     * and a u32 count for each
+     */
+    void encode(std::vector<uint8_t> &encoded) const;
+    /**
+     * \brief reads what encode wrote, starting at cursor which is moved past it
+     * \return false if the data is cut off or names a bucket that doesn't exist, the histogram is then left empty
+     */
+    bool decode(const uint8_t *&cursor, const uint8_t *end);
+
+    static size_t bucket_index(uint32_t latency_us);
+    static uint32_t bucket_highest_value(size_t bucket);
+
+  private:
+    std::array<uint32_t, num_buckets> bucket_counts = {};
+    uint64_t count = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,65 @@
+#include "snapshot_parts.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace snapshot_parts;
+
+static void write_header(const SnapshotPartHeader &header, std::vector<uint8_t> &encoded) {
+    std::memcpy(encoded.data(), &header.tick, sizeof(header.tick));
+    encoded[sizeof(header.tick)] = header.part_index;
+    encoded[sizeof(header.tick) + 1] = header.part_count;
+}
+
+static constexpr size_t part_overhead_bytes = header_bytes + compact_character_data::header_bytes;
+
+size_t snapshot_parts_size(size_t character_count) {
+    size_t num_parts = std::max<size_t>(1, (character_count + max_characters_per_part - 1) / max_characters_per_part);
+    return num_parts * part_overhead_bytes + character_count * compact_character_data::bytes_per_character;
+}
+
+size_t max_characters_within(size_t bytes) {
+    size_t full_parts = bytes / max_part_bytes;
+    size_t rest = bytes % max_part_bytes;
+    size_t characters = full_parts * max_characters_per_part;
+    if (rest > part_overhead_bytes) {
+        characters += (rest - part_overhead_bytes) / compact_character_data::bytes_per_character;
+    }
+    return std::min(characters, max_parts * max_characters_per_part);
+}
+
+void encode_snapshot_parts(uint32_t tick, const CharacterStateArrays &states,
+                           CompactCharacterDataCodec &character_data_codec, SnapshotParts &encoded) {
+    size_t num_characters = std::min(states.size(), max_parts * max_characters_per_part);
+    size_t num_parts = std::max<size_t>(1, (num_characters + max_characters_per_part - 1) / max_characters_per_part);
+    if (encoded.parts.size() < num_parts) {
+        encoded.parts.resize(num_parts);
+    }
+    encoded.num_parts = num_parts;
+
+    for (size_t i = 0; i < num_parts; i++) {
+        size_t first = i * max_characters_per_part;
+        size_t count = std::min(max_characters_per_part, num_characters - first);
+        character_data_codec.encode(states, first, count, header_bytes, encoded.parts[i]);
+        write_header({tick, static_cast<uint8_t>(i), static_cast<uint8_t>(num_parts)}, encoded.parts[i]);
+    }
+}
+
+void encode_extra_snapshot_part(uint32_t tick, const CharacterStateArrays &states,
+                                CompactCharacterDataCodec &character_data_codec, std::vector<uint8_t> &encoded) {
+    character_data_codec.encode(states, 0, std::min(states.size(), max_characters_per_part), header_bytes, encoded);
+    write_header({tick, extra_part_index, 0}, encoded);
+}
+
+bool decode_snapshot_part(const uint8_t *data, size_t length, CompactCharacterDataCodec &character_data_codec,
+                          SnapshotPartHeader &header, CharacterStateArrays &states) {
+    if (length < header_bytes) {
+        return false;
+    }
+    std::memcpy(&header.tick, data, sizeof(header.tick));
+    header.part_index = data[sizeof(header.tick)];
+    header.part_count = data[sizeof(header.tick) + 1];
+    if (header.part_index != extra_part_index && header.part_index >= header.part_count) {
+        return false;
+    }
+    return character_data_codec.decode(data + header_bytes, length - header_bytes, states);
+}
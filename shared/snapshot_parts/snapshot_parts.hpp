@@ -0,0 +1,72 @@
+#ifndef SNAPSHOT_PARTS_HPP
+#define SNAPSHOT_PARTS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "compact_character_data/compact_character_data.hpp"
+
+/**
+ * \brief a game state is sent unreliably, and enet splits a packet that's longer than the mtu into fragments and drops
+ * the whole packet if any one of them is lost. so past a few dozen characters a lost datagram cost everyone a tick.
+ * instead the characters of a game state are cut into parts that each fit into one datagram and decode on their own,
+ * a lost part only costs the characters that were in it, and the client applies whatever parts arrive.
+ *
+ * layout: u32 tick | u8 part index | u8 part count | a compact character state message, see compact_character_data.hpp
+ *
+ * the tick is the low 32 bits of the server's game state tick, the client uses it to not apply a part that arrived
+ * after a newer one for the same character. a part that comes on top of the split, like the client's own character when
+ * it was left out of the game state, has extra_part_index as its index.
+ */
+namespace snapshot_parts {
+constexpr size_t header_bytes = sizeof(uint32_t) + 2 * sizeof(uint8_t);
+// enet fragments anything longer than its default mtu of 1392 minus its protocol header (4 bytes) and the header of a
+// fragment command (24 bytes)
+constexpr size_t max_part_bytes = 1392 - 4 - 24;
+constexpr size_t max_characters_per_part = (max_part_bytes - header_bytes - compact_character_data::header_bytes) /
+                                           compact_character_data::bytes_per_character;
+constexpr uint8_t extra_part_index = UINT8_MAX;
+constexpr size_t max_parts = UINT8_MAX; // the indices below extra_part_index
+} // namespace snapshot_parts
+
+struct SnapshotPartHeader {
+    uint32_t tick = 0;
+    uint8_t part_index = 0;
+    uint8_t part_count = 0;
+};
+
+/**
+ * \brief the encoded parts of one game state
+ */
+struct SnapshotParts {
+    // only the first num_parts are used, the others are kept so that their memory is reused
+    std::vector<std::vector<uint8_t>> parts;
+    size_t num_parts = 0;
+};
+
+/**
+ * \return how many bytes the parts of a game state with this many characters take altogether
+ */
+size_t snapshot_parts_size(size_t character_count);
+/**
+ * \return the most characters a game state can have without its parts taking more than this many bytes altogether
+ */
+size_t max_characters_within(size_t bytes);
+
+/**
+ * \brief cuts states into as few parts as fit them, there's always at least one even if there are no characters
+ */
+void encode_snapshot_parts(uint32_t tick, const CharacterStateArrays &states,
+                           CompactCharacterDataCodec &character_data_codec, SnapshotParts &encoded);
+/**
+ * \brief replaces the contents of encoded with one part that isn't part of the split, states has to fit into a part
+ */
+void encode_extra_snapshot_part(uint32_t tick, const CharacterStateArrays &states,
+                                CompactCharacterDataCodec &character_data_codec, std::vector<uint8_t> &encoded);
+/**
+ * \return false if the data isn't a well formed snapshot part
+ */
+bool decode_snapshot_part(const uint8_t *data, size_t length, CompactCharacterDataCodec &character_data_codec,
+                          SnapshotPartHeader &header, CharacterStateArrays &states);
+
+#endif // SNAPSHOT_PARTS_HPP
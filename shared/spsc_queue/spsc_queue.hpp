@@ -0,0 +1,66 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * \brief a fixed size queue between exactly one producer thread and one consumer thread that never locks.
+ *
+ * elements are filled and read in place and the slots are reused round and round, so an element that owns memory
+ * (like a vector) keeps it from one trip around the ring to the next, once every slot has grown to the usual size
+ * nothing allocates anymore.
+ *
+ * each side keeps its own copy of where the other side was last seen, so the shared indices are only read when that
+ * copy says the queue looks full or empty, the indices are on separate cache lines so the two threads don't fight
+ * over one line on every push and pop.
+ */
+template <typename T, size_t capacity> class SpscQueue {
+    static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "capacity has to be a power of two");
+
+  public:
+    /**
+     * \brief producer only, the slot still holds whatever was in it the last time around, it only becomes visible to
+     * the consumer on finish_push
+     * \return nullptr if the queue is full
+     */
+    T *begin_push() {
+        size_t tail = tail_index.load(std::memory_order_relaxed);
+        if (tail - producer_cached_head == capacity) {
+            producer_cached_head = head_index.load(std::memory_order_acquire);
+            if (tail - producer_cached_head == capacity) {
+                return nullptr;
+            }
+        }
+        return &slots[tail & (capacity - 1)];
+    }
+    void finish_push() { tail_index.store(tail_index.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /**
+     * \brief consumer only, the element stays valid until pop
+     * \return nullptr if the queue is empty
+     */
+    T *front() {
+        size_t head = head_index.load(std::memory_order_relaxed);
+        if (head == consumer_cached_tail) {
+            consumer_cached_tail = tail_index.load(std::memory_order_acquire);
+            if (head == consumer_cached_tail) {
+                return nullptr;
+            }
+        }
+        return &slots[head & (capacity - 1)];
+    }
+    void pop() { head_index.store(head_index.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  private:
+    std::array<T, capacity> slots;
+
+    // indices only ever go up, they're wrapped when used, so full and empty can be told apart
+    alignas(64) std::atomic<size_t> head_index = 0; // written by the consumer
+    size_t consumer_cached_tail = 0;
+    alignas(64) std::atomic<size_t> tail_index = 0; // written by the producer
+    size_t producer_cached_head = 0;
+};
+
+#endif // SPSC_QUEUE_HPP
@@ -0,0 +1,58 @@
+#include "time_sync.hpp"
+#include <cstring>
+
+using namespace time_sync;
+
+template <typename T> static inline void write_field(uint8_t *&cursor, const T &value) {
+    std::memcpy(cursor, &value, sizeof(T));
+    cursor += sizeof(T);
+}
+
+template <typename T> static inline void read_field(const uint8_t *&cursor, T &value) {
+    std::memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+}
+
+void encode_time_sync_request(const TimeSyncRequest &request, std::vector<uint8_t> &encoded) {
+    encoded.resize(request_bytes);
+    uint8_t *cursor = encoded.data();
+    write_field(cursor, request.client_sent_at);
+    write_field(cursor, request.tick_phase_error_ms);
+}
+
+bool decode_time_sync_request(const uint8_t *data, size_t length, TimeSyncRequest &request) {
+    if (length != request_bytes) {
+        return false;
+    }
+    const uint8_t *cursor = data;
+    read_field(cursor, request.client_sent_at);
+    read_field(cursor, request.tick_phase_error_ms);
+    return true;
+}
+
+void encode_time_sync_response(const TimeSyncResponse &response, std::vector<uint8_t> &encoded) {
+    encoded.resize(response_bytes);
+    uint8_t *cursor = encoded.data();
+    write_field(cursor, response.client_sent_at);
+    write_field(cursor, response.server_received_at);
+    write_field(cursor, response.server_sent_at);
+    write_field(cursor, response.tick);
+    write_field(cursor, response.tick_started_at);
+    write_field(cursor, response.tick_period_ns);
+    write_field(cursor, response.input_buffer_depth);
+}
+
+bool decode_time_sync_response(const uint8_t *data, size_t length, TimeSyncResponse &response) {
+    if (length != response_bytes) {
+        return false;
+    }
+    const uint8_t *cursor = data;
+    read_field(cursor, response.client_sent_at);
+    read_field(cursor, response.server_received_at);
+    read_field(cursor, response.server_sent_at);
+    read_field(cursor, response.tick);
+    read_field(cursor, response.tick_started_at);
+    read_field(cursor, response.tick_period_ns);
+    read_field(cursor, response.input_buffer_depth);
+    return true;
+}
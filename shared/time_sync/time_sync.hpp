@@ -0,0 +1,50 @@
+#ifndef TIME_SYNC_HPP
+#define TIME_SYNC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief lets a client work out the server's clock and where the server is in its ticks, the way ntp does it: the
+ * client stamps a request with when it sent it, the server answers with when the request came in and when it answered,
+ * and from the four times the client gets the round trip and how far apart the clocks are.
+ *
+ * all times are steady clock nanoseconds of whoever took them, the clocks of the client and the server have nothing to
+ * do with each other. the answer also says when the server's latest tick started and how long its ticks take, so the
+ * client can tell when any server tick starts on its own clock, and how many of the client's inputs the server keeps
+ * back against jitter, which is how many ticks the client should run ahead.
+ *
+ * both go unreliably on a channel of their own, a resent request would only be a bad sample.
+ *
+ * request:  u64 client sent at | f32 tick phase error in ms, what the client measured with what it knew so far
+ * response: u64 client sent at | u64 server received at | u64 server sent at | u64 tick | u64 tick started at |
+ *           u32 tick period in ns | u8 input buffer depth
+ */
+namespace time_sync {
+constexpr uint8_t channel = 3;
+constexpr size_t request_bytes = sizeof(uint64_t) + sizeof(float);
+constexpr size_t response_bytes = 5 * sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint8_t);
+} // namespace time_sync
+
+struct TimeSyncRequest {
+    uint64_t client_sent_at = 0;
+    float tick_phase_error_ms = 0.0f;
+};
+
+struct TimeSyncResponse {
+    uint64_t client_sent_at = 0; // echoed from the request
+    uint64_t server_received_at = 0;
+    uint64_t server_sent_at = 0;
+    uint64_t tick = 0;
+    uint64_t tick_started_at = 0;
+    uint32_t tick_period_ns = 0; // 0 until the server has ticked twice
+    uint8_t input_buffer_depth = 0;
+};
+
+void encode_time_sync_request(const TimeSyncRequest &request, std::vector<uint8_t> &encoded);
+bool decode_time_sync_request(const uint8_t *data, size_t length, TimeSyncRequest &request);
+void encode_time_sync_response(const TimeSyncResponse &response, std::vector<uint8_t> &encoded);
+bool decode_time_sync_response(const uint8_t *data, size_t length, TimeSyncResponse &response);
+
+#endif // TIME_SYNC_HPP